@@ -1,5 +1,8 @@
 ﻿#include "MeshQuadTree.h"
 #include<format>
+#include "Async/ParallelFor.h"
+#include "MeshQuadTreePageTable.h"
+#include "QuadtreeMesh.h"
 
 
 void FMeshQuadTree::GatherHitProxies(TArray<TRefCountPtr<HHitProxy>>& OutHitProxies) const
@@ -10,30 +13,43 @@ void FMeshQuadTree::GatherHitProxies(TArray<TRefCountPtr<HHitProxy>>& OutHitProx
 	}
 }
 
-void FMeshQuadTree::InitTree(const FBox2D& InBounds, float InTileSize, FIntPoint InExtentInTiles,bool bInIsGPUQuadTree)
+void FMeshQuadTree::GatherParameterData(TArray<FVector4f>& OutParameters) const
 {
-	ensure(InBounds.GetArea() > 0.0f);
+	OutParameters.Reserve(OutParameters.Num() + NodeData.QuadtreeMeshRenderData.Num() * NumParametersPerRenderData);
+	for (const FQuadtreeMeshRenderData& Data : NodeData.QuadtreeMeshRenderData)
+	{
+		OutParameters.Add(FVector4f(Data.SurfaceColor));
+		OutParameters.Add(Data.WaveParameters);
+	}
+}
+
+void FMeshQuadTree::InitTree(const FBox2D& InCoverageBounds, float InTileSize, bool bInIsGPUQuadTree, bool bInReserveNodes)
+{
+	ensure(InCoverageBounds.GetArea() > 0.0f);
 	ensure(InTileSize > 0.0f);
-	ensure(InExtentInTiles.X > 0);
-	ensure(InExtentInTiles.Y > 0);
 
 	bIsGPUQuadTree = bInIsGPUQuadTree;
 
-	// Maximum number of allocated leaf nodes for this config
-	MaxLeafCount = InExtentInTiles.X*InExtentInTiles.Y*4;
+	// Leaf tiles needed to cover the bounds, the region is snapped to the leaf grid starting at the bounds min
+	const FVector2D CoverageSize = InCoverageBounds.GetSize();
+	ExtentInTiles = FIntPoint(
+		FMath::Max(FMath::CeilToInt(CoverageSize.X / InTileSize - UE_KINDA_SMALL_NUMBER), 1),
+		FMath::Max(FMath::CeilToInt(CoverageSize.Y / InTileSize - UE_KINDA_SMALL_NUMBER), 1));
 	LeafSize = InTileSize;
-	ExtentInTiles = InExtentInTiles;
+
+	// Maximum number of allocated leaf nodes for this config
+	MaxLeafCount = ExtentInTiles.X * ExtentInTiles.Y;
 
 	// Calculate the depth of the tree. This also corresponds to the LOD count. 0 means root is leaf node
-	// Find a pow2 tile resolution that contains the user defined extent in tiles
-	const int32 MaxDim = FMath::Max(InExtentInTiles.X * 4, InExtentInTiles.Y * 4);
+	// Find a pow2 tile resolution that contains the covered tiles. At least 2 so the tree has one density level to render with
+	const int32 MaxDim = FMath::Max3(ExtentInTiles.X, ExtentInTiles.Y, 2);
 	const float RootDim = static_cast<float>(FMath::RoundUpToPowerOfTwo(MaxDim));
 
-	TileRegion = InBounds;
+	TileRegion = FBox2D(InCoverageBounds.Min, InCoverageBounds.Min + FVector2D(ExtentInTiles) * InTileSize);
 
 	// Allocate theoretical max, shrink later in Lock()
 	// This is so that the node array doesn't move in memory while inserting
-	if (!bIsGPUQuadTree)
+	if (!bIsGPUQuadTree && bInReserveNodes)
 	{
 		NodeData.Nodes.Empty((float)(FMath::Square(RootDim) * 4) / 3.0f);
 	}
@@ -44,6 +60,11 @@ void FMeshQuadTree::InitTree(const FBox2D& InBounds, float InTileSize, FIntPoint
 	
 	NodeData.QuadtreeMeshRenderData.Empty(1);
 	NodeData.QuadtreeMeshRenderData.AddDefaulted();
+	NodeData.QuadtreeMeshRenderDataHot.Empty(1);
+	NodeData.QuadtreeMeshRenderDataHot.AddDefaulted();
+	NodeData.PageTable.Reset();
+	FreeNodeIndices.Reset();
+	CoveredBounds.Init();
 
 	ensure(NodeData.Nodes.Num() == 0);
 
@@ -131,7 +152,219 @@ void FMeshQuadTree::Unlock(bool bPruneRedundantNodes)
 		NodeData.Nodes.SetNum(EndIndex + 1);
 	}
 
+	CoveredBounds.Init();
+	ForEachCoveredNode([this](const FBox& InBounds)
+	{
+		CoveredBounds += InBounds;
+	});
+
+	bIsReadOnly = true;
+}
+
+void FMeshQuadTree::BuildPagedTree(int32 InPageDepth, int32 InMaxResidentPages, FGetLeafBlockQuadtreeMeshIndex InGetBlockQuadtreeMeshIndex, double InMinZOffset, double InMaxZOffset)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::BuildPagedTree);
+	check(!bIsReadOnly && !bIsGPUQuadTree);
+	check(GetNodeCount() == 1 && FreeNodeIndices.Num() == 0);
+
+	const int32 PageDepth = FMath::Clamp(InPageDepth, 0, TreeDepth);
+	TSharedPtr<FPageTable, ESPMode::ThreadSafe> PageTable = MakeShared<FPageTable, ESPMode::ThreadSafe>(InMaxResidentPages);
+	TMap<uint32, int32> PageIndexByBuiltNode;
+	TArray<uint32> WrittenNodes;
+
+	// Copy the subtree of InNodeIndex to OutNodes depth first, dropping the nodes freed while building. Parents stay in front of their children.
+	// InPageIndices moves along the page of each paged node
+	auto CopySubtree = [this, &PageTable](auto& Self, TArray<FNode>& OutNodes, uint32 InNodeIndex, uint32 InParentIndex, const TMap<uint32, int32>* InPageIndices) -> uint32
+	{
+		const FNode& Node = NodeData.Nodes[InNodeIndex];
+		const uint32 CopyIndex = OutNodes.Add(Node);
+		OutNodes[CopyIndex].ParentIndex = InParentIndex;
+		if (Node.IsPaged)
+		{
+			PageTable->PageIndexByNode.Add(CopyIndex, InPageIndices->FindChecked(InNodeIndex));
+		}
+
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if (Node.Children[i] > 0)
+			{
+				const uint32 ChildCopyIndex = Self(Self, OutNodes, Node.Children[i], CopyIndex, InPageIndices);
+				OutNodes[CopyIndex].Children[i] = ChildCopyIndex;
+			}
+		}
+		return CopyIndex;
+	};
+
+	// The subtree of a node at PageDepth is built alone in an empty node array, compressed into a page, and only its root is kept
+	auto BuildPage = [&](uint32 InNodeIndex, const FLeafBlock& InBlock) -> bool
+	{
+		TArray<FNode> TopNodes = MoveTemp(NodeData.Nodes);
+		TArray<uint32> TopFreeNodeIndices = MoveTemp(FreeNodeIndices);
+		NodeData.Nodes.Emplace();
+
+		const bool bHasTiles = FillLeafBlock(0, InBlock, InGetBlockQuadtreeMeshIndex, InMinZOffset, InMaxZOffset, WrittenNodes);
+		WrittenNodes.Reset();
+		FNode PageRoot = NodeData.Nodes[0];
+		int32 PageIndex = INDEX_NONE;
+		if (bHasTiles)
+		{
+			ForEachCoveredNode([this](const FBox& InBounds)
+			{
+				CoveredBounds += InBounds;
+			});
+
+			if ((PageRoot.Children[0] | PageRoot.Children[1] | PageRoot.Children[2] | PageRoot.Children[3]) != 0)
+			{
+				TArray<FNode> PageNodes;
+				CopySubtree(CopySubtree, PageNodes, 0, INVALID_PARENT, nullptr);
+				PageIndex = PageTable->WritePage(PageNodes);
+
+				FMemory::Memzero(&PageRoot.Children, sizeof(uint32) * 4);
+				PageRoot.IsPaged = 1;
+			}
+		}
+
+		NodeData.Nodes = MoveTemp(TopNodes);
+		FreeNodeIndices = MoveTemp(TopFreeNodeIndices);
+		PageRoot.ParentIndex = NodeData.Nodes[InNodeIndex].ParentIndex;
+		NodeData.Nodes[InNodeIndex] = PageRoot;
+		if (PageIndex != INDEX_NONE)
+		{
+			PageIndexByBuiltNode.Add(InNodeIndex, PageIndex);
+		}
+		return bHasTiles;
+	};
+
+	// Nodes above PageDepth, built like FillLeafBlock(..) but with their subtrees at PageDepth paged
+	auto BuildNode = [&](auto& Self, uint32 InNodeIndex, const FLeafBlock& InBlock, int32 InDepth) -> bool
+	{
+		if (InDepth == PageDepth)
+		{
+			return BuildPage(InNodeIndex, InBlock);
+		}
+
+		if (InGetBlockQuadtreeMeshIndex(InBlock) != INDEX_NONE)
+		{
+			// Uniform, nothing to page
+			const bool bHasTiles = FillLeafBlock(InNodeIndex, InBlock, InGetBlockQuadtreeMeshIndex, InMinZOffset, InMaxZOffset, WrittenNodes);
+			if (bHasTiles)
+			{
+				CoveredBounds += NodeData.Nodes[InNodeIndex].Bounds;
+			}
+			return bHasTiles;
+		}
+
+		NodeData.Nodes[InNodeIndex].Bounds = GetLeafBlockBounds(InBlock);
+		const uint64 NumChildLeaves = 1ull << (2 * (InBlock.Level - 1));
+		for (int32 i = 0; i < 4; ++i)
+		{
+			const uint32 ChildIndex = AllocateNode(InNodeIndex, WrittenNodes);
+			if (Self(Self, ChildIndex, FLeafBlock{ InBlock.MortonBegin + i * NumChildLeaves, InBlock.Level - 1 }, InDepth + 1))
+			{
+				NodeData.Nodes[InNodeIndex].Children[i] = ChildIndex;
+			}
+			else
+			{
+				FreeSubtree(ChildIndex);
+			}
+		}
+		return UpdateNodeFromChildren(InNodeIndex, WrittenNodes);
+	};
+
+	CoveredBounds.Init();
+	const FBox RootBounds = NodeData.Nodes[0].Bounds;
+	if (!BuildNode(BuildNode, 0, FLeafBlock{ 0, TreeDepth }, 0))
+	{
+		// Nothing to render, an empty root like Unlock(true) leaves
+		NodeData.Nodes[0] = FNode();
+		NodeData.Nodes[0].Bounds = RootBounds;
+	}
+
+	// Compact the resident nodes
+	TArray<FNode> ResidentNodes;
+	CopySubtree(CopySubtree, ResidentNodes, 0, INVALID_PARENT, &PageIndexByBuiltNode);
+	NodeData.Nodes = MoveTemp(ResidentNodes);
+	FreeNodeIndices.Empty();
+	bIsReadOnly = true;
+
+	if (PageTable->PageIndexByNode.IsEmpty())
+	{
+		// No subtree below PageDepth, the tree is small enough as is
+		return;
+	}
+
+	PageTable->FinishWriting(NodeData.QuadtreeMeshRenderDataHot);
+	UE_LOG(LogQuadtreeMesh, Verbose, TEXT("Built %d resident quadtree mesh nodes and %d pages (%lld compressed bytes)"), NodeData.Nodes.Num(), PageTable->PageIndexByNode.Num(), PageTable->PageData.Num());
+	NodeData.PageTable = MoveTemp(PageTable);
+}
+
+void FMeshQuadTree::SavePages(FArchive& Ar, TArray64<uint8>& OutPageData) const
+{
+	check(Ar.IsSaving() && bIsReadOnly && HasPagedSubtrees());
+	static_assert(std::is_trivially_copyable_v<FNode>, "Nodes are saved as raw memory, like the pages");
+
+	int32 SavedTreeDepth = TreeDepth;
+	int32 NumNodes = NodeData.Nodes.Num();
+	FBox SavedCoveredBounds = CoveredBounds;
+	Ar << SavedTreeDepth;
+	Ar << NumNodes;
+	Ar.Serialize(const_cast<FNode*>(NodeData.Nodes.GetData()), NumNodes * sizeof(FNode));
+	Ar << SavedCoveredBounds;
+	NodeData.PageTable->SerializeLayout(Ar);
+
+	OutPageData = NodeData.PageTable->PageData;
+}
+
+bool FMeshQuadTree::LoadPages(FArchive& Ar, const TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>& InPageBulkData, int32 InMaxResidentPages)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::LoadPages);
+	check(Ar.IsLoading() && !bIsReadOnly && !bIsGPUQuadTree);
+	check(GetNodeCount() == 1);
+
+	int32 SavedTreeDepth = 0;
+	int32 NumNodes = 0;
+	Ar << SavedTreeDepth;
+	Ar << NumNodes;
+	if (Ar.IsError() || SavedTreeDepth != TreeDepth || NumNodes <= 0 || !InPageBulkData)
+	{
+		return false;
+	}
+
+	TArray<FNode> ResidentNodes;
+	ResidentNodes.SetNumUninitialized(NumNodes);
+	Ar.Serialize(ResidentNodes.GetData(), NumNodes * sizeof(FNode));
+	FBox SavedCoveredBounds(ForceInit);
+	Ar << SavedCoveredBounds;
+
+	TSharedPtr<FPageTable, ESPMode::ThreadSafe> PageTable = MakeShared<FPageTable, ESPMode::ThreadSafe>(InMaxResidentPages);
+	PageTable->SerializeLayout(Ar);
+	if (Ar.IsError())
+	{
+		return false;
+	}
+
+	PageTable->PageBulkData = InPageBulkData;
+	PageTable->FinishWriting(NodeData.QuadtreeMeshRenderDataHot);
+
+	NodeData.Nodes = MoveTemp(ResidentNodes);
+	NodeData.PageTable = MoveTemp(PageTable);
+	CoveredBounds = SavedCoveredBounds;
 	bIsReadOnly = true;
+	return true;
+}
+
+FMeshQuadTree::FPagingStats FMeshQuadTree::GetPagingStats() const
+{
+	return NodeData.PageTable ? NodeData.PageTable->GetStats() : FPagingStats();
+}
+
+TSharedPtr<const FMeshQuadTree::FNodeData, ESPMode::ThreadSafe> FMeshQuadTree::FNodeData::AcquirePage(const FNode& InPagedNode) const
+{
+	check(InPagedNode.IsPaged && PageTable);
+
+	const uint32 NodeIndex = static_cast<uint32>(&InPagedNode - Nodes.GetData());
+	check(Nodes.IsValidIndex(NodeIndex));
+	return PageTable->Acquire(PageTable->PageIndexByNode.FindChecked(NodeIndex));
 }
 
 void FMeshQuadTree::AddQuadtreeMeshTilesInsideBounds(const FBox& InBounds, uint32 InQuadtreeMeshIndex)
@@ -154,6 +387,379 @@ void FMeshQuadTree::AddQuadtreeMesh(const TArray<FVector2D>& InPoly, const FBox&
 	
 }
 
+void FMeshQuadTree::AddQuadtreeMeshTilesFromLeafBlocks(FGetLeafBlockQuadtreeMeshIndex InGetBlockQuadtreeMeshIndex, double InMinZOffset, double InMaxZOffset)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::AddQuadtreeMeshTilesFromLeafBlocks);
+	check(!bIsReadOnly);
+	check(!bIsGPUQuadTree);
+
+	const FBox MeshBounds(FVector(TileRegion.Min, 0.0f), FVector(TileRegion.Max, 0.0f));
+	const FVector2D RootMin(NodeData.Nodes[0].Bounds.Min);
+	// Shrunk so the block doesn't touch the neighbor leaves
+	const FVector2D LeafSizeShrink(LeafSize * 0.25, LeafSize * 0.25);
+
+	auto AddBlock = [&](auto& Self, const FLeafBlock& InBlock) -> void
+	{
+		const int32 QuadtreeMeshIndex = InGetBlockQuadtreeMeshIndex(InBlock);
+		if (QuadtreeMeshIndex == INDEX_NONE)
+		{
+			check(InBlock.Level > 0);
+			const uint64 NumChildLeaves = 1ull << (2 * (InBlock.Level - 1));
+			for (uint64 ChildIndex = 0; ChildIndex < 4; ++ChildIndex)
+			{
+				Self(Self, FLeafBlock{ InBlock.MortonBegin + ChildIndex * NumChildLeaves, InBlock.Level - 1 });
+			}
+			return;
+		}
+
+		if (QuadtreeMeshIndex == 0)
+		{
+			return;
+		}
+
+		const FVector2D BlockMin = RootMin + FVector2D(static_cast<double>(FMath::ReverseMortonCode2_64(InBlock.MortonBegin)), static_cast<double>(FMath::ReverseMortonCode2_64(InBlock.MortonBegin >> 1))) * LeafSize;
+		const FVector2D BlockSize(LeafSize * static_cast<double>(1ull << InBlock.Level));
+		const double SurfaceBaseHeight = NodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex].SurfaceBaseHeight;
+		const FBox BlockBounds(FVector(BlockMin + LeafSizeShrink, SurfaceBaseHeight + InMinZOffset), FVector(BlockMin + BlockSize - LeafSizeShrink, SurfaceBaseHeight + InMaxZOffset));
+		NodeData.Nodes[0].AddNodes(NodeData, MeshBounds, BlockBounds, QuadtreeMeshIndex, TreeDepth, 0);
+	};
+	AddBlock(AddBlock, FLeafBlock{ 0, TreeDepth });
+}
+
+bool FMeshQuadTree::RebuildLeafBlocks(TConstArrayView<FLeafBlock> InBlocks, FGetLeafBlockQuadtreeMeshIndex InGetBlockQuadtreeMeshIndex, double InMinZOffset, double InMaxZOffset, FEditPatch& OutPatch)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::RebuildLeafBlocks);
+	check(bIsReadOnly);
+
+	if (bIsGPUQuadTree || HasPagedSubtrees() || GetNodeCount() == 0)
+	{
+		return false;
+	}
+
+	TArray<uint32> WrittenNodes;
+	TArray<uint32, TInlineAllocator<32>> Path;
+	for (const FLeafBlock& Block : InBlocks)
+	{
+		check(Block.Level >= 0 && Block.Level <= TreeDepth);
+
+		// Walk down to the node of the block, ancestors standing for a uniform area get explicit children on the way
+		Path.Reset();
+		uint32 NodeIndex = 0;
+		bool bBuiltMissingChild = false;
+		for (int32 Level = TreeDepth; Level > Block.Level; --Level)
+		{
+			Path.Add(NodeIndex);
+
+			FNode& Node = NodeData.Nodes[NodeIndex];
+			const bool bHasChildren = (Node.Children[0] | Node.Children[1] | Node.Children[2] | Node.Children[3]) != 0;
+			if (!bHasChildren && Node.HasCompleteSubtree && Node.IsSubtreeSameQuadtreeMesh && Node.QuadtreeMeshIndex != 0)
+			{
+				FBox ChildBounds[4];
+				GetImplicitChildBounds(Node.Bounds, ChildBounds);
+				for (int32 i = 0; i < 4; ++i)
+				{
+					const uint32 ChildIndex = AllocateNode(NodeIndex, WrittenNodes);
+					FNode& Child = NodeData.Nodes[ChildIndex];
+					const FNode& Parent = NodeData.Nodes[NodeIndex];
+					Child.Bounds = ChildBounds[i];
+					Child.QuadtreeMeshIndex = Parent.QuadtreeMeshIndex;
+					Child.TransitionQuadtreeMeshIndex = Parent.TransitionQuadtreeMeshIndex;
+					Child.HasMaterial = Parent.HasMaterial;
+					NodeData.Nodes[NodeIndex].Children[i] = ChildIndex;
+				}
+				WrittenNodes.Add(NodeIndex);
+			}
+
+			const int32 ChildSlot = static_cast<int32>((Block.MortonBegin >> (2 * (Level - 1))) & 3);
+			const uint32 ChildIndex = NodeData.Nodes[NodeIndex].Children[ChildSlot];
+			if (ChildIndex == 0)
+			{
+				// Nothing rendered there yet, the whole child is built from the new coverage
+				const uint64 ChildMortonBegin = Block.MortonBegin & ~((1ull << (2 * (Level - 1))) - 1);
+				const uint32 NewChildIndex = AllocateNode(NodeIndex, WrittenNodes);
+				if (FillLeafBlock(NewChildIndex, FLeafBlock{ ChildMortonBegin, Level - 1 }, InGetBlockQuadtreeMeshIndex, InMinZOffset, InMaxZOffset, WrittenNodes))
+				{
+					NodeData.Nodes[NodeIndex].Children[ChildSlot] = NewChildIndex;
+				}
+				else
+				{
+					FreeSubtree(NewChildIndex);
+				}
+				bBuiltMissingChild = true;
+				break;
+			}
+			NodeIndex = ChildIndex;
+		}
+
+		if (bBuiltMissingChild)
+		{
+			// Done above
+		}
+		else if (NodeIndex == 0)
+		{
+			// The block is the whole tree, the root stays even when nothing is left
+			for (const uint32 ChildIndex : NodeData.Nodes[0].Children)
+			{
+				if (ChildIndex > 0)
+				{
+					FreeSubtree(ChildIndex);
+				}
+			}
+			const FBox RootBounds = NodeData.Nodes[0].Bounds;
+			NodeData.Nodes[0] = FNode();
+			NodeData.Nodes[0].Bounds = RootBounds;
+			WrittenNodes.Add(0);
+			if (!FillLeafBlock(0, Block, InGetBlockQuadtreeMeshIndex, InMinZOffset, InMaxZOffset, WrittenNodes))
+			{
+				NodeData.Nodes[0] = FNode();
+				NodeData.Nodes[0].Bounds = FBox(FVector(FVector2D(RootBounds.Min), TNumericLimits<float>::Max()), FVector(FVector2D(RootBounds.Max), TNumericLimits<float>::Lowest()));
+			}
+		}
+		else
+		{
+			// Replace the subtree of the block in its parent
+			const uint32 ParentIndex = Path.Last();
+			const int32 ChildSlot = static_cast<int32>((Block.MortonBegin >> (2 * Block.Level)) & 3);
+			FreeSubtree(NodeIndex);
+
+			const uint32 NewNodeIndex = AllocateNode(ParentIndex, WrittenNodes);
+			if (FillLeafBlock(NewNodeIndex, Block, InGetBlockQuadtreeMeshIndex, InMinZOffset, InMaxZOffset, WrittenNodes))
+			{
+				NodeData.Nodes[ParentIndex].Children[ChildSlot] = NewNodeIndex;
+			}
+			else
+			{
+				FreeSubtree(NewNodeIndex);
+				NodeData.Nodes[ParentIndex].Children[ChildSlot] = 0;
+			}
+		}
+
+		// Ancestors bottom up, the ones left without tiles are removed like Unlock(true) would
+		for (int32 PathIndex = Path.Num() - 1; PathIndex >= 0; --PathIndex)
+		{
+			const uint32 AncestorIndex = Path[PathIndex];
+			if (UpdateNodeFromChildren(AncestorIndex, WrittenNodes) || AncestorIndex == 0)
+			{
+				continue;
+			}
+
+			FNode& Parent = NodeData.Nodes[Path[PathIndex - 1]];
+			for (uint32& ChildIndex : Parent.Children)
+			{
+				if (ChildIndex == AncestorIndex)
+				{
+					ChildIndex = 0;
+				}
+			}
+			FreeSubtree(AncestorIndex);
+		}
+	}
+
+	CoveredBounds.Init();
+	ForEachCoveredNode([this](const FBox& InBounds)
+	{
+		CoveredBounds += InBounds;
+	});
+
+	// Nodes freed after being written are sent too, nothing references them
+	WrittenNodes.Sort();
+	OutPatch.NodeIndices.Reset(WrittenNodes.Num());
+	OutPatch.Nodes.Reset(WrittenNodes.Num());
+	for (int32 Index = 0; Index < WrittenNodes.Num(); ++Index)
+	{
+		if (Index == 0 || WrittenNodes[Index] != WrittenNodes[Index - 1])
+		{
+			OutPatch.NodeIndices.Add(WrittenNodes[Index]);
+			OutPatch.Nodes.Add(NodeData.Nodes[WrittenNodes[Index]]);
+		}
+	}
+	OutPatch.NodeCount = NodeData.Nodes.Num();
+	OutPatch.RenderData = NodeData.QuadtreeMeshRenderData;
+	OutPatch.CoveredBounds = CoveredBounds;
+	return true;
+}
+
+void FMeshQuadTree::ApplyEditPatch(const FEditPatch& InPatch)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::ApplyEditPatch);
+	check(bIsReadOnly);
+	check(!HasPagedSubtrees());
+
+	NodeData.Nodes.SetNum(InPatch.NodeCount);
+	for (int32 Index = 0; Index < InPatch.NodeIndices.Num(); ++Index)
+	{
+		NodeData.Nodes[InPatch.NodeIndices[Index]] = InPatch.Nodes[Index];
+	}
+
+	NodeData.QuadtreeMeshRenderData = InPatch.RenderData;
+	NodeData.QuadtreeMeshRenderDataHot.Reset(InPatch.RenderData.Num());
+	for (const FQuadtreeMeshRenderData& RenderData : InPatch.RenderData)
+	{
+		NodeData.QuadtreeMeshRenderDataHot.Add(MakeRenderDataHot(RenderData));
+	}
+
+	CoveredBounds = InPatch.CoveredBounds;
+}
+
+uint32 FMeshQuadTree::AllocateNode(uint32 InParentIndex, TArray<uint32>& InOutWrittenNodes)
+{
+	const uint32 NodeIndex = FreeNodeIndices.Num() > 0 ? FreeNodeIndices.Pop(EAllowShrinking::No) : NodeData.Nodes.AddDefaulted();
+	NodeData.Nodes[NodeIndex] = FNode();
+	NodeData.Nodes[NodeIndex].ParentIndex = InParentIndex;
+	InOutWrittenNodes.Add(NodeIndex);
+	return NodeIndex;
+}
+
+void FMeshQuadTree::FreeSubtree(uint32 InNodeIndex)
+{
+	check(InNodeIndex != 0);
+	for (const uint32 ChildIndex : NodeData.Nodes[InNodeIndex].Children)
+	{
+		if (ChildIndex > 0)
+		{
+			FreeSubtree(ChildIndex);
+		}
+	}
+	FreeNodeIndices.Add(InNodeIndex);
+}
+
+FBox FMeshQuadTree::GetLeafBlockBounds(const FLeafBlock& InBlock) const
+{
+	// The root starts at the tile region min, see InitTree(..)
+	const FVector2D BlockMin = TileRegion.Min + FVector2D(static_cast<double>(FMath::ReverseMortonCode2_64(InBlock.MortonBegin)), static_cast<double>(FMath::ReverseMortonCode2_64(InBlock.MortonBegin >> 1))) * LeafSize;
+	const FVector2D BlockSize(LeafSize * static_cast<double>(1ull << InBlock.Level));
+	return FBox(FVector(BlockMin, 0.0), FVector(BlockMin + BlockSize, 0.0));
+}
+
+bool FMeshQuadTree::FillLeafBlock(uint32 InNodeIndex, const FLeafBlock& InBlock, FGetLeafBlockQuadtreeMeshIndex InGetBlockQuadtreeMeshIndex, double InMinZOffset, double InMaxZOffset, TArray<uint32>& InOutWrittenNodes)
+{
+	NodeData.Nodes[InNodeIndex].Bounds = GetLeafBlockBounds(InBlock);
+	InOutWrittenNodes.Add(InNodeIndex);
+
+	const int32 QuadtreeMeshIndex = InGetBlockQuadtreeMeshIndex(InBlock);
+	if (QuadtreeMeshIndex != INDEX_NONE)
+	{
+		// Uniform, its children are implicit. Material-less tiles never render, Unlock(true) drops them too
+		if (QuadtreeMeshIndex == 0 || !NodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex].bHasMaterial)
+		{
+			return false;
+		}
+
+		FNode& Node = NodeData.Nodes[InNodeIndex];
+		const double SurfaceBaseHeight = NodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex].SurfaceBaseHeight;
+		Node.Bounds.Min.Z = SurfaceBaseHeight + InMinZOffset;
+		Node.Bounds.Max.Z = SurfaceBaseHeight + InMaxZOffset;
+		Node.QuadtreeMeshIndex = QuadtreeMeshIndex;
+		Node.TransitionQuadtreeMeshIndex = QuadtreeMeshIndex;
+		Node.HasMaterial = 1;
+		Node.HasCompleteSubtree = 1;
+		Node.IsSubtreeSameQuadtreeMesh = 1;
+		return true;
+	}
+
+	check(InBlock.Level > 0);
+	const uint64 NumChildLeaves = 1ull << (2 * (InBlock.Level - 1));
+	for (int32 i = 0; i < 4; ++i)
+	{
+		const uint32 ChildIndex = AllocateNode(InNodeIndex, InOutWrittenNodes);
+		if (FillLeafBlock(ChildIndex, FLeafBlock{ InBlock.MortonBegin + i * NumChildLeaves, InBlock.Level - 1 }, InGetBlockQuadtreeMeshIndex, InMinZOffset, InMaxZOffset, InOutWrittenNodes))
+		{
+			NodeData.Nodes[InNodeIndex].Children[i] = ChildIndex;
+		}
+		else
+		{
+			FreeSubtree(ChildIndex);
+		}
+	}
+	return UpdateNodeFromChildren(InNodeIndex, InOutWrittenNodes);
+}
+
+bool FMeshQuadTree::UpdateNodeFromChildren(uint32 InNodeIndex, TArray<uint32>& InOutWrittenNodes)
+{
+	FNode& Node = NodeData.Nodes[InNodeIndex];
+	InOutWrittenNodes.Add(InNodeIndex);
+
+	// Same as FNode::AddNodes(..) with the blocks added in Morton order: the render data of the last child wins
+	bool bHasChild = false;
+	Node.HasCompleteSubtree = 1;
+	Node.IsSubtreeSameQuadtreeMesh = 1;
+	Node.Bounds.Min.Z = TNumericLimits<float>::Max();
+	Node.Bounds.Max.Z = TNumericLimits<float>::Lowest();
+	const FNode* PrevChildNode = nullptr;
+	for (const uint32 ChildIndex : Node.Children)
+	{
+		if (ChildIndex == 0)
+		{
+			Node.HasCompleteSubtree = 0;
+			continue;
+		}
+
+		const FNode& ChildNode = NodeData.Nodes[ChildIndex];
+		if (ChildNode.IsSubtreeSameQuadtreeMesh == 0 || (PrevChildNode && !ChildNode.CanMerge(*PrevChildNode)))
+		{
+			Node.IsSubtreeSameQuadtreeMesh = 0;
+		}
+		if (ChildNode.HasCompleteSubtree == 0)
+		{
+			Node.HasCompleteSubtree = 0;
+		}
+
+		Node.Bounds.Min.Z = FMath::Min(Node.Bounds.Min.Z, ChildNode.Bounds.Min.Z);
+		Node.Bounds.Max.Z = FMath::Max(Node.Bounds.Max.Z, ChildNode.Bounds.Max.Z);
+		Node.QuadtreeMeshIndex = ChildNode.QuadtreeMeshIndex;
+		Node.TransitionQuadtreeMeshIndex = ChildNode.TransitionQuadtreeMeshIndex;
+		PrevChildNode = &ChildNode;
+		bHasChild = true;
+	}
+
+	if (!bHasChild)
+	{
+		Node.QuadtreeMeshIndex = 0;
+		Node.TransitionQuadtreeMeshIndex = 0;
+		Node.HasMaterial = 0;
+		return false;
+	}
+
+	Node.HasMaterial = NodeData.QuadtreeMeshRenderDataHot[Node.QuadtreeMeshIndex].bHasMaterial;
+	if (Node.HasCompleteSubtree && Node.IsSubtreeSameQuadtreeMesh)
+	{
+		for (uint32& ChildIndex : Node.Children)
+		{
+			FreeSubtree(ChildIndex);
+			ChildIndex = 0;
+		}
+		return Node.HasMaterial != 0;
+	}
+	return true;
+}
+
+FQuadtreeMeshRenderDataHot FMeshQuadTree::MakeRenderDataHot(const FQuadtreeMeshRenderData& InQuadtreeMeshRenderData)
+{
+	FQuadtreeMeshRenderDataHot HotData;
+	HotData.SurfaceBaseHeight = InQuadtreeMeshRenderData.SurfaceBaseHeight;
+	HotData.HitProxyColor = InQuadtreeMeshRenderData.HitProxy ? InQuadtreeMeshRenderData.HitProxy->Id.GetColor() : FColor::Black;
+	HotData.MaterialIndex = InQuadtreeMeshRenderData.MaterialIndex;
+	HotData.bHasMaterial = InQuadtreeMeshRenderData.Material != nullptr;
+	HotData.bQuadtreeMeshSelected = InQuadtreeMeshRenderData.bQuadtreeMeshSelected;
+	return HotData;
+}
+
+uint32 FMeshQuadTree::AddQuadtreeMeshRenderData(const FQuadtreeMeshRenderData& InQuadtreeMeshRenderData)
+{
+	NodeData.QuadtreeMeshRenderDataHot.Add(MakeRenderDataHot(InQuadtreeMeshRenderData));
+
+	const uint32 Index = NodeData.QuadtreeMeshRenderData.Add(InQuadtreeMeshRenderData);
+	check(Index == NodeData.QuadtreeMeshRenderDataHot.Num() - 1);
+	return Index;
+}
+
+void FMeshQuadTree::SetQuadtreeMeshRenderData(uint32 InQuadtreeMeshIndex, const FQuadtreeMeshRenderData& InQuadtreeMeshRenderData)
+{
+	check(InQuadtreeMeshIndex > 0);
+	NodeData.QuadtreeMeshRenderData[InQuadtreeMeshIndex] = InQuadtreeMeshRenderData;
+	NodeData.QuadtreeMeshRenderDataHot[InQuadtreeMeshIndex] = MakeRenderDataHot(InQuadtreeMeshRenderData);
+}
+
 void FMeshQuadTree::BuildMaterialIndices()
 {
 	int32 NextIdx = 0;
@@ -179,143 +785,1187 @@ void FMeshQuadTree::BuildMaterialIndices()
 	{
 		FQuadtreeMeshRenderData& Data = NodeData.QuadtreeMeshRenderData[Idx];
 		Data.MaterialIndex = GetMatIdx(Data.Material);
+		NodeData.QuadtreeMeshRenderDataHot[Idx].MaterialIndex = Data.MaterialIndex;
+	}
+
+	
+
+	QuadtreeMeshMaterials.Empty(MatToIdxMap.Num());
+	QuadtreeMeshMaterials.AddUninitialized(MatToIdxMap.Num());
+
+	for (TMap<FMaterialRenderProxy*, int32>::TConstIterator It(MatToIdxMap); It; ++It)
+	{
+		QuadtreeMeshMaterials[It->Value] = It->Key;
+	}
+}
+
+void FMeshQuadTree::BuildQuadtreeMeshTileInstanceData(const FTraversalDesc& InTraversalDesc,
+	FTraversalOutput& Output) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(BuildQuadtreeMeshTileInstanceData);
+
+	SelectQuadtreeMeshTiles(InTraversalDesc, Output);
+	PackQuadtreeMeshTileInstanceData(InTraversalDesc, Output);
+}
+
+void FMeshQuadTree::SelectQuadtreeMeshTiles(const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(SelectQuadtreeMeshTiles);
+	check(bIsReadOnly);
+
+	Output.SelectedTiles.Reset();
+	
+	if (!bIsGPUQuadTree)
+	{
+		// A valid tessellated region restricts full density to that region, everything else is rendered with collapsed coarse tiles
+		if (InTraversalDesc.TessellatedQuadtreeMeshBounds.bIsValid)
+		{
+			NodeData.Nodes[0].SelectLODWithinBounds(NodeData, TreeDepth, EFrustumTestResult::Intersecting, InTraversalDesc, Output);
+		}
+		else if (InTraversalDesc.bWideTraversal)
+		{
+			NodeData.Nodes[0].SelectLODWide(NodeData, TreeDepth, EFrustumTestResult::Intersecting, InTraversalDesc, Output);
+		}
+		else
+		{
+			NodeData.Nodes[0].SelectLOD(NodeData, TreeDepth, EFrustumTestResult::Intersecting, InTraversalDesc, Output);
+		}
+	}
+
+	if (InTraversalDesc.bGatherUnculledInstances)
+	{
+		SortSelectedTilesByBucket(Output);
+	}
+}
+
+void FMeshQuadTree::PackQuadtreeMeshTileInstanceData(const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(PackQuadtreeMeshTileInstanceData);
+
+	// Small enough to keep a few chunks per worker on typical tile counts, big enough to amortize the task overhead
+	constexpr int32 PackingChunkSize = 256;
+
+	const int32 NumTiles = Output.SelectedTiles.Num();
+	Output.StagingInstanceData.SetNumUninitialized(NumTiles);
+
+	const int32 NumChunks = FMath::DivideAndRoundUp(NumTiles, PackingChunkSize);
+	const TArray<FQuadtreeMeshRenderDataHot>& RenderData = NodeData.QuadtreeMeshRenderDataHot;
+
+	ParallelFor(TEXT("QuadtreeMesh.PackInstances"), NumChunks, 1, [&InTraversalDesc, &Output, &RenderData, NumTiles](int32 ChunkIndex)
+	{
+		const int32 FirstTile = ChunkIndex * PackingChunkSize;
+		const int32 LastTile = FMath::Min(FirstTile + PackingChunkSize, NumTiles);
+
+		for (int32 TileIndex = FirstTile; TileIndex < LastTile; ++TileIndex)
+		{
+			const FSelectedTile& Tile = Output.SelectedTiles[TileIndex];
+			const FQuadtreeMeshRenderDataHot& QuadtreeMeshRenderData = RenderData[Tile.QuadtreeMeshIndex];
+			FStagingInstanceData& StagingData = Output.StagingInstanceData[TileIndex];
+
+			// The base height of this tile comes either the top of the bounding box (for rivers) or the given base height (lakes and ocean)
+			const double BaseHeight = QuadtreeMeshRenderData.SurfaceBaseHeight;
+
+			const float BaseHeightTWS = BaseHeight + InTraversalDesc.PreViewTranslation.Z;
+
+			const FVector2D TranslatedWorldPosition(Tile.Center + FVector2D(InTraversalDesc.PreViewTranslation));
+
+			// Add the data to the bucket
+			StagingData.BucketIndex = Tile.BucketIndex;
+			StagingData.bInFrustum = Tile.bInFrustum;
+			StagingData.Data[0].X = TranslatedWorldPosition.X;
+			StagingData.Data[0].Y = TranslatedWorldPosition.Y;
+			StagingData.Data[0].Z = BaseHeightTWS;
+			StagingData.Data[0].W = std::bit_cast<float>(static_cast<uint32>(Tile.QuadtreeMeshIndex));
+
+			// Lowest LOD isn't always 0, this increases with the height distance 
+			const bool bIsLowestLOD = (Tile.LODLevel == InTraversalDesc.LowestLOD);
+
+			// Only allow a tile to morph if it's not the last density level and not the last LOD level, sicne there is no next level to morph to
+			const uint32 bShouldMorph = (InTraversalDesc.bLODMorphingEnabled && (Tile.DensityIndex != InTraversalDesc.DensityCount - 1)) ? 1 : 0;
+			// Tiles can morph twice to be able to morph between 3 LOD levels. Next to last density level can only morph once
+			const uint32 bCanMorphTwice = (Tile.DensityIndex < InTraversalDesc.DensityCount - 2) ? 1 : 0;
+
+			// Pack some of the data to save space. LOD level in the lower 8 bits and then bShouldMorph in the 9th bit and bCanMorphTwice in the 10th bit
+			const uint32 BitPackedChannel = static_cast<uint32>(Tile.LODLevel) | (bShouldMorph << 8) | (bCanMorphTwice << 9);
+
+			StagingData.Data[1].X = std::bit_cast<float>(BitPackedChannel);
+			StagingData.Data[1].Y = bIsLowestLOD ? InTraversalDesc.HeightMorph : 0.0f;
+			StagingData.Data[1].Z = Tile.Size.X;
+			StagingData.Data[1].W = Tile.Size.Y;
+
+			// Instance Hit Proxy ID
+			const FLinearColor HitProxyColor = QuadtreeMeshRenderData.HitProxyColor.ReinterpretAsLinear();
+			StagingData.Data[2].X = HitProxyColor.R;
+			StagingData.Data[2].Y = HitProxyColor.G;
+			StagingData.Data[2].Z = HitProxyColor.B;
+			StagingData.Data[2].W = QuadtreeMeshRenderData.bQuadtreeMeshSelected ? 1.0f : 0.0f;
+		}
+	}, NumChunks > 1 ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+}
+
+FMeshQuadTree::EFrustumTestResult FMeshQuadTree::TestFrustum(const FConvexVolume& InFrustum, EFrustumTestResult InParentResult, const FVector& InCenter, const FVector& InExtent)
+{
+	if (InParentResult == EFrustumTestResult::KnownIntersecting)
+	{
+		return EFrustumTestResult::Intersecting;
+	}
+
+	if (InParentResult != EFrustumTestResult::Intersecting)
+	{
+		return InParentResult;
+	}
+
+	bool bFullyContained = false;
+	if (!InFrustum.IntersectBox(InCenter, InExtent, bFullyContained))
+	{
+		return EFrustumTestResult::Outside;
+	}
+
+	return bFullyContained ? EFrustumTestResult::Inside : EFrustumTestResult::Intersecting;
+}
+
+template<int32 NumBoxes>
+void FMeshQuadTree::TestFrustumBatch(const FConvexVolume& InFrustum, const FBox* InBounds, EFrustumTestResult* OutResults)
+{
+	static_assert(NumBoxes % 4 == 0, "Boxes are tested 4 lanes per register");
+	constexpr int32 NumRegisters = NumBoxes / 4;
+
+	double CenterX[NumBoxes], CenterY[NumBoxes], CenterZ[NumBoxes], ExtentX[NumBoxes], ExtentY[NumBoxes], ExtentZ[NumBoxes];
+	for (int32 i = 0; i < NumBoxes; ++i)
+	{
+		FVector Center, Extent;
+		InBounds[i].GetCenterAndExtents(Center, Extent);
+		CenterX[i] = Center.X;
+		CenterY[i] = Center.Y;
+		CenterZ[i] = Center.Z;
+		ExtentX[i] = Extent.X;
+		ExtentY[i] = Extent.Y;
+		ExtentZ[i] = Extent.Z;
+	}
+
+	VectorRegister4Double CX[NumRegisters], CY[NumRegisters], CZ[NumRegisters], EX[NumRegisters], EY[NumRegisters], EZ[NumRegisters];
+	VectorRegister4Double OutsideMask[NumRegisters], IntersectMask[NumRegisters];
+	for (int32 r = 0; r < NumRegisters; ++r)
+	{
+		CX[r] = VectorLoad(CenterX + r * 4);
+		CY[r] = VectorLoad(CenterY + r * 4);
+		CZ[r] = VectorLoad(CenterZ + r * 4);
+		EX[r] = VectorLoad(ExtentX + r * 4);
+		EY[r] = VectorLoad(ExtentY + r * 4);
+		EZ[r] = VectorLoad(ExtentZ + r * 4);
+		OutsideMask[r] = GlobalVectorConstants::DoubleZero;
+		IntersectMask[r] = GlobalVectorConstants::DoubleZero;
+	}
+
+	// Same as FConvexVolume::IntersectBox, but one box per lane. Each plane is splatted once for all the registers
+	for (const FPlane& Plane : InFrustum.Planes)
+	{
+		const VectorRegister4Double NX = MakeVectorRegisterDouble(Plane.X, Plane.X, Plane.X, Plane.X);
+		const VectorRegister4Double NY = MakeVectorRegisterDouble(Plane.Y, Plane.Y, Plane.Y, Plane.Y);
+		const VectorRegister4Double NZ = MakeVectorRegisterDouble(Plane.Z, Plane.Z, Plane.Z, Plane.Z);
+		const VectorRegister4Double W = MakeVectorRegisterDouble(Plane.W, Plane.W, Plane.W, Plane.W);
+		const VectorRegister4Double AbsNX = VectorAbs(NX);
+		const VectorRegister4Double AbsNY = VectorAbs(NY);
+		const VectorRegister4Double AbsNZ = VectorAbs(NZ);
+
+		for (int32 r = 0; r < NumRegisters; ++r)
+		{
+			const VectorRegister4Double Distance = VectorSubtract(VectorMultiplyAdd(CZ[r], NZ, VectorMultiplyAdd(CY[r], NY, VectorMultiply(CX[r], NX))), W);
+			const VectorRegister4Double PushOut = VectorMultiplyAdd(EZ[r], AbsNZ, VectorMultiplyAdd(EY[r], AbsNY, VectorMultiply(EX[r], AbsNX)));
+
+			OutsideMask[r] = VectorBitwiseOr(OutsideMask[r], VectorCompareGT(Distance, PushOut));
+			IntersectMask[r] = VectorBitwiseOr(IntersectMask[r], VectorCompareGT(Distance, VectorNegate(PushOut)));
+		}
+	}
+
+	uint32 OutsideBits = 0;
+	uint32 IntersectBits = 0;
+	for (int32 r = 0; r < NumRegisters; ++r)
+	{
+		OutsideBits |= static_cast<uint32>(VectorMaskBits(OutsideMask[r])) << (r * 4);
+		IntersectBits |= static_cast<uint32>(VectorMaskBits(IntersectMask[r])) << (r * 4);
+	}
+
+	for (int32 i = 0; i < NumBoxes; ++i)
+	{
+		if (OutsideBits & (1 << i))
+		{
+			OutResults[i] = EFrustumTestResult::Outside;
+		}
+		else
+		{
+			OutResults[i] = (IntersectBits & (1 << i)) ? EFrustumTestResult::KnownIntersecting : EFrustumTestResult::Inside;
+		}
+	}
+}
+
+void FMeshQuadTree::TestFrustum4(const FConvexVolume& InFrustum, const FBox InBounds[4], EFrustumTestResult OutResults[4])
+{
+	TestFrustumBatch<4>(InFrustum, InBounds, OutResults);
+}
+
+void FMeshQuadTree::TestFrustum16(const FConvexVolume& InFrustum, const FBox InBounds[16], EFrustumTestResult OutResults[16])
+{
+	TestFrustumBatch<16>(InFrustum, InBounds, OutResults);
+}
+
+void FMeshQuadTree::TestChildrenFrustum(const FBox InChildBounds[4], EFrustumTestResult InFrustumTest, const FTraversalDesc& InTraversalDesc,
+	FTraversalOutput& Output, EFrustumTestResult OutChildFrustumTests[4])
+{
+	FBox PaddedChildBounds[4];
+	if (!InTraversalDesc.BoundsPadding.IsZero())
+	{
+		for (int32 i = 0; i < 4; ++i)
+		{
+			PaddedChildBounds[i] = InChildBounds[i].ExpandBy(InTraversalDesc.BoundsPadding);
+		}
+		InChildBounds = PaddedChildBounds;
+	}
+
+	if (InFrustumTest == EFrustumTestResult::Intersecting && InTraversalDesc.bBatchChildFrustumTests)
+	{
+		TestFrustum4(InTraversalDesc.Frustum, InChildBounds, OutChildFrustumTests);
+#if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
+		++Output.Stats.BatchedFrustumTests;
+#endif
+		return;
+	}
+
+	// Either the children don't need testing or they test themselves
+	for (int32 i = 0; i < 4; ++i)
+	{
+		OutChildFrustumTests[i] = InFrustumTest;
+	}
+}
+
+void FMeshQuadTree::TestWideChildrenFrustum(const FBox InChildBounds[16], EFrustumTestResult InFrustumTest, const FTraversalDesc& InTraversalDesc,
+	FTraversalOutput& Output, EFrustumTestResult OutChildFrustumTests[16])
+{
+	if (InFrustumTest != EFrustumTestResult::Intersecting)
+	{
+		// The node's result holds for all of them
+		for (int32 i = 0; i < 16; ++i)
+		{
+			OutChildFrustumTests[i] = InFrustumTest;
+		}
+		return;
+	}
+
+	FBox PaddedChildBounds[16];
+	if (!InTraversalDesc.BoundsPadding.IsZero())
+	{
+		for (int32 i = 0; i < 16; ++i)
+		{
+			PaddedChildBounds[i] = InChildBounds[i].ExpandBy(InTraversalDesc.BoundsPadding);
+		}
+		InChildBounds = PaddedChildBounds;
+	}
+
+	TestFrustum16(InTraversalDesc.Frustum, InChildBounds, OutChildFrustumTests);
+#if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
+	++Output.Stats.WideFrustumTests;
+#endif
+}
+
+bool FMeshQuadTree::IsOutsideClipCircle(const FTraversalDesc& InTraversalDesc, const FBox& InBounds)
+{
+	const double ClipRadius = InTraversalDesc.ClipCircle.Z;
+	if (ClipRadius < 0.0)
+	{
+		return false;
+	}
+
+	const FBox2D Bounds2D(FVector2D(InBounds.Min), FVector2D(InBounds.Max));
+	return Bounds2D.ComputeSquaredDistanceToPoint(FVector2D(InTraversalDesc.ClipCircle)) > FMath::Square(ClipRadius + InTraversalDesc.BoundsPadding.X);
+}
+
+bool FMeshQuadTree::IsInOccludedCell(const FTraversalDesc& InTraversalDesc, const FBox& InBounds)
+{
+	if (InTraversalDesc.OccludedCells == nullptr)
+	{
+		return false;
+	}
+
+	const FVector2D Size(InBounds.GetSize());
+	if (Size.X > InTraversalDesc.OcclusionCellSize.X * 1.001 || Size.Y > InTraversalDesc.OcclusionCellSize.Y * 1.001)
+	{
+		return false;
+	}
+
+	const int32 CellDim = 1 << InTraversalDesc.OcclusionCellDepth;
+	const FVector2D Cell = (FVector2D(InBounds.GetCenter()) - InTraversalDesc.OcclusionCellOrigin) / InTraversalDesc.OcclusionCellSize;
+	const int32 CellX = FMath::FloorToInt(Cell.X);
+	const int32 CellY = FMath::FloorToInt(Cell.Y);
+	if (CellX < 0 || CellY < 0 || CellX >= CellDim || CellY >= CellDim)
+	{
+		return false;
+	}
+
+	const int32 CellIndex = CellY * CellDim + CellX;
+	return InTraversalDesc.OccludedCells->IsValidIndex(CellIndex) && (*InTraversalDesc.OccludedCells)[CellIndex];
+}
+
+void FMeshQuadTree::GetImplicitChildBounds(const FBox& InBounds, FBox OutChildBounds[4])
+{
+	const FVector HalfBoundSize(InBounds.GetExtent().X, InBounds.GetExtent().Y, InBounds.GetSize().Z);
+	const FVector HalfOffsets[] = { {0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f} , {0.0f, 1.0f, 0.0f} , {1.0f, 1.0f, 0.0f} };
+	for (int32 i = 0; i < 4; i++)
+	{
+		const FVector ChildMin = InBounds.Min + HalfBoundSize * HalfOffsets[i];
+		OutChildBounds[i] = FBox(ChildMin, ChildMin + HalfBoundSize);
+	}
+}
+
+void FMeshQuadTree::RecordNodeVisit(FTraversalOutput& Output, int32 InDepth, EFrustumTestResult InParentFrustumTest)
+{
+#if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
+	++Output.Stats.NodeVisits;
+	Output.Stats.FrustumTests += (InParentFrustumTest == EFrustumTestResult::Intersecting) ? 1 : 0;
+	Output.Stats.MaxDepth = FMath::Max(Output.Stats.MaxDepth, InDepth);
+#endif
+}
+
+void FMeshQuadTree::SortSelectedTilesByBucket(FTraversalOutput& Output)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(SortSelectedTilesByBucket);
+
+	const int32 NumBuckets = Output.UnculledBucketInstanceCounts.Num();
+	TArray<int32, TInlineAllocator<32>> BucketOffsets;
+	BucketOffsets.SetNumUninitialized(NumBuckets);
+
+	int32 Offset = 0;
+	for (int32 BucketIndex = 0; BucketIndex < NumBuckets; ++BucketIndex)
+	{
+		BucketOffsets[BucketIndex] = Offset;
+		Offset += Output.UnculledBucketInstanceCounts[BucketIndex];
+	}
+	check(Offset == Output.SelectedTiles.Num());
+
+	TArray<FSelectedTile> SortedTiles;
+	SortedTiles.SetNumUninitialized(Output.SelectedTiles.Num());
+	for (const FSelectedTile& Tile : Output.SelectedTiles)
+	{
+		SortedTiles[BucketOffsets[Tile.BucketIndex]++] = Tile;
+	}
+
+	Output.SelectedTiles = MoveTemp(SortedTiles);
+}
+
+bool FMeshQuadTree::QueryInterpolatedTileBaseHeightAtLocation(const FVector2D& InWorldLocationXY,float& OutHeight) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::QueryInterpolatedTileBaseHeightAtLocation);
+
+	// Figure out what 4 samples to take
+	// Sample point grid is aligned with center of leaf node tiles. So offset the grid negative half a leaf tile
+	const FVector2D SampleGridWorldPosition(GetTileRegion().Min - FVector2D(GetLeafSize() * 0.5f));
+	const FVector2D CornerSampleGridPosition(InWorldLocationXY - SampleGridWorldPosition);
+	const FVector2D NormalizedGridPosition(CornerSampleGridPosition / GetLeafSize());
+	const FVector2D CornerSampleWorldPosition00 = FVector2D(FMath::Floor(NormalizedGridPosition.X), FMath::Floor(NormalizedGridPosition.Y)) * GetLeafSize() + SampleGridWorldPosition;
+	
+	// 4 world positions to use for sampling
+	const FVector2D CornerSampleWorldPositions[] =
+	{
+		CornerSampleWorldPosition00 + FVector2D(0.0f, 0.0f),
+		CornerSampleWorldPosition00 + FVector2D(GetLeafSize(), 0.0f),
+		CornerSampleWorldPosition00 + FVector2D(0.0f, GetLeafSize()),
+		CornerSampleWorldPosition00 + FVector2D(GetLeafSize(), GetLeafSize())
+	};
+
+	// Sample 4 locations
+	float HeightSamples[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	int32 NumValidSamples = 0;
+	for(int32 i = 0; i < 4; i++)
+	{
+		if (QueryTileBaseHeightAtLocation(CornerSampleWorldPositions[i], HeightSamples[i]))
+		{
+			NumValidSamples++;
+		}
+	}
+
+	// Return bilinear interpolated value
+	OutHeight = FMath::BiLerp(HeightSamples[0], HeightSamples[1], HeightSamples[2], HeightSamples[3], FMath::Frac(NormalizedGridPosition.X), FMath::Frac(NormalizedGridPosition.Y));
+
+	return NumValidSamples == 4;
+}
+
+bool FMeshQuadTree::QueryTileBaseHeightAtLocation(const FVector2D& InWorldLocationXY, float& OutWorldHeight) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::QueryTileBaseHeightAtLocation);
+	if (GetNodeCount() > 0)
+	{
+		check(bIsReadOnly);
+		return NodeData.Nodes[0].QueryBaseHeightAtLocation(NodeData, InWorldLocationXY, OutWorldHeight);
+	}
+	
+	OutWorldHeight = 0.0f;
+	return false;
+}
+
+bool FMeshQuadTree::QueryNearestCoveredTile(const FVector2D& InWorldLocationXY, double InMaxRadius, int32 InQuadtreeMeshIndexFilter, FNearestTileQueryResult& OutResult) const
+{
+	OutResult = FNearestTileQueryResult();
+	if (GetNodeCount() == 0)
+	{
+		return false;
+	}
+	check(bIsReadOnly);
+
+	struct FQueueEntry
+	{
+		double DistanceSquared;
+		uint32 NodeIndex;
+		/** Tree or page the node is in */
+		const FNodeData* NodeData;
+	};
+	auto ClosestFirst = [](const FQueueEntry& A, const FQueueEntry& B) { return A.DistanceSquared < B.DistanceSquared; };
+	auto DistanceSquaredToNode = [&InWorldLocationXY](const FNode& Node)
+	{
+		return FBox2D(FVector2D(Node.Bounds.Min), FVector2D(Node.Bounds.Max)).ComputeSquaredDistanceToPoint(InWorldLocationXY);
+	};
+
+	const double MaxDistanceSquared = FMath::Square(InMaxRadius);
+
+	// Nodes are visited in order of their distance lower bound, so the first covered node popped is the closest one
+	TArray<FQueueEntry, TInlineAllocator<64>> Queue;
+	Queue.HeapPush({ DistanceSquaredToNode(NodeData.Nodes[0]), 0, &NodeData }, ClosestFirst);
+
+	// Pages reached by the search stay referenced until it's done
+	TArray<TSharedPtr<const FNodeData, ESPMode::ThreadSafe>, TInlineAllocator<4>> Pages;
+
+	while (Queue.Num() > 0)
+	{
+		FQueueEntry Entry;
+		Queue.HeapPop(Entry, ClosestFirst, EAllowShrinking::No);
+
+		if (Entry.DistanceSquared > MaxDistanceSquared)
+		{
+			break;
+		}
+
+		const FNode& Node = Entry.NodeData->Nodes[Entry.NodeIndex];
+		if (Node.IsPaged)
+		{
+			// Pages that aren't resident yet are skipped, coverage below them is unknown
+			if (TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Page = Entry.NodeData->AcquirePage(Node))
+			{
+				Queue.HeapPush({ Entry.DistanceSquared, 0, Page.Get() }, ClosestFirst);
+				Pages.Add(MoveTemp(Page));
+			}
+			continue;
+		}
+
+		if (Node.IsCovered())
+		{
+			if (InQuadtreeMeshIndexFilter == INDEX_NONE || Node.QuadtreeMeshIndex == static_cast<uint32>(InQuadtreeMeshIndexFilter))
+			{
+				const FVector2D ClosestPoint(FMath::Clamp(InWorldLocationXY.X, Node.Bounds.Min.X, Node.Bounds.Max.X), FMath::Clamp(InWorldLocationXY.Y, Node.Bounds.Min.Y, Node.Bounds.Max.Y));
+				OutResult.SurfaceLocation = FVector(ClosestPoint, NodeData.QuadtreeMeshRenderDataHot[Node.QuadtreeMeshIndex].SurfaceBaseHeight);
+				OutResult.TileBounds = Node.Bounds;
+				OutResult.Distance = FMath::Sqrt(Entry.DistanceSquared);
+				OutResult.QuadtreeMeshIndex = Node.QuadtreeMeshIndex;
+				OutResult.bFound = true;
+				return true;
+			}
+
+			// The whole subtree belongs to another render data
+			continue;
+		}
+
+		for (const uint32 ChildIndex : Node.Children)
+		{
+			if (ChildIndex > 0)
+			{
+				const double ChildDistanceSquared = DistanceSquaredToNode(Entry.NodeData->Nodes[ChildIndex]);
+				if (ChildDistanceSquared <= MaxDistanceSquared)
+				{
+					Queue.HeapPush({ ChildDistanceSquared, ChildIndex, Entry.NodeData }, ClosestFirst);
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+void FMeshQuadTree::QueryNearestCoveredTiles(TConstArrayView<FVector2D> InWorldLocationsXY, double InMaxRadius, int32 InQuadtreeMeshIndexFilter, TArrayView<FNearestTileQueryResult> OutResults) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::QueryNearestCoveredTiles);
+	check(InWorldLocationsXY.Num() == OutResults.Num());
+
+	// Each query is only a handful of node visits, batch them so a task does a meaningful amount of work
+	constexpr int32 QueriesPerTask = 64;
+
+	ParallelFor(TEXT("QuadtreeMesh.NearestCoveredTiles"), InWorldLocationsXY.Num(), QueriesPerTask, [this, InWorldLocationsXY, InMaxRadius, InQuadtreeMeshIndexFilter, OutResults](int32 QueryIndex)
+	{
+		QueryNearestCoveredTile(InWorldLocationsXY[QueryIndex], InMaxRadius, InQuadtreeMeshIndexFilter, OutResults[QueryIndex]);
+	});
+}
+
+void FMeshQuadTree::QueryCoverageCellAtLocation(const FVector2D& InWorldLocationXY, FBox2D& OutCell, uint32& OutQuadtreeMeshIndex) const
+{
+	OutQuadtreeMeshIndex = 0;
+
+	if (GetNodeCount() == 0)
+	{
+		// Nothing is covered anywhere
+		OutCell = FBox2D(FVector2D(-UE_OLD_WORLD_MAX), FVector2D(UE_OLD_WORLD_MAX));
+		return;
+	}
+	check(bIsReadOnly);
+
+	const FNodeData* CurrentNodeData = &NodeData;
+	TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Page;
+	const FNode* Node = &NodeData.Nodes[0];
+	FBox2D NodeBounds2D(FVector2D(Node->Bounds.Min), FVector2D(Node->Bounds.Max));
+
+	auto IsInside = [&InWorldLocationXY](const FBox2D& InBox)
+	{
+		return (InWorldLocationXY.X >= InBox.Min.X) && (InWorldLocationXY.X < InBox.Max.X)
+			&& (InWorldLocationXY.Y >= InBox.Min.Y) && (InWorldLocationXY.Y < InBox.Max.Y);
+	};
+
+	if (!IsInside(NodeBounds2D))
+	{
+		// Outside of the tree, use the root sized cell containing the location. Root sized cells tile the plane so this one never overlaps the tree
+		const FVector2D RootSize = NodeBounds2D.GetSize();
+		const FVector2D CellMin = NodeBounds2D.Min + FVector2D(FMath::Floor((InWorldLocationXY.X - NodeBounds2D.Min.X) / RootSize.X), FMath::Floor((InWorldLocationXY.Y - NodeBounds2D.Min.Y) / RootSize.Y)) * RootSize;
+		OutCell = FBox2D(CellMin, CellMin + RootSize);
+		return;
+	}
+
+	while (true)
+	{
+		if (Node->IsPaged)
+		{
+			Page = CurrentNodeData->AcquirePage(*Node);
+			if (!Page)
+			{
+				// Unknown until the page is resident, an empty cell makes the caller query again
+				OutCell = FBox2D(InWorldLocationXY, InWorldLocationXY);
+				return;
+			}
+
+			CurrentNodeData = Page.Get();
+			Node = &Page->Nodes[0];
+		}
+
+		if (Node->HasCompleteSubtree && Node->IsSubtreeSameQuadtreeMesh)
+		{
+			OutCell = NodeBounds2D;
+			OutQuadtreeMeshIndex = Node->QuadtreeMeshIndex;
+			return;
+		}
+
+		const FNode* ChildContainingLocation = nullptr;
+		for (const uint32 ChildIndex : Node->Children)
+		{
+			if (ChildIndex > 0)
+			{
+				const FNode& ChildNode = CurrentNodeData->Nodes[ChildIndex];
+				const FBox2D ChildBounds2D(FVector2D(ChildNode.Bounds.Min), FVector2D(ChildNode.Bounds.Max));
+				if (IsInside(ChildBounds2D))
+				{
+					ChildContainingLocation = &ChildNode;
+					NodeBounds2D = ChildBounds2D;
+					break;
+				}
+			}
+		}
+
+		if (!ChildContainingLocation)
+		{
+			// No child there, the whole quadrant containing the location is empty
+			const FVector2D Center = NodeBounds2D.GetCenter();
+			const FVector2D QuadrantMin(InWorldLocationXY.X < Center.X ? NodeBounds2D.Min.X : Center.X, InWorldLocationXY.Y < Center.Y ? NodeBounds2D.Min.Y : Center.Y);
+			OutCell = FBox2D(QuadrantMin, QuadrantMin + NodeBounds2D.GetExtent());
+			return;
+		}
+
+		Node = ChildContainingLocation;
+	}
+}
+
+void FMeshQuadTree::QueryBaseHeightsAtLocations(TConstArrayView<FVector2D> InWorldLocationsXY, TArrayView<float> OutHeights, TArrayView<bool> OutCovered) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::QueryBaseHeightsAtLocations);
+	check(InWorldLocationsXY.Num() == OutHeights.Num() && InWorldLocationsXY.Num() == OutCovered.Num());
+
+	constexpr int32 QueriesPerTask = 256;
+
+	ParallelFor(TEXT("QuadtreeMesh.BaseHeights"), InWorldLocationsXY.Num(), QueriesPerTask, [this, InWorldLocationsXY, OutHeights, OutCovered](int32 QueryIndex)
+	{
+		FBox2D Cell;
+		uint32 QuadtreeMeshIndex = 0;
+		QueryCoverageCellAtLocation(InWorldLocationsXY[QueryIndex], Cell, QuadtreeMeshIndex);
+
+		OutCovered[QueryIndex] = QuadtreeMeshIndex != 0;
+		OutHeights[QueryIndex] = QuadtreeMeshIndex != 0 ? static_cast<float>(NodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex].SurfaceBaseHeight) : 0.0f;
+	});
+}
+
+bool FMeshQuadTree::QueryNearestCoverageEdge(const FVector2D& InWorldLocationXY, double InMaxRadius, FVector2D& OutEdgeLocation, double& OutDistance) const
+{
+	FBox2D Cell;
+	uint32 QuadtreeMeshIndex = 0;
+	QueryCoverageCellAtLocation(InWorldLocationXY, Cell, QuadtreeMeshIndex);
+
+	if (QuadtreeMeshIndex == 0)
+	{
+		// Not covered, the edge is on the closest covered tile
+		FNearestTileQueryResult Result;
+		if (QueryNearestCoveredTile(InWorldLocationXY, InMaxRadius, INDEX_NONE, Result))
+		{
+			OutEdgeLocation = FVector2D(Result.SurfaceLocation);
+			OutDistance = Result.Distance;
+			return true;
+		}
+		return false;
+	}
+
+	// Covered, search the closest uncovered region. Empty regions are either missing children or the outside of the root node
+	const FBox2D RootBounds2D(FVector2D(NodeData.Nodes[0].Bounds.Min), FVector2D(NodeData.Nodes[0].Bounds.Max));
+	const double DistancesToRootSides[] =
+	{
+		InWorldLocationXY.X - RootBounds2D.Min.X, RootBounds2D.Max.X - InWorldLocationXY.X,
+		InWorldLocationXY.Y - RootBounds2D.Min.Y, RootBounds2D.Max.Y - InWorldLocationXY.Y
+	};
+	int32 ClosestSide = 0;
+	for (int32 Side = 1; Side < 4; ++Side)
+	{
+		ClosestSide = DistancesToRootSides[Side] < DistancesToRootSides[ClosestSide] ? Side : ClosestSide;
+	}
+
+	double BestDistanceSquared = FMath::Square(DistancesToRootSides[ClosestSide]);
+	FVector2D BestLocation = InWorldLocationXY;
+	switch (ClosestSide)
+	{
+	case 0: BestLocation.X = RootBounds2D.Min.X; break;
+	case 1: BestLocation.X = RootBounds2D.Max.X; break;
+	case 2: BestLocation.Y = RootBounds2D.Min.Y; break;
+	default: BestLocation.Y = RootBounds2D.Max.Y; break;
+	}
+
+	struct FQueueEntry
+	{
+		double DistanceSquared;
+		/** INDEX_NONE for an empty region */
+		int32 NodeIndex;
+		FBox2D Region;
+		/** Tree or page the node is in */
+		const FNodeData* NodeData;
+	};
+	auto ClosestFirst = [](const FQueueEntry& A, const FQueueEntry& B) { return A.DistanceSquared < B.DistanceSquared; };
+
+	TArray<FQueueEntry, TInlineAllocator<64>> Queue;
+	Queue.HeapPush({ 0.0, 0, RootBounds2D, &NodeData }, ClosestFirst);
+
+	// Pages reached by the search stay referenced until it's done
+	TArray<TSharedPtr<const FNodeData, ESPMode::ThreadSafe>, TInlineAllocator<4>> Pages;
+
+	while (Queue.Num() > 0)
+	{
+		FQueueEntry Entry;
+		Queue.HeapPop(Entry, ClosestFirst, EAllowShrinking::No);
+
+		if (Entry.DistanceSquared >= BestDistanceSquared)
+		{
+			break;
+		}
+
+		if (Entry.NodeIndex == INDEX_NONE)
+		{
+			// Closest empty region, nothing left in the queue can be closer
+			BestDistanceSquared = Entry.DistanceSquared;
+			BestLocation = FVector2D(FMath::Clamp(InWorldLocationXY.X, Entry.Region.Min.X, Entry.Region.Max.X), FMath::Clamp(InWorldLocationXY.Y, Entry.Region.Min.Y, Entry.Region.Max.Y));
+			break;
+		}
+
+		const FNode& Node = Entry.NodeData->Nodes[Entry.NodeIndex];
+		if (Node.IsPaged)
+		{
+			// Pages that aren't resident yet are skipped, coverage below them is unknown
+			if (TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Page = Entry.NodeData->AcquirePage(Node))
+			{
+				Queue.HeapPush({ Entry.DistanceSquared, 0, Entry.Region, Page.Get() }, ClosestFirst);
+				Pages.Add(MoveTemp(Page));
+			}
+			continue;
+		}
+
+		if (Node.HasCompleteSubtree && Node.IsSubtreeSameQuadtreeMesh)
+		{
+			if (Node.QuadtreeMeshIndex == 0)
+			{
+				Queue.HeapPush({ Entry.DistanceSquared, INDEX_NONE, Entry.Region, nullptr }, ClosestFirst);
+			}
+
+			// Otherwise fully covered, transitions between render data aren't edges
+			continue;
+		}
+
+		const FVector2D Center = Entry.Region.GetCenter();
+		const FVector2D QuadrantSize = Entry.Region.GetExtent();
+		for (int32 Quadrant = 0; Quadrant < 4; ++Quadrant)
+		{
+			const FVector2D QuadrantMin(Quadrant & 1 ? Center.X : Entry.Region.Min.X, Quadrant & 2 ? Center.Y : Entry.Region.Min.Y);
+			const FBox2D QuadrantBounds(QuadrantMin, QuadrantMin + QuadrantSize);
+
+			int32 QuadrantNodeIndex = INDEX_NONE;
+			for (const uint32 ChildIndex : Node.Children)
+			{
+				if (ChildIndex > 0 && QuadrantBounds.IsInside(FVector2D(Entry.NodeData->Nodes[ChildIndex].Bounds.GetCenter())))
+				{
+					QuadrantNodeIndex = ChildIndex;
+					break;
+				}
+			}
+
+			Queue.HeapPush({ QuadrantBounds.ComputeSquaredDistanceToPoint(InWorldLocationXY), QuadrantNodeIndex, QuadrantBounds, Entry.NodeData }, ClosestFirst);
+		}
+	}
+
+	if (BestDistanceSquared > FMath::Square(InMaxRadius))
+	{
+		return false;
+	}
+
+	OutEdgeLocation = BestLocation;
+	OutDistance = FMath::Sqrt(BestDistanceSquared);
+	return true;
+}
+
+void FMeshQuadTree::QueryNearestCoverageEdges(TConstArrayView<FVector2D> InWorldLocationsXY, double InMaxRadius, TArrayView<FVector2D> OutEdgeLocations, TArrayView<float> OutDistances, TArrayView<bool> OutFound) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::QueryNearestCoverageEdges);
+	check(InWorldLocationsXY.Num() == OutEdgeLocations.Num() && InWorldLocationsXY.Num() == OutDistances.Num() && InWorldLocationsXY.Num() == OutFound.Num());
+
+	constexpr int32 QueriesPerTask = 64;
+
+	ParallelFor(TEXT("QuadtreeMesh.NearestCoverageEdges"), InWorldLocationsXY.Num(), QueriesPerTask, [this, InWorldLocationsXY, InMaxRadius, OutEdgeLocations, OutDistances, OutFound](int32 QueryIndex)
+	{
+		double Distance = 0.0;
+		OutFound[QueryIndex] = QueryNearestCoverageEdge(InWorldLocationsXY[QueryIndex], InMaxRadius, OutEdgeLocations[QueryIndex], Distance);
+		OutDistances[QueryIndex] = OutFound[QueryIndex] ? static_cast<float>(Distance) : 0.0f;
+	});
+}
+
+bool FMeshQuadTree::QueryTileBoundsAtLocation(const FVector2D& InWorldLocationXY, FBox& OutWorldBounds) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::QueryTileBoundsAtLocation);
+	if (GetNodeCount() > 0)
+	{
+		check(bIsReadOnly);
+		return NodeData.Nodes[0].QueryBoundsAtLocation(NodeData, InWorldLocationXY, OutWorldBounds);
+	}
+
+	OutWorldBounds = FBox(ForceInit);
+	return false;
+}
+
+void FMeshQuadTree::BuildCoverageBitmap(FIntPoint InResolution, TBitArray<>& OutBitmap) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::BuildCoverageBitmap);
+
+	OutBitmap.Init(false, FMath::Max(InResolution.X, 0) * FMath::Max(InResolution.Y, 0));
+	if (GetNodeCount() == 0 || OutBitmap.Num() == 0)
+	{
+		return;
+	}
+	check(bIsReadOnly);
+
+	const FBox2D RootBounds2D(FVector2D(NodeData.Nodes[0].Bounds.Min), FVector2D(NodeData.Nodes[0].Bounds.Max));
+	const FVector2D CellSize = RootBounds2D.GetSize() / FVector2D(InResolution);
+
+	ForEachCoveredNode([&](const FBox& InBounds)
+	{
+		// Shrunk a little so a node doesn't mark the neighbor cells it only shares an edge with
+		const FVector2D Min = (FVector2D(InBounds.Min) - RootBounds2D.Min) / CellSize + FVector2D(UE_KINDA_SMALL_NUMBER);
+		const FVector2D Max = (FVector2D(InBounds.Max) - RootBounds2D.Min) / CellSize - FVector2D(UE_KINDA_SMALL_NUMBER);
+		const FIntPoint MinCell(FMath::Clamp(FMath::FloorToInt(Min.X), 0, InResolution.X - 1), FMath::Clamp(FMath::FloorToInt(Min.Y), 0, InResolution.Y - 1));
+		const FIntPoint MaxCell(FMath::Clamp(FMath::FloorToInt(Max.X), 0, InResolution.X - 1), FMath::Clamp(FMath::FloorToInt(Max.Y), 0, InResolution.Y - 1));
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+			{
+				OutBitmap[Y * InResolution.X + X] = true;
+			}
+		}
+	});
+}
+
+void FMeshQuadTree::GetCoveredCellBounds(int32 InCellDepth, TArray<FBox>& OutCellBounds) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::GetCoveredCellBounds);
+
+	const int32 CellDepth = FMath::Clamp(InCellDepth, 0, TreeDepth);
+	const int32 CellDim = 1 << CellDepth;
+	OutCellBounds.Init(FBox(ForceInit), CellDim * CellDim);
+	if (GetNodeCount() == 0)
+	{
+		return;
+	}
+
+	const FBox2D RootBounds2D(FVector2D(NodeData.Nodes[0].Bounds.Min), FVector2D(NodeData.Nodes[0].Bounds.Max));
+	const FVector2D CellSize = RootBounds2D.GetSize() / static_cast<double>(CellDim);
+
+	ForEachCoveredNode([&](const FBox& InBounds)
+	{
+		// Nodes above the cell depth span several cells, each gets its part
+		const FVector2D Min = (FVector2D(InBounds.Min) - RootBounds2D.Min) / CellSize + FVector2D(UE_KINDA_SMALL_NUMBER);
+		const FVector2D Max = (FVector2D(InBounds.Max) - RootBounds2D.Min) / CellSize - FVector2D(UE_KINDA_SMALL_NUMBER);
+		const FIntPoint MinCell(FMath::Clamp(FMath::FloorToInt(Min.X), 0, CellDim - 1), FMath::Clamp(FMath::FloorToInt(Min.Y), 0, CellDim - 1));
+		const FIntPoint MaxCell(FMath::Clamp(FMath::FloorToInt(Max.X), 0, CellDim - 1), FMath::Clamp(FMath::FloorToInt(Max.Y), 0, CellDim - 1));
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+			{
+				const FVector2D CellMin = RootBounds2D.Min + FVector2D(X, Y) * CellSize;
+				const FBox CellBox(FVector(CellMin, InBounds.Min.Z), FVector(CellMin + CellSize, InBounds.Max.Z));
+				OutCellBounds[Y * CellDim + X] += InBounds.Overlap(CellBox);
+			}
+		}
+	});
+}
+
+void FMeshQuadTree::ForEachCoveredNode(TFunctionRef<void(const FBox&)> InFunction) const
+{
+	if (GetNodeCount() == 0)
+	{
+		return;
+	}
+
+	// Keeps the pages reached during the walk resident
+	TArray<TSharedPtr<const FNodeData, ESPMode::ThreadSafe>> Pages;
+	TArray<TPair<const FNodeData*, const FNode*>> Stack;
+	Stack.Emplace(&NodeData, &NodeData.Nodes[0]);
+
+	while (Stack.Num() > 0)
+	{
+		const FNodeData* CurrentNodeData = Stack.Last().Key;
+		const FNode* Node = Stack.Last().Value;
+		Stack.Pop(EAllowShrinking::No);
+
+		if (Node->IsPaged)
+		{
+			TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Page = CurrentNodeData->AcquirePage(*Node);
+			if (!Page)
+			{
+				InFunction(Node->Bounds);
+				continue;
+			}
+
+			CurrentNodeData = Page.Get();
+			Node = &Page->Nodes[0];
+			Pages.Add(MoveTemp(Page));
+		}
+
+		// Complete subtrees are covered everywhere, their children may have been pruned
+		if (Node->HasCompleteSubtree && Node->QuadtreeMeshIndex != 0)
+		{
+			InFunction(Node->Bounds);
+			continue;
+		}
+
+		for (const uint32 ChildIndex : Node->Children)
+		{
+			if (ChildIndex > 0)
+			{
+				Stack.Emplace(CurrentNodeData, &CurrentNodeData->Nodes[ChildIndex]);
+			}
+		}
+	}
+}
+
+bool FMeshQuadTree::FNode::CanRender(int32 InDensityLevel, int32 InForceCollapseDensityLevel,
+                                     const FQuadtreeMeshRenderDataHot& InQuadtreeMeshRenderData) const
+{
+	return InQuadtreeMeshRenderData.bHasMaterial && IsSubtreeSameQuadtreeMesh && ((InDensityLevel > InForceCollapseDensityLevel) || HasCompleteSubtree);
+}
+
+void FMeshQuadTree::FNode::GetChildrenFrustumTests(const FNodeData& InNodeData, EFrustumTestResult InFrustumTest,
+	const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output, EFrustumTestResult OutChildFrustumTests[4]) const
+{
+	FBox ChildBounds[4];
+	for (int32 i = 0; i < 4; ++i)
+	{
+		// Missing children get their parent's bounds, their result is never used
+		ChildBounds[i] = Children[i] > 0 ? InNodeData.Nodes[Children[i]].Bounds : Bounds;
+	}
+	TestChildrenFrustum(ChildBounds, InFrustumTest, InTraversalDesc, Output, OutChildFrustumTests);
+}
+
+void FMeshQuadTree::FNode::SelectLODRefinement(const FNodeData& InNodeData, int32 InDensityLevel, int32 InLODLevel,
+	EFrustumTestResult InParentFrustumTest, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
+{
+	// Nodes outside of the animated clip circle or in an occluded cell are skipped along with their subtree, frustum or not
+	if (IsOutsideClipCircle(InTraversalDesc, Bounds) || IsInOccludedCell(InTraversalDesc, Bounds))
+	{
+		return;
+	}
+
+	if (IsPaged)
+	{
+		if (const TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Page = InNodeData.AcquirePage(*this))
+		{
+			Page->Nodes[0].SelectLODRefinement(*Page, InDensityLevel, InLODLevel, InParentFrustumTest, InTraversalDesc, Output);
+		}
+		else
+		{
+			AddPagedNodeForRender(InNodeData, InDensityLevel, InLODLevel, InParentFrustumTest, InTraversalDesc, Output);
+		}
+		return;
+	}
+
+	const FQuadtreeMeshRenderDataHot& QuadtreeMeshRenderData = InNodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex];
+	const FVector CenterPosition = Bounds.GetCenter();
+	const FVector Extent = Bounds.GetExtent() + InTraversalDesc.BoundsPadding;
+	const EFrustumTestResult FrustumTest = TestFrustum(InTraversalDesc.Frustum, InParentFrustumTest, CenterPosition, Extent);
+	RecordNodeVisit(Output, InTraversalDesc.LODCount - InLODLevel + InDensityLevel, InParentFrustumTest);
+
+	// Early out on frustum culling, unless culled tiles are gathered as well
+	if (FrustumTest != EFrustumTestResult::Outside || InTraversalDesc.bGatherUnculledInstances)
+	{
+		// This LOD can represent all its leaf nodes, simply add node
+		if (CanRender(InDensityLevel, InTraversalDesc.ForceCollapseDensityLevel, QuadtreeMeshRenderData))
+		{
+			AddNodeForRender(InNodeData, InDensityLevel, InLODLevel, FrustumTest != EFrustumTestResult::Outside, InTraversalDesc, Output);
+		}
+		else
+		{
+			// If not, we need to recurse down the children until we find one that can be rendered
+			SelectChildrenLODRefinement(InNodeData, InDensityLevel + 1, InLODLevel, FrustumTest, nullptr, InTraversalDesc, Output);
+		}
+	}
+}
+
+void FMeshQuadTree::FNode::SelectLOD(const FNodeData& InNodeData, int32 InLODLevel, EFrustumTestResult InParentFrustumTest,
+                                     const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
+{
+	// Nodes outside of the animated clip circle or in an occluded cell are skipped along with their subtree, frustum or not
+	if (IsOutsideClipCircle(InTraversalDesc, Bounds) || IsInOccludedCell(InTraversalDesc, Bounds))
+	{
+		return;
+	}
+
+	if (IsPaged)
+	{
+		// The subtree lives in a page, continue there. Until the page is resident this node stands in for its subtree
+		if (const TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Page = InNodeData.AcquirePage(*this))
+		{
+			Page->Nodes[0].SelectLOD(*Page, InLODLevel, InParentFrustumTest, InTraversalDesc, Output);
+		}
+		else
+		{
+			AddPagedNodeForRender(InNodeData, 0, InLODLevel, InParentFrustumTest, InTraversalDesc, Output);
+		}
+		return;
+	}
+
+	const FVector CenterPosition = Bounds.GetCenter();
+	const FVector Extent = Bounds.GetExtent() + InTraversalDesc.BoundsPadding;
+	const EFrustumTestResult FrustumTest = TestFrustum(InTraversalDesc.Frustum, InParentFrustumTest, CenterPosition, Extent);
+	const bool bInFrustum = FrustumTest != EFrustumTestResult::Outside;
+	RecordNodeVisit(Output, InTraversalDesc.LODCount - InLODLevel, InParentFrustumTest);
+
+	// Early out on frustum culling, unless culled tiles are gathered as well
+	if (!bInFrustum && !InTraversalDesc.bGatherUnculledInstances)
+	{
+		// Handled
+		return;
+	}
+
+	if (SelectLODForNode(InNodeData, InLODLevel, FrustumTest, nullptr, InTraversalDesc, Output))
+	{
+		return;
+	}
+
+	SelectChildrenLOD(InNodeData, InLODLevel, FrustumTest, InTraversalDesc, Output);
+}
+
+void FMeshQuadTree::FNode::SelectLODWide(const FNodeData& InNodeData, int32 InLODLevel, EFrustumTestResult InParentFrustumTest,
+                                         const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
+{
+	// Nodes outside of the animated clip circle or in an occluded cell are skipped along with their subtree, frustum or not
+	if (IsOutsideClipCircle(InTraversalDesc, Bounds) || IsInOccludedCell(InTraversalDesc, Bounds))
+	{
+		return;
+	}
+
+	if (IsPaged)
+	{
+		if (const TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Page = InNodeData.AcquirePage(*this))
+		{
+			Page->Nodes[0].SelectLODWide(*Page, InLODLevel, InParentFrustumTest, InTraversalDesc, Output);
+		}
+		else
+		{
+			AddPagedNodeForRender(InNodeData, 0, InLODLevel, InParentFrustumTest, InTraversalDesc, Output);
+		}
+		return;
 	}
 
-	
-
-	QuadtreeMeshMaterials.Empty(MatToIdxMap.Num());
-	QuadtreeMeshMaterials.AddUninitialized(MatToIdxMap.Num());
-
-	for (TMap<FMaterialRenderProxy*, int32>::TConstIterator It(MatToIdxMap); It; ++It)
+	const FVector CenterPosition = Bounds.GetCenter();
+	const FVector Extent = Bounds.GetExtent() + InTraversalDesc.BoundsPadding;
+	const EFrustumTestResult FrustumTest = TestFrustum(InTraversalDesc.Frustum, InParentFrustumTest, CenterPosition, Extent);
+	const bool bInFrustum = FrustumTest != EFrustumTestResult::Outside;
+	// Depth in the 16-ary tree, a step is two LOD levels
+	RecordNodeVisit(Output, (InTraversalDesc.LODCount - InLODLevel + 1) / 2, InParentFrustumTest);
+
+	// Early out on frustum culling, unless culled tiles are gathered as well
+	if (!bInFrustum && !InTraversalDesc.bGatherUnculledInstances)
 	{
-		QuadtreeMeshMaterials[It->Value] = It->Key;
+		// Handled
+		return;
 	}
-}
 
-void FMeshQuadTree::BuildQuadtreeMeshTileInstanceData(const FTraversalDesc& InTraversalDesc,
-	FTraversalOutput& Output) const
-{
-	TRACE_CPUPROFILER_EVENT_SCOPE(BuildQuadtreeMeshTileInstanceData);
-	check(bIsReadOnly);
-	
-	if (!bIsGPUQuadTree)
+	if (SelectLODForNode(InNodeData, InLODLevel, FrustumTest, nullptr, InTraversalDesc, Output))
 	{
-		NodeData.Nodes[0].SelectLOD(NodeData, TreeDepth, InTraversalDesc, Output);
+		return;
 	}
-}
 
-bool FMeshQuadTree::QueryInterpolatedTileBaseHeightAtLocation(const FVector2D& InWorldLocationXY,float& OutHeight) const
-{
-	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::QueryInterpolatedTileBaseHeightAtLocation);
+	// The 4x4 children would be below the last LOD, finish as a quadtree
+	if (InLODLevel < 2)
+	{
+		SelectChildrenLOD(InNodeData, InLODLevel, FrustumTest, InTraversalDesc, Output);
+		return;
+	}
 
-	// Figure out what 4 samples to take
-	// Sample point grid is aligned with center of leaf node tiles. So offset the grid negative half a leaf tile
-	const FVector2D SampleGridWorldPosition(GetTileRegion().Min - FVector2D(GetLeafSize() * 0.5f));
-	const FVector2D CornerSampleGridPosition(InWorldLocationXY - SampleGridWorldPosition);
-	const FVector2D NormalizedGridPosition(CornerSampleGridPosition / GetLeafSize());
-	const FVector2D CornerSampleWorldPosition00 = FVector2D(FMath::Floor(NormalizedGridPosition.X), FMath::Floor(NormalizedGridPosition.Y)) * GetLeafSize() + SampleGridWorldPosition;
-	
-	// 4 world positions to use for sampling
-	const FVector2D CornerSampleWorldPositions[] =
+	auto MakeImplicitChild = [](const FNode& InParent, const FBox& InChildBounds)
 	{
-		CornerSampleWorldPosition00 + FVector2D(0.0f, 0.0f),
-		CornerSampleWorldPosition00 + FVector2D(GetLeafSize(), 0.0f),
-		CornerSampleWorldPosition00 + FVector2D(0.0f, GetLeafSize()),
-		CornerSampleWorldPosition00 + FVector2D(GetLeafSize(), GetLeafSize())
+		FNode ChildNode;
+		ChildNode.HasCompleteSubtree = 1;
+		ChildNode.IsSubtreeSameQuadtreeMesh = 1;
+		ChildNode.TransitionQuadtreeMeshIndex = InParent.TransitionQuadtreeMeshIndex;
+		ChildNode.QuadtreeMeshIndex = InParent.QuadtreeMeshIndex;
+		ChildNode.Bounds = InChildBounds;
+		return ChildNode;
 	};
 
-	// Sample 4 locations
-	float HeightSamples[4] = {0.0f, 0.0f, 0.0f, 0.0f};
-	int32 NumValidSamples = 0;
-	for(int32 i = 0; i < 4; i++)
+	// The quadtree children of this node are the intermediate tiles of the half-level, each one groups 4 of the 4x4 children (lane = intermediate * 4 + child).
+	// Implicit nodes are created here like SelectLOD(..) does, missing children get this node's bounds and their result is never used
+	FNode ImplicitIntermediates[4];
+	FNode ImplicitChildren[16];
+	const FNode* Intermediates[4] = {};
+	const FNode* WideChildren[16] = {};
+	FBox WideChildBounds[16];
+
+	FBox ImplicitIntermediateBounds[4];
+	const bool bHasImplicitChildren = HasCompleteSubtree && IsSubtreeSameQuadtreeMesh;
+	if (bHasImplicitChildren)
 	{
-		if (QueryTileBaseHeightAtLocation(CornerSampleWorldPositions[i], HeightSamples[i]))
+		GetImplicitChildBounds(Bounds, ImplicitIntermediateBounds);
+	}
+
+	for (int32 i = 0; i < 4; ++i)
+	{
+		if (bHasImplicitChildren)
 		{
-			NumValidSamples++;
+			ImplicitIntermediates[i] = MakeImplicitChild(*this, ImplicitIntermediateBounds[i]);
+			Intermediates[i] = &ImplicitIntermediates[i];
+		}
+		else if (Children[i] > 0)
+		{
+			Intermediates[i] = &InNodeData.Nodes[Children[i]];
 		}
-	}
 
-	// Return bilinear interpolated value
-	OutHeight = FMath::BiLerp(HeightSamples[0], HeightSamples[1], HeightSamples[2], HeightSamples[3], FMath::Frac(NormalizedGridPosition.X), FMath::Frac(NormalizedGridPosition.Y));
+		const FNode* Intermediate = Intermediates[i];
+		if (Intermediate && !Intermediate->IsPaged && Intermediate->HasCompleteSubtree && Intermediate->IsSubtreeSameQuadtreeMesh)
+		{
+			GetImplicitChildBounds(Intermediate->Bounds, &WideChildBounds[i * 4]);
+			for (int32 j = 0; j < 4; ++j)
+			{
+				ImplicitChildren[i * 4 + j] = MakeImplicitChild(*Intermediate, WideChildBounds[i * 4 + j]);
+				WideChildren[i * 4 + j] = &ImplicitChildren[i * 4 + j];
+			}
+		}
+		else
+		{
+			for (int32 j = 0; j < 4; ++j)
+			{
+				const uint32 ChildIndex = Intermediate ? Intermediate->Children[j] : 0;
+				WideChildren[i * 4 + j] = ChildIndex > 0 ? &InNodeData.Nodes[ChildIndex] : nullptr;
+				WideChildBounds[i * 4 + j] = ChildIndex > 0 ? InNodeData.Nodes[ChildIndex].Bounds : Bounds;
+			}
+		}
+	}
 
-	return NumValidSamples == 4;
-}
+	EFrustumTestResult WideChildFrustumTests[16];
+	TestWideChildrenFrustum(WideChildBounds, FrustumTest, InTraversalDesc, Output, WideChildFrustumTests);
 
-bool FMeshQuadTree::QueryTileBaseHeightAtLocation(const FVector2D& InWorldLocationXY, float& OutWorldHeight) const
-{
-	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::QueryTileBaseHeightAtLocation);
-	if (GetNodeCount() > 0)
+	for (int32 i = 0; i < 4; ++i)
 	{
-		check(bIsReadOnly);
-		return NodeData.Nodes[0].QueryBaseHeightAtLocation(NodeData, InWorldLocationXY, OutWorldHeight);
-	}
-	
-	OutWorldHeight = 0.0f;
-	return false;
-}
+		const FNode* Intermediate = Intermediates[i];
+		if (Intermediate == nullptr)
+		{
+			continue;
+		}
 
-bool FMeshQuadTree::QueryTileBoundsAtLocation(const FVector2D& InWorldLocationXY, FBox& OutWorldBounds) const
-{
-	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::QueryTileBoundsAtLocation);
-	if (GetNodeCount() > 0)
-	{
-		check(bIsReadOnly);
-		return NodeData.Nodes[0].QueryBoundsAtLocation(NodeData, InWorldLocationXY, OutWorldBounds);
-	}
+		// Its children are in a page, it continues as a node of its own
+		if (Intermediate->IsPaged)
+		{
+			Intermediate->SelectLODWide(InNodeData, InLODLevel - 1, FrustumTest, InTraversalDesc, Output);
+			continue;
+		}
 
-	OutWorldBounds = FBox(ForceInit);
-	return false;
-}
+		if (IsOutsideClipCircle(InTraversalDesc, Intermediate->Bounds) || IsInOccludedCell(InTraversalDesc, Intermediate->Bounds))
+		{
+			continue;
+		}
 
+		// Intermediate tiles aren't tested, they're outside (or inside) when all of their children are
+		int32 NumChildren = 0;
+		int32 NumOutside = 0;
+		int32 NumInside = 0;
+		for (int32 j = 0; j < 4; ++j)
+		{
+			if (WideChildren[i * 4 + j])
+			{
+				++NumChildren;
+				NumOutside += WideChildFrustumTests[i * 4 + j] == EFrustumTestResult::Outside ? 1 : 0;
+				NumInside += WideChildFrustumTests[i * 4 + j] == EFrustumTestResult::Inside ? 1 : 0;
+			}
+		}
 
-bool FMeshQuadTree::FNode::CanRender(int32 InDensityLevel, int32 InForceCollapseDensityLevel,
-                                     const FQuadtreeMeshRenderData& InQuadtreeMeshRenderData) const
-{
-	return InQuadtreeMeshRenderData.Material && IsSubtreeSameQuadtreeMesh && ((InDensityLevel > InForceCollapseDensityLevel) || HasCompleteSubtree);
-}
+		EFrustumTestResult IntermediateFrustumTest = EFrustumTestResult::Intersecting;
+		if (NumChildren == 0)
+		{
+			IntermediateFrustumTest = TestFrustum(InTraversalDesc.Frustum, FrustumTest, Intermediate->Bounds.GetCenter(), Intermediate->Bounds.GetExtent() + InTraversalDesc.BoundsPadding);
+		}
+		else if (NumOutside == NumChildren)
+		{
+			IntermediateFrustumTest = EFrustumTestResult::Outside;
+		}
+		else if (NumInside == NumChildren)
+		{
+			IntermediateFrustumTest = EFrustumTestResult::Inside;
+		}
 
-void FMeshQuadTree::FNode::SelectLODRefinement(const FNodeData& InNodeData, int32 InDensityLevel, int32 InLODLevel,
-	const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
-{
-	const FQuadtreeMeshRenderData& QuadtreeMeshRenderData = InNodeData.QuadtreeMeshRenderData[QuadtreeMeshIndex];
-	const FVector CenterPosition = Bounds.GetCenter();
-	const FVector Extent = Bounds.GetExtent();
+		if (IntermediateFrustumTest == EFrustumTestResult::Outside && !InTraversalDesc.bGatherUnculledInstances)
+		{
+			continue;
+		}
 
-	// Early out on frustum culling 
-	if (InTraversalDesc.Frustum.IntersectBox(CenterPosition, Extent))
-	{
-		// This LOD can represent all its leaf nodes, simply add node
-		if (CanRender(InDensityLevel, InTraversalDesc.ForceCollapseDensityLevel, QuadtreeMeshRenderData))
+		// The intermediate tile is rendered if the half-level is the LOD of its area, otherwise its children go on as 16-ary nodes
+		if (Intermediate->SelectLODForNode(InNodeData, InLODLevel - 1, IntermediateFrustumTest, &WideChildFrustumTests[i * 4], InTraversalDesc, Output))
 		{
-			AddNodeForRender(InNodeData, QuadtreeMeshRenderData, InDensityLevel, InLODLevel, InTraversalDesc, Output);
+			continue;
 		}
-		else
+
+		for (int32 j = 0; j < 4; ++j)
 		{
-			// If not, we need to recurse down the children until we find one that can be rendered
-			for (int32 ChildIndex : Children)
+			if (const FNode* WideChild = WideChildren[i * 4 + j])
 			{
-				if (ChildIndex > 0)
-				{
-					InNodeData.Nodes[ChildIndex].SelectLODRefinement(InNodeData, InDensityLevel + 1, InLODLevel, InTraversalDesc, Output);
-				}
+				WideChild->SelectLODWide(InNodeData, InLODLevel - 2, WideChildFrustumTests[i * 4 + j], InTraversalDesc, Output);
 			}
 		}
 	}
 }
 
-void FMeshQuadTree::FNode::SelectLOD(const FNodeData& InNodeData, int32 InLODLevel,
-                                     const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
+bool FMeshQuadTree::FNode::SelectLODForNode(const FNodeData& InNodeData, int32 InLODLevel, EFrustumTestResult InFrustumTest,
+	const EFrustumTestResult* InChildFrustumTests, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
 {
-	const FQuadtreeMeshRenderData& QuadtreeMeshRenderData = InNodeData.QuadtreeMeshRenderData[QuadtreeMeshIndex];
-	const FVector CenterPosition = Bounds.GetCenter();
-	const FVector Extent = Bounds.GetExtent();
-
-	// Early out on frustum culling 
-	if (!InTraversalDesc.Frustum.IntersectBox(CenterPosition, Extent))
-	{
-		// Handled
-		return;
-	}
+	const FQuadtreeMeshRenderDataHot& QuadtreeMeshRenderData = InNodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex];
+	const bool bInFrustum = InFrustumTest != EFrustumTestResult::Outside;
 
 	// Distance to tile (if 0, position is inside quad)
 	FBox2D Bounds2D(FVector2D(Bounds.Min), FVector2D(Bounds.Max));
@@ -327,22 +1977,16 @@ void FMeshQuadTree::FNode::SelectLOD(const FNodeData& InNodeData, int32 InLODLev
 		// This node is capable of representing all its leaf nodes, so just submit this node
 		if (CanRender(0, InTraversalDesc.ForceCollapseDensityLevel, QuadtreeMeshRenderData))
 		{
-			AddNodeForRender(InNodeData, QuadtreeMeshRenderData, 1, InLODLevel + 1, InTraversalDesc, Output);
+			AddNodeForRender(InNodeData, 1, InLODLevel + 1, bInFrustum, InTraversalDesc, Output);
 		}
 		else
 		{
 			// If not, we need to recurse down the children until we find one that can be rendered
-			for (int32 ChildIndex : Children)
-			{
-				if (ChildIndex > 0)
-				{
-					InNodeData.Nodes[ChildIndex].SelectLODRefinement(InNodeData, 2, InLODLevel + 1, InTraversalDesc, Output);
-				}
-			}
+			SelectChildrenLODRefinement(InNodeData, 2, InLODLevel + 1, InFrustumTest, InChildFrustumTests, InTraversalDesc, Output);
 		}
 
 		// Handled
-		return;
+		return true;
 	}
 
 	// Last LOD, simply add node
@@ -350,90 +1994,159 @@ void FMeshQuadTree::FNode::SelectLOD(const FNodeData& InNodeData, int32 InLODLev
 	{
 		if (CanRender(0, InTraversalDesc.ForceCollapseDensityLevel, QuadtreeMeshRenderData))
 		{
-			AddNodeForRender(InNodeData, QuadtreeMeshRenderData, 0, InLODLevel, InTraversalDesc, Output);
+			AddNodeForRender(InNodeData, 0, InLODLevel, bInFrustum, InTraversalDesc, Output);
 		}
+		return true;
 	}
-	else
+
+	// This quad is fully inside its LOD (also qualifies if it's simply the lowest LOD)
+	if (ClosestDistanceToTile > GetLODDistance(InLODLevel - 1, InTraversalDesc.LODScale) || InLODLevel == InTraversalDesc.LowestLOD)
 	{
-		// This quad is fully inside its LOD (also qualifies if it's simply the lowest LOD)
-		if (ClosestDistanceToTile > GetLODDistance(InLODLevel - 1, InTraversalDesc.LODScale) || InLODLevel == InTraversalDesc.LowestLOD)
+		// This node is capable of representing all its leaf nodes, so just submit this node
+		if (CanRender(0, InTraversalDesc.ForceCollapseDensityLevel, QuadtreeMeshRenderData))
 		{
-			// This node is capable of representing all its leaf nodes, so just submit this node
-			if (CanRender(0, InTraversalDesc.ForceCollapseDensityLevel, QuadtreeMeshRenderData))
-			{
-				AddNodeForRender(InNodeData, QuadtreeMeshRenderData, 0, InLODLevel, InTraversalDesc, Output);
-			}
-			else
-			{
-				// If not, we need to recurse down the children until we find one that can be rendered
-				for (int32 ChildIndex : Children)
-				{
-					if (ChildIndex > 0)
-					{
-						InNodeData.Nodes[ChildIndex].SelectLODRefinement(InNodeData, 1, InLODLevel, InTraversalDesc, Output);
-					}
-				}
-			}
+			AddNodeForRender(InNodeData, 0, InLODLevel, bInFrustum, InTraversalDesc, Output);
 		}
 		else
 		{
-			// If this node has a complete subtree it will not contain any actual children, they are implicit to save memory so we generate them here
-			if (HasCompleteSubtree && IsSubtreeSameQuadtreeMesh)
-			{
-				FNode ChildNode;
-				const FVector HalfBoundSize(Extent.X, Extent.Y, Extent.Z*2.0f);
-				const FVector HalfOffsets[] = { {0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f} , {0.0f, 1.0f, 0.0f} , {1.0f, 1.0f, 0.0f} };
-				for (int i = 0; i < 4; i++)
-				{
-					const FVector ChildMin = Bounds.Min + HalfBoundSize * HalfOffsets[i];
-					const FVector ChildMax = ChildMin + HalfBoundSize;
-					const FBox ChildBounds(ChildMin, ChildMax);
-
-					// Create a temporary node to traverse
-					ChildNode.HasCompleteSubtree = 1;
-					ChildNode.IsSubtreeSameQuadtreeMesh = 1;
-					ChildNode.TransitionQuadtreeMeshIndex = TransitionQuadtreeMeshIndex;
-					ChildNode.QuadtreeMeshIndex = QuadtreeMeshIndex;
-					ChildNode.Bounds = ChildBounds;
-
-					ChildNode.SelectLOD(InNodeData, InLODLevel - 1, InTraversalDesc, Output);
-				}
-			}
-			else
+			// If not, we need to recurse down the children until we find one that can be rendered
+			SelectChildrenLODRefinement(InNodeData, 1, InLODLevel, InFrustumTest, InChildFrustumTests, InTraversalDesc, Output);
+		}
+		return true;
+	}
+
+	return false;
+}
+
+void FMeshQuadTree::FNode::SelectChildrenLOD(const FNodeData& InNodeData, int32 InLODLevel, EFrustumTestResult InFrustumTest,
+	const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
+{
+	// If this node has a complete subtree it will not contain any actual children, they are implicit to save memory so we generate them here
+	if (HasCompleteSubtree && IsSubtreeSameQuadtreeMesh)
+	{
+		FBox ChildBounds[4];
+		GetImplicitChildBounds(Bounds, ChildBounds);
+
+		EFrustumTestResult ChildFrustumTests[4];
+		TestChildrenFrustum(ChildBounds, InFrustumTest, InTraversalDesc, Output, ChildFrustumTests);
+
+		FNode ChildNode;
+		for (int i = 0; i < 4; i++)
+		{
+
+			// Create a temporary node to traverse
+			ChildNode.HasCompleteSubtree = 1;
+			ChildNode.IsSubtreeSameQuadtreeMesh = 1;
+			ChildNode.TransitionQuadtreeMeshIndex = TransitionQuadtreeMeshIndex;
+			ChildNode.QuadtreeMeshIndex = QuadtreeMeshIndex;
+			ChildNode.Bounds = ChildBounds[i];
+
+			ChildNode.SelectLOD(InNodeData, InLODLevel - 1, ChildFrustumTests[i], InTraversalDesc, Output);
+		}
+	}
+	else
+	{
+		EFrustumTestResult ChildFrustumTests[4];
+		GetChildrenFrustumTests(InNodeData, InFrustumTest, InTraversalDesc, Output, ChildFrustumTests);
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if (Children[i] > 0)
 			{
-				for (int32 ChildIndex : Children)
-				{
-					if (ChildIndex > 0)
-					{
-						InNodeData.Nodes[ChildIndex].SelectLOD(InNodeData, InLODLevel - 1, InTraversalDesc, Output);
-					}
-				}
+				InNodeData.Nodes[Children[i]].SelectLOD(InNodeData, InLODLevel - 1, ChildFrustumTests[i], InTraversalDesc, Output);
 			}
 		}
 	}
 }
 
-void FMeshQuadTree::FNode::SelectLODWithinBounds(const FNodeData& InNodeData, int32 InLODLevel,
+void FMeshQuadTree::FNode::SelectChildrenLODRefinement(const FNodeData& InNodeData, int32 InDensityLevel, int32 InLODLevel, EFrustumTestResult InFrustumTest,
+	const EFrustumTestResult* InChildFrustumTests, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
+{
+	EFrustumTestResult ChildFrustumTests[4];
+	if (InChildFrustumTests == nullptr)
+	{
+		GetChildrenFrustumTests(InNodeData, InFrustumTest, InTraversalDesc, Output, ChildFrustumTests);
+		InChildFrustumTests = ChildFrustumTests;
+	}
+
+	for (int32 i = 0; i < 4; ++i)
+	{
+		if (Children[i] > 0)
+		{
+			InNodeData.Nodes[Children[i]].SelectLODRefinement(InNodeData, InDensityLevel, InLODLevel, InChildFrustumTests[i], InTraversalDesc, Output);
+		}
+	}
+}
+
+void FMeshQuadTree::FNode::SelectLODWithinBounds(const FNodeData& InNodeData, int32 InLODLevel, EFrustumTestResult InParentFrustumTest,
                                                  const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
 {
-	const FQuadtreeMeshRenderData& QuadtreeMeshRenderData = InNodeData.QuadtreeMeshRenderData[QuadtreeMeshIndex];
+	// Nodes outside of the animated clip circle or in an occluded cell are skipped along with their subtree, frustum or not
+	if (IsOutsideClipCircle(InTraversalDesc, Bounds) || IsInOccludedCell(InTraversalDesc, Bounds))
+	{
+		return;
+	}
+
+	if (IsPaged)
+	{
+		if (const TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Page = InNodeData.AcquirePage(*this))
+		{
+			Page->Nodes[0].SelectLODWithinBounds(*Page, InLODLevel, InParentFrustumTest, InTraversalDesc, Output);
+		}
+		else
+		{
+			AddPagedNodeForRender(InNodeData, 0, InLODLevel, InParentFrustumTest, InTraversalDesc, Output);
+		}
+		return;
+	}
+
+	const FQuadtreeMeshRenderDataHot& QuadtreeMeshRenderData = InNodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex];
 	const FVector CenterPosition = Bounds.GetCenter();
-	const FVector Extent = Bounds.GetExtent();
+	const FVector Extent = Bounds.GetExtent() + InTraversalDesc.BoundsPadding;
+	const EFrustumTestResult FrustumTest = TestFrustum(InTraversalDesc.Frustum, InParentFrustumTest, CenterPosition, Extent);
+	const bool bInFrustum = FrustumTest != EFrustumTestResult::Outside;
+	RecordNodeVisit(Output, InTraversalDesc.LODCount - InLODLevel, InParentFrustumTest);
 
-	// Early out on frustum culling 
-	if (!InTraversalDesc.Frustum.IntersectBox(CenterPosition, Extent))
+	// Early out on frustum culling, unless culled tiles are gathered as well
+	if (!bInFrustum && !InTraversalDesc.bGatherUnculledInstances)
 	{
 		// Handled
 		return;
 	}
 
 	check(InTraversalDesc.TessellatedQuadtreeMeshBounds.bIsValid);
+	const FBox2D Bounds2D(FVector2D(Bounds.Min), FVector2D(Bounds.Max));
+
+	// Outside of the tessellated region, collapse the node into a single tile at the coarsest density level
+	if (!InTraversalDesc.TessellatedQuadtreeMeshBounds.Intersect(Bounds2D))
+	{
+		if (CanRender(0, InTraversalDesc.ForceCollapseDensityLevel, QuadtreeMeshRenderData))
+		{
+			AddNodeForRender(InNodeData, InTraversalDesc.DensityCount - 1, InLODLevel, bInFrustum, InTraversalDesc, Output);
+		}
+		else
+		{
+			// Node has holes or mixed render data, go down until we find nodes that can represent their subtree
+			EFrustumTestResult ChildFrustumTests[4];
+			GetChildrenFrustumTests(InNodeData, FrustumTest, InTraversalDesc, Output, ChildFrustumTests);
+			for (int32 i = 0; i < 4; ++i)
+			{
+				if (Children[i] > 0)
+				{
+					InNodeData.Nodes[Children[i]].SelectLODWithinBounds(InNodeData, InLODLevel - 1, ChildFrustumTests[i], InTraversalDesc, Output);
+				}
+			}
+		}
+
+		// Handled
+		return;
+	}
+
 	if (InLODLevel == 0)
 	{
-		if ((InTraversalDesc.TessellatedQuadtreeMeshBounds.IsInsideOrOn(FVector2D(Bounds.Min)) && InTraversalDesc.TessellatedQuadtreeMeshBounds.IsInsideOrOn(FVector2D(Bounds.Max))) &&
-			CanRender(0, InTraversalDesc.ForceCollapseDensityLevel, QuadtreeMeshRenderData))
+		// Leaf tiles touching the tessellated region are rendered at full density so the region border doesn't leave holes
+		if (CanRender(0, InTraversalDesc.ForceCollapseDensityLevel, QuadtreeMeshRenderData))
 		{
-			AddNodeForRender(InNodeData, QuadtreeMeshRenderData, 0, InLODLevel, InTraversalDesc, Output);
+			AddNodeForRender(InNodeData, 0, InLODLevel, bInFrustum, InTraversalDesc, Output);
 		}
 	}
 	else
@@ -441,32 +2154,35 @@ void FMeshQuadTree::FNode::SelectLODWithinBounds(const FNodeData& InNodeData, in
 		// If this node has a complete subtree it will not contain any actual children, they are implicit to save memory so we generate them here
 		if (HasCompleteSubtree && IsSubtreeSameQuadtreeMesh)
 		{
+			FBox ChildBounds[4];
+			GetImplicitChildBounds(Bounds, ChildBounds);
+
+			EFrustumTestResult ChildFrustumTests[4];
+			TestChildrenFrustum(ChildBounds, FrustumTest, InTraversalDesc, Output, ChildFrustumTests);
+
 			FNode ChildNode;
-			const FVector HalfBoundSize(Extent.X, Extent.Y, Extent.Z*2.0f);
-			const FVector HalfOffsets[] = { {0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f} , {0.0f, 1.0f, 0.0f} , {1.0f, 1.0f, 0.0f} };
 			for (int i = 0; i < 4; i++)
 			{
-				const FVector ChildMin = Bounds.Min + HalfBoundSize * HalfOffsets[i];
-				const FVector ChildMax = ChildMin + HalfBoundSize;
-				const FBox ChildBounds(ChildMin, ChildMax);
 
 				// Create a temporary node to traverse
 				ChildNode.HasCompleteSubtree = 1;
 				ChildNode.IsSubtreeSameQuadtreeMesh = 1;
 				ChildNode.TransitionQuadtreeMeshIndex = TransitionQuadtreeMeshIndex;
 				ChildNode.QuadtreeMeshIndex = QuadtreeMeshIndex;
-				ChildNode.Bounds = ChildBounds;
+				ChildNode.Bounds = ChildBounds[i];
 
-				ChildNode.SelectLODWithinBounds(InNodeData, InLODLevel - 1, InTraversalDesc, Output);
+				ChildNode.SelectLODWithinBounds(InNodeData, InLODLevel - 1, ChildFrustumTests[i], InTraversalDesc, Output);
 			}
 		}
 		else
 		{
-			for (const int32 ChildIndex : Children)
+			EFrustumTestResult ChildFrustumTests[4];
+			GetChildrenFrustumTests(InNodeData, FrustumTest, InTraversalDesc, Output, ChildFrustumTests);
+			for (int32 i = 0; i < 4; ++i)
 			{
-				if (ChildIndex > 0)
+				if (Children[i] > 0)
 				{
-					InNodeData.Nodes[ChildIndex].SelectLODWithinBounds(InNodeData, InLODLevel - 1, InTraversalDesc, Output);
+					InNodeData.Nodes[Children[i]].SelectLODWithinBounds(InNodeData, InLODLevel - 1, ChildFrustumTests[i], InTraversalDesc, Output);
 				}
 			}
 		}
@@ -475,12 +2191,24 @@ void FMeshQuadTree::FNode::SelectLODWithinBounds(const FNodeData& InNodeData, in
 
 bool FMeshQuadTree::FNode::QueryBaseHeightAtLocation(const FNodeData& InNodeData, const FVector2D& InWorldLocationXY,float& OutHeight) const
 {
+	if (IsPaged)
+	{
+		if (const TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Page = InNodeData.AcquirePage(*this))
+		{
+			return Page->Nodes[0].QueryBaseHeightAtLocation(*Page, InWorldLocationXY, OutHeight);
+		}
+
+		// Not resident yet, same as not finding a valid sample
+		OutHeight = InNodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex].SurfaceBaseHeight;
+		return false;
+	}
+
 	// Note: Since we prune the quadtree of anything below this condition, it means there are no more granular nodes to fetch below this. In theory we could skip the pruning and have slightly more accurate height sampling, since rivers might have leaf nodes with individual bounds.
 	// Same condition as leaf nodes
 	if (HasCompleteSubtree && IsSubtreeSameQuadtreeMesh)
 	{
 		// Return "accurate" base height when there's a valid sample
-		OutHeight = InNodeData.QuadtreeMeshRenderData[QuadtreeMeshIndex].SurfaceBaseHeight;
+		OutHeight = InNodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex].SurfaceBaseHeight;
 		
 		return true;
 	}
@@ -502,7 +2230,7 @@ bool FMeshQuadTree::FNode::QueryBaseHeightAtLocation(const FNodeData& InNodeData
 	}
 
 	// Return regular base height when there's not valid sample
-	OutHeight = InNodeData.QuadtreeMeshRenderData[QuadtreeMeshIndex].SurfaceBaseHeight;
+	OutHeight = InNodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex].SurfaceBaseHeight;
 
 	// Point is not in any of these children, return false
 	return false;
@@ -512,6 +2240,12 @@ bool FMeshQuadTree::FNode::QueryBoundsAtLocation(const FNodeData& InNodeData, co
 {
 	OutBounds = Bounds;
 
+	if (IsPaged)
+	{
+		const TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Page = InNodeData.AcquirePage(*this);
+		return Page ? Page->Nodes[0].QueryBoundsAtLocation(*Page, InWorldLocationXY, OutBounds) : false;
+	}
+
 	int32 ChildCount = 0;
 	for (const int32 ChildIndex : Children)
 	{
@@ -547,7 +2281,7 @@ void FMeshQuadTree::FNode::AddNodes(FNodeData& InNodeData, const FBox& InMeshBou
 	// Assign the render data here (based on priority)
 	QuadtreeMeshIndex = InQuadtreeMeshIndex;
 	// Cache whether or not this node has a material
-	HasMaterial = InNodeData.QuadtreeMeshRenderData[QuadtreeMeshIndex].Material != nullptr;
+	HasMaterial = InNodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex].bHasMaterial;
 	
 
 	// Reset the flags before going through the children. These flags will be turned off by recursion if the state changes
@@ -619,80 +2353,52 @@ void FMeshQuadTree::FNode::AddNodes(FNodeData& InNodeData, const FBox& InMeshBou
 	}
 }
 
-void FMeshQuadTree::FNode::AddNodeForRender(const FNodeData& InNodeData,
-	const FQuadtreeMeshRenderData& InQuadtreeMeshRenderData, int32 InDensityLevel, int32 InLODLevel,
-	const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
+void FMeshQuadTree::FNode::AddPagedNodeForRender(const FNodeData& InNodeData, int32 InDensityLevel, int32 InLODLevel,
+	EFrustumTestResult InParentFrustumTest, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
 {
-	constexpr int32 MaterialIndex = 0;
-	constexpr  uint32 NodeQuadtreeMeshIndex = 2;
-	
+	const EFrustumTestResult FrustumTest = TestFrustum(InTraversalDesc.Frustum, InParentFrustumTest, Bounds.GetCenter(), Bounds.GetExtent() + InTraversalDesc.BoundsPadding);
+	const bool bInFrustum = FrustumTest != EFrustumTestResult::Outside;
+	RecordNodeVisit(Output, InTraversalDesc.LODCount - InLODLevel, InParentFrustumTest);
 
-	// The base height of this tile comes either the top of the bounding box (for rivers) or the given base height (lakes and ocean)
-	const double BaseHeight = InQuadtreeMeshRenderData.SurfaceBaseHeight;
+	if ((bInFrustum || InTraversalDesc.bGatherUnculledInstances) && InNodeData.QuadtreeMeshRenderDataHot[QuadtreeMeshIndex].bHasMaterial)
+	{
+		AddNodeForRender(InNodeData, InDensityLevel, InLODLevel, bInFrustum, InTraversalDesc, Output);
+	}
+}
 
-	const float BaseHeightTWS = BaseHeight + InTraversalDesc.PreViewTranslation.Z;
+void FMeshQuadTree::FNode::AddNodeForRender(const FNodeData& InNodeData, int32 InDensityLevel, int32 InLODLevel, bool bInFrustum,
+	const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const
+{
+	constexpr int32 MaterialIndex = 0;
 
-	const int32 DensityIndex = FMath::Min(InDensityLevel, InTraversalDesc.DensityCount - 1);
+	const int32 DensityIndex = FMath::Clamp(InDensityLevel, InTraversalDesc.MinDensityIndex, InTraversalDesc.DensityCount - 1);
 	const int32 BucketIndex = MaterialIndex * InTraversalDesc.DensityCount + DensityIndex;
 	
-	++Output.BucketInstanceCounts[BucketIndex];
-
-	FVector BoundsCenter = Bounds.GetCenter();
-	FVector TranslatedWorldPosition(BoundsCenter + InTraversalDesc.PreViewTranslation);
-	
-	
-	const FVector2D Scale(Bounds.GetSize());
-	FStagingInstanceData& StagingData = Output.StagingInstanceData[Output.StagingInstanceData.AddUninitialized()];
-
-	// Add the data to the bucket
-	StagingData.BucketIndex = BucketIndex;
-	StagingData.Data[0].X = TranslatedWorldPosition.X;
-	StagingData.Data[0].Y = TranslatedWorldPosition.Y;
-	StagingData.Data[0].Z = BaseHeightTWS;
-	//StagingData.Data[0].W = *(float*)&NodeQuadtreeMeshIndex;
-	StagingData.Data[0].W = std::bit_cast<float>(NodeQuadtreeMeshIndex);
-
-	// Lowest LOD isn't always 0, this increases with the height distance 
-	const bool bIsLowestLOD = (InLODLevel == InTraversalDesc.LowestLOD);
-
-	// Only allow a tile to morph if it's not the last density level and not the last LOD level, sicne there is no next level to morph to
-	const uint32 bShouldMorph = (InTraversalDesc.bLODMorphingEnabled && (DensityIndex != InTraversalDesc.DensityCount - 1)) ? 1 : 0;
-	// Tiles can morph twice to be able to morph between 3 LOD levels. Next to last density level can only morph once
-	const uint32 bCanMorphTwice = (DensityIndex < InTraversalDesc.DensityCount - 2) ? 1 : 0;
-
-	// Pack some of the data to save space. LOD level in the lower 8 bits and then bShouldMorph in the 9th bit and bCanMorphTwice in the 10th bit
-	const uint32 BitPackedChannel = (static_cast<uint32>(InLODLevel) & 0xFF) | (bShouldMorph << 8) | (bCanMorphTwice << 9);
-
-	// Should morph
-	//StagingData.Data[1].X = *(float*)&BitPackedChannel;
-	StagingData.Data[1].X = std::bit_cast<float>(BitPackedChannel);
-	StagingData.Data[1].Y = bIsLowestLOD ? InTraversalDesc.HeightMorph : 0.0f;
-	StagingData.Data[1].Z = Scale.X;
-	StagingData.Data[1].W = Scale.Y;
-
-
-	// Instance Hit Proxy ID
-	FLinearColor HitProxyColor;
-	if(InQuadtreeMeshRenderData.HitProxy)
+	if (bInFrustum)
 	{
-		HitProxyColor = InQuadtreeMeshRenderData.HitProxy->Id.GetColor().ReinterpretAsLinear();
+		++Output.BucketInstanceCounts[BucketIndex];
+		++Output.InstanceCount;
 	}
-	else
+
+	if (InTraversalDesc.bGatherUnculledInstances)
 	{
-		HitProxyColor = FLinearColor::Black;
+		++Output.UnculledBucketInstanceCounts[BucketIndex];
+		++Output.UnculledInstanceCount;
 	}
-	StagingData.Data[2].X = HitProxyColor.R;
-	StagingData.Data[2].Y = HitProxyColor.G;
-	StagingData.Data[2].Z = HitProxyColor.B;
-	StagingData.Data[2].W = InQuadtreeMeshRenderData.bQuadtreeMeshSelected ? 1.0f : 0.0f;
-
 
-	++Output.InstanceCount;
+	FSelectedTile& Tile = Output.SelectedTiles[Output.SelectedTiles.AddUninitialized()];
+	Tile.Center = FVector2D(Bounds.GetCenter());
+	Tile.Size = FVector2f(FVector2D(Bounds.GetSize()));
+	Tile.BucketIndex = static_cast<uint16>(BucketIndex);
+	Tile.QuadtreeMeshIndex = static_cast<uint16>(QuadtreeMeshIndex);
+	Tile.LODLevel = static_cast<uint8>(InLODLevel);
+	Tile.DensityIndex = static_cast<uint8>(DensityIndex);
+	Tile.bInFrustum = bInFrustum;
 
 #if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
 	// Debug drawing
 	
-	if (InTraversalDesc.DebugShowTile != 0)
+	if (InTraversalDesc.DebugShowTile != 0 && bInFrustum)
 	{
 		FColor Color;
 		if (InTraversalDesc.DebugShowTile == 1)
@@ -0,0 +1,215 @@
+﻿#include "MeshQuadTreePageTable.h"
+#include "Misc/Compression.h"
+#include "QuadtreeMesh.h"
+#include "QuadtreeMeshStats.h"
+#include "Tasks/Task.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Resident Pages"), STAT_QuadtreeMeshResidentPages, STATGROUP_QuadtreeMesh);
+DECLARE_MEMORY_STAT(TEXT("Resident Page Memory"), STAT_QuadtreeMeshResidentPageMemory, STATGROUP_QuadtreeMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Page Misses"), STAT_QuadtreeMeshPageMisses, STATGROUP_QuadtreeMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Page Loads"), STAT_QuadtreeMeshPageLoads, STATGROUP_QuadtreeMesh);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Last Page Load Latency (ms)"), STAT_QuadtreeMeshPageLoadLatency, STATGROUP_QuadtreeMesh);
+
+FMeshQuadTree::FPageTable::FPageTable(int32 InMaxResidentPages)
+	: MaxResidentPages(FMath::Max(1, InMaxResidentPages))
+{
+}
+
+FMeshQuadTree::FPageTable::~FPageTable()
+{
+	// Loads hold a reference to the table, nothing is in flight anymore
+	DEC_DWORD_STAT_BY(STAT_QuadtreeMeshResidentPages, NumResidentPages);
+	DEC_MEMORY_STAT_BY(STAT_QuadtreeMeshResidentPageMemory, ResidentPageMemory);
+}
+
+int32 FMeshQuadTree::FPageTable::WritePage(TConstArrayView<FNode> InNodes)
+{
+	static_assert(std::is_trivially_copyable_v<FNode>, "Pages store the nodes as raw memory");
+
+	const int32 UncompressedSize = InNodes.Num() * sizeof(FNode);
+	int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, UncompressedSize);
+
+	// Compressed straight into the page data, trimmed to the actual size after
+	const int64 Offset = PageData.Num();
+	PageData.AddUninitialized(CompressedSize);
+	verify(FCompression::CompressMemory(NAME_Zlib, PageData.GetData() + Offset, CompressedSize, InNodes.GetData(), UncompressedSize));
+	PageData.SetNum(Offset + CompressedSize, EAllowShrinking::No);
+
+	FPage& Page = Pages.AddDefaulted_GetRef();
+	Page.Offset = Offset;
+	Page.CompressedSize = CompressedSize;
+	Page.NodeCount = InNodes.Num();
+	return Pages.Num() - 1;
+}
+
+void FMeshQuadTree::FPageTable::FinishWriting(TArray<FQuadtreeMeshRenderDataHot> InQuadtreeMeshRenderDataHot)
+{
+	PageData.Shrink();
+	QuadtreeMeshRenderDataHot = MoveTemp(InQuadtreeMeshRenderDataHot);
+
+	PageLastUsed = MakeUnique<std::atomic<uint64>[]>(Pages.Num());
+	for (int32 PageIndex = 0; PageIndex < Pages.Num(); ++PageIndex)
+	{
+		PageLastUsed[PageIndex] = 0;
+	}
+}
+
+void FMeshQuadTree::FPageTable::SerializeLayout(FArchive& Ar)
+{
+	int32 NumPages = Pages.Num();
+	Ar << NumPages;
+	if (Ar.IsLoading())
+	{
+		Pages.SetNum(NumPages);
+	}
+
+	for (FPage& Page : Pages)
+	{
+		Ar << Page.Offset;
+		Ar << Page.CompressedSize;
+		Ar << Page.NodeCount;
+	}
+
+	Ar << PageIndexByNode;
+}
+
+TSharedPtr<const FMeshQuadTree::FNodeData, ESPMode::ThreadSafe> FMeshQuadTree::FPageTable::Acquire(int32 InPageIndex)
+{
+	{
+		FReadScopeLock ReadLock(Lock);
+		if (Pages[InPageIndex].Resident)
+		{
+			PageLastUsed[InPageIndex] = ++UseCounter;
+			return Pages[InPageIndex].Resident;
+		}
+	}
+
+	++NumMisses;
+	INC_DWORD_STAT(STAT_QuadtreeMeshPageMisses);
+
+	FWriteScopeLock WriteLock(Lock);
+	FPage& Page = Pages[InPageIndex];
+	if (Page.Resident)
+	{
+		// Arrived in between
+		PageLastUsed[InPageIndex] = ++UseCounter;
+		return Page.Resident;
+	}
+
+	if (Page.RequestTime == 0.0)
+	{
+		Page.RequestTime = FPlatformTime::Seconds();
+		UE::Tasks::Launch(UE_SOURCE_LOCATION, [PageTable = AsShared(), InPageIndex]()
+		{
+			PageTable->LoadPage(InPageIndex);
+		}, LowLevelTasks::ETaskPriority::BackgroundNormal);
+	}
+
+	return nullptr;
+}
+
+void FMeshQuadTree::FPageTable::LoadPage(int32 InPageIndex)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FMeshQuadTree::FPageTable::LoadPage);
+
+	// Pages are immutable once written, their location can be read without the lock
+	const FPage& PageLocation = Pages[InPageIndex];
+
+	TSharedPtr<FNodeData, ESPMode::ThreadSafe> PageNodeData = MakeShared<FNodeData, ESPMode::ThreadSafe>();
+	PageNodeData->Nodes.SetNumUninitialized(PageLocation.NodeCount);
+	PageNodeData->QuadtreeMeshRenderDataHot = QuadtreeMeshRenderDataHot;
+
+	bool bLoaded = false;
+	if (PageBulkData)
+	{
+		// Only the page is read from the cooked package
+		TUniquePtr<IBulkDataIORequest> Request(PageBulkData->CreateStreamingRequest(PageLocation.Offset, PageLocation.CompressedSize, AIOP_BelowNormal, nullptr, nullptr));
+		if (Request && Request->WaitCompletion())
+		{
+			if (uint8* CompressedData = Request->GetReadResults())
+			{
+				bLoaded = FCompression::UncompressMemory(NAME_Zlib, PageNodeData->Nodes.GetData(), PageLocation.NodeCount * sizeof(FNode), CompressedData, PageLocation.CompressedSize);
+				FMemory::Free(CompressedData);
+			}
+		}
+	}
+	else
+	{
+		bLoaded = FCompression::UncompressMemory(NAME_Zlib, PageNodeData->Nodes.GetData(), PageLocation.NodeCount * sizeof(FNode), PageData.GetData() + PageLocation.Offset, PageLocation.CompressedSize);
+	}
+
+	if (!bLoaded)
+	{
+		UE_LOG(LogQuadtreeMesh, Error, TEXT("Failed to load quadtree mesh page %d"), InPageIndex);
+	}
+
+	FWriteScopeLock WriteLock(Lock);
+	FPage& Page = Pages[InPageIndex];
+	const double LoadLatency = FPlatformTime::Seconds() - Page.RequestTime;
+
+	if (bLoaded)
+	{
+		Page.Resident = PageNodeData;
+		Page.RequestTime = 0.0;
+		PageLastUsed[InPageIndex] = ++UseCounter;
+
+		const uint64 PageMemory = PageNodeData->GetAllocatedSize();
+		++NumResidentPages;
+		ResidentPageMemory += PageMemory;
+		++NumLoads;
+		TotalLoadLatency += LoadLatency;
+		MaxLoadLatency = FMath::Max(MaxLoadLatency, LoadLatency);
+
+		INC_DWORD_STAT(STAT_QuadtreeMeshResidentPages);
+		INC_MEMORY_STAT_BY(STAT_QuadtreeMeshResidentPageMemory, PageMemory);
+		INC_DWORD_STAT(STAT_QuadtreeMeshPageLoads);
+		SET_FLOAT_STAT(STAT_QuadtreeMeshPageLoadLatency, LoadLatency * 1000.0);
+
+		EvictPages();
+	}
+	// On failure RequestTime stays set so the page isn't requested again, its node keeps rendering in place of the subtree
+}
+
+void FMeshQuadTree::FPageTable::EvictPages()
+{
+	while (NumResidentPages > MaxResidentPages)
+	{
+		int32 LeastRecentlyUsedPage = INDEX_NONE;
+		uint64 LeastRecentUse = TNumericLimits<uint64>::Max();
+		for (int32 PageIndex = 0; PageIndex < Pages.Num(); ++PageIndex)
+		{
+			const uint64 LastUsed = PageLastUsed[PageIndex];
+			if (Pages[PageIndex].Resident && LastUsed < LeastRecentUse)
+			{
+				LeastRecentlyUsedPage = PageIndex;
+				LeastRecentUse = LastUsed;
+			}
+		}
+
+		FPage& Page = Pages[LeastRecentlyUsedPage];
+		const uint64 PageMemory = Page.Resident->GetAllocatedSize();
+		Page.Resident.Reset();
+
+		--NumResidentPages;
+		ResidentPageMemory -= PageMemory;
+		DEC_DWORD_STAT(STAT_QuadtreeMeshResidentPages);
+		DEC_MEMORY_STAT_BY(STAT_QuadtreeMeshResidentPageMemory, PageMemory);
+	}
+}
+
+FMeshQuadTree::FPagingStats FMeshQuadTree::FPageTable::GetStats() const
+{
+	FReadScopeLock ReadLock(Lock);
+
+	FPagingStats Stats;
+	Stats.NumPages = Pages.Num();
+	Stats.NumResidentPages = NumResidentPages;
+	Stats.ResidentPageMemory = ResidentPageMemory;
+	Stats.bCooked = PageBulkData.IsValid();
+	Stats.CompressedPageMemory = Stats.bCooked ? PageBulkData->GetBulkDataSize() : PageData.Num();
+	Stats.NumMisses = NumMisses;
+	Stats.NumLoads = NumLoads;
+	Stats.AverageLoadLatencyMs = NumLoads > 0 ? TotalLoadLatency * 1000.0 / NumLoads : 0.0;
+	Stats.MaxLoadLatencyMs = MaxLoadLatency * 1000.0;
+	return Stats;
+}
@@ -0,0 +1,80 @@
+﻿#pragma once
+
+#include "MeshQuadTree.h"
+#include "Misc/ScopeRWLock.h"
+#include "Serialization/BulkData.h"
+#include <atomic>
+
+/**
+ * Compressed subtrees of a FMeshQuadTree, see FMeshQuadTree::BuildPagedTree(..). They're kept in memory when the tree is built at runtime,
+ * or streamed from the cooked bulk data of the component, see FMeshQuadTree::LoadPages(..).
+ * Shared by all the copies of a tree (game thread, scene proxy, query snapshots), pages are decompressed by background tasks
+ */
+struct FMeshQuadTree::FPageTable : public TSharedFromThis<FPageTable, ESPMode::ThreadSafe>
+{
+	struct FPage
+	{
+		/** In PageData or PageBulkData */
+		int64 Offset = 0;
+		int32 CompressedSize = 0;
+		int32 NodeCount = 0;
+
+		/** Null when not resident. Users keep their own reference so eviction never frees a page in use */
+		TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Resident;
+
+		/** Time the load was requested, 0 when no load is in flight */
+		double RequestTime = 0.0;
+	};
+
+	FPageTable(int32 InMaxResidentPages);
+	~FPageTable();
+
+	/** Resident page, or null after requesting its load */
+	TSharedPtr<const FNodeData, ESPMode::ThreadSafe> Acquire(int32 InPageIndex);
+
+	/** Compress InNodes and append them to PageData, returns the page index. Only used while building a tree */
+	int32 WritePage(TConstArrayView<FNode> InNodes);
+
+	/** Called once all pages are written or loaded */
+	void FinishWriting(TArray<FQuadtreeMeshRenderDataHot> InQuadtreeMeshRenderDataHot);
+
+	/** Page locations and PageIndexByNode, not the page data itself */
+	void SerializeLayout(FArchive& Ar);
+
+	FPagingStats GetStats() const;
+
+	/** Page index of each paged node, by node index in the resident node array */
+	TMap<uint32, int32> PageIndexByNode;
+
+	/** Compressed pages of a tree built at runtime, empty when they're streamed from PageBulkData */
+	TArray64<uint8> PageData;
+
+	/** Cooked pages, owned by the component and shared so loads in flight outlive it */
+	TSharedPtr<FByteBulkData, ESPMode::ThreadSafe> PageBulkData;
+
+private:
+	void LoadPage(int32 InPageIndex);
+
+	/** Evict least recently used pages until we're within budget. Write lock must be held */
+	void EvictPages();
+
+	TArray<FPage> Pages;
+
+	/** Last Acquire(..) of each page, updated under the read lock */
+	TUniquePtr<std::atomic<uint64>[]> PageLastUsed;
+	std::atomic<uint64> UseCounter = 0;
+
+	/** Render data pages are traversed with, the traversal only reads the hot render data */
+	TArray<FQuadtreeMeshRenderDataHot> QuadtreeMeshRenderDataHot;
+
+	int32 MaxResidentPages = 0;
+
+	mutable FRWLock Lock;
+
+	int32 NumResidentPages = 0;
+	uint64 ResidentPageMemory = 0;
+	std::atomic<uint64> NumMisses = 0;
+	uint64 NumLoads = 0;
+	double TotalLoadLatency = 0.0;
+	double MaxLoadLatency = 0.0;
+};
@@ -14,6 +14,9 @@ AQuadtreeMeshActor::AQuadtreeMeshActor()
 {
 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
+
+	// Replicates only when the mesh's bReplicateEdits is set, and then stays dormant until the first edit
+	NetDormancy = DORM_Initial;
 	
 	QuadtreeMeshComponent = CreateDefaultSubobject<UQuadtreeMeshComponent>(TEXT("QuadtreeMeshComponent"));
 	
@@ -1,5 +1,59 @@
 ﻿#include "QuadtreeMeshActorDesc.h"
 #include "QuadtreeMeshActor.h"
+#include "QuadtreeMeshCustomVersion.h"
+
+#if WITH_EDITOR
+
+namespace QuadtreeMeshActorDesc
+{
+	// Enough to reject most queries on a world scale tool, small enough to keep the descriptor a few hundred bytes
+	constexpr int32 MaxCoverageResolution = 64;
+}
+
+bool FQuadtreeMeshActorDesc::FTreeSummary::MayBeCovered(const FVector2D& InWorldLocationXY) const
+{
+	return MayBeCovered(FBox2D(InWorldLocationXY, InWorldLocationXY));
+}
+
+bool FQuadtreeMeshActorDesc::FTreeSummary::MayBeCovered(const FBox2D& InWorldBounds) const
+{
+	if (!IsValid() || CoverageBitmap.Num() != CoverageResolution.X * CoverageResolution.Y)
+	{
+		return false;
+	}
+
+	const FBox2D Bounds2D(FVector2D(Bounds.Min), FVector2D(Bounds.Max));
+	if (!Bounds2D.Intersect(InWorldBounds))
+	{
+		return false;
+	}
+
+	const FVector2D CellSize = Bounds2D.GetSize() / FVector2D(CoverageResolution);
+	const FVector2D Min = (InWorldBounds.Min - Bounds2D.Min) / CellSize;
+	const FVector2D Max = (InWorldBounds.Max - Bounds2D.Min) / CellSize;
+	const FIntPoint MinCell(FMath::Clamp(FMath::FloorToInt(Min.X), 0, CoverageResolution.X - 1), FMath::Clamp(FMath::FloorToInt(Min.Y), 0, CoverageResolution.Y - 1));
+	const FIntPoint MaxCell(FMath::Clamp(FMath::FloorToInt(Max.X), 0, CoverageResolution.X - 1), FMath::Clamp(FMath::FloorToInt(Max.Y), 0, CoverageResolution.Y - 1));
+	for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+	{
+		for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+		{
+			if (CoverageBitmap[Y * CoverageResolution.X + X])
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+FArchive& operator<<(FArchive& Ar, FQuadtreeMeshActorDesc::FTreeSummary& Summary)
+{
+	Ar << Summary.Bounds;
+	Ar << Summary.CoverageResolution;
+	Ar << Summary.CoverageBitmap;
+	Ar << Summary.RenderDataCount;
+	return Ar;
+}
 
 FQuadtreeMeshActorDesc::FQuadtreeMeshActorDesc()
 	:OverlapPriority(0)
@@ -13,15 +67,58 @@ void FQuadtreeMeshActorDesc::Init(const AActor* InActor)
 	if (const AQuadtreeMeshActor* QuadtreeMesh = CastChecked<AQuadtreeMeshActor>(InActor))
 	{
 		OverlapPriority = QuadtreeMesh->GetOverlapPriority();
+
+		TreeSummary = FTreeSummary();
+		const UQuadtreeMeshComponent* Component = QuadtreeMesh->QuadtreeMeshComponent;
+		if (!Component)
+		{
+			return;
+		}
+
+		// Resaves, commandlets and freshly loaded actors never ticked the subsystem, their tree is built here rather than left empty
+		FMeshQuadTree DetachedQuadTree;
+		if (Component->NeedsRebuild())
+		{
+			Component->BuildDetachedQuadTree(DetachedQuadTree);
+		}
+
+		const FMeshQuadTree& MeshQuadTree = Component->NeedsRebuild() ? DetachedQuadTree : Component->GetMeshQuadTree();
+		if (MeshQuadTree.GetNodeCount() > 0)
+		{
+			TreeSummary.Bounds = MeshQuadTree.GetBounds();
+			TreeSummary.RenderDataCount = MeshQuadTree.GetQuadtreeMeshRenderDataCount();
+
+			// No finer than the leaf tiles
+			const FVector2D LeafCount = FVector2D(TreeSummary.Bounds.GetSize()) / MeshQuadTree.GetLeafSize();
+			TreeSummary.CoverageResolution = FIntPoint(
+				FMath::Clamp(FMath::RoundToInt(LeafCount.X), 1, QuadtreeMeshActorDesc::MaxCoverageResolution),
+				FMath::Clamp(FMath::RoundToInt(LeafCount.Y), 1, QuadtreeMeshActorDesc::MaxCoverageResolution));
+			MeshQuadTree.BuildCoverageBitmap(TreeSummary.CoverageResolution, TreeSummary.CoverageBitmap);
+		}
 	}
 }
 
 bool FQuadtreeMeshActorDesc::Equals(const FWorldPartitionActorDesc* Other) const
 {
-	return FWorldPartitionActorDesc::Equals(Other);
+	if (FWorldPartitionActorDesc::Equals(Other))
+	{
+		const FQuadtreeMeshActorDesc* QuadtreeMeshActorDesc = static_cast<const FQuadtreeMeshActorDesc*>(Other);
+		return OverlapPriority == QuadtreeMeshActorDesc->OverlapPriority && TreeSummary == QuadtreeMeshActorDesc->TreeSummary;
+	}
+	return false;
 }
 
 void FQuadtreeMeshActorDesc::Serialize(FArchive& Ar)
 {
+	Ar.UsingCustomVersion(FQuadtreeMeshCustomVersion::GUID);
+
 	FWorldPartitionActorDesc::Serialize(Ar);
+
+	if (Ar.CustomVer(FQuadtreeMeshCustomVersion::GUID) >= FQuadtreeMeshCustomVersion::ActorDescTreeSummary)
+	{
+		Ar << OverlapPriority;
+		Ar << TreeSummary;
+	}
 }
+
+#endif
@@ -0,0 +1,71 @@
+﻿#include "QuadtreeMeshAutoConfiguration.h"
+
+namespace QuadtreeMeshAutoConfiguration
+{
+	// Same limit as FQuadtreeMeshSceneProxy::GetScaledLODScale
+	constexpr double MinLODScale = 0.5;
+
+	/**
+	 *	Tiles selected around an observer at LOD scale 1: the LOD 0 disc is 2 leaves in radius, every further ring doubles both its radius and its tile size so it
+	 *	holds the same number of tiles, PI * (4 - 1). The tile count grows with the square of the LOD scale
+	 */
+	static double GetTilesPerView(int32 InTreeDepth)
+	{
+		return UE_DOUBLE_PI * (4.0 + 3.0 * FMath::Max(InTreeDepth - 1, 0));
+	}
+}
+
+FQuadtreeMeshAutoConfiguration FQuadtreeMeshAutoConfiguration::Compute(const FVector2D& InCoverageExtent, float InTargetVertexSpacing, int32 InVertexBudget)
+{
+	using namespace QuadtreeMeshAutoConfiguration;
+
+	const double VertexSpacing = FMath::Max(InTargetVertexSpacing, 1.0f);
+	const double VertexBudget = FMath::Max(InVertexBudget, 1);
+	const double CoverageSize = 2.0 * FMath::Max(InCoverageExtent.GetAbs().GetMax(), 1.0);
+
+	FQuadtreeMeshAutoConfiguration Best;
+	for (int32 Factor = 1; Factor <= MaxTessellationFactor; ++Factor)
+	{
+		const int32 NumQuads = 1 << Factor;
+		const double Leaf = VertexSpacing * NumQuads;
+
+		// Same depth as FMeshQuadTree::InitTree
+		const int32 LeafCount = FMath::Max(FMath::CeilToInt(CoverageSize / Leaf - UE_KINDA_SMALL_NUMBER), 2);
+		const int32 Depth = FMath::FloorLog2(FMath::RoundUpToPowerOfTwo(LeafCount));
+
+		const double VerticesPerTile = FMath::Square(NumQuads + 1.0);
+		const double TilesPerView = GetTilesPerView(Depth);
+		// Beyond the root size every tile is in the LOD 0 disc anyway
+		const double Scale = FMath::Min(FMath::Sqrt(VertexBudget / (VerticesPerTile * TilesPerView)), static_cast<double>(1 << Depth));
+
+		// Larger tiles only get further from the budget
+		if (Scale < MinLODScale && Best.IsValid())
+		{
+			break;
+		}
+
+		Best.LeafSize = static_cast<float>(Leaf);
+		Best.TessellationFactor = Factor;
+		Best.LODScale = static_cast<float>(FMath::Max(Scale, MinLODScale));
+		Best.TreeDepth = Depth;
+		Best.bOverBudget = Scale < MinLODScale;
+
+		const double TileCount = FMath::Min(TilesPerView * FMath::Square(static_cast<double>(Best.LODScale)), FMath::Square(static_cast<double>(LeafCount)));
+		Best.EstimatedTilesPerView = FMath::CeilToInt(TileCount);
+		Best.EstimatedVerticesPerView = static_cast<int32>(FMath::Min(TileCount * VerticesPerTile, static_cast<double>(MAX_int32)));
+		Best.FullDensityRadius = static_cast<float>(2.0 * Best.LODScale * Leaf);
+
+		if (Best.bOverBudget || Leaf >= CoverageSize)
+		{
+			break;
+		}
+	}
+
+	return Best;
+}
+
+FString FQuadtreeMeshAutoConfiguration::ToString() const
+{
+	return FString::Printf(TEXT("leaf size %.0f, tessellation factor %d, LOD scale %.2f, tree depth %d, full density within %.0f, ~%d tiles and ~%d vertices per view%s"),
+		LeafSize, TessellationFactor, LODScale, TreeDepth, FullDensityRadius, EstimatedTilesPerView, EstimatedVerticesPerView, bOverBudget ? TEXT(" (over budget)") : TEXT(""));
+}
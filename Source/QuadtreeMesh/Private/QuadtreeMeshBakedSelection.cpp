@@ -0,0 +1,451 @@
+﻿#include "QuadtreeMeshBakedSelection.h"
+
+#include "QuadtreeMesh.h"
+#include "Async/ParallelFor.h"
+#include <atomic>
+
+namespace QuadtreeMeshBakedSelection
+{
+	using FBakedTile = FQuadtreeMeshBakedSelectionDecoder::FBakedTile;
+
+	// Key layout: node depth in the top bits, then the Y and X index of the node in the grid of its depth
+	constexpr int32 PositionBits = 29;
+	constexpr uint64 PositionMask = (1ull << PositionBits) - 1;
+	constexpr int32 MaxDepth = PositionBits;
+
+	// Past that the cell size is most likely a mistake, the bake would take minutes
+	constexpr int64 MaxCellCount = 1 << 20;
+
+	static uint64 MakeKey(uint64 InDepth, uint64 InX, uint64 InY)
+	{
+		return (InDepth << (2 * PositionBits)) | (InY << PositionBits) | InX;
+	}
+
+	static void GetTileGeometry(const FBox& InTreeBounds, uint64 InKey, FVector2D& OutCenter, FVector2D& OutSize)
+	{
+		const uint64 Depth = InKey >> (2 * PositionBits);
+		OutSize = FVector2D(InTreeBounds.GetSize()) / static_cast<double>(1ull << Depth);
+		OutCenter = FVector2D(InTreeBounds.Min) + FVector2D(static_cast<double>(InKey & PositionMask) + 0.5, static_cast<double>((InKey >> PositionBits) & PositionMask) + 0.5) * OutSize;
+	}
+
+#if WITH_EDITOR
+	/** Key of a selected tile, fails if the tile isn't a node of the regular subdivision of InTreeBounds */
+	static bool MakeTileKey(const FBox& InTreeBounds, const FMeshQuadTree::FSelectedTile& InTile, uint64& OutKey)
+	{
+		const FVector2D RootSize(InTreeBounds.GetSize());
+		const int32 Depth = FMath::RoundToInt(FMath::Log2(RootSize.X / InTile.Size.X));
+		if (Depth < 0 || Depth > MaxDepth)
+		{
+			return false;
+		}
+
+		const FVector2D NodeSize = RootSize / static_cast<double>(1ull << Depth);
+		const FVector2D NodeIndex = (InTile.Center - FVector2D(InTreeBounds.Min)) / NodeSize - FVector2D(0.5);
+		const int64 X = FMath::RoundToInt64(NodeIndex.X);
+		const int64 Y = FMath::RoundToInt64(NodeIndex.Y);
+		if (X < 0 || Y < 0 || X > static_cast<int64>(PositionMask) || Y > static_cast<int64>(PositionMask))
+		{
+			return false;
+		}
+
+		OutKey = MakeKey(Depth, X, Y);
+
+		// Decoding must give back the exact tile
+		FVector2D Center, Size;
+		GetTileGeometry(InTreeBounds, OutKey, Center, Size);
+		const double Tolerance = FMath::Max(0.1, NodeSize.GetMax() * UE_KINDA_SMALL_NUMBER);
+		return Center.Equals(InTile.Center, Tolerance) && Size.Equals(FVector2D(InTile.Size), Tolerance);
+	}
+
+	static void WriteVarUInt(TArray<uint8>& Out, uint64 InValue)
+	{
+		while (InValue >= 0x80)
+		{
+			Out.Add(static_cast<uint8>(InValue) | 0x80);
+			InValue >>= 7;
+		}
+		Out.Add(static_cast<uint8>(InValue));
+	}
+
+	/** Cell layout: lowest LOD, removed count, removed keys (delta to the previous key), added count, added tiles (key delta, LOD, density, render data index) */
+	static void EncodeCellDelta(int32 InLowestLOD, TConstArrayView<FBakedTile> InPreviousTiles, TConstArrayView<FBakedTile> InTiles, TArray<uint8>& Out)
+	{
+		TArray<uint64> RemovedKeys;
+		TArray<const FBakedTile*> AddedTiles;
+
+		// Both sets are sorted by key
+		int32 PreviousIndex = 0;
+		int32 Index = 0;
+		while (PreviousIndex < InPreviousTiles.Num() || Index < InTiles.Num())
+		{
+			if (Index == InTiles.Num() || (PreviousIndex < InPreviousTiles.Num() && InPreviousTiles[PreviousIndex].Key < InTiles[Index].Key))
+			{
+				RemovedKeys.Add(InPreviousTiles[PreviousIndex++].Key);
+			}
+			else if (PreviousIndex == InPreviousTiles.Num() || InTiles[Index].Key < InPreviousTiles[PreviousIndex].Key)
+			{
+				AddedTiles.Add(&InTiles[Index++]);
+			}
+			else
+			{
+				const FBakedTile& PreviousTile = InPreviousTiles[PreviousIndex++];
+				const FBakedTile& Tile = InTiles[Index++];
+				if (PreviousTile.LODLevel != Tile.LODLevel || PreviousTile.DensityIndex != Tile.DensityIndex || PreviousTile.QuadtreeMeshIndex != Tile.QuadtreeMeshIndex)
+				{
+					RemovedKeys.Add(PreviousTile.Key);
+					AddedTiles.Add(&Tile);
+				}
+			}
+		}
+
+		Out.Add(static_cast<uint8>(InLowestLOD));
+
+		uint64 PreviousKey = 0;
+		WriteVarUInt(Out, RemovedKeys.Num());
+		for (const uint64 Key : RemovedKeys)
+		{
+			WriteVarUInt(Out, Key - PreviousKey);
+			PreviousKey = Key;
+		}
+
+		PreviousKey = 0;
+		WriteVarUInt(Out, AddedTiles.Num());
+		for (const FBakedTile* Tile : AddedTiles)
+		{
+			WriteVarUInt(Out, Tile->Key - PreviousKey);
+			Out.Add(Tile->LODLevel);
+			Out.Add(Tile->DensityIndex);
+			WriteVarUInt(Out, Tile->QuadtreeMeshIndex);
+			PreviousKey = Tile->Key;
+		}
+	}
+#endif
+
+	static uint64 ReadVarUInt(const uint8*& InOutData)
+	{
+		uint64 Value = 0;
+		int32 Shift = 0;
+		uint8 Byte;
+		do
+		{
+			Byte = *InOutData++;
+			Value |= static_cast<uint64>(Byte & 0x7F) << Shift;
+			Shift += 7;
+		}
+		while (Byte & 0x80);
+		return Value;
+	}
+}
+
+bool FQuadtreeMeshBakedSelection::IsValidFor(const FMeshQuadTree& InTree, const FMeshQuadTree::FTraversalDesc& InTraversalDesc) const
+{
+	return IsBaked()
+		&& !InTree.IsGPUQuadTree()
+		&& !InTree.HasPagedSubtrees()
+		&& !InTraversalDesc.TessellatedQuadtreeMeshBounds.bIsValid
+		&& FMath::IsNearlyEqual(LODScale, InTraversalDesc.LODScale)
+		&& LODCount == InTraversalDesc.LODCount
+		&& DensityCount == InTraversalDesc.DensityCount
+		&& ForceCollapseDensityLevel == InTraversalDesc.ForceCollapseDensityLevel
+		&& TreeNodeCount == InTree.GetNodeCount()
+		&& TreeBounds.Equals(InTree.GetBounds());
+}
+
+bool FQuadtreeMeshBakedSelection::GetCell(const FVector& InPosition, FIntVector& OutCell) const
+{
+	if (!IsBaked() || !Volume.IsInsideOrOn(InPosition))
+	{
+		return false;
+	}
+
+	const FVector LocalPosition = (InPosition - Volume.Min) / CellSize;
+	OutCell.X = FMath::Clamp(FMath::FloorToInt(LocalPosition.X), 0, CellCount.X - 1);
+	OutCell.Y = FMath::Clamp(FMath::FloorToInt(LocalPosition.Y), 0, CellCount.Y - 1);
+	OutCell.Z = FMath::Clamp(FMath::FloorToInt(LocalPosition.Z), 0, CellCount.Z - 1);
+	return true;
+}
+
+#if WITH_EDITOR
+bool FQuadtreeMeshBakedSelection::Bake(const FMeshQuadTree& InTree, const FMeshQuadTree::FTraversalDesc& InTraversalDesc, const FBox& InVolume, float InCellSize,
+	TFunctionRef<void(const FVector&, FMeshQuadTree::FTraversalDesc&)> InSetupObserver)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FQuadtreeMeshBakedSelection::Bake);
+	using namespace QuadtreeMeshBakedSelection;
+
+	Reset();
+
+	if (InTree.GetNodeCount() == 0 || InTree.IsGPUQuadTree() || InTree.HasPagedSubtrees() || InTraversalDesc.TessellatedQuadtreeMeshBounds.bIsValid)
+	{
+		UE_LOG(LogQuadtreeMesh, Warning, TEXT("Can't bake the LOD selection of an empty, GPU, paged or tessellated region quadtree"));
+		return false;
+	}
+
+	if (!InVolume.IsValid || InCellSize <= 0.0f || InTree.GetTreeDepth() > MaxDepth)
+	{
+		UE_LOG(LogQuadtreeMesh, Warning, TEXT("Invalid LOD selection bake volume or cell size"));
+		return false;
+	}
+
+	const FVector VolumeSize = InVolume.GetSize();
+	const FIntVector NewCellCount(
+		FMath::Max(FMath::CeilToInt(VolumeSize.X / InCellSize), 1),
+		FMath::Max(FMath::CeilToInt(VolumeSize.Y / InCellSize), 1),
+		FMath::Max(FMath::CeilToInt(VolumeSize.Z / InCellSize), 1));
+
+	if (static_cast<int64>(NewCellCount.X) * NewCellCount.Y * NewCellCount.Z > MaxCellCount)
+	{
+		UE_LOG(LogQuadtreeMesh, Warning, TEXT("LOD selection bake of %dx%dx%d cells is over the limit of %lld cells, use a larger cell size"), NewCellCount.X, NewCellCount.Y, NewCellCount.Z, MaxCellCount);
+		return false;
+	}
+
+	const FBox NewTreeBounds = InTree.GetBounds();
+	const int32 NumBuckets = FMath::Max(InTree.GetQuadtreeMeshMaterials().Num(), 1) * InTraversalDesc.DensityCount;
+
+	// Rows along X are independent, the first cell of each one is a keyframe
+	const int32 NumRows = NewCellCount.Y * NewCellCount.Z;
+	TArray<TArray<uint8>> RowData;
+	TArray<TArray<int32>> RowCellOffsets;
+	RowData.SetNum(NumRows);
+	RowCellOffsets.SetNum(NumRows);
+	std::atomic<bool> bFailed = false;
+
+	ParallelFor(TEXT("QuadtreeMesh.BakeSelection"), NumRows, 1, [&](int32 RowIndex)
+	{
+		FMeshQuadTree::FTraversalDesc TraversalDesc = InTraversalDesc;
+		TraversalDesc.Frustum = FConvexVolume();
+		TraversalDesc.MinDensityIndex = 0;
+		TraversalDesc.bGatherUnculledInstances = false;
+#if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
+		TraversalDesc.DebugPDI = nullptr;
+#endif
+
+		FMeshQuadTree::FTraversalOutput Output;
+		TArray<FBakedTile> PreviousTiles;
+		TArray<FBakedTile> Tiles;
+
+		const int32 Y = RowIndex % NewCellCount.Y;
+		const int32 Z = RowIndex / NewCellCount.Y;
+		for (int32 X = 0; X < NewCellCount.X && !bFailed; ++X)
+		{
+			const FVector CellCenter = InVolume.Min + (FVector(X, Y, Z) + FVector(0.5)) * InCellSize;
+			TraversalDesc.ObserverPosition = CellCenter;
+			InSetupObserver(CellCenter, TraversalDesc);
+
+			Output.BucketInstanceCounts.Init(0, NumBuckets);
+			InTree.SelectQuadtreeMeshTiles(TraversalDesc, Output);
+
+			Tiles.Reset(Output.SelectedTiles.Num());
+			for (const FMeshQuadTree::FSelectedTile& SelectedTile : Output.SelectedTiles)
+			{
+				FBakedTile& Tile = Tiles.AddDefaulted_GetRef();
+				if (!MakeTileKey(NewTreeBounds, SelectedTile, Tile.Key))
+				{
+					bFailed = true;
+					return;
+				}
+				Tile.QuadtreeMeshIndex = SelectedTile.QuadtreeMeshIndex;
+				Tile.LODLevel = SelectedTile.LODLevel;
+				Tile.DensityIndex = SelectedTile.DensityIndex;
+			}
+			Tiles.Sort([](const FBakedTile& A, const FBakedTile& B) { return A.Key < B.Key; });
+
+			RowCellOffsets[RowIndex].Add(RowData[RowIndex].Num());
+			EncodeCellDelta(TraversalDesc.LowestLOD, PreviousTiles, Tiles, RowData[RowIndex]);
+			Swap(PreviousTiles, Tiles);
+		}
+	});
+
+	if (bFailed)
+	{
+		UE_LOG(LogQuadtreeMesh, Warning, TEXT("LOD selection bake failed, the selected tiles aren't aligned on the quadtree bounds"));
+		return false;
+	}
+
+	int32 DataSize = 0;
+	for (const TArray<uint8>& Row : RowData)
+	{
+		DataSize += Row.Num();
+	}
+
+	Data.Reserve(DataSize);
+	CellOffsets.Reserve(NumRows * NewCellCount.X);
+	for (int32 RowIndex = 0; RowIndex < NumRows; ++RowIndex)
+	{
+		for (const int32 Offset : RowCellOffsets[RowIndex])
+		{
+			CellOffsets.Add(Data.Num() + Offset);
+		}
+		Data.Append(RowData[RowIndex]);
+	}
+
+	Volume = InVolume;
+	CellSize = InCellSize;
+	CellCount = NewCellCount;
+	LODScale = InTraversalDesc.LODScale;
+	LODCount = InTraversalDesc.LODCount;
+	DensityCount = InTraversalDesc.DensityCount;
+	ForceCollapseDensityLevel = InTraversalDesc.ForceCollapseDensityLevel;
+	TreeBounds = NewTreeBounds;
+	TreeNodeCount = InTree.GetNodeCount();
+
+	UE_LOG(LogQuadtreeMesh, Log, TEXT("Baked the LOD selection of %d cells in %d bytes"), CellOffsets.Num(), Data.Num());
+	return true;
+}
+#endif
+
+int32 FQuadtreeMeshBakedSelectionDecoder::ApplyCellDelta(const uint8* InData)
+{
+	using namespace QuadtreeMeshBakedSelection;
+
+	const int32 LowestLOD = *InData++;
+
+	RemovedKeys.Reset();
+	uint64 Key = 0;
+	for (uint64 NumRemoved = ReadVarUInt(InData); NumRemoved > 0; --NumRemoved)
+	{
+		Key += ReadVarUInt(InData);
+		RemovedKeys.Add(Key);
+	}
+
+	AddedTiles.Reset();
+	Key = 0;
+	for (uint64 NumAdded = ReadVarUInt(InData); NumAdded > 0; --NumAdded)
+	{
+		FBakedTile& Tile = AddedTiles.AddDefaulted_GetRef();
+		Key += ReadVarUInt(InData);
+		Tile.Key = Key;
+		Tile.LODLevel = *InData++;
+		Tile.DensityIndex = *InData++;
+		Tile.QuadtreeMeshIndex = static_cast<uint16>(ReadVarUInt(InData));
+	}
+
+	if (RemovedKeys.Num() == 0 && AddedTiles.Num() == 0)
+	{
+		return LowestLOD;
+	}
+
+	// Merge in place of the sorted sets, removed keys are always present in Tiles
+	TArray<FBakedTile> MergedTiles;
+	MergedTiles.Reserve(Tiles.Num() - RemovedKeys.Num() + AddedTiles.Num());
+
+	int32 RemovedIndex = 0;
+	int32 AddedIndex = 0;
+	for (const FBakedTile& Tile : Tiles)
+	{
+		if (RemovedIndex < RemovedKeys.Num() && RemovedKeys[RemovedIndex] == Tile.Key)
+		{
+			++RemovedIndex;
+			continue;
+		}
+
+		while (AddedIndex < AddedTiles.Num() && AddedTiles[AddedIndex].Key < Tile.Key)
+		{
+			MergedTiles.Add(AddedTiles[AddedIndex++]);
+		}
+		MergedTiles.Add(Tile);
+	}
+	MergedTiles.Append(AddedTiles.GetData() + AddedIndex, AddedTiles.Num() - AddedIndex);
+
+	Tiles = MoveTemp(MergedTiles);
+	return LowestLOD;
+}
+
+bool FQuadtreeMeshBakedSelectionDecoder::SelectTiles(const FQuadtreeMeshBakedSelection& InBakedSelection, const FMeshQuadTree& InTree,
+	const FMeshQuadTree::FTraversalDesc& InTraversalDesc, FMeshQuadTree::FTraversalOutput& Output)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FQuadtreeMeshBakedSelectionDecoder::SelectTiles);
+	using namespace QuadtreeMeshBakedSelection;
+
+	FIntVector Cell;
+	if (!InBakedSelection.GetCell(InTraversalDesc.ObserverPosition, Cell))
+	{
+		return false;
+	}
+
+	const int32 NewCellIndex = InBakedSelection.GetCellIndex(Cell);
+	if (NewCellIndex != CellIndex)
+	{
+		// Moving forward along the same row only needs the deltas in between, otherwise start over from the row keyframe
+		const int32 RowStartIndex = NewCellIndex - Cell.X;
+		int32 FirstCellIndex = RowStartIndex;
+		if (CellIndex >= RowStartIndex && CellIndex < NewCellIndex)
+		{
+			FirstCellIndex = CellIndex + 1;
+		}
+		else
+		{
+			Tiles.Reset();
+		}
+
+		for (int32 Index = FirstCellIndex; Index <= NewCellIndex; ++Index)
+		{
+			CellLowestLOD = ApplyCellDelta(InBakedSelection.Data.GetData() + InBakedSelection.CellOffsets[Index]);
+		}
+		CellIndex = NewCellIndex;
+	}
+
+	// The selection of the cell center doesn't hold if the observer is at a height where another LOD is the lowest
+	if (CellLowestLOD != InTraversalDesc.LowestLOD)
+	{
+		return false;
+	}
+
+	// Tiles are culled against the height range of the whole tree, the baked tiles don't keep their own
+	const FBox TreeBounds = InTree.GetBounds();
+	const double CenterZ = TreeBounds.GetCenter().Z;
+	const double ExtentZ = TreeBounds.GetExtent().Z;
+
+	Output.SelectedTiles.Reset(Tiles.Num());
+	for (const FBakedTile& BakedTile : Tiles)
+	{
+		FVector2D Center, Size;
+		GetTileGeometry(InBakedSelection.TreeBounds, BakedTile.Key, Center, Size);
+
+		const FVector TileCenter(Center, CenterZ);
+		const FVector TileExtent(Size * 0.5, ExtentZ);
+		const bool bInFrustum = InTraversalDesc.Frustum.IntersectBox(TileCenter, TileExtent);
+		if (!bInFrustum && !InTraversalDesc.bGatherUnculledInstances)
+		{
+			continue;
+		}
+
+		// Same occlusion culling as the traversal, tiles fitting in a cell found occluded are skipped
+		if (FMeshQuadTree::IsInOccludedCell(InTraversalDesc, FBox(TileCenter - TileExtent, TileCenter + TileExtent)))
+		{
+			continue;
+		}
+
+		constexpr int32 MaterialIndex = 0;
+
+		const int32 DensityIndex = FMath::Clamp<int32>(BakedTile.DensityIndex, InTraversalDesc.MinDensityIndex, InTraversalDesc.DensityCount - 1);
+		const int32 BucketIndex = MaterialIndex * InTraversalDesc.DensityCount + DensityIndex;
+
+		if (bInFrustum)
+		{
+			++Output.BucketInstanceCounts[BucketIndex];
+			++Output.InstanceCount;
+		}
+
+		if (InTraversalDesc.bGatherUnculledInstances)
+		{
+			++Output.UnculledBucketInstanceCounts[BucketIndex];
+			++Output.UnculledInstanceCount;
+		}
+
+		FMeshQuadTree::FSelectedTile& Tile = Output.SelectedTiles[Output.SelectedTiles.AddUninitialized()];
+		Tile.Center = Center;
+		Tile.Size = FVector2f(Size);
+		Tile.BucketIndex = static_cast<uint16>(BucketIndex);
+		Tile.QuadtreeMeshIndex = BakedTile.QuadtreeMeshIndex;
+		Tile.LODLevel = BakedTile.LODLevel;
+		Tile.DensityIndex = static_cast<uint8>(DensityIndex);
+		Tile.bInFrustum = bInFrustum;
+	}
+
+	if (InTraversalDesc.bGatherUnculledInstances)
+	{
+		FMeshQuadTree::SortSelectedTilesByBucket(Output);
+	}
+
+	return true;
+}
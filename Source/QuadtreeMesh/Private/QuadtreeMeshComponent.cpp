@@ -8,7 +8,348 @@
 #include "MaterialDomain.h"
 #include "PSOPrecacheMaterial.h"
 #include "QuadtreeMeshActor.h"
+#include "QuadtreeMeshSubsystem.h"
 #include "Chaos/ImplicitObjectBVH.h"
+#include "QuadtreeMesh.h"
+#include "SceneManagement.h"
+#include "Net/UnrealNetwork.h"
+#include "Algo/Sort.h"
+#include "Misc/App.h"
+#include "Serialization/BitReader.h"
+#include "Serialization/BitWriter.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+
+#if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
+namespace QuadtreeMeshTraversalBenchmark
+{
+	struct FTraversalMode
+	{
+		const TCHAR* Name;
+		bool bBatchChildFrustumTests;
+		bool bWideTraversal;
+	};
+
+	/**
+	 *	Traverse the game thread copy of the tree from the views rendered last frame (or from above the mesh when there is none), once per traversal mode.
+	 *	Only the view locations are known, the views look down at the middle of the mesh. The 16-ary depth counts steps of two levels
+	 */
+	static void Run(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 NumIterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100;
+		if (World == nullptr)
+		{
+			return;
+		}
+
+		static const FTraversalMode TraversalModes[] =
+		{
+			{ TEXT("quadtree, single child tests"), false, false },
+			{ TEXT("quadtree, batched child tests"), true, false },
+			{ TEXT("16-ary"), true, true },
+		};
+
+		for (TObjectIterator<UQuadtreeMeshComponent> It; It; ++It)
+		{
+			const UQuadtreeMeshComponent* Component = *It;
+			if (Component->GetWorld() != World)
+			{
+				continue;
+			}
+
+			const FMeshQuadTree& MeshQuadTree = Component->GetMeshQuadTree();
+			if (MeshQuadTree.GetNodeCount() == 0)
+			{
+				continue;
+			}
+
+			const FBox TreeBounds = MeshQuadTree.GetBounds();
+			TArray<FVector, TInlineAllocator<4>> ViewLocations(World->ViewLocationsRenderedLastFrame);
+			if (ViewLocations.IsEmpty())
+			{
+				ViewLocations.Add(TreeBounds.GetCenter() + FVector(0.0f, 0.0f, MeshQuadTree.GetLeafSize() * 4.0f));
+			}
+
+			const int32 NumQuads = static_cast<int32>(FMath::Pow(2.0f, static_cast<float>(Component->GetTessellationFactor())));
+			const FMatrix ProjectionMatrix = FReversedZPerspectiveMatrix(FMath::DegreesToRadians(45.0f), 16.0f, 9.0f, 10.0f);
+
+			TArray<FMeshQuadTree::FTraversalDesc, TInlineAllocator<4>> TraversalDescs;
+			for (const FVector& ViewLocation : ViewLocations)
+			{
+				const FRotator ViewRotation(-30.0f, (TreeBounds.GetCenter() - ViewLocation).Rotation().Yaw, 0.0f);
+				const FMatrix ViewMatrix = FInverseRotationMatrix(ViewRotation) * FMatrix(FPlane(0, 0, 1, 0), FPlane(1, 0, 0, 0), FPlane(0, 1, 0, 0), FPlane(0, 0, 0, 1));
+
+				FMeshQuadTree::FTraversalDesc& TraversalDesc = TraversalDescs.AddDefaulted_GetRef();
+				TraversalDesc.LODCount = MeshQuadTree.GetTreeDepth();
+				TraversalDesc.DensityCount = FMath::Min(MeshQuadTree.GetTreeDepth(), static_cast<int32>(FMath::FloorLog2(NumQuads)));
+				TraversalDesc.LODScale = MeshQuadTree.GetLeafSize() * FMath::Max(Component->GetLODScale(), 0.5f);
+				TraversalDesc.ObserverPosition = ViewLocation;
+				TraversalDesc.PreViewTranslation = -ViewLocation;
+				GetViewFrustumBounds(TraversalDesc.Frustum, FTranslationMatrix(-ViewLocation) * ViewMatrix * ProjectionMatrix, false);
+				if (Component->ForceCollapseDensityLevel > -1)
+				{
+					TraversalDesc.ForceCollapseDensityLevel = Component->ForceCollapseDensityLevel;
+				}
+			}
+
+			for (const FTraversalMode& TraversalMode : TraversalModes)
+			{
+				for (FMeshQuadTree::FTraversalDesc& TraversalDesc : TraversalDescs)
+				{
+					TraversalDesc.bBatchChildFrustumTests = TraversalMode.bBatchChildFrustumTests;
+					TraversalDesc.bWideTraversal = TraversalMode.bWideTraversal;
+				}
+
+				// Totals over the views of the last iteration
+				FMeshQuadTree::FTraversalOutput::FTraversalStats Stats;
+				int32 NumTiles = 0;
+
+				const double StartTime = FPlatformTime::Seconds();
+				for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+				{
+					for (const FMeshQuadTree::FTraversalDesc& TraversalDesc : TraversalDescs)
+					{
+						FMeshQuadTree::FTraversalOutput Output;
+						Output.BucketInstanceCounts.AddZeroed(TraversalDesc.DensityCount);
+						MeshQuadTree.SelectQuadtreeMeshTiles(TraversalDesc, Output);
+
+						if (Iteration == NumIterations - 1)
+						{
+							NumTiles += Output.InstanceCount;
+							Stats.NodeVisits += Output.Stats.NodeVisits;
+							Stats.FrustumTests += Output.Stats.FrustumTests;
+							Stats.BatchedFrustumTests += Output.Stats.BatchedFrustumTests;
+							Stats.WideFrustumTests += Output.Stats.WideFrustumTests;
+							Stats.MaxDepth = FMath::Max(Stats.MaxDepth, Output.Stats.MaxDepth);
+						}
+					}
+				}
+				const double AverageMicroseconds = (FPlatformTime::Seconds() - StartTime) * 1e6 / NumIterations;
+
+				UE_LOG(LogQuadtreeMesh, Display, TEXT("%s (%s, %d views): depth %d, %d nodes, %d tiles, %d visits, %d frustum tests, %d batched tests, %d wide tests, %.2f us"),
+					*Component->GetPathName(), TraversalMode.Name, TraversalDescs.Num(), Stats.MaxDepth, MeshQuadTree.GetNodeCount(), NumTiles,
+					Stats.NodeVisits, Stats.FrustumTests, Stats.BatchedFrustumTests, Stats.WideFrustumTests, AverageMicroseconds);
+			}
+		}
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs Command(
+		TEXT("QuadtreeMesh.BenchmarkTraversal"),
+		TEXT("Time the tile selection of every quadtree mesh as a quadtree (with and without batched child frustum tests) and as a 16-ary tree, comparing depth, visits and time. Optional argument: number of iterations (default 100)."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&Run));
+}
+
+namespace QuadtreeMeshPagingStats
+{
+	static void Run(const TArray<FString>& Args, UWorld* World)
+	{
+		for (TObjectIterator<UQuadtreeMeshComponent> It; It; ++It)
+		{
+			const UQuadtreeMeshComponent* Component = *It;
+			if (Component->GetWorld() != World || !Component->GetMeshQuadTree().HasPagedSubtrees())
+			{
+				continue;
+			}
+
+			const FMeshQuadTree::FPagingStats Stats = Component->GetMeshQuadTree().GetPagingStats();
+			UE_LOG(LogQuadtreeMesh, Display, TEXT("%s: %d/%d pages resident (%.1f KB), %s pages (%.1f KB), %llu misses, %llu loads, load latency avg %.2f ms max %.2f ms"),
+				*Component->GetPathName(), Stats.NumResidentPages, Stats.NumPages, Stats.ResidentPageMemory / 1024.0, Stats.bCooked ? TEXT("cooked") : TEXT("compressed"),
+				Stats.CompressedPageMemory / 1024.0, Stats.NumMisses, Stats.NumLoads, Stats.AverageLoadLatencyMs, Stats.MaxLoadLatencyMs);
+		}
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs Command(
+		TEXT("QuadtreeMesh.PagingStats"),
+		TEXT("Log page residency, misses and load latency of every paged quadtree mesh."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&Run));
+}
+
+namespace QuadtreeMeshEditLoopback
+{
+	static void Run(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 NumEdits = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1000;
+		FRandomStream Random(0x51ED);
+
+		for (TObjectIterator<UQuadtreeMeshComponent> It; It; ++It)
+		{
+			const UQuadtreeMeshComponent* Component = *It;
+			const FMeshQuadTree& SourceTree = Component->GetMeshQuadTree();
+			const int32 TreeDepth = SourceTree.GetTreeDepth();
+			if (Component->GetWorld() != World || SourceTree.GetNodeCount() == 0 || SourceTree.GetQuadtreeMeshRenderDataCount() == 0 || TreeDepth > FQuadtreeMeshEditLog::MaxTreeDepth)
+			{
+				continue;
+			}
+
+			// Random boxes of up to an eighth of the tree, a few render data edits among them
+			const int32 MaxLeaf = (1 << TreeDepth) - 1;
+			TArray<FQuadtreeMeshEdit> Edits;
+			Edits.SetNum(NumEdits);
+			for (int32 EditIndex = 0; EditIndex < NumEdits; ++EditIndex)
+			{
+				FQuadtreeMeshEdit& Edit = Edits[EditIndex];
+				Edit.Revision = EditIndex + 1;
+				Edit.Slot = static_cast<uint8>(Random.RandRange(0, 3));
+				if (Edit.Slot > 1 && Random.FRand() < 0.1f)
+				{
+					Edit.bRenderData = true;
+					Edit.SurfaceHeightOffset = Random.FRandRange(-500.0f, 500.0f);
+					Edit.SurfaceColor = FColor::MakeRandomColor();
+					continue;
+				}
+
+				const FIntPoint Size(Random.RandRange(1, FMath::Max(MaxLeaf / 8, 1)), Random.RandRange(1, FMath::Max(MaxLeaf / 8, 1)));
+				const FIntPoint Min(Random.RandRange(0, MaxLeaf - Size.X + 1), Random.RandRange(0, MaxLeaf - Size.Y + 1));
+				FQuadtreeMeshEditLog::GetMortonRanges(Min, Min + Size - FIntPoint(1, 1), TreeDepth, Edit.Ranges);
+			}
+
+			// Round trip through the net serializer
+			int64 TotalBits = 0;
+			int32 NumMismatches = 0;
+			for (FQuadtreeMeshEdit& Edit : Edits)
+			{
+				bool bSuccess = true;
+				FBitWriter Writer(0, true);
+				Edit.NetSerialize(Writer, nullptr, bSuccess);
+				TotalBits += Writer.GetNumBits();
+
+				FBitReader Reader(Writer.GetData(), Writer.GetNumBits());
+				FQuadtreeMeshEdit Received;
+				Received.NetSerialize(Reader, nullptr, bSuccess);
+				NumMismatches += (!bSuccess || Reader.IsError() || !(Received == Edit)) ? 1 : 0;
+			}
+
+			// What a joining client receives instead of the whole log
+			FQuadtreeMeshEditBaseline Baseline;
+			for (const FQuadtreeMeshEdit& Edit : Edits)
+			{
+				Baseline.Apply(Edit);
+			}
+			int64 BaselineBits = 0;
+			{
+				bool bSuccess = true;
+				FBitWriter Writer(0, true);
+				Baseline.NetSerialize(Writer, nullptr, bSuccess);
+				BaselineBits = Writer.GetNumBits();
+
+				FBitReader Reader(Writer.GetData(), Writer.GetNumBits());
+				FQuadtreeMeshEditBaseline Received;
+				Received.NetSerialize(Reader, nullptr, bSuccess);
+				NumMismatches += (!bSuccess || Reader.IsError() || !(Received == Baseline)) ? 1 : 0;
+			}
+
+			// Full build of a tree like the component's from the baseline
+			const FBox2D TileRegion = SourceTree.GetTileRegion();
+			const FQuadtreeMeshRenderData& BaseRenderData = SourceTree.GetQuadtreeMeshRenderData(1);
+			const FBox TileBounds(FVector(TileRegion.Min, BaseRenderData.SurfaceBaseHeight), FVector(TileRegion.Max, BaseRenderData.SurfaceBaseHeight));
+			TArray<FQuadtreeMeshRenderData> SlotRenderData;
+			Baseline.GetSlotRenderData(BaseRenderData, SlotRenderData);
+
+			FMeshQuadTree Tree;
+			uint64 StartCycles = FPlatformTime::Cycles64();
+			Tree.InitTree(TileRegion, SourceTree.GetLeafSize(), false);
+			FQuadtreeMeshEditLog::AddEditedTiles(Tree, TileBounds, SlotRenderData, Baseline);
+			Tree.Unlock(true);
+			const double BuildMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+
+			// The same edits patched one at a time into the unedited tree, like a client receiving them. It starts with the final render data of every slot,
+			// render data edits don't touch the nodes
+			FMeshQuadTree PatchedTree;
+			PatchedTree.InitTree(TileRegion, SourceTree.GetLeafSize(), false);
+			FQuadtreeMeshEditLog::AddEditedTiles(PatchedTree, TileBounds, SlotRenderData, FQuadtreeMeshEditBaseline());
+			PatchedTree.Unlock(true);
+
+			FQuadtreeMeshEditBaseline Applied;
+
+			const FQuadtreeMeshEditCoverage Coverage(PatchedTree, TileBounds);
+			TArray<FMeshQuadTree::FLeafBlock> Blocks;
+			int32 NumPatchedNodes = 0;
+			StartCycles = FPlatformTime::Cycles64();
+			for (const FQuadtreeMeshEdit& Edit : Edits)
+			{
+				Applied.Apply(Edit);
+				if (Edit.bRenderData)
+				{
+					continue;
+				}
+
+				FQuadtreeMeshEditLog::GetLeafBlocks(Edit.Ranges, TreeDepth, Blocks);
+				FMeshQuadTree::FEditPatch Patch;
+				PatchedTree.RebuildLeafBlocks(Blocks, [&Coverage, &Applied](const FMeshQuadTree::FLeafBlock& InBlock)
+				{
+					return Coverage.GetBlockQuadtreeMeshIndex(Applied, InBlock);
+				}, 0.0, 0.0, Patch);
+				NumPatchedNodes += Patch.NodeIndices.Num();
+			}
+			const double PatchMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+
+			UE_LOG(LogQuadtreeMesh, Display, TEXT("%s: %d edits, %.1f bits per edit, baseline of %d runs in %lld bits, %d mismatches. Full build in %.2f ms (%d nodes), patched one edit at a time in %.2f ms (%.1f nodes sent per edit)"),
+				*Component->GetPathName(), NumEdits, static_cast<double>(TotalBits) / NumEdits, Baseline.Runs.Num(), BaselineBits, NumMismatches, BuildMs, Tree.GetNodeCount(),
+				PatchMs, static_cast<double>(NumPatchedNodes) / NumEdits);
+		}
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs Command(
+		TEXT("QuadtreeMesh.EditLoopback"),
+		TEXT("Serialize random runtime edits of every quadtree mesh through the net serializer, check they round trip and time applying them. Optional argument: number of edits (default 1000)."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&Run));
+}
+
+namespace QuadtreeMeshGPUSceneInstances
+{
+	static void Run(const TArray<FString>& Args, UWorld* World)
+	{
+		// Publishing never touches the RHI, this also runs with -nullrhi
+		for (TObjectIterator<UQuadtreeMeshComponent> It; It; ++It)
+		{
+			const UQuadtreeMeshComponent* Component = *It;
+			const FMeshQuadTree& MeshQuadTree = Component->GetMeshQuadTree();
+			if (Component->GetWorld() != World || MeshQuadTree.GetNodeCount() == 0)
+			{
+				continue;
+			}
+
+			FVector ObserverPosition = MeshQuadTree.GetBounds().GetCenter() + FVector(0.0f, 0.0f, MeshQuadTree.GetLeafSize() * 4.0f);
+			if (World && World->ViewLocationsRenderedLastFrame.Num() > 0)
+			{
+				ObserverPosition = World->ViewLocationsRenderedLastFrame[0];
+			}
+
+			FMeshQuadTree::FTraversalDesc TraversalDesc;
+			Component->GetDefaultTraversalDesc(TraversalDesc);
+			const FQuadtreeMeshSceneProxy::FQuadtreeMeshLODParams LODParams = FQuadtreeMeshSceneProxy::GetQuadtreeMeshLODParams(MeshQuadTree, TraversalDesc.LODScale, ObserverPosition);
+			TraversalDesc.LowestLOD = LODParams.LowestLOD;
+			TraversalDesc.HeightMorph = LODParams.HeightLODFactor;
+			TraversalDesc.ObserverPosition = ObserverPosition;
+
+			FQuadtreeMeshGPUSceneInstances Instances;
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+			Instances.Publish(MeshQuadTree, TraversalDesc, Component->GetComponentTransform(), Component->GetGPUSceneInstanceDisplacement(), 0.0);
+			const double PublishMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+
+			TStringBuilder<256> DensityCounts;
+			for (int32 DensityIndex = 0; DensityIndex < TraversalDesc.DensityCount; ++DensityIndex)
+			{
+				int32 Count = 0;
+				for (int32 BucketIndex = DensityIndex; BucketIndex + 1 < Instances.BucketFirstInstance.Num(); BucketIndex += TraversalDesc.DensityCount)
+				{
+					Count += Instances.GetBucketInstanceCount(BucketIndex);
+				}
+				DensityCounts.Appendf(TEXT("%s%d"), DensityIndex > 0 ? TEXT("/") : TEXT(""), Count);
+			}
+
+			UE_LOG(LogQuadtreeMesh, Display, TEXT("%s: %d instances (per density %s), %.1f KB, published in %.2f ms. Currently published: %d"),
+				*Component->GetPathName(), Instances.Num(), DensityCounts.ToString(), Instances.GetAllocatedSize() / 1024.0, PublishMs, Component->GetGPUSceneInstances().Num());
+		}
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs Command(
+		TEXT("QuadtreeMesh.GPUSceneInstances"),
+		TEXT("Publish the GPU Scene instances of every quadtree mesh around the last rendered view and log their counts, see UQuadtreeMeshComponent::bPublishGPUSceneInstances."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&Run));
+}
+#endif
 
 
 
@@ -41,12 +382,72 @@ UQuadtreeMeshComponent::UQuadtreeMeshComponent()
 void UQuadtreeMeshComponent::PostInitProperties()
 {
 	Super::PostInitProperties();
+	EditLog.Owner = this;
 	SetMaterial(0,MeshMaterial);
 	UpdateBounds();
 	MarkRenderTransformDirty();
 	Update();
 }
 
+void UQuadtreeMeshComponent::OnRegister()
+{
+	Super::OnRegister();
+
+	RequestGrids();
+
+	if (UQuadtreeMeshSubsystem* QuadtreeMeshSubsystem = UWorld::GetSubsystem<UQuadtreeMeshSubsystem>(GetWorld()))
+	{
+		QuadtreeMeshSubsystem->RegisterQuadtreeMeshComponent(this);
+	}
+}
+
+void UQuadtreeMeshComponent::RequestGrids()
+{
+	// Dedicated servers and commandlets never create the buffers
+	if (!FApp::CanEverRender())
+	{
+		return;
+	}
+
+	const int32 NumQuads = 1 << GetTessellationFactor();
+	if (Grids.Num() > 0 && Grids[0]->GetNumQuadsPerSide() == NumQuads)
+	{
+		return;
+	}
+
+	// Same densities as the proxy's vertex factories, halving down to 2 quads per side
+	Grids.Reset();
+	for (int32 NumQuadsPerSide = NumQuads; NumQuadsPerSide > 1; NumQuadsPerSide /= 2)
+	{
+		Grids.Add(FQuadtreeMeshGridCache::Get().Request(NumQuadsPerSide));
+	}
+}
+
+void UQuadtreeMeshComponent::OnUnregister()
+{
+	if (UQuadtreeMeshSubsystem* QuadtreeMeshSubsystem = UWorld::GetSubsystem<UQuadtreeMeshSubsystem>(GetWorld()))
+	{
+		QuadtreeMeshSubsystem->UnregisterQuadtreeMeshComponent(this);
+	}
+
+	Grids.Reset();
+
+	Super::OnUnregister();
+}
+
+void UQuadtreeMeshComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Only the runtime edits replicate, meshes that are never edited stay off the network
+	AActor* Owner = GetOwner();
+	if (bReplicateEdits && Owner && Owner->HasAuthority())
+	{
+		Owner->SetReplicates(true);
+		SetIsReplicated(true);
+	}
+}
+
 int32 UQuadtreeMeshComponent::GetNumMaterials() const
 {
 	return 1;
@@ -57,8 +458,12 @@ FPrimitiveSceneProxy* UQuadtreeMeshComponent::CreateSceneProxy()
 	if(RHISupportsManualVertexFetch(GMaxRHIShaderPlatform))
 	{
 		SceneProxy = new FQuadtreeMeshSceneProxy(this);
+
+		// The proxy's buffers hold the grids they need until they've uploaded them, keeping them here would keep their CPU copy alive next to the GPU one
+		Grids.Reset();
 		return SceneProxy;
 	}
+	Grids.Reset();
 	return nullptr;
 }
 
@@ -132,10 +537,287 @@ void UQuadtreeMeshComponent::Update()
 {
 	if(bNeedsRebuild)
 	{
-		RebuildQuadtreeMesh(TileSize,ExtentInTiles);
-		PrecachePSOs(); 
-		bNeedsRebuild = false;
+		RebuildQuadtreeMesh();
+	}
+}
+
+bool UQuadtreeMeshComponent::UpdateAutoConfiguration()
+{
+	if (!bAutoConfigure)
+	{
+		const bool bChanged = AutoConfiguration.IsValid();
+		AutoConfiguration = FQuadtreeMeshAutoConfiguration();
+		return bChanged;
+	}
+
+	const FVector Scale = GetComponentScale();
+	const FVector2D CoverageExtent = FVector2D(TileSize * FMath::Abs(Scale.X), TileSize * FMath::Abs(Scale.Y));
+	const FQuadtreeMeshAutoConfiguration NewConfiguration = FQuadtreeMeshAutoConfiguration::Compute(CoverageExtent, TargetVertexSpacing, VertexBudget);
+	if (NewConfiguration == AutoConfiguration)
+	{
+		return false;
+	}
+
+	AutoConfiguration = NewConfiguration;
+	if (AutoConfiguration.bOverBudget)
+	{
+		UE_LOG(LogQuadtreeMesh, Warning, TEXT("%s: a vertex spacing of %.0f doesn't fit in %d vertices per view, using %s"), *GetPathName(), TargetVertexSpacing, VertexBudget, *AutoConfiguration.ToString());
+	}
+	else
+	{
+		UE_LOG(LogQuadtreeMesh, Display, TEXT("%s: auto configured to %s"), *GetPathName(), *AutoConfiguration.ToString());
+	}
+	return true;
+}
+
+void UQuadtreeMeshComponent::PrepareRebuild()
+{
+	check(IsInGameThread());
+
+	// Picks the tessellation factor the grids are requested for
+	UpdateAutoConfiguration();
+
+	// The grids build on workers alongside the tree, the proxy recreated after the rebuild finds them ready
+	RequestGrids();
+
+	PendingBuild = FPendingBuild();
+	GatherBuildInputs(ShouldRender(), PendingBuild);
+	PendingBuild.PageDepth = PageDepth;
+	PendingBuild.MaxResidentPages = MaxResidentPages;
+
+	if (AActor* QuadtreeMeshOwner = PendingBuild.bShouldRender ? GetOwner() : nullptr)
+	{
+		PendingBuild.RenderData.HitProxy = new HActor(/*InActor = */QuadtreeMeshOwner, /*InPrimComponent = */nullptr);
+		PendingBuild.RenderData.bQuadtreeMeshSelected = QuadtreeMeshOwner->IsSelected();
+	}
+}
+
+void UQuadtreeMeshComponent::GatherBuildInputs(bool bInShouldRender, FPendingBuild& OutBuild) const
+{
+	const FVector Scale = GetComponentScale();
+	// Position snapped to the grid
+	//FVector2D GridPosition = FVector2D(FMath::GridSnap<FVector::FReal>(GetComponentLocation().X, InTileSize), FMath::GridSnap<FVector::FReal>(GetComponentLocation().Y, InTileSize))+FVector2D(GetComponentLocation().X,GetComponentLocation().Y);
+	const FVector2D GridPosition = FVector2D(GetComponentLocation().X,GetComponentLocation().Y);
+	
+	// The tree only spans the inserted tiles, padding it out would only reserve nodes for empty space. The depth comes from subdividing this into leaves, see GetLeafSize
+	const FVector2D CoverageExtent = FVector2D(TileSize * FMath::Abs(Scale.X), TileSize * FMath::Abs(Scale.Y));
+
+	OutBuild.MeshWorldBox = FBox2D(-CoverageExtent + GridPosition, CoverageExtent + GridPosition);
+	OutBuild.TileSize = GetLeafSize();
+	if (bAutoConfigure && !AutoConfiguration.IsValid())
+	{
+		// Only updated by PrepareRebuild, not yet when the tree was never built
+		OutBuild.TileSize = FQuadtreeMeshAutoConfiguration::Compute(CoverageExtent, TargetVertexSpacing, VertexBudget).LeafSize;
+	}
+	OutBuild.bShouldRender = bInShouldRender;
+	if (!OutBuild.bShouldRender)
+	{
+		return;
+	}
+
+	FQuadtreeMeshRenderData& RenderData = OutBuild.RenderData;
+	RenderData.Material = MeshMaterial;
+	RenderData.SurfaceBaseHeight = GetComponentLocation().Z;
+	RenderData.SurfaceColor = SurfaceColor;
+	RenderData.WaveParameters = FVector4f(WaveParameters);
+
+	// Shrunk by a quarter tile like FMeshQuadTree::AddQuadtreeMesh, tile insertion is inclusive and the box edges lie on the leaf grid
+	const FVector2D LeafSizeShrink(OutBuild.TileSize * 0.25, OutBuild.TileSize * 0.25);
+	// Z spans what the material can do to the surface, the culling and the component bounds rely on it
+	OutBuild.TileBounds = FBox(
+		FVector(OutBuild.MeshWorldBox.Min + LeafSizeShrink, RenderData.SurfaceBaseHeight - MaxSurfaceDisplacement),
+		FVector(FVector2D::Max(OutBuild.MeshWorldBox.Max - LeafSizeShrink, OutBuild.MeshWorldBox.Min + LeafSizeShrink), RenderData.SurfaceBaseHeight + MaxSurfaceDisplacement));
+
+	if (AppliedEdits.HasEdits())
+	{
+		OutBuild.Edits = AppliedEdits;
+		AppliedEdits.GetSlotRenderData(RenderData, OutBuild.SlotRenderData);
+	}
+}
+
+void UQuadtreeMeshComponent::BuildTree(const FPendingBuild& InBuild, FMeshQuadTree& OutTree)
+{
+	// Paged trees are built subtree by subtree, the full node array is never allocated
+	const bool bPaged = InBuild.bShouldRender && InBuild.PageDepth > 0;
+	OutTree.InitTree(InBuild.MeshWorldBox, InBuild.TileSize, false, !bPaged);
+
+	if (bPaged)
+	{
+		// Render data index is the slot, like FQuadtreeMeshEditLog::AddEditedTiles(..)
+		OutTree.AddQuadtreeMeshRenderData(InBuild.RenderData);
+		for (int32 Slot = 2; Slot < InBuild.SlotRenderData.Num(); ++Slot)
+		{
+			OutTree.AddQuadtreeMeshRenderData(InBuild.SlotRenderData[Slot]);
+		}
+
+		const FQuadtreeMeshEditCoverage Coverage(OutTree, InBuild.TileBounds);
+		const double BaseHeight = InBuild.RenderData.SurfaceBaseHeight;
+		OutTree.BuildPagedTree(InBuild.PageDepth, InBuild.MaxResidentPages, [&Coverage, &InBuild](const FMeshQuadTree::FLeafBlock& InBlock)
+		{
+			return Coverage.GetBlockQuadtreeMeshIndex(InBuild.Edits, InBlock);
+		}, InBuild.TileBounds.Min.Z - BaseHeight, InBuild.TileBounds.Max.Z - BaseHeight);
+		return;
+	}
+
+	if (InBuild.bShouldRender && InBuild.Edits.HasEdits())
+	{
+		FQuadtreeMeshEditLog::AddEditedTiles(OutTree, InBuild.TileBounds, InBuild.SlotRenderData, InBuild.Edits);
+	}
+	else if (InBuild.bShouldRender)
+	{
+		const uint32 QuadtreeMeshRenderDataIndex = OutTree.AddQuadtreeMeshRenderData(InBuild.RenderData);
+		OutTree.AddQuadtreeMeshTilesInsideBounds(InBuild.TileBounds, QuadtreeMeshRenderDataIndex);
+	}
+
+	// Without render data this leaves an empty but locked tree so it can still be queried
+	OutTree.Unlock(true);
+}
+
+void UQuadtreeMeshComponent::BuildDetachedQuadTree(FMeshQuadTree& OutTree) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(BuildDetachedQuadTree);
+
+	// Built as if rendered, the coverage doesn't depend on the world this runs in
+	FPendingBuild Build;
+	GatherBuildInputs(true, Build);
+	BuildTree(Build, OutTree);
+}
+
+void UQuadtreeMeshComponent::BuildQuadtreeMesh()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(BuildQuadtreeMesh);
+
+	if (!LoadCookedPages())
+	{
+		BuildTree(PendingBuild, MeshQuadTree);
+	}
+}
+
+uint32 UQuadtreeMeshComponent::GetCookedPagesKey(const FPendingBuild& InBuild)
+{
+	const double Inputs[] =
+	{
+		InBuild.MeshWorldBox.Min.X, InBuild.MeshWorldBox.Min.Y, InBuild.MeshWorldBox.Max.X, InBuild.MeshWorldBox.Max.Y,
+		InBuild.TileBounds.Min.X, InBuild.TileBounds.Min.Y, InBuild.TileBounds.Min.Z, InBuild.TileBounds.Max.X, InBuild.TileBounds.Max.Y, InBuild.TileBounds.Max.Z,
+		InBuild.TileSize, static_cast<double>(InBuild.PageDepth), InBuild.RenderData.Material ? 1.0 : 0.0
+	};
+	// 0 stands for no cooked pages
+	return FMath::Max(FCrc::MemCrc32(Inputs, sizeof(Inputs)), 1u);
+}
+
+bool UQuadtreeMeshComponent::LoadCookedPages()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(LoadCookedPages);
+
+	// Edits change the nodes, their trees are built
+	if (CookedPages.Key == 0 || !PendingBuild.bShouldRender || PendingBuild.PageDepth <= 0 || PendingBuild.Edits.HasEdits()
+		|| CookedPages.Key != GetCookedPagesKey(PendingBuild))
+	{
+		return false;
+	}
+
+	MeshQuadTree.InitTree(PendingBuild.MeshWorldBox, PendingBuild.TileSize, false, false);
+	MeshQuadTree.AddQuadtreeMeshRenderData(PendingBuild.RenderData);
+
+	FMemoryReader Reader(CookedPages.Header);
+	if (!MeshQuadTree.LoadPages(Reader, CookedPages.BulkData, PendingBuild.MaxResidentPages))
+	{
+		UE_LOG(LogQuadtreeMesh, Warning, TEXT("%s: the cooked quadtree mesh pages don't match the tree, it's built at runtime"), *GetPathName());
+		return false;
+	}
+	return true;
+}
+
+void UQuadtreeMeshComponent::Serialize(FArchive& Ar)
+{
+	Super::Serialize(Ar);
+
+	// Only cooked packages carry the pages, the editor builds them when it needs them
+	if (Ar.IsPersistent() && Ar.IsFilterEditorOnly())
+	{
+#if WITH_EDITOR
+		if (Ar.IsCooking() && Ar.IsSaving())
+		{
+			CookPages();
+		}
+#endif
+		if (!CookedPages.BulkData)
+		{
+			CookedPages.BulkData = MakeShared<FByteBulkData, ESPMode::ThreadSafe>();
+		}
+
+		Ar << CookedPages.Key;
+		Ar << CookedPages.Header;
+		CookedPages.BulkData->Serialize(Ar, this);
+	}
+}
+
+#if WITH_EDITOR
+void UQuadtreeMeshComponent::CookPages()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(CookQuadtreeMeshPages);
+
+	CookedPages = FCookedPages();
+	CookedPages.BulkData = MakeShared<FByteBulkData, ESPMode::ThreadSafe>();
+	if (PageDepth <= 0)
+	{
+		return;
+	}
+
+	// The mesh as placed, edits only exist at runtime
+	FPendingBuild Build;
+	GatherBuildInputs(true, Build);
+	Build.Edits = FQuadtreeMeshEditBaseline();
+	Build.SlotRenderData.Reset();
+	Build.PageDepth = PageDepth;
+	Build.MaxResidentPages = MaxResidentPages;
+
+	FMeshQuadTree Tree;
+	BuildTree(Build, Tree);
+	if (!Tree.HasPagedSubtrees())
+	{
+		return;
+	}
+
+	TArray64<uint8> PageData;
+	FMemoryWriter Writer(CookedPages.Header);
+	Tree.SavePages(Writer, PageData);
+
+	// Kept out of the export so each page can be read on its own
+	CookedPages.BulkData->SetBulkDataFlags(BULKDATA_Force_NOT_InlinePayload);
+	CookedPages.BulkData->Lock(LOCK_READ_WRITE);
+	FMemory::Memcpy(CookedPages.BulkData->Realloc(PageData.Num()), PageData.GetData(), PageData.Num());
+	CookedPages.BulkData->Unlock();
+
+	CookedPages.Key = GetCookedPagesKey(Build);
+}
+#endif
+
+void UQuadtreeMeshComponent::FinishRebuild()
+{
+	check(IsInGameThread());
+
+	++TreeRevision;
+	if (UQuadtreeMeshSubsystem* QuadtreeMeshSubsystem = UWorld::GetSubsystem<UQuadtreeMeshSubsystem>(GetWorld()))
+	{
+		QuadtreeMeshSubsystem->NotifyCoverageChanged();
+	}
+
+	if (PendingBuild.bShouldRender)
+	{
+		MarkRenderStateDirty();
 	}
+	PrecachePSOs();
+
+	// Published from the previous tree, the subsystem republishes from the new one
+	GPUSceneInstances.Reset();
+
+	// Received edits are patched against it
+	BuiltTileBounds = PendingBuild.TileBounds;
+
+	// The tree holds its own copy, don't keep the hit proxy alive
+	PendingBuild = FPendingBuild();
+	bNeedsRebuild = false;
 }
 
 
@@ -147,7 +829,7 @@ FVector UQuadtreeMeshComponent::GetDynamicQuadtreeMeshExtent() const
 void UQuadtreeMeshComponent::SetExtentInTiles()
 {
 	const FVector2D QuadtreeMeshExtent = FVector2D(TileSize);
-	const float QuadtreeMeshTileSize = TileSize/FMath::Max(2.0,FMath::Pow(2,static_cast<float>(LODLayer)));
+	const float QuadtreeMeshTileSize = GetLeafSize();
 
 	int32 NewExtentInTilesX = FMath::FloorToInt(QuadtreeMeshExtent.X / QuadtreeMeshTileSize);
 	int32 NewExtentInTilesY = FMath::FloorToInt(QuadtreeMeshExtent.Y / QuadtreeMeshTileSize);
@@ -181,6 +863,18 @@ void UQuadtreeMeshComponent::SetMeshMaterial(UMaterialInterface* NewMaterial)
 	SetMaterial(0,MeshMaterial);
 }
 
+void UQuadtreeMeshComponent::SetSurfaceParameters(FLinearColor NewSurfaceColor, FVector4 NewWaveParameters)
+{
+	if (SurfaceColor == NewSurfaceColor && WaveParameters == NewWaveParameters)
+	{
+		return;
+	}
+
+	SurfaceColor = NewSurfaceColor;
+	WaveParameters = NewWaveParameters;
+	MarkQuadtreeMeshGridDirty();
+}
+
 FMaterialRelevance UQuadtreeMeshComponent::GetQuadtreeMeshMaterialRelevance(ERHIFeatureLevel::Type InFeatureLevel) const
 {
 	FMaterialRelevance Result;
@@ -193,6 +887,13 @@ FMaterialRelevance UQuadtreeMeshComponent::GetQuadtreeMeshMaterialRelevance(ERHI
 
 FBoxSphereBounds UQuadtreeMeshComponent::CalcBounds(const FTransform& LocalToWorld) const
 {
+	// Only the covered tiles, the root also spans the empty part of the tree
+	const FBox CoveredBounds = MeshQuadTree.GetCoveredBounds();
+	if (CoveredBounds.IsValid)
+	{
+		return CoveredBounds.ExpandBy(AppliedOceanPadding);
+	}
+
 	// Always return valid bounds (tree is initialized with invalid bounds and if nothing is inserted, the tree bounds will stay invalid)
 	FBox NewBounds = MeshQuadTree.GetBounds();
 
@@ -205,52 +906,14 @@ FBoxSphereBounds UQuadtreeMeshComponent::CalcBounds(const FTransform& LocalToWor
 	return NewBounds;
 }
 
-void UQuadtreeMeshComponent::RebuildQuadtreeMesh(float InTileSize, const FIntPoint& InExtentInTiles)
+void UQuadtreeMeshComponent::RebuildQuadtreeMesh()
 {
 	TRACE_CPUPROFILER_EVENT_SCOPE(RebuildQuadtreeMesh);
-	FVector Scale = GetComponentScale();
-	// Position snapped to the grid
-	//FVector2D GridPosition = FVector2D(FMath::GridSnap<FVector::FReal>(GetComponentLocation().X, InTileSize), FMath::GridSnap<FVector::FReal>(GetComponentLocation().Y, InTileSize))+FVector2D(GetComponentLocation().X,GetComponentLocation().Y);
-	FVector2D GridPosition = FVector2D(GetComponentLocation().X,GetComponentLocation().Y);
-	
-	const FVector2D WorldExtent = FVector2D(InTileSize * InExtentInTiles.X, InTileSize * InExtentInTiles.Y);
 
-	const FBox2D MeshWorldBox = FBox2D(-WorldExtent + GridPosition, WorldExtent + GridPosition);
-	MeshQuadTree.InitTree(MeshWorldBox,InTileSize, InExtentInTiles,false);
-
-	
-	FVector ComponentLocation = GetComponentLocation();
-	const float QuadtreeMeshHeight = ComponentLocation.Z;
-	
-	FQuadtreeMeshRenderData RenderData;
-	if(!ShouldRender())
-	{
-		return;
-	}
-	
-	
-	RenderData.Material = MeshMaterial;
-	RenderData.SurfaceBaseHeight = QuadtreeMeshHeight;
-	
-	if(AActor* QuadtreeMeshOwner = GetOwner())
-	{
-		RenderData.HitProxy = new HActor(/*InActor = */QuadtreeMeshOwner, /*InPrimComponent = */nullptr);
-		RenderData.bQuadtreeMeshSelected = QuadtreeMeshOwner->IsSelected();
-	}
-	
-	
-	const uint32 QuadtreeMeshRenderDataIndex = MeshQuadTree.AddQuadtreeMeshRenderData(RenderData);
-	FBox Bound;
-	Bound.Max = FVector(InTileSize*Scale.X+GridPosition.X,InTileSize*Scale.Y+GridPosition.Y,0.0f);
-	Bound.Min = FVector(-InTileSize*Scale.X+GridPosition.X,-InTileSize*Scale.Y+GridPosition.Y,0.0f);
-	
-	
-	const FBox MeshBounds = Bound;
-	MeshQuadTree.AddQuadtreeMeshTilesInsideBounds(MeshBounds, QuadtreeMeshRenderDataIndex);
-	MeshQuadTree.Unlock(true);
-	
-	MarkRenderStateDirty();
-}
+	PrepareRebuild();
+	BuildQuadtreeMesh();
+	FinishRebuild();
+}
 
 bool UQuadtreeMeshComponent::UpdateQuadtreeMeshInfoTexture()
 {
@@ -273,8 +936,19 @@ void UQuadtreeMeshComponent::PostEditChangeProperty(FPropertyChangedEvent& Prope
 	
 	if (PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, ForceCollapseDensityLevel)
 		|| PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, TessellationFactor)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, SurfaceColor)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, WaveParameters)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, PageDepth)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, MaxResidentPages)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, MaxSurfaceDisplacement)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, SubprimitiveOcclusionDepth)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, bAutoConfigure)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, TargetVertexSpacing)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, VertexBudget)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UQuadtreeMeshComponent, bEnableOcean)
 		)
 	{
+		UpdateAutoConfiguration();
 		MarkQuadtreeMeshGridDirty();
 		MarkRenderStateDirty();
 	}
@@ -310,8 +984,197 @@ void UQuadtreeMeshComponent::PostEditChangeProperty(FPropertyChangedEvent& Prope
 	Super::PostEditChangeProperty(PropertyChangedEvent);
 }
 
+void UQuadtreeMeshComponent::BakeLODSelection()
+{
+	if (NeedsRebuild())
+	{
+		RebuildQuadtreeMesh();
+	}
+
+	FMeshQuadTree::FTraversalDesc TraversalDesc;
+	GetDefaultTraversalDesc(TraversalDesc);
+
+	Modify();
+	BakedSelection.Bake(MeshQuadTree, TraversalDesc, BakeVolume, BakeCellSize, [this](const FVector& InObserverPosition, FMeshQuadTree::FTraversalDesc& InOutTraversalDesc)
+	{
+		const FQuadtreeMeshSceneProxy::FQuadtreeMeshLODParams LODParams = FQuadtreeMeshSceneProxy::GetQuadtreeMeshLODParams(MeshQuadTree, InOutTraversalDesc.LODScale, InObserverPosition);
+		InOutTraversalDesc.LowestLOD = LODParams.LowestLOD;
+		InOutTraversalDesc.HeightMorph = LODParams.HeightLODFactor;
+	});
+	MarkRenderStateDirty();
+}
+
+void UQuadtreeMeshComponent::ClearBakedLODSelection()
+{
+	Modify();
+	BakedSelection.Reset();
+	MarkRenderStateDirty();
+}
+
 #endif
 
+void UQuadtreeMeshComponent::GetDefaultTraversalDesc(FMeshQuadTree::FTraversalDesc& OutTraversalDesc) const
+{
+	// Same settings as the proxy at the default scalability, see FQuadtreeMeshSceneProxy
+	const int32 NumQuads = 1 << GetTessellationFactor();
+
+	OutTraversalDesc.LODCount = MeshQuadTree.GetTreeDepth();
+	OutTraversalDesc.DensityCount = FMath::Min(MeshQuadTree.GetTreeDepth(), static_cast<int32>(FMath::FloorLog2(NumQuads)));
+	OutTraversalDesc.LODScale = MeshQuadTree.GetLeafSize() * FMath::Max(GetLODScale(), 0.5f);
+	if (ForceCollapseDensityLevel > -1)
+	{
+		OutTraversalDesc.ForceCollapseDensityLevel = ForceCollapseDensityLevel;
+	}
+	OutTraversalDesc.TessellatedQuadtreeMeshBounds = TessellatedRegion;
+	OutTraversalDesc.BoundsPadding = AppliedOceanPadding;
+}
+
+void UQuadtreeMeshComponent::UpdateGPUSceneInstances(TConstArrayView<FVector> InViewLocations)
+{
+	check(IsInGameThread());
+
+	if (!bPublishGPUSceneInstances || NeedsRebuild() || MeshQuadTree.GetNodeCount() == 0)
+	{
+		if (GPUSceneInstances.bIsValid)
+		{
+			GPUSceneInstances.Reset();
+			PushGPUSceneInstancesToProxy();
+		}
+		return;
+	}
+
+	// Nothing was rendered (dedicated server, minimized window), keep what was published
+	if (InViewLocations.IsEmpty())
+	{
+		return;
+	}
+
+	// Keep the selection while any view still uses it, so views far apart don't take turns republishing
+	for (const FVector& ViewLocation : InViewLocations)
+	{
+		if (GPUSceneInstances.IsValidFor(ViewLocation))
+		{
+			return;
+		}
+	}
+
+	const FVector ObserverPosition = InViewLocations[0];
+	FMeshQuadTree::FTraversalDesc TraversalDesc;
+	GetDefaultTraversalDesc(TraversalDesc);
+	const FQuadtreeMeshSceneProxy::FQuadtreeMeshLODParams LODParams = FQuadtreeMeshSceneProxy::GetQuadtreeMeshLODParams(MeshQuadTree, TraversalDesc.LODScale, ObserverPosition);
+	TraversalDesc.LowestLOD = LODParams.LowestLOD;
+	TraversalDesc.HeightMorph = LODParams.HeightLODFactor;
+	TraversalDesc.ObserverPosition = ObserverPosition;
+
+	// Within half a LOD 0 tile the selection barely changes, the shader morphs from the actual view position
+	const double ObserverTolerance = MeshQuadTree.GetLeafSize() * FMath::Max(GetLODScale(), 0.5f) * 0.5;
+	GPUSceneInstances.Publish(MeshQuadTree, TraversalDesc, GetComponentTransform(), GetGPUSceneInstanceDisplacement(), ObserverTolerance);
+	PushGPUSceneInstancesToProxy();
+}
+
+FVector UQuadtreeMeshComponent::GetGPUSceneInstanceDisplacement() const
+{
+	return FVector(AppliedOceanPadding.X, AppliedOceanPadding.Y, GetMaxSurfaceDisplacement());
+}
+
+void UQuadtreeMeshComponent::PushGPUSceneInstancesToProxy()
+{
+	FQuadtreeMeshSceneProxy* QuadtreeMeshSceneProxy = static_cast<FQuadtreeMeshSceneProxy*>(SceneProxy);
+	if (QuadtreeMeshSceneProxy == nullptr)
+	{
+		// Picked up when the proxy is created
+		return;
+	}
+
+	// The instance data buffer of a primitive is fixed at creation, only a proxy made with it can take instances
+	if (!QuadtreeMeshSceneProxy->SupportsGPUSceneInstances())
+	{
+		MarkRenderStateDirty();
+		return;
+	}
+
+	QuadtreeMeshSceneProxy->UpdateGPUSceneInstances_GameThread(GPUSceneInstances);
+	GetScene()->UpdatePrimitiveInstances(this);
+}
+
+void UQuadtreeMeshComponent::UpdateOceanSimulation(double InWorldTime)
+{
+	check(IsInGameThread());
+
+	if (!bEnableOcean)
+	{
+		if (OceanSimulation.IsValid())
+		{
+			OceanSimulation.Reset();
+			SetOceanBoundsPadding(FVector::ZeroVector);
+			MarkRenderStateDirty();
+		}
+		return;
+	}
+
+	if (!OceanSimulation.IsValid() || OceanSimulation->GetSettings() != OceanSettings)
+	{
+		// The proxy keeps the previous texture alive until it is recreated
+		OceanSimulation = MakeUnique<FQuadtreeMeshOceanSimulation>(OceanSettings);
+		SetOceanBoundsPadding(FVector::ZeroVector);
+		MarkRenderStateDirty();
+	}
+
+	OceanSimulation->Tick(InWorldTime);
+
+	// Crests higher or further out than the padding would be culled, leave some room so the rare bigger waves don't update it every time
+	const float MaxHorizontalAmplitude = OceanSimulation->GetMaxHorizontalAmplitude();
+	const float MaxAmplitude = OceanSimulation->GetMaxAmplitude();
+	if (MaxHorizontalAmplitude > AppliedOceanPadding.X || MaxAmplitude > AppliedOceanPadding.Z)
+	{
+		SetOceanBoundsPadding(FVector(MaxHorizontalAmplitude, MaxHorizontalAmplitude, MaxAmplitude) * 1.25f);
+	}
+}
+
+void UQuadtreeMeshComponent::SetOceanBoundsPadding(const FVector& InPadding)
+{
+	if (InPadding == AppliedOceanPadding)
+	{
+		return;
+	}
+
+	AppliedOceanPadding = InPadding;
+
+	// Moves the primitive bounds in the scene without recreating the proxy
+	UpdateBounds();
+	MarkRenderTransformDirty();
+	if (SceneProxy)
+	{
+		static_cast<FQuadtreeMeshSceneProxy*>(SceneProxy)->OnBoundsPaddingChanged_GameThread(AppliedOceanPadding);
+	}
+
+	// The instance bounds are padded too, the next update republishes them
+	GPUSceneInstances.Reset();
+}
+
+bool UQuadtreeMeshComponent::GetOceanSurfaceHeight(FVector Location, float& OutHeight) const
+{
+	const FVector2D LocationXY(Location);
+	float BaseHeight = 0.0f;
+	bool bCovered = false;
+	MeshQuadTree.QueryBaseHeightsAtLocations(MakeArrayView(&LocationXY, 1), MakeArrayView(&BaseHeight, 1), MakeArrayView(&bCovered, 1));
+
+	OutHeight = BaseHeight;
+	if (!bCovered)
+	{
+		return false;
+	}
+
+	if (OceanSimulation.IsValid())
+	{
+		if (const TSharedPtr<const FQuadtreeMeshOceanField, ESPMode::ThreadSafe> Field = OceanSimulation->GetField())
+		{
+			OutHeight += Field->SampleHeight(LocationXY);
+		}
+	}
+	return true;
+}
+
 void UQuadtreeMeshComponent::PushTessellatedQuadtreeMeshBoundsToPoxy(const FBox2D& TessellatedWaterMeshBounds)const
 {
 	if (SceneProxy)
@@ -320,6 +1183,308 @@ void UQuadtreeMeshComponent::PushTessellatedQuadtreeMeshBoundsToPoxy(const FBox2
 	}
 }
 
+void UQuadtreeMeshComponent::SetTessellatedRegion(FVector Center, FVector2D HalfExtent)
+{
+	const FVector2D Center2D(Center);
+	const FBox2D NewTessellatedRegion(Center2D - HalfExtent.GetAbs(), Center2D + HalfExtent.GetAbs());
+	if (NewTessellatedRegion == TessellatedRegion)
+	{
+		return;
+	}
+
+	TessellatedRegion = NewTessellatedRegion;
+	PushTessellatedQuadtreeMeshBoundsToPoxy(TessellatedRegion);
+}
+
+void UQuadtreeMeshComponent::SetClipCircle(FVector Center, float Radius)
+{
+	const FVector NewClipCircle(Center.X, Center.Y, Radius < 0.0f ? -1.0 : static_cast<double>(Radius));
+	if (NewClipCircle == ClipCircle)
+	{
+		return;
+	}
+
+	ClipCircle = NewClipCircle;
+	if (SceneProxy)
+	{
+		static_cast<FQuadtreeMeshSceneProxy*>(SceneProxy)->OnClipCircleChanged_GameThread(ClipCircle);
+	}
+}
+
+void UQuadtreeMeshComponent::ClearClipCircle()
+{
+	SetClipCircle(FVector::ZeroVector, -1.0f);
+}
+
+void UQuadtreeMeshComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(UQuadtreeMeshComponent, EditLog);
+	DOREPLIFETIME(UQuadtreeMeshComponent, EditBaseline);
+}
+
+void UQuadtreeMeshComponent::EditCoverage(FVector Center, FVector2D HalfExtent, int32 RenderDataSlot)
+{
+	if (RenderDataSlot < 0 || RenderDataSlot >= FQuadtreeMeshEditLog::MaxSlots)
+	{
+		UE_LOG(LogQuadtreeMesh, Warning, TEXT("Quadtree mesh edit slot %d is out of range [0, %d)"), RenderDataSlot, FQuadtreeMeshEditLog::MaxSlots);
+		return;
+	}
+
+	// Edits are expressed on the leaf grid of the tree
+	if (NeedsRebuild())
+	{
+		RebuildQuadtreeMesh();
+	}
+
+	const int32 TreeDepth = MeshQuadTree.GetTreeDepth();
+	if (MeshQuadTree.GetNodeCount() == 0 || TreeDepth > FQuadtreeMeshEditLog::MaxTreeDepth)
+	{
+		UE_LOG(LogQuadtreeMesh, Warning, TEXT("%s can't be edited, its tree is empty or deeper than %d levels"), *GetPathName(), FQuadtreeMeshEditLog::MaxTreeDepth);
+		return;
+	}
+
+	// Leaves whose center is in the box
+	const FVector2D RootMin(MeshQuadTree.GetBounds().Min);
+	const FVector2D BoxMin = (FVector2D(Center) - HalfExtent.GetAbs() - RootMin) / MeshQuadTree.GetLeafSize() - FVector2D(0.5);
+	const FVector2D BoxMax = (FVector2D(Center) + HalfExtent.GetAbs() - RootMin) / MeshQuadTree.GetLeafSize() - FVector2D(0.5);
+	const int32 MaxLeaf = (1 << TreeDepth) - 1;
+	const FIntPoint LeafMin(FMath::Max(FMath::CeilToInt(BoxMin.X), 0), FMath::Max(FMath::CeilToInt(BoxMin.Y), 0));
+	const FIntPoint LeafMax(FMath::Min(FMath::FloorToInt(BoxMax.X), MaxLeaf), FMath::Min(FMath::FloorToInt(BoxMax.Y), MaxLeaf));
+	if (LeafMin.X > LeafMax.X || LeafMin.Y > LeafMax.Y)
+	{
+		return;
+	}
+
+	FQuadtreeMeshEdit& Edit = EditLog.AddEdit();
+	Edit.Slot = static_cast<uint8>(RenderDataSlot);
+	FQuadtreeMeshEditLog::GetMortonRanges(LeafMin, LeafMax, TreeDepth, Edit.Ranges);
+	EditLog.MarkItemDirty(Edit);
+
+	OnEditsChanged();
+	FoldLoggedEdits();
+}
+
+void UQuadtreeMeshComponent::SetEditRenderData(int32 RenderDataSlot, float SurfaceHeightOffset, FLinearColor EditSurfaceColor)
+{
+	if (RenderDataSlot <= 1 || RenderDataSlot >= FQuadtreeMeshEditLog::MaxSlots)
+	{
+		UE_LOG(LogQuadtreeMesh, Warning, TEXT("Quadtree mesh edit render data slot %d is out of range [2, %d)"), RenderDataSlot, FQuadtreeMeshEditLog::MaxSlots);
+		return;
+	}
+
+	FQuadtreeMeshEdit& Edit = EditLog.AddEdit();
+	Edit.Slot = static_cast<uint8>(RenderDataSlot);
+	Edit.bRenderData = true;
+	Edit.SurfaceHeightOffset = SurfaceHeightOffset;
+	Edit.SurfaceColor = EditSurfaceColor.ToFColor(true);
+	EditLog.MarkItemDirty(Edit);
+
+	OnEditsChanged();
+	FoldLoggedEdits();
+}
+
+void UQuadtreeMeshComponent::ClearEdits()
+{
+	if (EditLog.Edits.Num() == 0 && !EditBaseline.HasEdits())
+	{
+		return;
+	}
+
+	EditLog.Edits.Reset();
+	EditLog.MarkArrayDirty();
+
+	// Newer than every edit, replaces whatever the clients applied
+	EditBaseline.Reset(++EditLog.LastRevision);
+
+	OnEditsChanged();
+}
+
+void UQuadtreeMeshComponent::OnRep_EditBaseline()
+{
+	OnEditsChanged();
+}
+
+void UQuadtreeMeshComponent::OnEditsChanged()
+{
+	if (AActor* Owner = GetOwner(); Owner && Owner->HasAuthority())
+	{
+		Owner->FlushNetDormancy();
+	}
+
+	// A newer baseline (log overflow on the server, cleared edits) replaces what was applied
+	bool bNeedsFullRebuild = false;
+	if (EditBaseline.Revision > AppliedEdits.Revision)
+	{
+		AppliedEdits = EditBaseline;
+		bNeedsFullRebuild = true;
+	}
+
+	// Logged edits apply in revision order, a gap waits for the baseline or the missing edits
+	TArray<const FQuadtreeMeshEdit*> NewEdits;
+	for (const FQuadtreeMeshEdit& Edit : EditLog.Edits)
+	{
+		if (Edit.Revision > AppliedEdits.Revision)
+		{
+			NewEdits.Add(&Edit);
+		}
+	}
+	Algo::SortBy(NewEdits, &FQuadtreeMeshEdit::Revision);
+
+	TArray<FQuadtreeMeshMortonRange> ChangedRanges;
+	for (const FQuadtreeMeshEdit* Edit : NewEdits)
+	{
+		if (Edit->Revision != AppliedEdits.Revision + 1)
+		{
+			break;
+		}
+
+		// The bounds of the nodes already using the slot depend on its height
+		if (Edit->bRenderData && AppliedEdits.UsesSlot(Edit->Slot))
+		{
+			bNeedsFullRebuild = true;
+		}
+		else if (!Edit->bRenderData)
+		{
+			ChangedRanges.Append(Edit->Ranges);
+		}
+		AppliedEdits.Apply(*Edit);
+	}
+
+	if (bNeedsFullRebuild || NeedsRebuild() || !PatchEditedTree(ChangedRanges))
+	{
+		// The subsystem rebuilds dirty meshes on worker threads, several edits in a frame cost one rebuild
+		MarkQuadtreeMeshGridDirty();
+	}
+}
+
+void UQuadtreeMeshComponent::FoldLoggedEdits()
+{
+	if (EditLog.Edits.Num() <= FQuadtreeMeshEditLog::MaxLoggedEdits)
+	{
+		return;
+	}
+
+	// The log is in revision order on the authority, the oldest half goes to the baseline. Clients get the baseline once instead of every old edit
+	const int32 NumFolded = EditLog.Edits.Num() / 2;
+	for (int32 EditIndex = 0; EditIndex < NumFolded; ++EditIndex)
+	{
+		EditBaseline.Apply(EditLog.Edits[EditIndex]);
+	}
+	EditLog.Edits.RemoveAt(0, NumFolded);
+	EditLog.MarkArrayDirty();
+}
+
+bool UQuadtreeMeshComponent::PatchEditedTree(TConstArrayView<FQuadtreeMeshMortonRange> InRanges)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(UQuadtreeMeshComponent::PatchEditedTree);
+
+	const int32 TreeDepth = MeshQuadTree.GetTreeDepth();
+	if (MeshQuadTree.GetNodeCount() == 0 || MeshQuadTree.IsGPUQuadTree() || MeshQuadTree.HasPagedSubtrees() || !BuiltTileBounds.IsValid
+		|| MeshQuadTree.GetQuadtreeMeshRenderDataCount() == 0 || TreeDepth > FQuadtreeMeshEditLog::MaxTreeDepth)
+	{
+		return false;
+	}
+
+	// Render data index is the slot: new slots are appended, the ones whose render data changed while unused are overwritten
+	const FQuadtreeMeshRenderData& BaseRenderData = MeshQuadTree.GetQuadtreeMeshRenderData(1);
+	TArray<FQuadtreeMeshRenderData> SlotRenderData;
+	AppliedEdits.GetSlotRenderData(BaseRenderData, SlotRenderData);
+	for (int32 Slot = 2; Slot < SlotRenderData.Num(); ++Slot)
+	{
+		if (Slot <= MeshQuadTree.GetQuadtreeMeshRenderDataCount())
+		{
+			MeshQuadTree.SetQuadtreeMeshRenderData(Slot, SlotRenderData[Slot]);
+		}
+		else
+		{
+			verify(MeshQuadTree.AddQuadtreeMeshRenderData(SlotRenderData[Slot]) == Slot);
+		}
+	}
+
+	TArray<FMeshQuadTree::FLeafBlock> Blocks;
+	FQuadtreeMeshEditLog::GetLeafBlocks(InRanges, TreeDepth, Blocks);
+
+	const FQuadtreeMeshEditCoverage Coverage(MeshQuadTree, BuiltTileBounds);
+	const double BaseHeight = BaseRenderData.SurfaceBaseHeight;
+	FMeshQuadTree::FEditPatch Patch;
+	const bool bPatched = MeshQuadTree.RebuildLeafBlocks(Blocks, [this, &Coverage](const FMeshQuadTree::FLeafBlock& InBlock)
+	{
+		return Coverage.GetBlockQuadtreeMeshIndex(AppliedEdits, InBlock);
+	}, BuiltTileBounds.Min.Z - BaseHeight, BuiltTileBounds.Max.Z - BaseHeight, Patch);
+	if (!bPatched)
+	{
+		return false;
+	}
+
+	++TreeRevision;
+	if (UQuadtreeMeshSubsystem* QuadtreeMeshSubsystem = UWorld::GetSubsystem<UQuadtreeMeshSubsystem>(GetWorld()))
+	{
+		QuadtreeMeshSubsystem->NotifyCoverageChanged();
+	}
+
+	UpdateBounds();
+	MarkRenderTransformDirty();
+	if (SceneProxy)
+	{
+		static_cast<FQuadtreeMeshSceneProxy*>(SceneProxy)->ApplyEditPatch_GameThread(MoveTemp(Patch));
+	}
+
+	// Published from the previous nodes, the subsystem republishes from the patched ones
+	GPUSceneInstances.Reset();
+	return true;
+}
+
+FQuadtreeMeshTelemetry UQuadtreeMeshComponent::GetTelemetry() const
+{
+	if (SceneProxy)
+	{
+		return static_cast<const FQuadtreeMeshSceneProxy*>(SceneProxy)->GetTelemetry();
+	}
+	return FQuadtreeMeshTelemetry();
+}
+
+void UQuadtreeMeshComponent::SetGPUBudgetEviction(int32 InEvictedDensityLevels, bool bInEvictRayTracing)
+{
+	if (InEvictedDensityLevels == GPUBudgetEvictedDensityLevels && bInEvictRayTracing == bGPUBudgetEvictedRayTracing)
+	{
+		return;
+	}
+
+	GPUBudgetEvictedDensityLevels = InEvictedDensityLevels;
+	bGPUBudgetEvictedRayTracing = bInEvictRayTracing;
+
+	if (SceneProxy)
+	{
+		static_cast<FQuadtreeMeshSceneProxy*>(SceneProxy)->SetGPUBudgetEviction_GameThread(GPUBudgetEvictedDensityLevels, bGPUBudgetEvictedRayTracing);
+	}
+}
+
+bool UQuadtreeMeshComponent::FindNearestCoveredLocation(FVector Location, float MaxRadius, FVector& OutLocation) const
+{
+	FMeshQuadTree::FNearestTileQueryResult Result;
+	if (MeshQuadTree.QueryNearestCoveredTile(FVector2D(Location), MaxRadius, INDEX_NONE, Result))
+	{
+		OutLocation = Result.SurfaceLocation;
+		return true;
+	}
+
+	OutLocation = Location;
+	return false;
+}
+
+void UQuadtreeMeshComponent::ClearTessellatedRegion()
+{
+	if (!TessellatedRegion.bIsValid)
+	{
+		return;
+	}
+
+	TessellatedRegion = FBox2D(ForceInit);
+	PushTessellatedQuadtreeMeshBoundsToPoxy(TessellatedRegion);
+}
+
 
 void UQuadtreeMeshComponent::PostLoad()
 {
@@ -0,0 +1,7 @@
+﻿#include "QuadtreeMeshCustomVersion.h"
+#include "Serialization/CustomVersion.h"
+
+const FGuid FQuadtreeMeshCustomVersion::GUID(0x6B2E91C4, 0x3F8D4A07, 0x9E51C2D8, 0x47A0B36F);
+
+// Register the custom version with core
+FCustomVersionRegistration GRegisterQuadtreeMeshCustomVersion(FQuadtreeMeshCustomVersion::GUID, FQuadtreeMeshCustomVersion::LatestVersion, TEXT("QuadtreeMeshVer"));
@@ -0,0 +1,411 @@
+﻿#include "QuadtreeMeshEdits.h"
+
+#include "Algo/BinarySearch.h"
+#include "QuadtreeMesh.h"
+#include "QuadtreeMeshComponent.h"
+
+namespace QuadtreeMeshEdits
+{
+	// Larger counts can only come from a corrupted or malicious packet
+	constexpr uint32 MaxRangesPerEdit = 1 << 16;
+	constexpr uint32 MaxBaselineRuns = 1 << 20;
+
+	static uint64 GetMortonCode(uint32 InX, uint32 InY)
+	{
+		return FMath::MortonCode2_64(InX) | (FMath::MortonCode2_64(InY) << 1);
+	}
+}
+
+bool FQuadtreeMeshEdit::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	Ar.SerializeIntPacked(Revision);
+	Ar << Slot;
+
+	uint8 bRenderDataBit = bRenderData ? 1 : 0;
+	Ar.SerializeBits(&bRenderDataBit, 1);
+	bRenderData = bRenderDataBit != 0;
+
+	if (bRenderData)
+	{
+		Ar << SurfaceHeightOffset;
+		Ar << SurfaceColor;
+		bOutSuccess = !Ar.IsError();
+		return true;
+	}
+
+	uint32 NumRanges = Ranges.Num();
+	Ar.SerializeIntPacked(NumRanges);
+	if (Ar.IsLoading())
+	{
+		if (NumRanges > QuadtreeMeshEdits::MaxRangesPerEdit)
+		{
+			Ar.SetError();
+			bOutSuccess = false;
+			return true;
+		}
+		Ranges.SetNum(NumRanges);
+	}
+
+	// Ranges are sorted so the gap to the previous range and the length are small numbers
+	uint64 PreviousEnd = 0;
+	for (FQuadtreeMeshMortonRange& Range : Ranges)
+	{
+		uint64 Gap = Range.Begin - PreviousEnd;
+		uint64 Length = Range.End - Range.Begin;
+		Ar.SerializeIntPacked64(Gap);
+		Ar.SerializeIntPacked64(Length);
+
+		if (Ar.IsLoading())
+		{
+			Range.Begin = PreviousEnd + Gap;
+			Range.End = Range.Begin + Length;
+		}
+		PreviousEnd = Range.End;
+	}
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
+void FQuadtreeMeshEditLog::PostReplicatedReceive(const FFastArraySerializer::FPostReplicatedReceiveParameters& Parameters)
+{
+	if (Owner)
+	{
+		Owner->OnEditsChanged();
+	}
+}
+
+FQuadtreeMeshEdit& FQuadtreeMeshEditLog::AddEdit()
+{
+	FQuadtreeMeshEdit& NewEdit = Edits.AddDefaulted_GetRef();
+	NewEdit.Revision = ++LastRevision;
+	return NewEdit;
+}
+
+void FQuadtreeMeshEditBaseline::Reset(uint32 InRevision)
+{
+	Revision = InRevision;
+	Runs.Reset();
+	RenderDataEdits.Reset();
+}
+
+void FQuadtreeMeshEditBaseline::Apply(const FQuadtreeMeshEdit& InEdit)
+{
+	check(InEdit.Revision > Revision);
+	Revision = InEdit.Revision;
+
+	if (InEdit.bRenderData)
+	{
+		if (FQuadtreeMeshEdit* SlotEdit = RenderDataEdits.FindByPredicate([&InEdit](const FQuadtreeMeshEdit& Edit) { return Edit.Slot == InEdit.Slot; }))
+		{
+			*SlotEdit = InEdit;
+		}
+		else
+		{
+			RenderDataEdits.Add(InEdit);
+		}
+		return;
+	}
+
+	for (const FQuadtreeMeshMortonRange& Range : InEdit.Ranges)
+	{
+		Assign(Range.Begin, Range.End, InEdit.Slot);
+	}
+}
+
+int32 FQuadtreeMeshEditBaseline::FindRun(uint64 InLeaf) const
+{
+	check(Runs.Num() > 0 && Runs[0].Begin == 0);
+	return Algo::UpperBoundBy(Runs, InLeaf, &FQuadtreeMeshSlotRun::Begin) - 1;
+}
+
+void FQuadtreeMeshEditBaseline::Assign(uint64 InBegin, uint64 InEnd, int16 InSlot)
+{
+	if (InBegin >= InEnd)
+	{
+		return;
+	}
+
+	if (Runs.IsEmpty())
+	{
+		Runs.Add({ 0, Unedited });
+	}
+
+	// Runs starting inside the range are replaced by one run, the leaves after it keep their slot
+	const int16 SlotAfter = Runs[FindRun(InEnd)].Slot;
+	const int32 First = Algo::LowerBoundBy(Runs, InBegin, &FQuadtreeMeshSlotRun::Begin);
+	const int32 Last = Algo::UpperBoundBy(Runs, InEnd, &FQuadtreeMeshSlotRun::Begin);
+	Runs.RemoveAt(First, Last - First, EAllowShrinking::No);
+	Runs.Insert({ InEnd, SlotAfter }, First);
+	Runs.Insert({ InBegin, InSlot }, First);
+
+	// Merge with the neighbors, right to left so the indices stay valid. The run after SlotAfter already differs from it
+	if (SlotAfter == InSlot)
+	{
+		Runs.RemoveAt(First + 1);
+	}
+	if (First > 0 && Runs[First - 1].Slot == InSlot)
+	{
+		Runs.RemoveAt(First);
+	}
+}
+
+bool FQuadtreeMeshEditBaseline::GetUniformSlot(uint64 InBegin, uint64 InEnd, int16& OutSlot) const
+{
+	if (Runs.IsEmpty())
+	{
+		OutSlot = Unedited;
+		return true;
+	}
+
+	const int32 RunIndex = FindRun(InBegin);
+	if (RunIndex + 1 < Runs.Num() && Runs[RunIndex + 1].Begin < InEnd)
+	{
+		return false;
+	}
+	OutSlot = Runs[RunIndex].Slot;
+	return true;
+}
+
+bool FQuadtreeMeshEditBaseline::UsesSlot(int16 InSlot) const
+{
+	return Runs.ContainsByPredicate([InSlot](const FQuadtreeMeshSlotRun& Run) { return Run.Slot == InSlot; });
+}
+
+bool FQuadtreeMeshEditBaseline::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	Ar.SerializeIntPacked(Revision);
+
+	uint32 NumRuns = Runs.Num();
+	Ar.SerializeIntPacked(NumRuns);
+	uint32 NumRenderDataEdits = RenderDataEdits.Num();
+	Ar.SerializeIntPacked(NumRenderDataEdits);
+	if (Ar.IsLoading())
+	{
+		if (NumRuns > QuadtreeMeshEdits::MaxBaselineRuns || NumRenderDataEdits > FQuadtreeMeshEditLog::MaxSlots)
+		{
+			Ar.SetError();
+			bOutSuccess = false;
+			return true;
+		}
+		Runs.SetNum(NumRuns);
+		RenderDataEdits.SetNum(NumRenderDataEdits);
+	}
+
+	// Gaps to the previous run, slots offset so Unedited packs in a byte
+	uint64 PreviousBegin = 0;
+	for (int32 RunIndex = 0; RunIndex < Runs.Num(); ++RunIndex)
+	{
+		FQuadtreeMeshSlotRun& Run = Runs[RunIndex];
+		uint64 Gap = Run.Begin - PreviousBegin;
+		uint32 PackedSlot = static_cast<uint32>(Run.Slot - Unedited);
+		Ar.SerializeIntPacked64(Gap);
+		Ar.SerializeIntPacked(PackedSlot);
+
+		if (Ar.IsLoading())
+		{
+			// FindRun(..) needs the first run at 0 and the others strictly increasing, the slots index the render data
+			const bool bValidGap = (RunIndex == 0) ? (Gap == 0) : (Gap > 0 && Gap <= TNumericLimits<uint64>::Max() - PreviousBegin);
+			if (!bValidGap || PackedSlot >= static_cast<uint32>(FQuadtreeMeshEditLog::MaxSlots - Unedited))
+			{
+				Ar.SetError();
+				bOutSuccess = false;
+				return true;
+			}
+			Run.Begin = PreviousBegin + Gap;
+			Run.Slot = static_cast<int16>(static_cast<int32>(PackedSlot) + Unedited);
+		}
+		PreviousBegin = Run.Begin;
+	}
+
+	bool bEditsSuccess = true;
+	for (FQuadtreeMeshEdit& Edit : RenderDataEdits)
+	{
+		Edit.NetSerialize(Ar, Map, bEditsSuccess);
+		// Only render data edits are kept apart from the runs
+		if (Ar.IsLoading() && !Edit.bRenderData)
+		{
+			Ar.SetError();
+			bOutSuccess = false;
+			return true;
+		}
+	}
+
+	bOutSuccess = bEditsSuccess && !Ar.IsError();
+	return true;
+}
+
+FQuadtreeMeshEditCoverage::FQuadtreeMeshEditCoverage(const FMeshQuadTree& InTree, const FBox& InTileBounds)
+{
+	const int32 MaxLeaf = (1 << InTree.GetTreeDepth()) - 1;
+	const FVector2D RootMin(InTree.GetBounds().Min);
+	const double LeafSize = InTree.GetLeafSize();
+
+	// Same leaves as AddQuadtreeMeshTilesInsideBounds(InTileBounds): every leaf touching the bounds
+	TileMin = FIntPoint(
+		FMath::Max(FMath::CeilToInt((InTileBounds.Min.X - RootMin.X) / LeafSize) - 1, 0),
+		FMath::Max(FMath::CeilToInt((InTileBounds.Min.Y - RootMin.Y) / LeafSize) - 1, 0));
+	TileMax = FIntPoint(
+		FMath::Min(FMath::FloorToInt((InTileBounds.Max.X - RootMin.X) / LeafSize), MaxLeaf),
+		FMath::Min(FMath::FloorToInt((InTileBounds.Max.Y - RootMin.Y) / LeafSize), MaxLeaf));
+
+	const FVector2D RegionSize = InTree.GetTileRegion().GetSize() / LeafSize;
+	RegionMax = FIntPoint(
+		FMath::Min(FMath::RoundToInt(RegionSize.X) - 1, MaxLeaf),
+		FMath::Min(FMath::RoundToInt(RegionSize.Y) - 1, MaxLeaf));
+}
+
+int32 FQuadtreeMeshEditCoverage::GetBlockQuadtreeMeshIndex(const FQuadtreeMeshEditBaseline& InEdits, const FMeshQuadTree::FLeafBlock& InBlock) const
+{
+	const int64 BlockSize = 1ll << InBlock.Level;
+	const FInt64Point BlockMin(static_cast<int64>(FMath::ReverseMortonCode2_64(InBlock.MortonBegin)), static_cast<int64>(FMath::ReverseMortonCode2_64(InBlock.MortonBegin >> 1)));
+	const FInt64Point BlockMax = BlockMin + FInt64Point(BlockSize - 1, BlockSize - 1);
+
+	if (BlockMin.X > RegionMax.X || BlockMin.Y > RegionMax.Y)
+	{
+		return 0;
+	}
+	if (BlockMax.X > RegionMax.X || BlockMax.Y > RegionMax.Y)
+	{
+		return INDEX_NONE;
+	}
+
+	int16 Slot = FQuadtreeMeshEditBaseline::Unedited;
+	if (!InEdits.GetUniformSlot(InBlock.MortonBegin, InBlock.MortonBegin + (1ull << (2 * InBlock.Level)), Slot))
+	{
+		return INDEX_NONE;
+	}
+	if (Slot != FQuadtreeMeshEditBaseline::Unedited)
+	{
+		return Slot;
+	}
+
+	// Unedited, the mesh's own tiles use slot 1
+	if (BlockMax.X < TileMin.X || BlockMax.Y < TileMin.Y || BlockMin.X > TileMax.X || BlockMin.Y > TileMax.Y)
+	{
+		return 0;
+	}
+	if (BlockMin.X >= TileMin.X && BlockMin.Y >= TileMin.Y && BlockMax.X <= TileMax.X && BlockMax.Y <= TileMax.Y)
+	{
+		return 1;
+	}
+	return INDEX_NONE;
+}
+
+void FQuadtreeMeshEditLog::GetMortonRanges(FIntPoint InMin, FIntPoint InMax, int32 InTreeDepth, TArray<FQuadtreeMeshMortonRange>& OutRanges)
+{
+	OutRanges.Reset();
+	if (InMin.X > InMax.X || InMin.Y > InMax.Y)
+	{
+		return;
+	}
+
+	// Aligned blocks fully inside the rectangle are one range, blocks crossing its edges are split into their 4 children. Visited in Morton order so the ranges come out sorted
+	auto AddBlock = [&InMin, &InMax, &OutRanges](auto& Self, int32 InLevel, uint32 InX, uint32 InY) -> void
+	{
+		const uint32 BlockSize = 1u << InLevel;
+		const FIntPoint BlockMin(InX, InY);
+		const FIntPoint BlockMax(InX + BlockSize - 1, InY + BlockSize - 1);
+		if (BlockMax.X < InMin.X || BlockMax.Y < InMin.Y || BlockMin.X > InMax.X || BlockMin.Y > InMax.Y)
+		{
+			return;
+		}
+
+		if (BlockMin.X >= InMin.X && BlockMin.Y >= InMin.Y && BlockMax.X <= InMax.X && BlockMax.Y <= InMax.Y)
+		{
+			const uint64 Begin = QuadtreeMeshEdits::GetMortonCode(InX, InY);
+			const uint64 End = Begin + (1ull << (2 * InLevel));
+			if (OutRanges.Num() > 0 && OutRanges.Last().End == Begin)
+			{
+				OutRanges.Last().End = End;
+			}
+			else
+			{
+				OutRanges.Add({ Begin, End });
+			}
+			return;
+		}
+
+		const uint32 HalfSize = BlockSize / 2;
+		Self(Self, InLevel - 1, InX, InY);
+		Self(Self, InLevel - 1, InX + HalfSize, InY);
+		Self(Self, InLevel - 1, InX, InY + HalfSize);
+		Self(Self, InLevel - 1, InX + HalfSize, InY + HalfSize);
+	};
+	AddBlock(AddBlock, InTreeDepth, 0, 0);
+}
+
+void FQuadtreeMeshEditLog::GetLeafBlocks(TConstArrayView<FQuadtreeMeshMortonRange> InRanges, int32 InTreeDepth, TArray<FMeshQuadTree::FLeafBlock>& OutBlocks)
+{
+	OutBlocks.Reset();
+	const uint64 NumLeaves = 1ull << (2 * InTreeDepth);
+	for (const FQuadtreeMeshMortonRange& Range : InRanges)
+	{
+		// Largest block starting at Begin that is aligned and fits in the range
+		uint64 Begin = Range.Begin;
+		const uint64 End = FMath::Min(Range.End, NumLeaves);
+		while (Begin < End)
+		{
+			int32 Level = Begin == 0 ? InTreeDepth : FMath::Min(static_cast<int32>(FMath::CountTrailingZeros64(Begin)) / 2, InTreeDepth);
+			while ((1ull << (2 * Level)) > End - Begin)
+			{
+				--Level;
+			}
+			OutBlocks.Add({ Begin, Level });
+			Begin += 1ull << (2 * Level);
+		}
+	}
+}
+
+void FQuadtreeMeshEditBaseline::GetSlotRenderData(const FQuadtreeMeshRenderData& InBaseRenderData, TArray<FQuadtreeMeshRenderData>& OutSlotRenderData) const
+{
+	int32 NumSlots = 2;
+	for (const FQuadtreeMeshSlotRun& Run : Runs)
+	{
+		NumSlots = FMath::Max(NumSlots, Run.Slot + 1);
+	}
+	for (const FQuadtreeMeshEdit& Edit : RenderDataEdits)
+	{
+		NumSlots = FMath::Max(NumSlots, Edit.Slot + 1);
+	}
+
+	OutSlotRenderData.Init(InBaseRenderData, NumSlots);
+
+	for (const FQuadtreeMeshEdit& Edit : RenderDataEdits)
+	{
+		// The component's own render data only changes with the component
+		if (Edit.Slot > 1)
+		{
+			FQuadtreeMeshRenderData& RenderData = OutSlotRenderData[Edit.Slot];
+			RenderData.SurfaceBaseHeight = InBaseRenderData.SurfaceBaseHeight + Edit.SurfaceHeightOffset;
+			RenderData.SurfaceColor = FLinearColor(Edit.SurfaceColor);
+		}
+	}
+}
+
+void FQuadtreeMeshEditLog::AddEditedTiles(FMeshQuadTree& InOutTree, const FBox& InTileBounds, TConstArrayView<FQuadtreeMeshRenderData> InSlotRenderData, const FQuadtreeMeshEditBaseline& InEdits)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FQuadtreeMeshEditLog::AddEditedTiles);
+
+	const int32 TreeDepth = InOutTree.GetTreeDepth();
+	if (TreeDepth > MaxTreeDepth)
+	{
+		UE_LOG(LogQuadtreeMesh, Warning, TEXT("Quadtree mesh edits are ignored on trees deeper than %d levels"), MaxTreeDepth);
+		InOutTree.AddQuadtreeMeshTilesInsideBounds(InTileBounds, InOutTree.AddQuadtreeMeshRenderData(InSlotRenderData[1]));
+		return;
+	}
+
+	// Every slot gets its render data even when no leaf uses it yet, so later edits can be patched in with the render data index being the slot
+	for (int32 Slot = 1; Slot < InSlotRenderData.Num(); ++Slot)
+	{
+		verify(InOutTree.AddQuadtreeMeshRenderData(InSlotRenderData[Slot]) == Slot);
+	}
+
+	// Only the blocks whose leaves differ are split, no per leaf storage
+	const FQuadtreeMeshEditCoverage Coverage(InOutTree, InTileBounds);
+	const double BaseHeight = InSlotRenderData[1].SurfaceBaseHeight;
+	InOutTree.AddQuadtreeMeshTilesFromLeafBlocks([&Coverage, &InEdits](const FMeshQuadTree::FLeafBlock& InBlock)
+	{
+		return Coverage.GetBlockQuadtreeMeshIndex(InEdits, InBlock);
+	}, InTileBounds.Min.Z - BaseHeight, InTileBounds.Max.Z - BaseHeight);
+}
@@ -0,0 +1,94 @@
+﻿#include "QuadtreeMeshGPUSceneInstances.h"
+#include "QuadtreeMeshStats.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("GPU Scene Instances Published"), STAT_QuadtreeMeshGPUSceneInstances, STATGROUP_QuadtreeMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("GPU Scene Publishes"), STAT_QuadtreeMeshGPUScenePublishes, STATGROUP_QuadtreeMesh);
+
+void FQuadtreeMeshGPUSceneInstances::Publish(const FMeshQuadTree& InMeshQuadTree, const FMeshQuadTree::FTraversalDesc& InTraversalDesc, const FTransform& InPrimitiveToWorld, const FVector& InDisplacement, double InObserverTolerance)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FQuadtreeMeshGPUSceneInstances::Publish);
+
+	Reset();
+
+	const int32 NumBuckets = InTraversalDesc.DensityCount * InMeshQuadTree.GetQuadtreeMeshMaterials().Num();
+	if (NumBuckets == 0 || InMeshQuadTree.GetNodeCount() == 0)
+	{
+		return;
+	}
+
+	// No frustum planes: every selected tile is flagged inside, the engine culls the instances. Translating by the primitive origin keeps the packed positions small
+	const FVector PrimitiveOrigin = InPrimitiveToWorld.GetLocation();
+	FMeshQuadTree::FTraversalDesc TraversalDesc = InTraversalDesc;
+	TraversalDesc.Frustum = FConvexVolume();
+	TraversalDesc.PreViewTranslation = -PrimitiveOrigin;
+	TraversalDesc.ClipCircle = FVector(0.0, 0.0, -1.0);
+	TraversalDesc.OccludedCells = nullptr;
+	TraversalDesc.bGatherUnculledInstances = true;
+#if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
+	TraversalDesc.DebugPDI = nullptr;
+#endif
+
+	FMeshQuadTree::FTraversalOutput Output;
+	Output.BucketInstanceCounts.SetNumZeroed(NumBuckets);
+	Output.UnculledBucketInstanceCounts.SetNumZeroed(NumBuckets);
+	InMeshQuadTree.BuildQuadtreeMeshTileInstanceData(TraversalDesc, Output);
+
+	BucketFirstInstance.SetNumUninitialized(NumBuckets + 1);
+	BucketFirstInstance[0] = 0;
+	for (int32 BucketIndex = 0; BucketIndex < NumBuckets; ++BucketIndex)
+	{
+		BucketFirstInstance[BucketIndex + 1] = BucketFirstInstance[BucketIndex] + Output.UnculledBucketInstanceCounts[BucketIndex];
+	}
+
+	const int32 NumInstances = Output.StagingInstanceData.Num();
+	check(BucketFirstInstance.Last() == NumInstances);
+	InstanceSceneData.SetNumUninitialized(NumInstances);
+	InstanceCustomData.SetNumUninitialized(NumInstances * NumCustomDataFloats);
+	InstanceLocalBounds.SetNumUninitialized(NumInstances);
+
+	// Tiles are placed in world space, undo the rotation and scale of the primitive
+	FTransform PrimitiveRotationScale = InPrimitiveToWorld;
+	PrimitiveRotationScale.SetLocation(FVector::ZeroVector);
+	const FMatrix44f OriginToPrimitive = FMatrix44f(PrimitiveRotationScale.ToInverseMatrixWithScale());
+
+	for (int32 InstanceIndex = 0; InstanceIndex < NumInstances; ++InstanceIndex)
+	{
+		const FMeshQuadTree::FStagingInstanceData& Staging = Output.StagingInstanceData[InstanceIndex];
+		const FMeshQuadTree::FSelectedTile& Tile = Output.SelectedTiles[InstanceIndex];
+
+		const FMatrix44f TileToOrigin = FScaleMatrix44f(FVector3f(Staging.Data[1].Z, Staging.Data[1].W, 1.0f)) * FTranslationMatrix44f(FVector3f(Staging.Data[0].X, Staging.Data[0].Y, Staging.Data[0].Z));
+		InstanceSceneData[InstanceIndex].LocalToPrimitive = FRenderTransform(TileToOrigin * OriginToPrimitive);
+
+		// Unit grid, the instance transform only scales it in XY so the horizontal displacement is scaled down with it
+		const FVector3f Extent(0.5f + InDisplacement.X / Staging.Data[1].Z, 0.5f + InDisplacement.Y / Staging.Data[1].W, InDisplacement.Z);
+		InstanceLocalBounds[InstanceIndex] = FRenderBounds(-Extent, Extent);
+
+		float* CustomData = &InstanceCustomData[InstanceIndex * NumCustomDataFloats];
+		CustomData[0] = Staging.Data[1].X;
+		CustomData[1] = Staging.Data[1].Y;
+		CustomData[2] = Staging.Data[1].Z;
+		CustomData[3] = Staging.Data[1].W;
+		CustomData[4] = Staging.Data[0].W;
+		CustomData[5] = static_cast<float>(Tile.DensityIndex);
+	}
+
+	ObserverPosition = InTraversalDesc.ObserverPosition;
+	ObserverTolerance = InObserverTolerance;
+	DensityCount = InTraversalDesc.DensityCount;
+	LODScale = InTraversalDesc.LODScale;
+	ForceCollapseDensityLevel = InTraversalDesc.ForceCollapseDensityLevel;
+	TessellatedQuadtreeMeshBounds = InTraversalDesc.TessellatedQuadtreeMeshBounds;
+	bIsValid = true;
+
+	INC_DWORD_STAT_BY(STAT_QuadtreeMeshGPUSceneInstances, NumInstances);
+	INC_DWORD_STAT(STAT_QuadtreeMeshGPUScenePublishes);
+}
+
+void FQuadtreeMeshGPUSceneInstances::Reset()
+{
+	InstanceSceneData.Reset();
+	InstanceCustomData.Reset();
+	InstanceLocalBounds.Reset();
+	BucketFirstInstance.Reset();
+	bIsValid = false;
+}
@@ -0,0 +1,171 @@
+﻿#include "QuadtreeMeshGridCache.h"
+
+#include "QuadtreeMesh.h"
+#include "QuadtreeMeshStats.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+#if WITH_EDITOR
+#include "DerivedDataCacheInterface.h"
+#endif
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Grid Cache Hits"), STAT_QuadtreeMeshGridCacheHits, STATGROUP_QuadtreeMesh);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Grid Builds"), STAT_QuadtreeMeshGridBuilds, STATGROUP_QuadtreeMesh);
+
+static TAutoConsoleVariable<int32> CVarQuadtreeMeshGridUseDDC(
+	TEXT("r.QuadtreeMesh.GridCache.UseDDC"),
+	0,
+	TEXT("Store the quadtree mesh grids of at least r.QuadtreeMesh.GridCache.MinDDCQuadsPerSide quads per side in the derived data cache (editor only). Smaller grids are always faster to build than to fetch."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarQuadtreeMeshGridMinDDCQuadsPerSide(
+	TEXT("r.QuadtreeMesh.GridCache.MinDDCQuadsPerSide"),
+	1024,
+	TEXT("Smallest grid stored in the derived data cache when r.QuadtreeMesh.GridCache.UseDDC is enabled."),
+	ECVF_Default);
+
+#if WITH_EDITOR
+namespace QuadtreeMeshGridCache
+{
+	// Change this guid to invalidate the grids stored in the DDC when the grid layout changes
+	static const TCHAR* DDCVersion = TEXT("5A1E0C2D8B9F4E7A9C3D6B1F0E2A4C85");
+
+	static FString GetDDCKey(int32 NumQuadsPerSide)
+	{
+		return FDerivedDataCacheInterface::BuildCacheKey(TEXT("QUADTREEMESHGRID"), DDCVersion, *FString::FromInt(NumQuadsPerSide));
+	}
+}
+#endif
+
+FQuadtreeMeshGridCache& FQuadtreeMeshGridCache::Get()
+{
+	static FQuadtreeMeshGridCache Cache;
+	return Cache;
+}
+
+FQuadtreeMeshGridRef FQuadtreeMeshGridCache::Request(int32 NumQuadsPerSide)
+{
+	check(NumQuadsPerSide > 0);
+
+	FScopeLock Lock(&Mutex);
+
+	if (TSharedPtr<const FQuadtreeMeshGrid, ESPMode::ThreadSafe> CachedGrid = Grids.FindRef(NumQuadsPerSide).Pin())
+	{
+		INC_DWORD_STAT(STAT_QuadtreeMeshGridCacheHits);
+		return CachedGrid.ToSharedRef();
+	}
+
+	INC_DWORD_STAT(STAT_QuadtreeMeshGridBuilds);
+
+	TSharedRef<FQuadtreeMeshGrid, ESPMode::ThreadSafe> Grid = MakeShared<FQuadtreeMeshGrid, ESPMode::ThreadSafe>(NumQuadsPerSide);
+	// The grid waits for its build in its destructor, so the task doesn't need to keep it alive
+	FQuadtreeMeshGrid* GridToBuild = &Grid.Get();
+	Grid->BuildTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [GridToBuild]()
+	{
+		GridToBuild->Build();
+	});
+
+	Grids.Add(NumQuadsPerSide, Grid);
+	return Grid;
+}
+
+void FQuadtreeMeshGrid::Build()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FQuadtreeMeshGrid::Build);
+
+#if WITH_EDITOR
+	const bool bUseDDC = CVarQuadtreeMeshGridUseDDC.GetValueOnAnyThread() != 0 && NumQuadsPerSide >= CVarQuadtreeMeshGridMinDDCQuadsPerSide.GetValueOnAnyThread();
+	const FString DDCKey = bUseDDC ? QuadtreeMeshGridCache::GetDDCKey(NumQuadsPerSide) : FString();
+
+	TArray<uint8> DerivedData;
+	if (bUseDDC && GetDerivedDataCacheRef().GetSynchronous(*DDCKey, DerivedData, TEXT("QuadtreeMeshGrid")))
+	{
+		FMemoryReader Ar(DerivedData);
+		Ar << Vertices;
+		Ar << IndexData;
+
+		const int64 NumVertsPerSide = NumQuadsPerSide + 1;
+		if (!Ar.IsError() && Vertices.Num() == NumVertsPerSide * NumVertsPerSide && IndexData.Num() == static_cast<int64>(NumQuadsPerSide) * NumQuadsPerSide * 6 * GetIndexStride())
+		{
+			return;
+		}
+
+		UE_LOG(LogQuadtreeMesh, Warning, TEXT("Discarding the corrupted cached grid of %d quads per side"), NumQuadsPerSide);
+	}
+#endif
+
+	const int32 NumVertsPerSide = NumQuadsPerSide + 1;
+	Vertices.SetNumUninitialized(NumVertsPerSide * NumVertsPerSide);
+
+	for (int32 VertY = 0; VertY < NumVertsPerSide; VertY++)
+	{
+		FVector4f VertPos;
+		VertPos.Y = static_cast<float>(VertY) / NumQuadsPerSide - 0.5f;
+
+		for (int32 VertX = 0; VertX < NumVertsPerSide; VertX++)
+		{
+			VertPos.X = static_cast<float>(VertX) / NumQuadsPerSide - 0.5f;
+
+			Vertices[NumVertsPerSide * VertY + VertX] = VertPos;
+		}
+	}
+
+	// This is an optimized index buffer path for water tiles containing less than uint16 max vertices
+	if (NumQuadsPerSide < 256)
+	{
+		BuildIndices<uint16>();
+	}
+	else
+	{
+		BuildIndices<uint32>();
+	}
+
+#if WITH_EDITOR
+	if (bUseDDC)
+	{
+		DerivedData.Reset();
+		FMemoryWriter Ar(DerivedData);
+		Ar << Vertices;
+		Ar << IndexData;
+		GetDerivedDataCacheRef().Put(*DDCKey, DerivedData, TEXT("QuadtreeMeshGrid"));
+	}
+#endif
+}
+
+template <typename IndexType>
+void FQuadtreeMeshGrid::BuildIndices()
+{
+	const int32 NumQuads = NumQuadsPerSide * NumQuadsPerSide;
+	IndexData.SetNumUninitialized(NumQuads * 6 * sizeof(IndexType));
+	IndexType* Indices = reinterpret_cast<IndexType*>(IndexData.GetData());
+
+	// Build index buffer in morton order for better vertex reuse. This amounts to roughly 75% reuse rate vs 66% of naive scanline approach
+	for (int32 Morton = 0; Morton < NumQuads; Morton++)
+	{
+		int32 SquareX = FMath::ReverseMortonCode2(Morton);
+		int32 SquareY = FMath::ReverseMortonCode2(Morton >> 1);
+
+		bool ForwardDiagonal = false;
+
+		if (SquareX % 2)
+		{
+			ForwardDiagonal = !ForwardDiagonal;
+		}
+		if (SquareY % 2)
+		{
+			ForwardDiagonal = !ForwardDiagonal;
+		}
+
+		int32 Index0 = SquareX + SquareY * (NumQuadsPerSide + 1);
+		int32 Index1 = Index0 + 1;
+		int32 Index2 = Index0 + (NumQuadsPerSide + 1);
+		int32 Index3 = Index2 + 1;
+
+		*Indices++ = static_cast<IndexType>(Index3);
+		*Indices++ = static_cast<IndexType>(Index1);
+		*Indices++ = static_cast<IndexType>(ForwardDiagonal ? Index2 : Index0);
+		*Indices++ = static_cast<IndexType>(Index0);
+		*Indices++ = static_cast<IndexType>(Index2);
+		*Indices++ = static_cast<IndexType>(ForwardDiagonal ? Index1 : Index3);
+	}
+}
@@ -0,0 +1,446 @@
+﻿#include "QuadtreeMeshOcean.h"
+#include "Async/ParallelFor.h"
+#include "RenderingThread.h"
+#include "QuadtreeMeshStats.h"
+
+DECLARE_CYCLE_STAT(TEXT("Ocean Simulation"), STAT_QuadtreeMeshOceanSimulation, STATGROUP_QuadtreeMesh);
+
+namespace QuadtreeMeshOcean
+{
+	/** In cm/s^2 */
+	constexpr float Gravity = 981.0f;
+
+	/** Lines transformed together, one per SIMD lane */
+	constexpr int32 LinesPerBatch = 4;
+
+	/** Waves going against the wind keep this fraction of their energy */
+	constexpr float AgainstWindDamping = 0.07f;
+
+	/** Smallest stretch of the grid under the horizontal displacements the slopes are computed with, keeps them finite where the surface folds */
+	constexpr float MinStretch = 0.1f;
+}
+
+FVector3f FQuadtreeMeshOceanField::SampleDisplacement(const FVector2D& InWorldLocationXY) const
+{
+	if (Resolution == 0)
+	{
+		return FVector3f::ZeroVector;
+	}
+
+	// Position in texels within the patch, the field tiles from the world origin
+	const FVector2D TexelPosition = FVector2D(FMath::Frac(InWorldLocationXY.X / PatchSize), FMath::Frac(InWorldLocationXY.Y / PatchSize)) * Resolution;
+	const int32 FloorX = FMath::FloorToInt32(TexelPosition.X);
+	const int32 FloorY = FMath::FloorToInt32(TexelPosition.Y);
+	const float FractionX = static_cast<float>(TexelPosition.X - FloorX);
+	const float FractionY = static_cast<float>(TexelPosition.Y - FloorY);
+
+	const int32 Mask = Resolution - 1;
+	const int32 X0 = FloorX & Mask;
+	const int32 Y0 = FloorY & Mask;
+	const int32 X1 = (X0 + 1) & Mask;
+	const int32 Y1 = (Y0 + 1) & Mask;
+
+	const FVector4f D00 = Displacement[Y0 * Resolution + X0];
+	const FVector4f D10 = Displacement[Y0 * Resolution + X1];
+	const FVector4f D01 = Displacement[Y1 * Resolution + X0];
+	const FVector4f D11 = Displacement[Y1 * Resolution + X1];
+
+	const FVector4f Result = FMath::Lerp(FMath::Lerp(D00, D10, FractionX), FMath::Lerp(D01, D11, FractionX), FractionY);
+	return FVector3f(Result.X, Result.Y, Result.Z);
+}
+
+float FQuadtreeMeshOceanField::SampleHeight(const FVector2D& InWorldLocationXY, int32 InNumIterations) const
+{
+	// Find the grid point P with P + D(P) = InWorldLocationXY, converges as long as the surface doesn't fold over
+	FVector2D GridPoint = InWorldLocationXY;
+	for (int32 Iteration = 0; Iteration < InNumIterations; ++Iteration)
+	{
+		const FVector3f Offset = SampleDisplacement(GridPoint);
+		GridPoint = InWorldLocationXY - FVector2D(Offset.X, Offset.Y);
+	}
+
+	return SampleDisplacement(GridPoint).Z;
+}
+
+void FQuadtreeMeshOceanTexture::InitRHI(FRHICommandListBase& RHICmdList)
+{
+	// 32 bit floats so the vertex factory reads exactly what the queries read
+	const FRHITextureCreateDesc Desc = FRHITextureCreateDesc::Create2D(TEXT("QuadtreeMeshOceanDisplacement"), Resolution, Resolution, PF_A32B32G32R32F)
+		.SetFlags(ETextureCreateFlags::ShaderResource)
+		.SetInitialState(ERHIAccess::SRVMask);
+	TextureRHI = RHICreateTexture(Desc);
+	SamplerStateRHI = TStaticSamplerState<SF_Point, AM_Wrap, AM_Wrap, AM_Wrap>::GetRHI();
+
+	const FRHITextureCreateDesc SlopeDesc = FRHITextureCreateDesc::Create2D(TEXT("QuadtreeMeshOceanSlope"), Resolution, Resolution, PF_G32R32F)
+		.SetFlags(ETextureCreateFlags::ShaderResource)
+		.SetInitialState(ERHIAccess::SRVMask);
+	SlopeTextureRHI = RHICreateTexture(SlopeDesc);
+
+	// Flat until the first field is published
+	TArray<FVector4f> Zeros;
+	Zeros.SetNumZeroed(Resolution * Resolution);
+	RHICmdList.UpdateTexture2D(TextureRHI, 0, FUpdateTextureRegion2D(0, 0, 0, 0, Resolution, Resolution), Resolution * sizeof(FVector4f), reinterpret_cast<const uint8*>(Zeros.GetData()));
+	RHICmdList.UpdateTexture2D(SlopeTextureRHI, 0, FUpdateTextureRegion2D(0, 0, 0, 0, Resolution, Resolution), Resolution * sizeof(FVector2f), reinterpret_cast<const uint8*>(Zeros.GetData()));
+}
+
+void FQuadtreeMeshOceanTexture::Update(FRHICommandListImmediate& RHICmdList, const FQuadtreeMeshOceanField& InField)
+{
+	check(IsInRenderingThread());
+
+	if (!TextureRHI || InField.Resolution != Resolution)
+	{
+		return;
+	}
+
+	RHICmdList.UpdateTexture2D(TextureRHI, 0, FUpdateTextureRegion2D(0, 0, 0, 0, Resolution, Resolution), Resolution * sizeof(FVector4f), reinterpret_cast<const uint8*>(InField.Displacement.GetData()));
+	RHICmdList.UpdateTexture2D(SlopeTextureRHI, 0, FUpdateTextureRegion2D(0, 0, 0, 0, Resolution, Resolution), Resolution * sizeof(FVector2f), reinterpret_cast<const uint8*>(InField.Slopes.GetData()));
+}
+
+FQuadtreeMeshOceanSimulation::FQuadtreeMeshOceanSimulation(const FQuadtreeMeshOceanSettings& InSettings)
+	: Settings(InSettings)
+{
+	using namespace QuadtreeMeshOcean;
+
+	Resolution = static_cast<int32>(FMath::RoundUpToPowerOfTwo(FMath::Clamp(Settings.Resolution, 16, 512)));
+	Settings.PatchSize = FMath::Max(Settings.PatchSize, 100.0f);
+
+	const int32 NumSamples = Resolution * Resolution;
+	InitialSpectrum.SetNumUninitialized(NumSamples);
+	AngularFrequencies.SetNumUninitialized(NumSamples);
+	WaveDirections.SetNumUninitialized(NumSamples);
+	WaveNumbers.SetNumUninitialized(NumSamples);
+
+	// Phillips spectrum: the largest waves the wind can raise are Speed^2 / g long, waves shorter than a sample are suppressed
+	const float LargestWaveLength = FMath::Square(FMath::Max(Settings.WindSpeed, 1.0f)) / Gravity;
+	const float SmallestWaveLength = Settings.PatchSize / Resolution;
+	float WindSin, WindCos;
+	FMath::SinCos(&WindSin, &WindCos, FMath::DegreesToRadians(Settings.WindDirection));
+	const FVector2f Wind(WindCos, WindSin);
+
+	FRandomStream Random(Settings.Seed);
+	double Variance = 0.0;
+	for (int32 Y = 0; Y < Resolution; ++Y)
+	{
+		for (int32 X = 0; X < Resolution; ++X)
+		{
+			const int32 Index = Y * Resolution + X;
+
+			// FFT order, the second half of each axis holds the negative wave numbers
+			const FVector2f WaveVector = FVector2f(X < Resolution / 2 ? X : X - Resolution, Y < Resolution / 2 ? Y : Y - Resolution) * (UE_TWO_PI / Settings.PatchSize);
+			const float WaveNumber = WaveVector.Size();
+
+			// Gaussian pair, drawn for every sample so the seed gives the same sea at any wind
+			const float Radius = FMath::Sqrt(-2.0f * FMath::Loge(FMath::Max(Random.GetFraction(), UE_SMALL_NUMBER)));
+			const float Angle = UE_TWO_PI * Random.GetFraction();
+
+			// The Nyquist wave vectors are their own opposite, their horizontal displacement can't be made real
+			if (WaveNumber < UE_SMALL_NUMBER || X == Resolution / 2 || Y == Resolution / 2)
+			{
+				InitialSpectrum[Index] = FVector2f::ZeroVector;
+				AngularFrequencies[Index] = 0.0f;
+				WaveDirections[Index] = FVector2f::ZeroVector;
+				WaveNumbers[Index] = 0.0f;
+				continue;
+			}
+
+			const FVector2f Direction = WaveVector / WaveNumber;
+			const float Alignment = FVector2f::DotProduct(Direction, Wind);
+			float Phillips = FMath::Exp(-1.0f / FMath::Square(WaveNumber * LargestWaveLength)) / FMath::Square(FMath::Square(WaveNumber))
+				* FMath::Square(Alignment) * FMath::Exp(-FMath::Square(WaveNumber * SmallestWaveLength));
+			if (Alignment < 0.0f)
+			{
+				Phillips *= AgainstWindDamping;
+			}
+
+			const FVector2f Amplitude = FVector2f(Radius * FMath::Cos(Angle), Radius * FMath::Sin(Angle)) * FMath::Sqrt(Phillips * 0.5f);
+			InitialSpectrum[Index] = Amplitude;
+			AngularFrequencies[Index] = FMath::Sqrt(Gravity * WaveNumber);
+			WaveDirections[Index] = Direction;
+			WaveNumbers[Index] = WaveNumber;
+
+			// Each initial amplitude contributes to the wave vector and its opposite
+			Variance += 2.0 * Amplitude.SizeSquared();
+		}
+	}
+
+	// The significant wave height is 4 standard deviations of the height
+	if (Variance > 0.0)
+	{
+		const float Scale = static_cast<float>(Settings.SignificantWaveHeight / (4.0 * FMath::Sqrt(Variance)));
+		for (FVector2f& Amplitude : InitialSpectrum)
+		{
+			Amplitude *= Scale;
+		}
+	}
+
+	const int32 NumBits = FMath::FloorLog2(Resolution);
+	BitReversedIndices.SetNumUninitialized(Resolution);
+	for (int32 Index = 0; Index < Resolution; ++Index)
+	{
+		BitReversedIndices[Index] = static_cast<int32>(ReverseBits(static_cast<uint32>(Index)) >> (32 - NumBits));
+	}
+
+	Twiddles.SetNumUninitialized(Resolution / 2);
+	for (int32 Index = 0; Index < Resolution / 2; ++Index)
+	{
+		float Sin, Cos;
+		FMath::SinCos(&Sin, &Cos, UE_TWO_PI * Index / Resolution);
+		Twiddles[Index] = FVector2f(Cos, Sin);
+	}
+
+	MaxAmplitude = Settings.SignificantWaveHeight;
+	MaxHorizontalAmplitude = Settings.SignificantWaveHeight * Settings.Choppiness;
+
+	Texture = MakeShared<FQuadtreeMeshOceanTexture, ESPMode::ThreadSafe>(Resolution);
+	BeginInitResource(Texture.Get());
+}
+
+FQuadtreeMeshOceanSimulation::~FQuadtreeMeshOceanSimulation()
+{
+	// The task reads the spectrum
+	SimulationTask.Wait();
+
+	// Proxies may still hold the texture, it's released but only deleted with the last reference
+	ENQUEUE_RENDER_COMMAND(ReleaseQuadtreeMeshOceanTexture)(
+		[Texture = MoveTemp(Texture)](FRHICommandListImmediate& RHICmdList)
+		{
+			Texture->ReleaseResource();
+		});
+}
+
+void FQuadtreeMeshOceanSimulation::Tick(double InTime)
+{
+	check(IsInGameThread());
+
+	if (PendingField.IsValid())
+	{
+		// Launched a tick ago, usually done by now
+		SimulationTask.Wait();
+
+		TSharedPtr<const FQuadtreeMeshOceanField, ESPMode::ThreadSafe> Published = PendingField;
+		{
+			FScopeLock Lock(&FieldMutex);
+			Field = Published;
+		}
+		MaxAmplitude = FMath::Max(MaxAmplitude, Published->MaxHeight);
+		MaxHorizontalAmplitude = FMath::Max(MaxHorizontalAmplitude, Published->MaxOffset);
+
+		ENQUEUE_RENDER_COMMAND(UpdateQuadtreeMeshOceanTexture)(
+			[Texture = Texture, Published](FRHICommandListImmediate& RHICmdList)
+			{
+				Texture->Update(RHICmdList, *Published);
+			});
+
+		PendingField.Reset();
+	}
+
+	PendingField = MakeShared<FQuadtreeMeshOceanField, ESPMode::ThreadSafe>();
+	SimulationTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, Target = PendingField, InTime]()
+	{
+		Simulate(InTime, *Target);
+	});
+}
+
+TSharedPtr<const FQuadtreeMeshOceanField, ESPMode::ThreadSafe> FQuadtreeMeshOceanSimulation::GetField() const
+{
+	FScopeLock Lock(&FieldMutex);
+	return Field;
+}
+
+void FQuadtreeMeshOceanSimulation::Simulate(double InTime, FQuadtreeMeshOceanField& OutField) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FQuadtreeMeshOceanSimulation::Simulate);
+	SCOPE_CYCLE_COUNTER(STAT_QuadtreeMeshOceanSimulation);
+
+	const int32 NumSamples = Resolution * Resolution;
+	const int32 Mask = Resolution - 1;
+	const float Choppiness = Settings.Choppiness;
+
+	// Height, then pairs of real fields packed in one complex field each (x in the real part, y in the imaginary part):
+	// the horizontal displacements, the slopes of the height and the stretch of the horizontal displacements along their own axis
+	TArray<float> HeightReal, HeightImag, OffsetReal, OffsetImag, SlopeReal, SlopeImag, StretchReal, StretchImag;
+	for (TArray<float>* Samples : { &HeightReal, &HeightImag, &OffsetReal, &OffsetImag, &SlopeReal, &SlopeImag, &StretchReal, &StretchImag })
+	{
+		Samples->SetNumUninitialized(NumSamples);
+	}
+
+	ParallelFor(TEXT("QuadtreeMesh.OceanSpectrum"), Resolution, 16, [&](int32 Y)
+	{
+		const int32 MirroredY = (Resolution - Y) & Mask;
+		for (int32 X = 0; X < Resolution; ++X)
+		{
+			const int32 Index = Y * Resolution + X;
+			const int32 MirroredIndex = MirroredY * Resolution + ((Resolution - X) & Mask);
+
+			// h0(k) e^(iwt) + conj(h0(-k)) e^(-iwt), wrapped in double so long sessions keep their precision
+			const float Phase = static_cast<float>(FMath::Fmod(static_cast<double>(AngularFrequencies[Index]) * InTime, UE_DOUBLE_TWO_PI));
+			float Sin, Cos;
+			FMath::SinCos(&Sin, &Cos, Phase);
+
+			const FVector2f H0 = InitialSpectrum[Index];
+			const FVector2f H0Mirrored = InitialSpectrum[MirroredIndex];
+			const float Real = H0.X * Cos - H0.Y * Sin + H0Mirrored.X * Cos - H0Mirrored.Y * Sin;
+			const float Imag = H0.X * Sin + H0.Y * Cos - H0Mirrored.X * Sin - H0Mirrored.Y * Cos;
+
+			HeightReal[Index] = Real;
+			HeightImag[Index] = Imag;
+
+			// The y field of each pair is multiplied by i to share the transform
+			const FVector2f Direction = WaveDirections[Index];
+			const FVector2f WaveVector = Direction * WaveNumbers[Index];
+
+			// i k/|k| h, towards the crests
+			OffsetReal[Index] = -Choppiness * (Direction.X * Imag + Direction.Y * Real);
+			OffsetImag[Index] = Choppiness * (Direction.X * Real - Direction.Y * Imag);
+
+			// i k h
+			SlopeReal[Index] = -(WaveVector.X * Imag + WaveVector.Y * Real);
+			SlopeImag[Index] = WaveVector.X * Real - WaveVector.Y * Imag;
+
+			// Derivative of the offsets along their axis: -k^2/|k| h
+			const float StretchX = -Choppiness * Direction.X * WaveVector.X;
+			const float StretchY = -Choppiness * Direction.Y * WaveVector.Y;
+			StretchReal[Index] = StretchX * Real - StretchY * Imag;
+			StretchImag[Index] = StretchX * Imag + StretchY * Real;
+		}
+	});
+
+	InverseFFT2D(HeightReal, HeightImag);
+	InverseFFT2D(OffsetReal, OffsetImag);
+	InverseFFT2D(SlopeReal, SlopeImag);
+	InverseFFT2D(StretchReal, StretchImag);
+
+	OutField.Resolution = Resolution;
+	OutField.PatchSize = Settings.PatchSize;
+	OutField.Time = InTime;
+	OutField.Displacement.SetNumUninitialized(NumSamples);
+	OutField.Slopes.SetNumUninitialized(NumSamples);
+
+	float MaxHeight = 0.0f;
+	float MaxOffset = 0.0f;
+	for (int32 Index = 0; Index < NumSamples; ++Index)
+	{
+		OutField.Displacement[Index] = FVector4f(OffsetReal[Index], OffsetImag[Index], HeightReal[Index], 0.0f);
+		MaxHeight = FMath::Max(MaxHeight, FMath::Abs(HeightReal[Index]));
+		MaxOffset = FMath::Max3(MaxOffset, FMath::Abs(OffsetReal[Index]), FMath::Abs(OffsetImag[Index]));
+
+		// The grid is squeezed towards the crests by the offsets, which steepens the slope per world unit. Clamped where the surface folds over
+		OutField.Slopes[Index] = FVector2f(SlopeReal[Index] / FMath::Max(1.0f + StretchReal[Index], MinStretch), SlopeImag[Index] / FMath::Max(1.0f + StretchImag[Index], MinStretch));
+	}
+	OutField.MaxHeight = MaxHeight;
+	OutField.MaxOffset = MaxOffset;
+}
+
+void FQuadtreeMeshOceanSimulation::InverseFFT2D(TArray<float>& InOutReal, TArray<float>& InOutImag) const
+{
+	using namespace QuadtreeMeshOcean;
+
+	const int32 NumBatches = Resolution / LinesPerBatch;
+
+	// Rows: gather 4 rows into the lanes
+	ParallelFor(TEXT("QuadtreeMesh.OceanRows"), NumBatches, 1, [this, &InOutReal, &InOutImag](int32 Batch)
+	{
+		TArray<float> Real, Imag;
+		Real.SetNumUninitialized(Resolution * LinesPerBatch);
+		Imag.SetNumUninitialized(Resolution * LinesPerBatch);
+
+		for (int32 Lane = 0; Lane < LinesPerBatch; ++Lane)
+		{
+			const int32 RowStart = (Batch * LinesPerBatch + Lane) * Resolution;
+			for (int32 Index = 0; Index < Resolution; ++Index)
+			{
+				Real[Index * LinesPerBatch + Lane] = InOutReal[RowStart + Index];
+				Imag[Index * LinesPerBatch + Lane] = InOutImag[RowStart + Index];
+			}
+		}
+
+		InverseFFT4(Real.GetData(), Imag.GetData());
+
+		for (int32 Lane = 0; Lane < LinesPerBatch; ++Lane)
+		{
+			const int32 RowStart = (Batch * LinesPerBatch + Lane) * Resolution;
+			for (int32 Index = 0; Index < Resolution; ++Index)
+			{
+				InOutReal[RowStart + Index] = Real[Index * LinesPerBatch + Lane];
+				InOutImag[RowStart + Index] = Imag[Index * LinesPerBatch + Lane];
+			}
+		}
+	});
+
+	// Columns: 4 adjacent columns are already interleaved in a row major field
+	ParallelFor(TEXT("QuadtreeMesh.OceanColumns"), NumBatches, 1, [this, &InOutReal, &InOutImag](int32 Batch)
+	{
+		TArray<float> Real, Imag;
+		Real.SetNumUninitialized(Resolution * LinesPerBatch);
+		Imag.SetNumUninitialized(Resolution * LinesPerBatch);
+
+		const int32 Column = Batch * LinesPerBatch;
+		for (int32 Index = 0; Index < Resolution; ++Index)
+		{
+			FMemory::Memcpy(&Real[Index * LinesPerBatch], &InOutReal[Index * Resolution + Column], LinesPerBatch * sizeof(float));
+			FMemory::Memcpy(&Imag[Index * LinesPerBatch], &InOutImag[Index * Resolution + Column], LinesPerBatch * sizeof(float));
+		}
+
+		InverseFFT4(Real.GetData(), Imag.GetData());
+
+		for (int32 Index = 0; Index < Resolution; ++Index)
+		{
+			FMemory::Memcpy(&InOutReal[Index * Resolution + Column], &Real[Index * LinesPerBatch], LinesPerBatch * sizeof(float));
+			FMemory::Memcpy(&InOutImag[Index * Resolution + Column], &Imag[Index * LinesPerBatch], LinesPerBatch * sizeof(float));
+		}
+	});
+}
+
+void FQuadtreeMeshOceanSimulation::InverseFFT4(float* InOutReal, float* InOutImag) const
+{
+	using namespace QuadtreeMeshOcean;
+
+	// Iterative radix 2, the input goes in bit reversed order
+	for (int32 Index = 0; Index < Resolution; ++Index)
+	{
+		const int32 Reversed = BitReversedIndices[Index];
+		if (Index < Reversed)
+		{
+			const VectorRegister4Float Real = VectorLoad(&InOutReal[Index * LinesPerBatch]);
+			const VectorRegister4Float Imag = VectorLoad(&InOutImag[Index * LinesPerBatch]);
+			VectorStore(VectorLoad(&InOutReal[Reversed * LinesPerBatch]), &InOutReal[Index * LinesPerBatch]);
+			VectorStore(VectorLoad(&InOutImag[Reversed * LinesPerBatch]), &InOutImag[Index * LinesPerBatch]);
+			VectorStore(Real, &InOutReal[Reversed * LinesPerBatch]);
+			VectorStore(Imag, &InOutImag[Reversed * LinesPerBatch]);
+		}
+	}
+
+	for (int32 Size = 2; Size <= Resolution; Size *= 2)
+	{
+		const int32 HalfSize = Size / 2;
+		const int32 TwiddleStep = Resolution / Size;
+		for (int32 Start = 0; Start < Resolution; Start += Size)
+		{
+			for (int32 Offset = 0; Offset < HalfSize; ++Offset)
+			{
+				const FVector2f Twiddle = Twiddles[Offset * TwiddleStep];
+				const VectorRegister4Float TwiddleReal = VectorSetFloat1(Twiddle.X);
+				const VectorRegister4Float TwiddleImag = VectorSetFloat1(Twiddle.Y);
+
+				float* EvenReal = &InOutReal[(Start + Offset) * LinesPerBatch];
+				float* EvenImag = &InOutImag[(Start + Offset) * LinesPerBatch];
+				float* OddReal = &InOutReal[(Start + Offset + HalfSize) * LinesPerBatch];
+				float* OddImag = &InOutImag[(Start + Offset + HalfSize) * LinesPerBatch];
+
+				const VectorRegister4Float ER = VectorLoad(EvenReal);
+				const VectorRegister4Float EI = VectorLoad(EvenImag);
+				const VectorRegister4Float OR = VectorLoad(OddReal);
+				const VectorRegister4Float OI = VectorLoad(OddImag);
+
+				// Odd * Twiddle
+				const VectorRegister4Float TR = VectorSubtract(VectorMultiply(OR, TwiddleReal), VectorMultiply(OI, TwiddleImag));
+				const VectorRegister4Float TI = VectorMultiplyAdd(OR, TwiddleImag, VectorMultiply(OI, TwiddleReal));
+
+				VectorStore(VectorAdd(ER, TR), EvenReal);
+				VectorStore(VectorAdd(EI, TI), EvenImag);
+				VectorStore(VectorSubtract(ER, TR), OddReal);
+				VectorStore(VectorSubtract(EI, TI), OddImag);
+			}
+		}
+	}
+}
@@ -0,0 +1,60 @@
+﻿#include "QuadtreeMeshScalability.h"
+
+#include "Scalability.h"
+
+static TAutoConsoleVariable<int32> CVarQuadtreeMeshScalabilityClampedDensityLevels(
+	TEXT("r.QuadtreeMesh.Scalability.ClampedDensityLevels"),
+	0,
+	TEXT("Number of densest grids never drawn by the quadtree meshes, their tiles use the next coarser grid and the buffers are released. The coarsest grid is always kept."),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<float> CVarQuadtreeMeshScalabilityLODScaleMultiplier(
+	TEXT("r.QuadtreeMesh.Scalability.LODScaleMultiplier"),
+	1.0f,
+	TEXT("Multiplier applied to the LODScale of every quadtree mesh."),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarQuadtreeMeshScalabilityForceCollapseDensityLevel(
+	TEXT("r.QuadtreeMesh.Scalability.ForceCollapseDensityLevel"),
+	-1,
+	TEXT("Force collapse level used by the quadtree meshes when lower than their own. -1 to disable."),
+	ECVF_Scalability);
+
+namespace QuadtreeMeshScalability
+{
+	/** Defaults per sg.ViewDistanceQuality level (low, medium, high, epic), cinematic and above use the epic values */
+	static constexpr int32 ClampedDensityLevels[] = { 2, 1, 0, 0 };
+	static constexpr float LODScaleMultipliers[] = { 0.5f, 0.75f, 1.0f, 1.0f };
+	static constexpr int32 ForceCollapseDensityLevels[] = { 1, -1, -1, -1 };
+
+	static FDelegateHandle OnScalabilitySettingsChangedHandle;
+
+	static void ApplyQualityLevels(const Scalability::FQualityLevels& QualityLevels)
+	{
+		const int32 Level = FMath::Clamp(QualityLevels.ViewDistanceQuality, 0, static_cast<int32>(UE_ARRAY_COUNT(ClampedDensityLevels)) - 1);
+
+		// Same priority as the scalability ini sections, so values set in ini files or from the console win
+		CVarQuadtreeMeshScalabilityClampedDensityLevels->Set(ClampedDensityLevels[Level], ECVF_SetByScalability);
+		CVarQuadtreeMeshScalabilityLODScaleMultiplier->Set(LODScaleMultipliers[Level], ECVF_SetByScalability);
+		CVarQuadtreeMeshScalabilityForceCollapseDensityLevel->Set(ForceCollapseDensityLevels[Level], ECVF_SetByScalability);
+	}
+}
+
+FQuadtreeMeshScalability FQuadtreeMeshScalability::Get()
+{
+	FQuadtreeMeshScalability Settings;
+	Settings.ClampedDensityLevels = FMath::Max(CVarQuadtreeMeshScalabilityClampedDensityLevels.GetValueOnGameThread(), 0);
+	Settings.LODScaleMultiplier = FMath::Max(CVarQuadtreeMeshScalabilityLODScaleMultiplier.GetValueOnGameThread(), UE_KINDA_SMALL_NUMBER);
+	Settings.ForceCollapseDensityLevel = FMath::Max(CVarQuadtreeMeshScalabilityForceCollapseDensityLevel.GetValueOnGameThread(), -1);
+	return Settings;
+}
+
+void FQuadtreeMeshScalability::Initialize()
+{
+	QuadtreeMeshScalability::OnScalabilitySettingsChangedHandle = Scalability::OnScalabilitySettingsChanged.AddStatic(&QuadtreeMeshScalability::ApplyQualityLevels);
+}
+
+void FQuadtreeMeshScalability::Shutdown()
+{
+	Scalability::OnScalabilitySettingsChanged.Remove(QuadtreeMeshScalability::OnScalabilitySettingsChangedHandle);
+}
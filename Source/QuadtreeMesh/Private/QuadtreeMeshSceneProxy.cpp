@@ -5,13 +5,102 @@
 #include "RenderGraphBuilder.h"
 #include "Materials/Material.h"
 #include "Materials/MaterialRenderProxy.h"
+#include "QuadtreeMeshStats.h"
+#include "ConvexVolume.h"
+#include "QuadtreeMeshOcean.h"
+#include "RenderUtils.h"
 
 
-DECLARE_STATS_GROUP(TEXT("Quadtree Mesh"), STATGROUP_QuadtreeMesh, STATCAT_Advanced);
 DECLARE_DWORD_COUNTER_STAT(TEXT("Tiles Drawn"), STAT_QuadtreeMeshTilesDrawn, STATGROUP_QuadtreeMesh);
 DECLARE_DWORD_COUNTER_STAT(TEXT("Draw Calls"), STAT_QuadtreeMeshDrawCalls, STATGROUP_QuadtreeMesh);
 DECLARE_DWORD_COUNTER_STAT(TEXT("Vertices Drawn"), STAT_QuadtreeMeshVerticesDrawn, STATGROUP_QuadtreeMesh);
 DECLARE_DWORD_COUNTER_STAT(TEXT("Number Drawn Materials"), STAT_QuadtreeMeshDrawnMats, STATGROUP_QuadtreeMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Speculative Traversal Hits"), STAT_QuadtreeMeshSpeculativeHits, STATGROUP_QuadtreeMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Speculative Traversal Misses"), STAT_QuadtreeMeshSpeculativeMisses, STATGROUP_QuadtreeMesh);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Speculative Traversal Hit Rate %"), STAT_QuadtreeMeshSpeculativeHitRate, STATGROUP_QuadtreeMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Baked Selection Views"), STAT_QuadtreeMeshBakedSelectionViews, STATGROUP_QuadtreeMesh);
+
+static TAutoConsoleVariable<int32> CVarQuadtreeMeshBatchChildFrustumTests(
+	TEXT("r.QuadtreeMesh.BatchChildFrustumTests"),
+	1,
+	TEXT("Test the 4 children of a quadtree node intersecting the view frustum with a single SIMD test."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarQuadtreeMeshWideTraversal(
+	TEXT("r.QuadtreeMesh.WideTraversal"),
+	0,
+	TEXT("Select the tiles by traversing the quadtree as a 16-ary tree, two levels per step with the 4x4 children tested by a single SIMD test.\n")
+	TEXT("The skipped levels are rendered from implicit intermediate tiles. See QuadtreeMesh.BenchmarkTraversal to compare both."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarQuadtreeMeshTelemetry(
+	TEXT("r.QuadtreeMesh.Telemetry"),
+	1,
+	TEXT("Measure the per component rendering cost returned by UQuadtreeMeshComponent::GetTelemetry. Available in shipping builds."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarQuadtreeMeshTelemetrySmoothingFrames(
+	TEXT("r.QuadtreeMesh.Telemetry.SmoothingFrames"),
+	30,
+	TEXT("Number of frames the quadtree mesh telemetry averages are smoothed over."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarQuadtreeMeshBakedSelection(
+	TEXT("r.QuadtreeMesh.BakedSelection"),
+	1,
+	TEXT("Use the baked LOD selection of a quadtree mesh instead of traversing the tree when the view is inside the baked volume."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarQuadtreeMeshSpeculativeTraversal(
+	TEXT("r.QuadtreeMesh.SpeculativeTraversal"),
+	0,
+	TEXT("Predict the next frame's view from the last two and select its tiles on a worker during the current frame. Only single view families without ray tracing are predicted."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarQuadtreeMeshSpeculativePositionTolerance(
+	TEXT("r.QuadtreeMesh.SpeculativeTraversal.PositionTolerance"),
+	5.0f,
+	TEXT("Largest distance between the predicted and the actual view origin for the speculative traversal to be used."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarQuadtreeMeshSpeculativeAngleTolerance(
+	TEXT("r.QuadtreeMesh.SpeculativeTraversal.AngleTolerance"),
+	1.0f,
+	TEXT("Largest angle in degrees between the predicted and the actual view rotation for the speculative traversal to be used. The predicted frustum is widened by this angle."),
+	ECVF_RenderThreadSafe);
+
+namespace QuadtreeMeshSpeculativeTraversal
+{
+	// Halved past a threshold so the reported hit rate follows recent frames
+	static std::atomic<uint32> RecentHits = 0;
+	static std::atomic<uint32> RecentPredictions = 0;
+
+	static void RecordResult(bool bHit)
+	{
+		if (bHit)
+		{
+			INC_DWORD_STAT(STAT_QuadtreeMeshSpeculativeHits);
+			++RecentHits;
+		}
+		else
+		{
+			INC_DWORD_STAT(STAT_QuadtreeMeshSpeculativeMisses);
+		}
+
+		if (++RecentPredictions > 1024)
+		{
+			RecentHits = RecentHits / 2;
+			RecentPredictions = RecentPredictions / 2;
+		}
+
+		SET_FLOAT_STAT(STAT_QuadtreeMeshSpeculativeHitRate, 100.0f * RecentHits / FMath::Max(RecentPredictions.load(), 1u));
+	}
+
+	static FQuat GetViewRotation(const FSceneView& View)
+	{
+		return FQuat(View.ViewMatrices.GetViewMatrix().RemoveTranslation());
+	}
+}
 
 SIZE_T FQuadtreeMeshSceneProxy::GetTypeHash() const
 {
@@ -27,22 +116,77 @@ FQuadtreeMeshSceneProxy::FQuadtreeMeshSceneProxy(UQuadtreeMeshComponent* Compone
 	
 	// Cache the tiles and settings
 	MeshQuadTree = Component->GetMeshQuadTree();
-	// Leaf size * 0.5 equals the tightest possible LOD Scale that doesn't break the morphing. Can be scaled larger
-	LODScale = MeshQuadTree.GetLeafSize() * FMath::Max(Component->GetLODScale(), 0.5f);
+	TessellatedQuadtreeMeshBounds = Component->GetTessellatedRegion();
+	ClipCircle = Component->GetClipCircle();
+	BoundsPadding = Component->GetOceanBoundsPadding();
+
+	// The simulation outlives the proxy through the shared texture, the vertex factories are pointed at it once they exist
+	if (const FQuadtreeMeshOceanSimulation* OceanSimulation = Component->GetOceanSimulation())
+	{
+		OceanTexture = OceanSimulation->GetTexture();
+		OceanPatchSize = OceanSimulation->GetSettings().PatchSize;
+		OceanResolution = OceanSimulation->GetTexture()->GetSizeX();
+	}
+
+	if (Component->SubprimitiveOcclusionDepth > 0 && MeshQuadTree.GetNodeCount() > 0)
+	{
+		OcclusionCellDepth = FMath::Min(Component->SubprimitiveOcclusionDepth, MeshQuadTree.GetTreeDepth());
+
+		TArray<FBox> CellBounds;
+		MeshQuadTree.GetCoveredCellBounds(OcclusionCellDepth, CellBounds);
+		for (int32 CellIndex = 0; CellIndex < CellBounds.Num(); ++CellIndex)
+		{
+			if (CellBounds[CellIndex].IsValid)
+			{
+				OcclusionBounds.Add(FBoxSphereBounds(CellBounds[CellIndex]));
+				OcclusionCellIndices.Add(CellIndex);
+			}
+		}
+	}
+	BakedSelection = Component->BakedSelection;
+
+	// See UQuadtreeMeshComponent::bPublishGPUSceneInstances. The instance data buffer can't be added to an existing primitive, opt in before anything is published
+	bSupportsGPUSceneInstances = Component->bPublishGPUSceneInstances && UseGPUScene(GetScene().GetShaderPlatform(), GetScene().GetFeatureLevel());
+	if (bSupportsGPUSceneInstances)
+	{
+		bSupportsInstanceDataBuffer = true;
+		bHasPerInstanceCustomData = true;
+		bHasPerInstanceLocalBounds = true;
+
+		FQuadtreeMeshGPUSceneInstances GPUSceneInstances = Component->GetGPUSceneInstances();
+		SetGPUSceneInstances(MoveTemp(GPUSceneInstances));
+	}
+
+	const FQuadtreeMeshScalability Scalability = FQuadtreeMeshScalability::Get();
+	ComponentLODScale = Component->GetLODScale();
+	LODScale = GetScaledLODScale(Scalability.LODScaleMultiplier);
 
 	// Assign the force collapse level if there is one, otherwise leave it at the default
 	if (Component->ForceCollapseDensityLevel > -1)
 	{
-		ForceCollapseDensityLevel = Component->ForceCollapseDensityLevel;
+		ComponentForceCollapseDensityLevel = Component->ForceCollapseDensityLevel;
 	}
+	ForceCollapseDensityLevel = GetScaledForceCollapseDensityLevel(Scalability.ForceCollapseDensityLevel);
 
 	int32 NumQuads = static_cast<int32>(FMath::Pow(2.0f, static_cast<float>(Component->GetTessellationFactor())));
 	DensityCount = FMath::Min(MeshQuadTree.GetTreeDepth(), static_cast<int32>(FMath::FloorLog2(NumQuads)));
+
+	// Densities evicted by the GPU budget before the render state was recreated stay evicted, clamped densities are dropped too. Their grids are never created
+	BudgetEvictedDensityLevels = Component->GetGPUBudgetEvictedDensityLevels();
+	ScalabilityClampedDensityLevels = Scalability.ClampedDensityLevels;
+	MinDensityIndex = FMath::Clamp(FMath::Max(BudgetEvictedDensityLevels, ScalabilityClampedDensityLevels), 0, FMath::Max(DensityCount - 1, 0));
+
 	QuadtreeMeshVertexFactories.Reserve(MeshQuadTree.GetTreeDepth());
+	DensityGridMemorySizes.Reserve(MeshQuadTree.GetTreeDepth());
 	for (uint8 i = 0; i < MeshQuadTree.GetTreeDepth(); i++)
 	{
-		QuadtreeMeshVertexFactories.Add(new FQuadtreeMeshVertexFactory(GetScene().GetFeatureLevel(), NumQuads,LODScale));
-		BeginInitResource(QuadtreeMeshVertexFactories.Last());
+		QuadtreeMeshVertexFactories.Add(new FQuadtreeMeshVertexFactory(GetScene().GetFeatureLevel(), NumQuads,LODScale, ClipCircle, i >= MinDensityIndex));
+		DensityGridMemorySizes.Add(FQuadtreeMeshVertexFactory::GetGridMemorySize(NumQuads));
+		if (i >= MinDensityIndex)
+		{
+			BeginInitResource(QuadtreeMeshVertexFactories.Last());
+			GridMemorySize += DensityGridMemorySizes.Last();
+		}
 
 		NumQuads /= 2;
 		
@@ -54,23 +198,49 @@ FQuadtreeMeshSceneProxy::FQuadtreeMeshSceneProxy(UQuadtreeMeshComponent* Compone
 
 	QuadtreeMeshVertexFactories.Shrink();
 	check(DensityCount == QuadtreeMeshVertexFactories.Num());
+
+	// Declarations only, the grids stay with the factories above
+	if (bSupportsGPUSceneInstances)
+	{
+		GPUSceneVertexFactories.Reserve(DensityCount);
+		for (const FQuadtreeMeshVertexFactory* QuadtreeMeshFactory : QuadtreeMeshVertexFactories)
+		{
+			GPUSceneVertexFactories.Add(new FQuadtreeMeshGPUSceneVertexFactory(GetScene().GetFeatureLevel(), QuadtreeMeshFactory));
+			BeginInitResource(GPUSceneVertexFactories.Last());
+		}
+	}
 	
 	const int32 TotalLeafNodes = MeshQuadTree.GetMaxLeafCount();
 	QuadtreeMeshInstanceDataBuffers = new FQuadtreeMeshInstanceDataBuffers(TotalLeafNodes);
 
-	QuadtreeMeshUserDataBuffers = new FQuadtreeMeshUserDataBuffers(QuadtreeMeshInstanceDataBuffers);
+	TArray<FVector4f> QuadtreeMeshParameters;
+	MeshQuadTree.GatherParameterData(QuadtreeMeshParameters);
+	QuadtreeMeshParameterBuffer = new FQuadtreeMeshParameterBuffer(MoveTemp(QuadtreeMeshParameters));
+	BeginInitResource(QuadtreeMeshParameterBuffer);
+
+	QuadtreeMeshUserDataBuffers = new FQuadtreeMeshUserDataBuffers(QuadtreeMeshInstanceDataBuffers, QuadtreeMeshParameterBuffer);
 
 	MeshQuadTree.BuildMaterialIndices();
 	
 	
 #if RHI_RAYTRACING
 	RayTracingQuadtreeMeshData.SetNum(DensityCount);
+	bRayTracingEvicted = Component->IsRayTracingEvictedByGPUBudget();
 #endif
 	
 }
 
 FQuadtreeMeshSceneProxy::~FQuadtreeMeshSceneProxy()
 {
+	// The speculative traversal reads the tree
+	SpeculativeTraversal.Task.Wait();
+
+	for (FQuadtreeMeshGPUSceneVertexFactory* GPUSceneFactory : GPUSceneVertexFactories)
+	{
+		GPUSceneFactory->ReleaseResource();
+		delete GPUSceneFactory;
+	}
+
 	for (FQuadtreeMeshVertexFactory* QuadtreeMeshFactory : QuadtreeMeshVertexFactories)
 	{
 		QuadtreeMeshFactory->ReleaseResource();
@@ -79,17 +249,13 @@ FQuadtreeMeshSceneProxy::~FQuadtreeMeshSceneProxy()
 
 	delete QuadtreeMeshInstanceDataBuffers;
 
+	QuadtreeMeshParameterBuffer->ReleaseResource();
+	delete QuadtreeMeshParameterBuffer;
+
 	delete QuadtreeMeshUserDataBuffers;
 
 #if RHI_RAYTRACING
-	for (auto& QuadtreeMeshDataArray : RayTracingQuadtreeMeshData)
-	{
-		for (auto& QuadtreeMeshRayTracingItem : QuadtreeMeshDataArray)
-		{
-			QuadtreeMeshRayTracingItem.Geometry.ReleaseResource();
-			QuadtreeMeshRayTracingItem.DynamicVertexBuffer.Release();
-		}
-	}	
+	ReleaseRayTracingData();
 #endif
 }
 
@@ -97,6 +263,14 @@ void FQuadtreeMeshSceneProxy::CreateRenderThreadResources(FRHICommandListBase& R
 {
 	SceneProxyCreatedFrameNumberRenderThread = GFrameNumberRenderThread;
 
+	if (OceanTexture.IsValid())
+	{
+		for (FQuadtreeMeshVertexFactory* QuadtreeMeshFactory : QuadtreeMeshVertexFactories)
+		{
+			QuadtreeMeshFactory->SetOcean(OceanTexture->TextureRHI, OceanTexture->SlopeTextureRHI, OceanPatchSize, OceanResolution);
+		}
+	}
+
 	if (MeshQuadTree.IsGPUQuadTree())
 	{
 		FQuadtreeMeshGPUWork::FCallback Callback;
@@ -169,11 +343,25 @@ void FQuadtreeMeshSceneProxy::GetDynamicMeshElements(const TArray<const FSceneVi
 
 	const int32 NumBuckets = MeshQuadTree.GetQuadtreeMeshMaterials().Num() * DensityCount;
 
-	TArray<FMeshQuadTree::FTraversalOutput, TInlineAllocator<4>> QuadtreeMeshInstanceDataPerView;
+	TArray<FMeshQuadTree::FTraversalOutput, TInlineAllocator<4>> QuadtreeMeshInstanceDataStorage;
+	TArray<FMeshQuadTree::FTraversalOutput*, TInlineAllocator<4>> QuadtreeMeshInstanceDataPerView;
+
+#if RHI_RAYTRACING
+	// The first gathered view also produces the unculled tile set for the ray tracing gather of this frame, saving it a traversal of its own
+	bool bGatherRayTracingTiles = IsRayTracingEnabled();
+#endif
 
 	bool bEncounteredISRView = false;
 	int32 InstanceFactor = 1;
 
+	// Selection outlines and per tile hit proxies need the instance streams
+	const bool bCanDrawGPUSceneInstances = !GPUSceneVertexFactories.IsEmpty() && BatchRenderGroups.Num() == 1 && !ViewFamily.EngineShowFlags.HitProxies;
+	bool bHasGPUSceneViews = false;
+
+	const bool bRecordTelemetry = CVarQuadtreeMeshTelemetry.GetValueOnRenderThread() != 0;
+	FTelemetryFrame Telemetry;
+	const uint64 TraversalStartCycles = bRecordTelemetry ? FPlatformTime::Cycles64() : 0;
+
 	// Gather visible tiles, their lod and materials for all renderable views (skip right view when stereo pair is rendered instanced)
 	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
 	{
@@ -187,15 +375,50 @@ void FQuadtreeMeshSceneProxy::GetDynamicMeshElements(const TArray<const FSceneVi
 		// skip gathering visible tiles from instanced right eye views
 		if ((VisibilityMap & (1 << ViewIndex)) && (!bEncounteredISRView || View->IsPrimarySceneView()))
 		{
+			// Near the published observer the view draws the GPU Scene instances and leaves the culling to the engine
+			if (bCanDrawGPUSceneInstances && !bEncounteredISRView && CanDrawGPUSceneInstances(*View))
+			{
+				QuadtreeMeshInstanceDataPerView.Add(nullptr);
+				bHasGPUSceneViews = true;
+				continue;
+			}
+
 			const FVector ObserverPosition = View->ViewMatrices.GetViewOrigin();
 			
 			FQuadtreeMeshLODParams QuadtreeMeshLODParams = GetQuadtreeMeshLODParams(ObserverPosition);
 
 	TRACE_CPUPROFILER_EVENT_SCOPE(QuadTreeTraversalPerView);
 
-			FMeshQuadTree::FTraversalOutput& QuadtreeMeshInstanceData = QuadtreeMeshInstanceDataPerView.Emplace_GetRef();
+			bool bGatherUnculledInstances = false;
+#if RHI_RAYTRACING
+			bGatherUnculledInstances = bGatherRayTracingTiles;
+			bGatherRayTracingTiles = false;
+#endif
+
+			FMeshQuadTree::FTraversalOutput* QuadtreeMeshInstanceDataPtr = nullptr;
+#if RHI_RAYTRACING
+			if (bGatherUnculledInstances)
+			{
+				RayTracingTraversalOutput = FMeshQuadTree::FTraversalOutput();
+				RayTracingTraversalFrameNumber = ViewFamily.FrameNumber;
+				RayTracingTraversalObserverPosition = ObserverPosition;
+				QuadtreeMeshInstanceDataPtr = &RayTracingTraversalOutput;
+			}
+#endif
+			if (QuadtreeMeshInstanceDataPtr == nullptr)
+			{
+				QuadtreeMeshInstanceDataPtr = &QuadtreeMeshInstanceDataStorage.Emplace_GetRef();
+			}
+			QuadtreeMeshInstanceDataPerView.Add(QuadtreeMeshInstanceDataPtr);
+
+			FMeshQuadTree::FTraversalOutput& QuadtreeMeshInstanceData = *QuadtreeMeshInstanceDataPtr;
 			QuadtreeMeshInstanceData.BucketInstanceCounts.Empty(NumBuckets);
 			QuadtreeMeshInstanceData.BucketInstanceCounts.AddZeroed(NumBuckets);
+			if (bGatherUnculledInstances)
+			{
+				QuadtreeMeshInstanceData.UnculledBucketInstanceCounts.Empty(NumBuckets);
+				QuadtreeMeshInstanceData.UnculledBucketInstanceCounts.AddZeroed(NumBuckets);
+			}
 			
 
 			FMeshQuadTree::FTraversalDesc TraversalDesc;
@@ -204,36 +427,99 @@ void FQuadtreeMeshSceneProxy::GetDynamicMeshElements(const TArray<const FSceneVi
 			TraversalDesc.LODCount = MeshQuadTree.GetTreeDepth();
 			TraversalDesc.DensityCount = DensityCount;
 			TraversalDesc.ForceCollapseDensityLevel = ForceCollapseDensityLevel;
+			TraversalDesc.MinDensityIndex = MinDensityIndex;
 			TraversalDesc.Frustum = View->ViewFrustum;
 			TraversalDesc.ObserverPosition = ObserverPosition;
 			TraversalDesc.PreViewTranslation = View->ViewMatrices.GetPreViewTranslation();
 			TraversalDesc.LODScale = LODScale;
 			TraversalDesc.bLODMorphingEnabled = true;
 			TraversalDesc.TessellatedQuadtreeMeshBounds = TessellatedQuadtreeMeshBounds;
+			TraversalDesc.ClipCircle = ClipCircle;
+			TraversalDesc.BoundsPadding = BoundsPadding;
+			TraversalDesc.bGatherUnculledInstances = bGatherUnculledInstances;
+
+			// The ray tracing tiles can't skip what the view doesn't see
+			TBitArray<> OccludedCells;
+			const bool bUseOcclusion = !bGatherUnculledInstances && GetOccludedCells(*View, ViewFamily.FrameNumber, OccludedCells);
+			if (bUseOcclusion)
+			{
+				const FBox RootBounds = MeshQuadTree.GetBounds();
+				TraversalDesc.OccludedCells = &OccludedCells;
+				TraversalDesc.OcclusionCellDepth = OcclusionCellDepth;
+				TraversalDesc.OcclusionCellOrigin = FVector2D(RootBounds.Min);
+				TraversalDesc.OcclusionCellSize = FVector2D(RootBounds.GetSize()) / static_cast<double>(1 << OcclusionCellDepth);
+			}
+			TraversalDesc.bBatchChildFrustumTests = CVarQuadtreeMeshBatchChildFrustumTests.GetValueOnRenderThread() != 0;
+			TraversalDesc.bWideTraversal = CVarQuadtreeMeshWideTraversal.GetValueOnRenderThread() != 0;
 
 #if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
 			TraversalDesc.DebugPDI = Collector.GetPDI(ViewIndex);
 #endif
-			MeshQuadTree.BuildQuadtreeMeshTileInstanceData(TraversalDesc, QuadtreeMeshInstanceData);
+			// The ray tracing gather needs the unculled tiles of an exact traversal, and alternating views would never match their predictions
+			const bool bSpeculate = CVarQuadtreeMeshSpeculativeTraversal.GetValueOnRenderThread() != 0
+				&& Views.Num() == 1
+				&& !bGatherUnculledInstances
+				&& !View->bIsSceneCapture
+				&& View->IsPerspectiveProjection()
+				&& !MeshQuadTree.IsGPUQuadTree()
+				&& !bUseOcclusion;
+
+			// Baked data is checked against the current settings every frame, scalability changes LODScale and the collapse level without recreating the proxy
+			// The baked tiles ignore the clip circle, the vertex factory still clips them. Occluded cells are skipped by the decoder like the traversal does
+			const bool bUseBakedSelection = CVarQuadtreeMeshBakedSelection.GetValueOnRenderThread() != 0
+				&& BakedSelection.IsValidFor(MeshQuadTree, TraversalDesc)
+				&& BakedSelectionDecoder.SelectTiles(BakedSelection, MeshQuadTree, TraversalDesc, QuadtreeMeshInstanceData);
+
+			if (bUseBakedSelection)
+			{
+				INC_DWORD_STAT(STAT_QuadtreeMeshBakedSelectionViews);
+				MeshQuadTree.PackQuadtreeMeshTileInstanceData(TraversalDesc, QuadtreeMeshInstanceData);
+			}
+			else if (bSpeculate && TryAcceptSpeculativeTraversal(*View, TraversalDesc, QuadtreeMeshInstanceData))
+			{
+				MeshQuadTree.PackQuadtreeMeshTileInstanceData(TraversalDesc, QuadtreeMeshInstanceData);
+			}
+			else
+			{
+				MeshQuadTree.BuildQuadtreeMeshTileInstanceData(TraversalDesc, QuadtreeMeshInstanceData);
+			}
+
+			if (bSpeculate && !bUseBakedSelection)
+			{
+				LaunchSpeculativeTraversal(*View, TraversalDesc);
+			}
 			
 			HistoricalMaxViewInstanceCount = FMath::Max(HistoricalMaxViewInstanceCount, QuadtreeMeshInstanceData.InstanceCount);
 		}
 	}
 
+	if (bRecordTelemetry)
+	{
+		Telemetry.TraversalCycles = FPlatformTime::Cycles64() - TraversalStartCycles;
+	}
+
 	// Get number of total instances for all views
 	int32 TotalInstanceCount = 0;
-	for (const FMeshQuadTree::FTraversalOutput& QuadtreeMeshInstanceData : QuadtreeMeshInstanceDataPerView)
+	for (const FMeshQuadTree::FTraversalOutput* QuadtreeMeshInstanceData : QuadtreeMeshInstanceDataPerView)
 	{
-		TotalInstanceCount += QuadtreeMeshInstanceData.InstanceCount;
+		TotalInstanceCount += QuadtreeMeshInstanceData ? QuadtreeMeshInstanceData->InstanceCount : 0;
 	}
 
-	if (TotalInstanceCount == 0)
+	if (TotalInstanceCount == 0 && !bHasGPUSceneViews)
 	{
+		if (bRecordTelemetry)
+		{
+			RecordTelemetry_RenderThread(ViewFamily.FrameNumber, Telemetry);
+		}
+
 		// no instance visible, early exit
 		return;
 	}
 
-	QuadtreeMeshInstanceDataBuffers->Lock(RHICmdList, TotalInstanceCount * InstanceFactor);
+	if (TotalInstanceCount > 0)
+	{
+		QuadtreeMeshInstanceDataBuffers->Lock(RHICmdList, TotalInstanceCount * InstanceFactor);
+	}
 
 	int32 InstanceDataOffset = 0;
 
@@ -246,9 +532,16 @@ void FQuadtreeMeshSceneProxy::GetDynamicMeshElements(const TArray<const FSceneVi
 		{
 			TRACE_CPUPROFILER_EVENT_SCOPE(BucketsPerView);
 
-			FMeshQuadTree::FTraversalOutput& QuadtreeMeshInstanceData = QuadtreeMeshInstanceDataPerView[TraversalIndex];
-			const int32 NumQuadtreeMeshMaterials = MeshQuadTree.GetQuadtreeMeshMaterials().Num();
+			FMeshQuadTree::FTraversalOutput* QuadtreeMeshInstanceDataPtr = QuadtreeMeshInstanceDataPerView[TraversalIndex];
 			TraversalIndex++;
+			if (QuadtreeMeshInstanceDataPtr == nullptr)
+			{
+				DrawGPUSceneInstances(ViewIndex, WireframeMaterialInstance, Collector, Telemetry);
+				continue;
+			}
+
+			FMeshQuadTree::FTraversalOutput& QuadtreeMeshInstanceData = *QuadtreeMeshInstanceDataPtr;
+			const int32 NumQuadtreeMeshMaterials = MeshQuadTree.GetQuadtreeMeshMaterials().Num();
 
 			for (int32 MaterialIndex = 0; MaterialIndex < NumQuadtreeMeshMaterials; ++MaterialIndex)
 			{
@@ -333,6 +626,8 @@ void FQuadtreeMeshSceneProxy::GetDynamicMeshElements(const TArray<const FSceneVi
 							INC_DWORD_STAT_BY(STAT_QuadtreeMeshVerticesDrawn, QuadtreeMeshVertexFactories[DensityIndex]->VertexBuffer->GetVertexCount() * InstanceCount);
 							INC_DWORD_STAT(STAT_QuadtreeMeshDrawCalls);
 							INC_DWORD_STAT_BY(STAT_QuadtreeMeshTilesDrawn, InstanceCount);
+							++Telemetry.DrawCalls;
+							Telemetry.TilesDrawn += InstanceCount;
 
 							TRACE_CPUPROFILER_EVENT_SCOPE(Collector.AddMesh);
 
@@ -353,6 +648,11 @@ void FQuadtreeMeshSceneProxy::GetDynamicMeshElements(const TArray<const FSceneVi
 			for (int32 Idx = 0; Idx < NumStagingInstances; ++Idx)
 			{
 				const FMeshQuadTree::FStagingInstanceData& Data = QuadtreeMeshInstanceData.StagingInstanceData[Idx];
+				if (!Data.bInFrustum)
+				{
+					continue;
+				}
+
 				const int32 WriteIndex = QuadtreeMeshInstanceData.BucketInstanceCounts[Data.BucketIndex]++;
 
 				for (int32 StreamIdx = 0; StreamIdx < FQuadtreeMeshInstanceDataBuffers::NumBuffers; ++StreamIdx)
@@ -367,7 +667,206 @@ void FQuadtreeMeshSceneProxy::GetDynamicMeshElements(const TArray<const FSceneVi
 		}
 	}
 
-	QuadtreeMeshInstanceDataBuffers->Unlock(RHICmdList);
+	if (TotalInstanceCount > 0)
+	{
+		QuadtreeMeshInstanceDataBuffers->Unlock(RHICmdList);
+	}
+
+	if (bRecordTelemetry)
+	{
+		Telemetry.UploadBytes = static_cast<uint64>(TotalInstanceCount) * InstanceFactor * FQuadtreeMeshInstanceDataBuffers::NumBuffers * sizeof(FVector4f);
+		RecordTelemetry_RenderThread(ViewFamily.FrameNumber, Telemetry);
+	}
+}
+
+void FQuadtreeMeshSceneProxy::UpdateGPUSceneInstances_GameThread(const FQuadtreeMeshGPUSceneInstances& InInstances)
+{
+	check(IsInGameThread());
+	check(bSupportsGPUSceneInstances);
+
+	FQuadtreeMeshSceneProxy* SceneProxy = this;
+	ENQUEUE_RENDER_COMMAND(UpdateQuadtreeMeshGPUSceneInstances)(
+		[SceneProxy, Instances = InInstances](FRHICommandListImmediate& RHICmdList) mutable
+		{
+			// Runs before the scene processes the instance update the component queues next
+			SceneProxy->SetGPUSceneInstances(MoveTemp(Instances));
+		});
+}
+
+void FQuadtreeMeshSceneProxy::SetGPUSceneInstances(FQuadtreeMeshGPUSceneInstances&& InInstances)
+{
+	InstanceSceneData = MoveTemp(InInstances.InstanceSceneData);
+	InstanceCustomData = MoveTemp(InInstances.InstanceCustomData);
+	InstanceLocalBounds = MoveTemp(InInstances.InstanceLocalBounds);
+	GPUSceneSelection = MoveTemp(InInstances);
+
+	GPUSceneInstanceRuns.Reset();
+	for (int32 BucketIndex = 0; BucketIndex + 1 < GPUSceneSelection.BucketFirstInstance.Num(); ++BucketIndex)
+	{
+		GPUSceneInstanceRuns.Add(GPUSceneSelection.BucketFirstInstance[BucketIndex]);
+		GPUSceneInstanceRuns.Add(GPUSceneSelection.BucketFirstInstance[BucketIndex + 1] - 1);
+	}
+}
+
+bool FQuadtreeMeshSceneProxy::CanDrawGPUSceneInstances(const FSceneView& View) const
+{
+	const int32 NumBuckets = MeshQuadTree.GetQuadtreeMeshMaterials().Num() * DensityCount;
+	if (!GPUSceneSelection.IsValidFor(View.ViewMatrices.GetViewOrigin())
+		|| GPUSceneSelection.BucketFirstInstance.Num() != NumBuckets + 1
+		|| GPUSceneSelection.DensityCount != DensityCount
+		|| GPUSceneSelection.LODScale != LODScale
+		|| GPUSceneSelection.ForceCollapseDensityLevel != ForceCollapseDensityLevel
+		|| GPUSceneSelection.TessellatedQuadtreeMeshBounds != TessellatedQuadtreeMeshBounds)
+	{
+		return false;
+	}
+
+	// Grids evicted or clamped since the publish can't be drawn, the traversal collapses their tiles to a coarser grid instead
+	for (int32 BucketIndex = 0; BucketIndex < NumBuckets; ++BucketIndex)
+	{
+		const int32 DensityIndex = BucketIndex % DensityCount;
+		if (GPUSceneSelection.GetBucketInstanceCount(BucketIndex) > 0 && (DensityIndex < MinDensityIndex || !QuadtreeMeshVertexFactories[DensityIndex]->IsInitialized()))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void FQuadtreeMeshSceneProxy::DrawGPUSceneInstances(int32 ViewIndex, const FMaterialRenderProxy* InWireframeMaterial, FMeshElementCollector& Collector, FTelemetryFrame& OutTelemetry) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FQuadtreeMeshSceneProxy::DrawGPUSceneInstances);
+
+	const int32 NumQuadtreeMeshMaterials = MeshQuadTree.GetQuadtreeMeshMaterials().Num();
+	for (int32 MaterialIndex = 0; MaterialIndex < NumQuadtreeMeshMaterials; ++MaterialIndex)
+	{
+		bool bMaterialDrawn = false;
+
+		for (int32 DensityIndex = 0; DensityIndex < DensityCount; ++DensityIndex)
+		{
+			const int32 BucketIndex = MaterialIndex * DensityCount + DensityIndex;
+			const int32 InstanceCount = GPUSceneSelection.GetBucketInstanceCount(BucketIndex);
+			if (!InstanceCount)
+			{
+				continue;
+			}
+
+			const FMaterialRenderProxy* MaterialRenderProxy = InWireframeMaterial ? InWireframeMaterial : MeshQuadTree.GetQuadtreeMeshMaterials()[MaterialIndex];
+			check(MaterialRenderProxy != nullptr);
+
+			bool bUseForDepthPass = false;
+			if (const FMaterial* BucketMaterial = MaterialRenderProxy->GetMaterialNoFallback(GetScene().GetFeatureLevel()))
+			{
+				bUseForDepthPass = !BucketMaterial->GetShadingModels().HasShadingModel(MSM_SingleLayerWater) && !IsTranslucentOnlyBlendMode(*BucketMaterial);
+			}
+
+			bMaterialDrawn = true;
+
+			const FQuadtreeMeshVertexFactory* GridVertexFactory = QuadtreeMeshVertexFactories[DensityIndex];
+
+			FMeshBatch& Mesh = Collector.AllocateMesh();
+			Mesh.bWireframe = InWireframeMaterial != nullptr;
+			Mesh.VertexFactory = GPUSceneVertexFactories[DensityIndex];
+			Mesh.MaterialRenderProxy = MaterialRenderProxy;
+			Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
+			Mesh.Type = PT_TriangleList;
+			Mesh.DepthPriorityGroup = SDPG_World;
+			Mesh.bUseForMaterial = true;
+			Mesh.CastShadow = false;
+			Mesh.bUseForDepthPass = bUseForDepthPass;
+			Mesh.bUseAsOccluder = false;
+
+			Mesh.Elements.SetNumZeroed(1);
+			FMeshBatchElement& BatchElement = Mesh.Elements[0];
+
+			// One run over the instances of the bucket, relative to the first instance of the primitive. The engine culls them one by one
+			BatchElement.InstanceRuns = &GPUSceneInstanceRuns[BucketIndex * 2];
+			BatchElement.bIsInstanceRuns = true;
+			BatchElement.NumInstances = 1;
+			BatchElement.bForceInstanceCulling = true;
+			BatchElement.UserData = (void*)QuadtreeMeshUserDataBuffers->GetUserData(EQuadtreeMeshRenderGroupType::RG_RenderQuadtreeMeshTiles);
+
+			BatchElement.FirstIndex = 0;
+			BatchElement.NumPrimitives = GridVertexFactory->IndexBuffer->GetIndexCount() / 3;
+			BatchElement.MinVertexIndex = 0;
+			BatchElement.MaxVertexIndex = GridVertexFactory->VertexBuffer->GetVertexCount() - 1;
+			BatchElement.IndexBuffer = GridVertexFactory->IndexBuffer;
+			BatchElement.PrimitiveIdMode = PrimID_FromPrimitiveSceneInfo;
+			BatchElement.PrimitiveUniformBuffer = GetUniformBuffer();
+
+			// Published tiles, before the engine's culling
+			INC_DWORD_STAT_BY(STAT_QuadtreeMeshVerticesDrawn, GridVertexFactory->VertexBuffer->GetVertexCount() * InstanceCount);
+			INC_DWORD_STAT(STAT_QuadtreeMeshDrawCalls);
+			INC_DWORD_STAT_BY(STAT_QuadtreeMeshTilesDrawn, InstanceCount);
+			++OutTelemetry.DrawCalls;
+			OutTelemetry.TilesDrawn += InstanceCount;
+
+			Collector.AddMesh(ViewIndex, Mesh);
+		}
+
+		INC_DWORD_STAT_BY(STAT_QuadtreeMeshDrawnMats, static_cast<int32>(bMaterialDrawn));
+	}
+}
+
+void FQuadtreeMeshSceneProxy::RecordTelemetry_RenderThread(uint32 InFrameNumber, const FTelemetryFrame& InFrame) const
+{
+	FScopeLock Lock(&TelemetryMutex);
+
+	if (InFrameNumber != TelemetryFrameNumber)
+	{
+		if (TelemetryFrameNumber != INDEX_NONE)
+		{
+			const float Alpha = 1.0f / FMath::Max(CVarQuadtreeMeshTelemetrySmoothingFrames.GetValueOnRenderThread(), 1);
+			TelemetryAverages.TilesDrawn = FMath::Lerp(TelemetryAverages.TilesDrawn, static_cast<float>(TelemetryFrame.TilesDrawn), Alpha);
+			TelemetryAverages.DrawCalls = FMath::Lerp(TelemetryAverages.DrawCalls, static_cast<float>(TelemetryFrame.DrawCalls), Alpha);
+			TelemetryAverages.TraversalMicroseconds = FMath::Lerp(TelemetryAverages.TraversalMicroseconds, static_cast<float>(FPlatformTime::ToMilliseconds64(TelemetryFrame.TraversalCycles) * 1000.0), Alpha);
+			TelemetryAverages.UploadBytes = FMath::Lerp(TelemetryAverages.UploadBytes, static_cast<float>(TelemetryFrame.UploadBytes), Alpha);
+
+			// Frames in between didn't render this mesh and cost nothing
+			const uint32 SkippedFrames = FMath::Min(InFrameNumber - TelemetryFrameNumber - 1, 1024u);
+			if (SkippedFrames > 0)
+			{
+				const float Decay = FMath::Pow(1.0f - Alpha, static_cast<float>(SkippedFrames));
+				TelemetryAverages.TilesDrawn *= Decay;
+				TelemetryAverages.DrawCalls *= Decay;
+				TelemetryAverages.TraversalMicroseconds *= Decay;
+				TelemetryAverages.UploadBytes *= Decay;
+			}
+		}
+
+		TelemetryFrame = FTelemetryFrame();
+		TelemetryFrameNumber = InFrameNumber;
+	}
+	TelemetryRenderFrameNumber = GFrameNumberRenderThread;
+
+	TelemetryFrame.TilesDrawn += InFrame.TilesDrawn;
+	TelemetryFrame.DrawCalls += InFrame.DrawCalls;
+	TelemetryFrame.TraversalCycles += InFrame.TraversalCycles;
+	TelemetryFrame.UploadBytes += InFrame.UploadBytes;
+}
+
+FQuadtreeMeshTelemetry FQuadtreeMeshSceneProxy::GetTelemetry() const
+{
+	FQuadtreeMeshTelemetry Telemetry;
+	{
+		FScopeLock Lock(&TelemetryMutex);
+		Telemetry = TelemetryAverages;
+
+		// Culled or hidden meshes record nothing, decay for the frames rendered since without them. The frame being rendered may not have reached this mesh yet
+		const uint32 CurrentFrameNumber = GFrameNumberRenderThread;
+		if (TelemetryRenderFrameNumber != INDEX_NONE && CurrentFrameNumber > TelemetryRenderFrameNumber + 1)
+		{
+			const uint32 SkippedFrames = FMath::Min(CurrentFrameNumber - TelemetryRenderFrameNumber - 1, 1024u);
+			const float Alpha = 1.0f / FMath::Max(CVarQuadtreeMeshTelemetrySmoothingFrames.GetValueOnAnyThread(), 1);
+			const float Decay = FMath::Pow(1.0f - Alpha, static_cast<float>(SkippedFrames));
+			Telemetry.TilesDrawn *= Decay;
+			Telemetry.DrawCalls *= Decay;
+			Telemetry.TraversalMicroseconds *= Decay;
+			Telemetry.UploadBytes *= Decay;
+		}
+	}
+	Telemetry.GPUMemoryBytes = static_cast<int64>(GetGPUMemoryUsage().GetTotal());
+	return Telemetry;
 }
 
 
@@ -410,6 +909,220 @@ void FQuadtreeMeshSceneProxy::OnTessellatedQuadtreeMeshBoundsChanged_RenderThrea
 	TessellatedQuadtreeMeshBounds = InTessellatedWaterMeshBounds;
 }
 
+void FQuadtreeMeshSceneProxy::AcceptOcclusionResults(const FSceneView* View, TArray<bool>* Results, int32 ResultsStart, int32 NumResults)
+{
+	check(IsInRenderingThread() || IsInParallelRenderingThread());
+
+	if (Results == nullptr || NumResults != OcclusionCellIndices.Num())
+	{
+		return;
+	}
+
+	FScopeLock Lock(&OcclusionMutex);
+	FOcclusionResults& ViewResults = OcclusionResultsByView.FindOrAdd(View->GetViewKey());
+	ViewResults.OccludedCells.Init(false, 1 << (2 * OcclusionCellDepth));
+	ViewResults.FrameNumber = View->Family->FrameNumber;
+	for (int32 Index = 0; Index < NumResults; ++Index)
+	{
+		ViewResults.OccludedCells[OcclusionCellIndices[Index]] = (*Results)[ResultsStart + Index];
+	}
+}
+
+bool FQuadtreeMeshSceneProxy::GetOccludedCells(const FSceneView& View, uint32 InFrameNumber, TBitArray<>& OutOccludedCells) const
+{
+	if (OcclusionCellIndices.Num() == 0)
+	{
+		return false;
+	}
+
+	FScopeLock Lock(&OcclusionMutex);
+	const FOcclusionResults* ViewResults = OcclusionResultsByView.Find(View.GetViewKey());
+
+	// Results stop coming when the view stops running occlusion queries, stale ones could hide tiles for good
+	if (ViewResults == nullptr || InFrameNumber - ViewResults->FrameNumber > 1 || !ViewResults->OccludedCells.Contains(true))
+	{
+		return false;
+	}
+
+	OutOccludedCells = ViewResults->OccludedCells;
+	return true;
+}
+
+void FQuadtreeMeshSceneProxy::OnClipCircleChanged_GameThread(const FVector& InClipCircle)
+{
+	check(IsInParallelGameThread() || IsInGameThread());
+
+	FQuadtreeMeshSceneProxy* SceneProxy = this;
+	ENQUEUE_RENDER_COMMAND(OnQuadtreeMeshClipCircleChanged)(
+		[SceneProxy, InClipCircle](FRHICommandListImmediate& RHICmdList)
+		{
+			SceneProxy->OnClipCircleChanged_RenderThread(InClipCircle);
+		});
+}
+
+void FQuadtreeMeshSceneProxy::OnClipCircleChanged_RenderThread(const FVector& InClipCircle)
+{
+	check(IsInRenderingThread());
+
+	ClipCircle = InClipCircle;
+	for (FQuadtreeMeshVertexFactory* QuadtreeMeshFactory : QuadtreeMeshVertexFactories)
+	{
+		QuadtreeMeshFactory->SetClipCircle(ClipCircle);
+	}
+}
+
+void FQuadtreeMeshSceneProxy::OnBoundsPaddingChanged_GameThread(const FVector& InBoundsPadding)
+{
+	check(IsInParallelGameThread() || IsInGameThread());
+
+	FQuadtreeMeshSceneProxy* SceneProxy = this;
+	ENQUEUE_RENDER_COMMAND(OnQuadtreeMeshBoundsPaddingChanged)(
+		[SceneProxy, InBoundsPadding](FRHICommandListImmediate& RHICmdList)
+		{
+			SceneProxy->OnBoundsPaddingChanged_RenderThread(InBoundsPadding);
+		});
+}
+
+void FQuadtreeMeshSceneProxy::OnBoundsPaddingChanged_RenderThread(const FVector& InBoundsPadding)
+{
+	check(IsInRenderingThread());
+
+	BoundsPadding = InBoundsPadding;
+}
+
+void FQuadtreeMeshSceneProxy::ApplyEditPatch_GameThread(FMeshQuadTree::FEditPatch&& InPatch)
+{
+	check(IsInGameThread());
+
+	FQuadtreeMeshSceneProxy* SceneProxy = this;
+	ENQUEUE_RENDER_COMMAND(ApplyQuadtreeMeshEditPatch)(
+		[SceneProxy, Patch = MoveTemp(InPatch)](FRHICommandListImmediate& RHICmdList)
+		{
+			SceneProxy->ApplyEditPatch_RenderThread(RHICmdList, Patch);
+		});
+}
+
+void FQuadtreeMeshSceneProxy::ApplyEditPatch_RenderThread(FRHICommandListBase& RHICmdList, const FMeshQuadTree::FEditPatch& InPatch)
+{
+	check(IsInRenderingThread());
+
+	// The speculative traversal reads the nodes, and its output was selected from the old ones
+	SpeculativeTraversal.Task.Wait();
+	SpeculativeTraversal.TargetFrameNumber = INDEX_NONE;
+
+	MeshQuadTree.ApplyEditPatch(InPatch);
+	MeshQuadTree.BuildMaterialIndices();
+
+	TArray<FVector4f> QuadtreeMeshParameters;
+	MeshQuadTree.GatherParameterData(QuadtreeMeshParameters);
+	QuadtreeMeshParameterBuffer->SetParameters(RHICmdList, MoveTemp(QuadtreeMeshParameters));
+
+	// Baked from the old coverage
+	BakedSelection.Reset();
+	BakedSelectionDecoder.Reset();
+
+	// The occlusion queries are fixed at creation, only their bounds follow the coverage. Cells left empty keep their old bounds
+	if (OcclusionCellIndices.Num() > 0)
+	{
+		TArray<FBox> CellBounds;
+		MeshQuadTree.GetCoveredCellBounds(OcclusionCellDepth, CellBounds);
+		for (int32 Index = 0; Index < OcclusionCellIndices.Num(); ++Index)
+		{
+			const FBox& Bounds = CellBounds[OcclusionCellIndices[Index]];
+			if (Bounds.IsValid)
+			{
+				OcclusionBounds[Index] = FBoxSphereBounds(Bounds);
+			}
+		}
+	}
+}
+
+FQuadtreeMeshSceneProxy::FGPUMemoryUsage FQuadtreeMeshSceneProxy::GetGPUMemoryUsage() const
+{
+	FGPUMemoryUsage Usage;
+	Usage.GridBytes = GridMemorySize.load(std::memory_order_relaxed);
+	Usage.InstanceBytes = QuadtreeMeshInstanceDataBuffers->GetAllocatedSize();
+	Usage.RayTracingBytes = RayTracingMemorySize.load(std::memory_order_relaxed);
+	return Usage;
+}
+
+void FQuadtreeMeshSceneProxy::SetGPUBudgetEviction_GameThread(int32 InEvictedDensityLevels, bool bInEvictRayTracing)
+{
+	check(IsInGameThread());
+
+	FQuadtreeMeshSceneProxy* SceneProxy = this;
+	ENQUEUE_RENDER_COMMAND(SetQuadtreeMeshGPUBudgetEviction)(
+		[SceneProxy, InEvictedDensityLevels, bInEvictRayTracing](FRHICommandListImmediate& RHICmdList)
+		{
+			SceneProxy->SetGPUBudgetEviction_RenderThread(RHICmdList, InEvictedDensityLevels, bInEvictRayTracing);
+		});
+}
+
+void FQuadtreeMeshSceneProxy::SetGPUBudgetEviction_RenderThread(FRHICommandListBase& RHICmdList, int32 InEvictedDensityLevels, bool bInEvictRayTracing)
+{
+	check(IsInRenderingThread());
+
+	BudgetEvictedDensityLevels = InEvictedDensityLevels;
+	UpdateDensityResources_RenderThread(RHICmdList);
+
+#if RHI_RAYTRACING
+	bRayTracingEvicted = bInEvictRayTracing;
+	if (bRayTracingEvicted)
+	{
+		ReleaseRayTracingData();
+	}
+#endif
+}
+
+void FQuadtreeMeshSceneProxy::SetScalability_GameThread(const FQuadtreeMeshScalability& InScalability)
+{
+	check(IsInGameThread());
+
+	FQuadtreeMeshSceneProxy* SceneProxy = this;
+	ENQUEUE_RENDER_COMMAND(SetQuadtreeMeshScalability)(
+		[SceneProxy, InScalability](FRHICommandListImmediate& RHICmdList)
+		{
+			SceneProxy->SetScalability_RenderThread(RHICmdList, InScalability);
+		});
+}
+
+void FQuadtreeMeshSceneProxy::SetScalability_RenderThread(FRHICommandListBase& RHICmdList, const FQuadtreeMeshScalability& InScalability)
+{
+	check(IsInRenderingThread());
+
+	LODScale = GetScaledLODScale(InScalability.LODScaleMultiplier);
+	for (FQuadtreeMeshVertexFactory* QuadtreeMeshFactory : QuadtreeMeshVertexFactories)
+	{
+		QuadtreeMeshFactory->SetLODScale(LODScale);
+	}
+
+	ForceCollapseDensityLevel = GetScaledForceCollapseDensityLevel(InScalability.ForceCollapseDensityLevel);
+
+	ScalabilityClampedDensityLevels = InScalability.ClampedDensityLevels;
+	UpdateDensityResources_RenderThread(RHICmdList);
+}
+
+void FQuadtreeMeshSceneProxy::UpdateDensityResources_RenderThread(FRHICommandListBase& RHICmdList)
+{
+	// The coarsest grid always stays so the mesh keeps rendering
+	MinDensityIndex = FMath::Clamp(FMath::Max(BudgetEvictedDensityLevels, ScalabilityClampedDensityLevels), 0, FMath::Max(DensityCount - 1, 0));
+
+	for (int32 DensityIndex = 0; DensityIndex < DensityCount; ++DensityIndex)
+	{
+		FQuadtreeMeshVertexFactory* QuadtreeMeshFactory = QuadtreeMeshVertexFactories[DensityIndex];
+		if (DensityIndex < MinDensityIndex && QuadtreeMeshFactory->IsInitialized())
+		{
+			QuadtreeMeshFactory->ReleaseResource();
+			GridMemorySize -= DensityGridMemorySizes[DensityIndex];
+		}
+		else if (DensityIndex >= MinDensityIndex && !QuadtreeMeshFactory->IsInitialized())
+		{
+			QuadtreeMeshFactory->InitResource(RHICmdList);
+			GridMemorySize += DensityGridMemorySizes[DensityIndex];
+		}
+	}
+}
+
 HHitProxy* FQuadtreeMeshSceneProxy::CreateHitProxies(UPrimitiveComponent* Component,
                                                      TArray<TRefCountPtr<HHitProxy>>& OutHitProxies)
 {
@@ -424,10 +1137,11 @@ public:
 	FQuadtreeMeshUserData UserData;
 };
 
+#if RHI_RAYTRACING
 void FQuadtreeMeshSceneProxy::GetDynamicRayTracingInstances(FRayTracingMaterialGatheringContext& Context,
 	TArray<FRayTracingInstance>& OutRayTracingInstances)
 {
-	if (!HasQuadtreeData())
+	if (!HasQuadtreeData() || bRayTracingEvicted)
 	{
 		return;
 	}
@@ -435,30 +1149,47 @@ void FQuadtreeMeshSceneProxy::GetDynamicRayTracingInstances(FRayTracingMaterialG
 	const FSceneView& SceneView = *Context.ReferenceView;
 	const FVector ObserverPosition = SceneView.ViewMatrices.GetViewOrigin();
 
-	FQuadtreeMeshLODParams QuadtreeMeshLODParams = GetQuadtreeMeshLODParams(ObserverPosition);
-
 	const int32 NumBuckets = MeshQuadTree.GetQuadtreeMeshMaterials().Num() * DensityCount;
 
-	FMeshQuadTree::FTraversalOutput QuadtreeMeshInstanceData;
-	QuadtreeMeshInstanceData.BucketInstanceCounts.Empty(NumBuckets);
-	QuadtreeMeshInstanceData.BucketInstanceCounts.AddZeroed(NumBuckets);
+	// Reuse the unculled tiles gathered along with the raster tiles this frame if they were gathered from the same point of view
+	const bool bHasRasterTraversal = RayTracingTraversalFrameNumber == SceneView.Family->FrameNumber
+		&& RayTracingTraversalObserverPosition.Equals(ObserverPosition)
+		&& RayTracingTraversalOutput.UnculledBucketInstanceCounts.Num() == NumBuckets;
 
-	FMeshQuadTree::FTraversalDesc TraversalDesc;
-	TraversalDesc.LowestLOD = QuadtreeMeshLODParams.LowestLOD;
-	TraversalDesc.HeightMorph = QuadtreeMeshLODParams.HeightLODFactor;
-	TraversalDesc.LODCount = MeshQuadTree.GetTreeDepth();
-	TraversalDesc.DensityCount = DensityCount;
-	TraversalDesc.ForceCollapseDensityLevel = ForceCollapseDensityLevel;
-	TraversalDesc.PreViewTranslation = SceneView.ViewMatrices.GetPreViewTranslation();
-	TraversalDesc.ObserverPosition = ObserverPosition;
-	TraversalDesc.Frustum = FConvexVolume(); // Default volume to disable frustum culling
-	TraversalDesc.LODScale = LODScale;
-	TraversalDesc.bLODMorphingEnabled = true;
-	TraversalDesc.TessellatedQuadtreeMeshBounds = TessellatedQuadtreeMeshBounds;
+	if (!bHasRasterTraversal)
+	{
+		FQuadtreeMeshLODParams QuadtreeMeshLODParams = GetQuadtreeMeshLODParams(ObserverPosition);
+
+		RayTracingTraversalOutput = FMeshQuadTree::FTraversalOutput();
+		RayTracingTraversalOutput.BucketInstanceCounts.AddZeroed(NumBuckets);
+		RayTracingTraversalOutput.UnculledBucketInstanceCounts.AddZeroed(NumBuckets);
+
+		FMeshQuadTree::FTraversalDesc TraversalDesc;
+		TraversalDesc.LowestLOD = QuadtreeMeshLODParams.LowestLOD;
+		TraversalDesc.HeightMorph = QuadtreeMeshLODParams.HeightLODFactor;
+		TraversalDesc.LODCount = MeshQuadTree.GetTreeDepth();
+		TraversalDesc.DensityCount = DensityCount;
+		TraversalDesc.ForceCollapseDensityLevel = ForceCollapseDensityLevel;
+		TraversalDesc.MinDensityIndex = MinDensityIndex;
+		TraversalDesc.PreViewTranslation = SceneView.ViewMatrices.GetPreViewTranslation();
+		TraversalDesc.ObserverPosition = ObserverPosition;
+		TraversalDesc.Frustum = FConvexVolume(); // Default volume to disable frustum culling
+		TraversalDesc.LODScale = LODScale;
+		TraversalDesc.bLODMorphingEnabled = true;
+		TraversalDesc.TessellatedQuadtreeMeshBounds = TessellatedQuadtreeMeshBounds;
+		TraversalDesc.ClipCircle = ClipCircle;
+		TraversalDesc.BoundsPadding = BoundsPadding;
+		TraversalDesc.bGatherUnculledInstances = true;
+
+		MeshQuadTree.BuildQuadtreeMeshTileInstanceData(TraversalDesc, RayTracingTraversalOutput);
+
+		RayTracingTraversalFrameNumber = SceneView.Family->FrameNumber;
+		RayTracingTraversalObserverPosition = ObserverPosition;
+	}
 
-	MeshQuadTree.BuildQuadtreeMeshTileInstanceData(TraversalDesc, QuadtreeMeshInstanceData);
+	const FMeshQuadTree::FTraversalOutput& QuadtreeMeshInstanceData = RayTracingTraversalOutput;
 
-	if (QuadtreeMeshInstanceData.InstanceCount == 0)
+	if (QuadtreeMeshInstanceData.UnculledInstanceCount == 0)
 	{
 		// no instance visible, early exit
 		return;
@@ -472,26 +1203,37 @@ void FQuadtreeMeshSceneProxy::GetDynamicRayTracingInstances(FRayTracingMaterialG
 		for (int32 MaterialIndex = 0; MaterialIndex < NumQuadtreeMeshMaterials; ++MaterialIndex)
 		{
 			const int32 BucketIndex = MaterialIndex * DensityCount + DensityIndex;
-			const int32 InstanceCount = QuadtreeMeshInstanceData.BucketInstanceCounts[BucketIndex];
+			const int32 InstanceCount = QuadtreeMeshInstanceData.UnculledBucketInstanceCounts[BucketIndex];
 			DensityInstanceCount += InstanceCount;
 		}
 
 		SetupRayTracingInstances(Context.GraphBuilder.RHICmdList, DensityInstanceCount, DensityIndex);
 	}
 
-	// Create per-bucket prefix sum and sort instance data so we can easily access per-instance data for each density
+	// Acceleration structures and vertex buffers are sized by the previous dynamic geometry update, close enough for the GPU budget
+	uint64 RayTracingBytes = 0;
+	for (const TArray<FRayTracingQuadtreeMeshData>& QuadtreeMeshDataArray : RayTracingQuadtreeMeshData)
+	{
+		for (const FRayTracingQuadtreeMeshData& QuadtreeMeshItem : QuadtreeMeshDataArray)
+		{
+			RayTracingBytes += QuadtreeMeshItem.DynamicVertexBuffer.NumBytes;
+			if (const FRHIRayTracingGeometry* GeometryRHI = QuadtreeMeshItem.Geometry.GetRHI())
+			{
+				RayTracingBytes += GeometryRHI->GetSizeInfo().ResultSize;
+			}
+		}
+	}
+	RayTracingMemorySize = RayTracingBytes;
+	LastRayTracingMemorySize = RayTracingBytes;
+
+	// Per-bucket prefix sum so we can easily access per-instance data for each density. The traversal already sorted the instance data by bucket
 	TArray<int32> BucketOffsets;
 	BucketOffsets.SetNumZeroed(NumBuckets);
 
 	for (int32 BucketIndex = 1; BucketIndex < NumBuckets; ++BucketIndex)
 	{
-		BucketOffsets[BucketIndex] = BucketOffsets[BucketIndex - 1] + QuadtreeMeshInstanceData.BucketInstanceCounts[BucketIndex - 1];
+		BucketOffsets[BucketIndex] = BucketOffsets[BucketIndex - 1] + QuadtreeMeshInstanceData.UnculledBucketInstanceCounts[BucketIndex - 1];
 	}
-	
-	QuadtreeMeshInstanceData.StagingInstanceData.StableSort([](const FMeshQuadTree::FStagingInstanceData& Lhs, const FMeshQuadTree::FStagingInstanceData& Rhs)
-		{
-			return Lhs.BucketIndex < Rhs.BucketIndex;
-		});
 
 	FMeshBatch BaseMesh;
 	BaseMesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
@@ -525,7 +1267,7 @@ void FQuadtreeMeshSceneProxy::GetDynamicRayTracingInstances(FRayTracingMaterialG
 		for (int32 MaterialIndex = 0; MaterialIndex < NumQuadtreeMeshMaterials; ++MaterialIndex)
 		{
 			const int32 BucketIndex = MaterialIndex * DensityCount + DensityIndex;
-			const int32 InstanceCount = QuadtreeMeshInstanceData.BucketInstanceCounts[BucketIndex];
+			const int32 InstanceCount = QuadtreeMeshInstanceData.UnculledBucketInstanceCounts[BucketIndex];
 
 			if (!InstanceCount)
 			{
@@ -551,6 +1293,7 @@ void FQuadtreeMeshSceneProxy::GetDynamicRayTracingInstances(FRayTracingMaterialG
 				UniformBufferParams.InstanceData1 = InstanceData.Data[1];
 
 				UserDataWrapper.UserData.InstanceDataBuffers = QuadtreeMeshUserDataBuffers->GetUserData(EQuadtreeMeshRenderGroupType::RG_RenderQuadtreeMeshTiles)->InstanceDataBuffers;
+				UserDataWrapper.UserData.ParameterBuffer = QuadtreeMeshParameterBuffer;
 				UserDataWrapper.UserData.RenderGroupType = EQuadtreeMeshRenderGroupType::RG_RenderQuadtreeMeshTiles;
 				UserDataWrapper.UserData.QuadtreeMeshVertexFactoryRaytracingVFUniformBuffer = FQuadtreeMeshVertexFactoryRaytracingParametersRef::CreateUniformBufferImmediate(UniformBufferParams, UniformBuffer_SingleFrame);
 							
@@ -623,25 +1366,166 @@ void FQuadtreeMeshSceneProxy::SetupRayTracingInstances(FRHICommandListBase& RHIC
 	}
 }
 
+void FQuadtreeMeshSceneProxy::ReleaseRayTracingData()
+{
+	for (auto& QuadtreeMeshDataArray : RayTracingQuadtreeMeshData)
+	{
+		for (auto& QuadtreeMeshRayTracingItem : QuadtreeMeshDataArray)
+		{
+			QuadtreeMeshRayTracingItem.Geometry.ReleaseResource();
+			QuadtreeMeshRayTracingItem.DynamicVertexBuffer.Release();
+		}
+		QuadtreeMeshDataArray.Empty();
+	}
+
+	RayTracingMemorySize = 0;
+}
+#endif
+
+
+
+bool FQuadtreeMeshSceneProxy::TryAcceptSpeculativeTraversal(const FSceneView& View, const FMeshQuadTree::FTraversalDesc& InTraversalDesc,
+	FMeshQuadTree::FTraversalOutput& Output) const
+{
+	FSpeculativeTraversal& Speculative = SpeculativeTraversal;
+	if (Speculative.TargetFrameNumber != View.Family->FrameNumber || Speculative.ViewKey != View.GetViewKey())
+	{
+		return false;
+	}
+	Speculative.TargetFrameNumber = INDEX_NONE;
+
+	// Within tolerance, the widened predicted frustum contains the actual one and the LOD selection barely moves
+	const FMeshQuadTree::FTraversalDesc& Predicted = Speculative.Desc;
+	const bool bHit = Speculative.Task.IsCompleted()
+		&& FVector::Dist(View.ViewMatrices.GetViewOrigin(), Predicted.ObserverPosition) <= Speculative.PositionTolerance
+		&& QuadtreeMeshSpeculativeTraversal::GetViewRotation(View).AngularDistance(Speculative.PredictedRotation) <= Speculative.AngleTolerance
+		&& View.ViewMatrices.GetProjectionNoAAMatrix().Equals(Speculative.ProjectionMatrix)
+		&& Predicted.LowestLOD == InTraversalDesc.LowestLOD
+		&& Predicted.LODScale == InTraversalDesc.LODScale
+		&& Predicted.DensityCount == InTraversalDesc.DensityCount
+		&& Predicted.MinDensityIndex == InTraversalDesc.MinDensityIndex
+		&& Predicted.ForceCollapseDensityLevel == InTraversalDesc.ForceCollapseDensityLevel
+		&& Predicted.TessellatedQuadtreeMeshBounds == InTraversalDesc.TessellatedQuadtreeMeshBounds
+		&& Predicted.ClipCircle == InTraversalDesc.ClipCircle
+		&& Predicted.BoundsPadding == InTraversalDesc.BoundsPadding
+		&& Predicted.bWideTraversal == InTraversalDesc.bWideTraversal;
+
+	QuadtreeMeshSpeculativeTraversal::RecordResult(bHit);
+
+	if (!bHit)
+	{
+		return false;
+	}
+
+	Output.SelectedTiles = MoveTemp(Speculative.Output.SelectedTiles);
+	Output.BucketInstanceCounts = MoveTemp(Speculative.Output.BucketInstanceCounts);
+	Output.InstanceCount = Speculative.Output.InstanceCount;
+	return true;
+}
+
+void FQuadtreeMeshSceneProxy::LaunchSpeculativeTraversal(const FSceneView& View, const FMeshQuadTree::FTraversalDesc& InTraversalDesc) const
+{
+	FSpeculativeTraversal& Speculative = SpeculativeTraversal;
+
+	const uint32 FrameNumber = View.Family->FrameNumber;
+	const FVector ViewOrigin = View.ViewMatrices.GetViewOrigin();
+	const FQuat ViewRotation = QuadtreeMeshSpeculativeTraversal::GetViewRotation(View);
 
+	const bool bHasHistory = Speculative.LastFrameNumber + 1 == FrameNumber && Speculative.ViewKey == View.GetViewKey();
+	const FVector LastViewOrigin = Speculative.LastViewOrigin;
+	const FQuat LastViewRotation = Speculative.LastViewRotation;
+
+	Speculative.LastViewOrigin = ViewOrigin;
+	Speculative.LastViewRotation = ViewRotation;
+	Speculative.LastFrameNumber = FrameNumber;
+	Speculative.ViewKey = View.GetViewKey();
+
+	// A prediction that came too late is still running, don't queue another one behind it
+	if (!bHasHistory || !Speculative.Task.IsCompleted())
+	{
+		return;
+	}
+
+	// Constant velocity over one frame
+	const FVector PredictedOrigin = ViewOrigin + (ViewOrigin - LastViewOrigin);
+	FQuat PredictedRotation = (ViewRotation * LastViewRotation.Inverse()) * ViewRotation;
+	PredictedRotation.Normalize();
+
+	const float PositionTolerance = FMath::Max(CVarQuadtreeMeshSpeculativePositionTolerance.GetValueOnRenderThread(), 0.0f);
+	const float AngleTolerance = FMath::DegreesToRadians(FMath::Clamp(CVarQuadtreeMeshSpeculativeAngleTolerance.GetValueOnRenderThread(), 0.0f, 45.0f));
+
+	// An accepted view rotation (roll included) moves each view ray by at most the angle tolerance, so all its rays are within the diagonal half-angle
+	// plus the tolerance of the predicted view direction. The predicted frustum is the square one containing that cone, its planes pushed out by the position tolerance.
+	// Past MaxSpeculativeHalfAngle the frustum would cover most of the hemisphere (and invert at 90 degrees), the next frame is traversed as usual then
+	constexpr double MaxSpeculativeHalfAngle = UE_DOUBLE_HALF_PI * (8.0 / 9.0);
+	FMatrix ProjectionMatrix = View.ViewMatrices.GetProjectionNoAAMatrix();
+	const double TanHalfAngleX = (1.0 + FMath::Abs(ProjectionMatrix.M[2][0])) / ProjectionMatrix.M[0][0];
+	const double TanHalfAngleY = (1.0 + FMath::Abs(ProjectionMatrix.M[2][1])) / ProjectionMatrix.M[1][1];
+	const double PredictedHalfAngle = FMath::Atan(FMath::Sqrt(FMath::Square(TanHalfAngleX) + FMath::Square(TanHalfAngleY))) + AngleTolerance;
+	if (PredictedHalfAngle > MaxSpeculativeHalfAngle)
+	{
+		return;
+	}
+	ProjectionMatrix.M[0][0] = 1.0 / FMath::Tan(PredictedHalfAngle);
+	ProjectionMatrix.M[1][1] = ProjectionMatrix.M[0][0];
+	ProjectionMatrix.M[2][0] = 0.0;
+	ProjectionMatrix.M[2][1] = 0.0;
+
+	const FMatrix PredictedViewMatrix = FTranslationMatrix(-PredictedOrigin) * PredictedRotation.ToMatrix();
+
+	FConvexVolume PredictedFrustum;
+	GetViewFrustumBounds(PredictedFrustum, PredictedViewMatrix * ProjectionMatrix, false);
+	for (FPlane& Plane : PredictedFrustum.Planes)
+	{
+		Plane.W += PositionTolerance;
+	}
+	PredictedFrustum.Init();
+
+	const FQuadtreeMeshLODParams QuadtreeMeshLODParams = GetQuadtreeMeshLODParams(PredictedOrigin);
+
+	Speculative.Desc = InTraversalDesc;
+	Speculative.Desc.LowestLOD = QuadtreeMeshLODParams.LowestLOD;
+	Speculative.Desc.HeightMorph = QuadtreeMeshLODParams.HeightLODFactor;
+	Speculative.Desc.ObserverPosition = PredictedOrigin;
+	Speculative.Desc.Frustum = PredictedFrustum;
+#if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
+	Speculative.Desc.DebugPDI = nullptr;
+#endif
+
+	Speculative.ProjectionMatrix = View.ViewMatrices.GetProjectionNoAAMatrix();
+	Speculative.PredictedRotation = PredictedRotation;
+	Speculative.PositionTolerance = PositionTolerance;
+	Speculative.AngleTolerance = AngleTolerance;
+	Speculative.TargetFrameNumber = FrameNumber + 1;
+
+	Speculative.Output = FMeshQuadTree::FTraversalOutput();
+	Speculative.Output.BucketInstanceCounts.SetNumZeroed(InTraversalDesc.DensityCount * MeshQuadTree.GetQuadtreeMeshMaterials().Num());
+
+	// Only the selection is speculative, the packing depends on the actual view
+	Speculative.Task = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this]()
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(QuadtreeMeshSpeculativeTraversal);
+		MeshQuadTree.SelectQuadtreeMeshTiles(SpeculativeTraversal.Desc, SpeculativeTraversal.Output);
+	}, UE::Tasks::ETaskPriority::BackgroundNormal);
+}
 
 FQuadtreeMeshSceneProxy::FQuadtreeMeshLODParams FQuadtreeMeshSceneProxy::GetQuadtreeMeshLODParams(
-	const FVector& Position) const
+	const FMeshQuadTree& InMeshQuadTree, float InLODScale, const FVector& Position)
 {
 	float QuadtreeMeshHeightForLOD = 0.0f;
-	MeshQuadTree.QueryInterpolatedTileBaseHeightAtLocation(FVector2D(Position), QuadtreeMeshHeightForLOD);
+	InMeshQuadTree.QueryInterpolatedTileBaseHeightAtLocation(FVector2D(Position), QuadtreeMeshHeightForLOD);
 
 	// Need to let the lowest LOD morph globally towards the next LOD. When the LOD is done morphing, simply clamp the LOD in the LOD selection to effectively promote the lowest LOD to the same LOD level as the one above
-	float DistToQuadtreeMesh = FMath::Abs(Position.Z - QuadtreeMeshHeightForLOD) / LODScale;
+	float DistToQuadtreeMesh = FMath::Abs(Position.Z - QuadtreeMeshHeightForLOD) / InLODScale;
 	DistToQuadtreeMesh = FMath::Max(DistToQuadtreeMesh - 2.0f, 0.0f);
 	DistToQuadtreeMesh *= 2.0f;
 
 	// Clamp to WaterTileQuadTree.GetLODCount() - 1.0f prevents the last LOD to morph
-	const float FloatLOD = FMath::Clamp(FMath::Log2(DistToQuadtreeMesh), 0.0f, MeshQuadTree.GetTreeDepth() - 1.0f);
+	const float FloatLOD = FMath::Clamp(FMath::Log2(DistToQuadtreeMesh), 0.0f, InMeshQuadTree.GetTreeDepth() - 1.0f);
 
 	FQuadtreeMeshLODParams QuadtreeMeshLODParams;
 	QuadtreeMeshLODParams.HeightLODFactor = FMath::Frac(FloatLOD);
-	QuadtreeMeshLODParams.LowestLOD = FMath::Clamp(FMath::FloorToInt(FloatLOD), 0, MeshQuadTree.GetTreeDepth() - 1);
+	QuadtreeMeshLODParams.LowestLOD = FMath::Clamp(FMath::FloorToInt(FloatLOD), 0, InMeshQuadTree.GetTreeDepth() - 1);
 	QuadtreeMeshLODParams.QuadtreeMeshHeightForLOD = QuadtreeMeshHeightForLOD;
 
 	return QuadtreeMeshLODParams;
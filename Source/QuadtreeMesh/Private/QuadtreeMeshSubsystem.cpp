@@ -3,8 +3,17 @@
 
 #include "QuadtreeMeshSubsystem.h"
 
-#include "EngineUtils.h"
+#include "Async/ParallelFor.h"
+#include "QuadtreeMesh.h"
 #include "QuadtreeMeshActor.h"
+#include "QuadtreeMeshComponent.h"
+#include "QuadtreeMeshSceneProxy.h"
+#include "QuadtreeMeshStats.h"
+
+DECLARE_MEMORY_STAT(TEXT("GPU Memory"), STAT_QuadtreeMeshGPUMemory, STATGROUP_QuadtreeMesh);
+DECLARE_MEMORY_STAT(TEXT("GPU Budget"), STAT_QuadtreeMeshGPUBudget, STATGROUP_QuadtreeMesh);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Evicted Density Levels"), STAT_QuadtreeMeshEvictedDensityLevels, STATGROUP_QuadtreeMesh);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Evicted Ray Tracing Meshes"), STAT_QuadtreeMeshEvictedRayTracingMeshes, STATGROUP_QuadtreeMesh);
 
 #if WITH_EDITOR
 
@@ -12,6 +21,24 @@ bool UQuadtreeMeshSubsystem::bAllowQuadtreeMeshSubsystemOnPreviewWorld = false;
 
 #endif
 
+static TAutoConsoleVariable<int32> CVarQuadtreeMeshParallelRebuild(
+	TEXT("r.QuadtreeMesh.ParallelRebuild"),
+	1,
+	TEXT("Build the trees of all the quadtree meshes dirtied in the same frame concurrently."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarQuadtreeMeshGPUBudgetMB(
+	TEXT("r.QuadtreeMesh.GPUBudgetMB"),
+	0.0f,
+	TEXT("GPU memory budget in MB shared by all the quadtree meshes (grids, instance buffers and ray tracing geometry). Over budget, the ray tracing data then the densest grids of the least important meshes are evicted. 0 disables the budget."),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<float> CVarQuadtreeMeshGPUBudgetUpdatePeriod(
+	TEXT("r.QuadtreeMesh.GPUBudgetUpdatePeriod"),
+	0.5f,
+	TEXT("Seconds between two evaluations of the quadtree mesh GPU budget."),
+	ECVF_Default);
+
 UQuadtreeMeshSubsystem::UQuadtreeMeshSubsystem()
 {
 	
@@ -21,12 +48,391 @@ void UQuadtreeMeshSubsystem::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 	check(GetWorld() != nullptr);
-	
-	for (AQuadtreeMeshActor* QuadtreeMeshActor : TActorRange<AQuadtreeMeshActor>(GetWorld()))
+
+	// Before the rebuilds, higher waves grow the bounds in the same tick
+	UpdateOceanSimulations();
+	RebuildDirtyQuadtreeMeshes();
+	UpdateOverlapActors();
+	ApplyScalability();
+	UpdateGPUBudget(DeltaTime);
+	UpdateGPUSceneInstances();
+}
+
+void UQuadtreeMeshSubsystem::RebuildDirtyQuadtreeMeshes()
+{
+	TArray<UQuadtreeMeshComponent*, TInlineAllocator<16>> DirtyComponents;
+	for (const TWeakObjectPtr<UQuadtreeMeshComponent>& WeakComponent : QuadtreeMeshComponents)
+	{
+		UQuadtreeMeshComponent* Component = WeakComponent.Get();
+		if (Component && Component->NeedsRebuild())
+		{
+			DirtyComponents.Add(Component);
+		}
+	}
+
+	if (DirtyComponents.Num() == 0)
+	{
+		return;
+	}
+
+	TRACE_CPUPROFILER_EVENT_SCOPE(UQuadtreeMeshSubsystem::RebuildDirtyQuadtreeMeshes);
+
+	for (UQuadtreeMeshComponent* Component : DirtyComponents)
+	{
+		Component->PrepareRebuild();
+	}
+
+	// Each build only touches its own tree, one task per component
+	const EParallelForFlags Flags = CVarQuadtreeMeshParallelRebuild.GetValueOnGameThread() != 0 ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread;
+	ParallelFor(TEXT("QuadtreeMesh.Rebuild"), DirtyComponents.Num(), 1, [&DirtyComponents](int32 Index)
+	{
+		DirtyComponents[Index]->BuildQuadtreeMesh();
+	}, Flags);
+
+	// Render state and PSO precaching are game thread only
+	for (UQuadtreeMeshComponent* Component : DirtyComponents)
+	{
+		Component->FinishRebuild();
+	}
+}
+
+void UQuadtreeMeshSubsystem::RegisterOverlapActor(AActor* Actor)
+{
+	if (Actor && !TrackedOverlapActors.ContainsByPredicate([Actor](const FTrackedOverlapActor& Tracked) { return Tracked.Actor == Actor; }))
+	{
+		FTrackedOverlapActor& Tracked = TrackedOverlapActors.AddDefaulted_GetRef();
+		Tracked.Actor = Actor;
+	}
+}
+
+void UQuadtreeMeshSubsystem::UnregisterOverlapActor(AActor* Actor)
+{
+	TrackedOverlapActors.RemoveAllSwap([Actor](const FTrackedOverlapActor& Tracked) { return Tracked.Actor == Actor; });
+}
+
+UQuadtreeMeshComponent* UQuadtreeMeshSubsystem::GetOverlappedQuadtreeMesh(const AActor* Actor) const
+{
+	const FTrackedOverlapActor* Tracked = TrackedOverlapActors.FindByPredicate([Actor](const FTrackedOverlapActor& Tracked) { return Tracked.Actor == Actor; });
+	return Tracked ? Tracked->OverlappedComponent.Get() : nullptr;
+}
+
+FQuadtreeMeshTelemetry UQuadtreeMeshSubsystem::GetTotalTelemetry() const
+{
+	FQuadtreeMeshTelemetry Total;
+	for (const TWeakObjectPtr<UQuadtreeMeshComponent>& ComponentPtr : QuadtreeMeshComponents)
+	{
+		if (const UQuadtreeMeshComponent* Component = ComponentPtr.Get())
+		{
+			Total += Component->GetTelemetry();
+		}
+	}
+	return Total;
+}
+
+void UQuadtreeMeshSubsystem::RegisterQuadtreeMeshComponent(UQuadtreeMeshComponent* Component)
+{
+	QuadtreeMeshComponents.AddUnique(Component);
+	NotifyCoverageChanged();
+}
+
+void UQuadtreeMeshSubsystem::UnregisterQuadtreeMeshComponent(UQuadtreeMeshComponent* Component)
+{
+	QuadtreeMeshComponents.RemoveSwap(Component);
+	NotifyCoverageChanged();
+}
+
+const TArray<UQuadtreeMeshSubsystem::FQuadTreeSnapshot>& UQuadtreeMeshSubsystem::GetQuadTreeSnapshots()
+{
+	check(IsInGameThread());
+
+	if (QuadTreeSnapshotsRevision == CoverageRevision)
+	{
+		return QuadTreeSnapshots;
+	}
+
+	TRACE_CPUPROFILER_EVENT_SCOPE(UQuadtreeMeshSubsystem::GetQuadTreeSnapshots);
+
+	TArray<FCachedQuadTreeSnapshot> PreviousSnapshots = MoveTemp(CachedQuadTreeSnapshots);
+	CachedQuadTreeSnapshots.Reset(QuadtreeMeshComponents.Num());
+
+	TArray<TPair<int32, FQuadTreeSnapshot>, TInlineAllocator<8>> SortedSnapshots;
+	for (const TWeakObjectPtr<UQuadtreeMeshComponent>& WeakComponent : QuadtreeMeshComponents)
+	{
+		const UQuadtreeMeshComponent* Component = WeakComponent.Get();
+		if (!Component || Component->GetMeshQuadTree().GetNodeCount() == 0)
+		{
+			continue;
+		}
+
+		// Only trees rebuilt since the last refresh are copied
+		FCachedQuadTreeSnapshot* Previous = PreviousSnapshots.FindByPredicate([Component](const FCachedQuadTreeSnapshot& Cached) { return Cached.Component == Component; });
+		FCachedQuadTreeSnapshot& Snapshot = CachedQuadTreeSnapshots.AddDefaulted_GetRef();
+		Snapshot.Component = Component;
+		Snapshot.TreeRevision = Component->GetTreeRevision();
+		Snapshot.Tree = Previous && Previous->TreeRevision == Snapshot.TreeRevision ? Previous->Tree : MakeShared<const FMeshQuadTree, ESPMode::ThreadSafe>(Component->GetMeshQuadTree());
+
+		const AQuadtreeMeshActor* QuadtreeMeshActor = Cast<AQuadtreeMeshActor>(Component->GetOwner());
+		SortedSnapshots.Emplace(QuadtreeMeshActor ? QuadtreeMeshActor->GetOverlapPriority() : 0, Snapshot.Tree);
+	}
+	SortedSnapshots.StableSort([](const TPair<int32, FQuadTreeSnapshot>& A, const TPair<int32, FQuadTreeSnapshot>& B) { return A.Key > B.Key; });
+
+	QuadTreeSnapshots.Reset(SortedSnapshots.Num());
+	for (const TPair<int32, FQuadTreeSnapshot>& Snapshot : SortedSnapshots)
+	{
+		QuadTreeSnapshots.Add(Snapshot.Value);
+	}
+	QuadTreeSnapshotsRevision = CoverageRevision;
+	return QuadTreeSnapshots;
+}
+
+void UQuadtreeMeshSubsystem::UpdateOverlapActors()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(UQuadtreeMeshSubsystem::UpdateOverlapActors);
+
+	for (int32 Index = TrackedOverlapActors.Num() - 1; Index >= 0; --Index)
+	{
+		// Event handlers may have removed actors
+		if (!TrackedOverlapActors.IsValidIndex(Index))
+		{
+			continue;
+		}
+
+		FTrackedOverlapActor& Tracked = TrackedOverlapActors[Index];
+		AActor* Actor = Tracked.Actor.Get();
+		if (!Actor)
+		{
+			TrackedOverlapActors.RemoveAtSwap(Index);
+			continue;
+		}
+
+		const FVector2D Location(Actor->GetActorLocation());
+
+		// Stationary actors, or actors moving within their cell, don't need a new query
+		if (Tracked.CoverageRevision == CoverageRevision
+			&& Location.X >= Tracked.Cell.Min.X && Location.X < Tracked.Cell.Max.X
+			&& Location.Y >= Tracked.Cell.Min.Y && Location.Y < Tracked.Cell.Max.Y)
+		{
+			continue;
+		}
+
+		// The cell is the intersection of the cells of every mesh, so crossing any of their boundaries triggers a new query
+		FBox2D Cell(FVector2D(-UE_OLD_WORLD_MAX), FVector2D(UE_OLD_WORLD_MAX));
+		UQuadtreeMeshComponent* OverlappedComponent = nullptr;
+		int32 OverlappedPriority = TNumericLimits<int32>::Lowest();
+		for (const TWeakObjectPtr<UQuadtreeMeshComponent>& WeakComponent : QuadtreeMeshComponents)
+		{
+			const UQuadtreeMeshComponent* Component = WeakComponent.Get();
+			if (!Component)
+			{
+				continue;
+			}
+
+			FBox2D ComponentCell;
+			uint32 QuadtreeMeshIndex = 0;
+			Component->GetMeshQuadTree().QueryCoverageCellAtLocation(Location, ComponentCell, QuadtreeMeshIndex);
+
+			Cell.Min = FVector2D::Max(Cell.Min, ComponentCell.Min);
+			Cell.Max = FVector2D::Min(Cell.Max, ComponentCell.Max);
+
+			if (QuadtreeMeshIndex != 0)
+			{
+				// Overlapping meshes resolve like the rest of the plugin, the highest overlap priority wins
+				const AQuadtreeMeshActor* QuadtreeMeshActor = Cast<AQuadtreeMeshActor>(Component->GetOwner());
+				const int32 Priority = QuadtreeMeshActor ? QuadtreeMeshActor->GetOverlapPriority() : 0;
+				if (!OverlappedComponent || Priority > OverlappedPriority)
+				{
+					OverlappedComponent = const_cast<UQuadtreeMeshComponent*>(Component);
+					OverlappedPriority = Priority;
+				}
+			}
+		}
+
+		Tracked.Cell = Cell;
+		Tracked.CoverageRevision = CoverageRevision;
+
+		UQuadtreeMeshComponent* PreviousComponent = Tracked.OverlappedComponent.Get();
+		if (PreviousComponent != OverlappedComponent)
+		{
+			Tracked.OverlappedComponent = OverlappedComponent;
+
+			// Broadcasting may register or unregister actors, Tracked must not be used after this point
+			if (PreviousComponent)
+			{
+				OnActorExitedQuadtreeMesh.Broadcast(Actor, PreviousComponent);
+			}
+			if (OverlappedComponent)
+			{
+				OnActorEnteredQuadtreeMesh.Broadcast(Actor, OverlappedComponent);
+			}
+		}
+	}
+}
+
+void UQuadtreeMeshSubsystem::ApplyScalability()
+{
+	const FQuadtreeMeshScalability Scalability = FQuadtreeMeshScalability::Get();
+	if (Scalability == AppliedScalability)
+	{
+		return;
+	}
+	AppliedScalability = Scalability;
+
+	// Proxies created from now on read the new settings themselves
+	for (const TWeakObjectPtr<UQuadtreeMeshComponent>& WeakComponent : QuadtreeMeshComponents)
+	{
+		UQuadtreeMeshComponent* Component = WeakComponent.Get();
+		if (Component && Component->SceneProxy)
+		{
+			static_cast<FQuadtreeMeshSceneProxy*>(Component->SceneProxy)->SetScalability_GameThread(Scalability);
+		}
+	}
+
+	// Clamped densities change what the budget has to work with
+	TimeSinceGPUBudgetUpdate = CVarQuadtreeMeshGPUBudgetUpdatePeriod.GetValueOnGameThread();
+}
+
+void UQuadtreeMeshSubsystem::UpdateGPUBudget(float DeltaTime)
+{
+	TimeSinceGPUBudgetUpdate += DeltaTime;
+	if (TimeSinceGPUBudgetUpdate < CVarQuadtreeMeshGPUBudgetUpdatePeriod.GetValueOnGameThread())
+	{
+		return;
+	}
+	TimeSinceGPUBudgetUpdate = 0.0f;
+
+	TRACE_CPUPROFILER_EVENT_SCOPE(UQuadtreeMeshSubsystem::UpdateGPUBudget);
+
+	struct FBudgetEntry
+	{
+		UQuadtreeMeshComponent* Component = nullptr;
+		const FQuadtreeMeshSceneProxy* SceneProxy = nullptr;
+		double Importance = 0.0;
+		uint64 RayTracingBytes = 0;
+		int32 EvictedDensityLevels = 0;
+		bool bEvictRayTracing = false;
+	};
+
+	TArray<FBudgetEntry, TInlineAllocator<16>> Entries;
+	const TArray<FVector>& ViewLocations = GetWorld()->ViewLocationsRenderedLastFrame;
+
+	// What every mesh would use with nothing evicted, and what they use now
+	uint64 RequestedBytes = 0;
+	uint64 UsedBytes = 0;
+	for (const TWeakObjectPtr<UQuadtreeMeshComponent>& WeakComponent : QuadtreeMeshComponents)
+	{
+		UQuadtreeMeshComponent* Component = WeakComponent.Get();
+		if (!Component || !Component->SceneProxy)
+		{
+			continue;
+		}
+
+		FBudgetEntry& Entry = Entries.AddDefaulted_GetRef();
+		Entry.Component = Component;
+		Entry.SceneProxy = static_cast<const FQuadtreeMeshSceneProxy*>(Component->SceneProxy);
+
+		const FQuadtreeMeshSceneProxy::FGPUMemoryUsage Usage = Entry.SceneProxy->GetGPUMemoryUsage();
+		Entry.RayTracingBytes = Component->IsRayTracingEvictedByGPUBudget() ? Entry.SceneProxy->GetLastRayTracingMemorySize() : Usage.RayTracingBytes;
+		UsedBytes += Usage.GetTotal();
+
+		// Densities clamped by the scalability settings are never requested
+		const TArray<uint64>& GridSizes = Entry.SceneProxy->GetDensityGridMemorySizes();
+		Entry.EvictedDensityLevels = FMath::Clamp(AppliedScalability.ClampedDensityLevels, 0, FMath::Max(GridSizes.Num() - 1, 0));
+
+		RequestedBytes += Usage.InstanceBytes + Entry.RayTracingBytes;
+		for (int32 DensityIndex = Entry.EvictedDensityLevels; DensityIndex < GridSizes.Num(); ++DensityIndex)
+		{
+			RequestedBytes += GridSizes[DensityIndex];
+		}
+
+		// Screen size from the closest view, a view inside the bounds makes the mesh the most important
+		const FBox Box = Component->Bounds.GetBox();
+		for (const FVector& ViewLocation : ViewLocations)
+		{
+			const double Distance = FMath::Sqrt(Box.ComputeSquaredDistanceToPoint(ViewLocation));
+			Entry.Importance = FMath::Max(Entry.Importance, Component->Bounds.SphereRadius / FMath::Max(Distance, 1.0));
+		}
+	}
+
+	const uint64 BudgetBytes = static_cast<uint64>(FMath::Max(CVarQuadtreeMeshGPUBudgetMB.GetValueOnGameThread(), 0.0f) * 1024.0 * 1024.0);
+	uint64 BudgetedBytes = RequestedBytes;
+	if (BudgetBytes > 0 && BudgetedBytes > BudgetBytes)
+	{
+		Entries.Sort([](const FBudgetEntry& A, const FBudgetEntry& B) { return A.Importance < B.Importance; });
+
+		// Ray tracing data goes first, it only affects secondary effects
+		for (FBudgetEntry& Entry : Entries)
+		{
+			if (BudgetedBytes <= BudgetBytes)
+			{
+				break;
+			}
+			if (Entry.RayTracingBytes > 0)
+			{
+				Entry.bEvictRayTracing = true;
+				BudgetedBytes -= Entry.RayTracingBytes;
+			}
+		}
+
+		// Then the densest grids, the coarsest one always stays so every mesh keeps rendering
+		for (FBudgetEntry& Entry : Entries)
+		{
+			const TArray<uint64>& GridSizes = Entry.SceneProxy->GetDensityGridMemorySizes();
+			while (BudgetedBytes > BudgetBytes && Entry.EvictedDensityLevels < GridSizes.Num() - 1)
+			{
+				BudgetedBytes -= GridSizes[Entry.EvictedDensityLevels++];
+			}
+		}
+	}
+
+	int32 EvictedDensityLevels = 0;
+	int32 EvictedRayTracingMeshes = 0;
+	for (const FBudgetEntry& Entry : Entries)
+	{
+		UQuadtreeMeshComponent* Component = Entry.Component;
+		if (Entry.EvictedDensityLevels != Component->GetGPUBudgetEvictedDensityLevels() || Entry.bEvictRayTracing != Component->IsRayTracingEvictedByGPUBudget())
+		{
+			UE_LOG(LogQuadtreeMesh, Log, TEXT("GPU budget: %s now evicts %d density levels%s (%.1f MB requested, %.1f MB budget)"),
+				*Component->GetPathName(), Entry.EvictedDensityLevels, Entry.bEvictRayTracing ? TEXT(" and its ray tracing data") : TEXT(""),
+				RequestedBytes / (1024.0 * 1024.0), BudgetBytes / (1024.0 * 1024.0));
+
+			Component->SetGPUBudgetEviction(Entry.EvictedDensityLevels, Entry.bEvictRayTracing);
+		}
+
+		EvictedDensityLevels += Entry.EvictedDensityLevels;
+		EvictedRayTracingMeshes += Entry.bEvictRayTracing ? 1 : 0;
+	}
+
+	SET_MEMORY_STAT(STAT_QuadtreeMeshGPUMemory, UsedBytes);
+	SET_MEMORY_STAT(STAT_QuadtreeMeshGPUBudget, BudgetBytes);
+	SET_DWORD_STAT(STAT_QuadtreeMeshEvictedDensityLevels, EvictedDensityLevels);
+	SET_DWORD_STAT(STAT_QuadtreeMeshEvictedRayTracingMeshes, EvictedRayTracingMeshes);
+}
+
+void UQuadtreeMeshSubsystem::UpdateGPUSceneInstances()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(UQuadtreeMeshSubsystem::UpdateGPUSceneInstances);
+
+	// Every view the world was rendered from, split screen players and editor viewports included
+	const TArray<FVector>& ViewLocations = GetWorld()->ViewLocationsRenderedLastFrame;
+	for (const TWeakObjectPtr<UQuadtreeMeshComponent>& WeakComponent : QuadtreeMeshComponents)
+	{
+		if (UQuadtreeMeshComponent* Component = WeakComponent.Get())
+		{
+			Component->UpdateGPUSceneInstances(ViewLocations);
+		}
+	}
+}
+
+void UQuadtreeMeshSubsystem::UpdateOceanSimulations()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(UQuadtreeMeshSubsystem::UpdateOceanSimulations);
+
+	const double WorldTime = GetWorld()->GetTimeSeconds();
+	for (const TWeakObjectPtr<UQuadtreeMeshComponent>& WeakComponent : QuadtreeMeshComponents)
 	{
-		if (QuadtreeMeshActor)
+		if (UQuadtreeMeshComponent* Component = WeakComponent.Get())
 		{
-			QuadtreeMeshActor->Update();
+			Component->UpdateOceanSimulation(WorldTime);
 		}
 	}
 }
@@ -5,6 +5,8 @@
 #include "MeshBatch.h"
 #include "MeshMaterialShader.h"
 #include "RenderUtils.h"
+#include "GlobalRenderResources.h"
+#include "Math/DoubleFloat.h"
 
 IMPLEMENT_GLOBAL_SHADER_PARAMETER_STRUCT(FQuadtreeMeshVertexFactoryParameters, "QuadtreeMeshVF");
 IMPLEMENT_GLOBAL_SHADER_PARAMETER_STRUCT(FQuadtreeMeshVertexFactoryRaytracingParameters, "QuadtreeMeshRaytracingVF");
@@ -17,6 +19,7 @@ public:
 
 	void Bind(const FShaderParameterMap& ParameterMap)
 	{
+		QuadtreeMeshParameters.Bind(ParameterMap, TEXT("QuadtreeMeshParameters"));
 	}
 
 	void GetElementShaderBindings(
@@ -40,6 +43,12 @@ public:
 
 		ShaderBindings.Add(Shader->GetUniformBufferParameter<FQuadtreeMeshVertexFactoryParameters>(), VertexFactory->GeFQuadtreeMeshVertexFactoryUniformBuffer(QuadtreeMeshUserData->RenderGroupType));
 
+		if (QuadtreeMeshParameters.IsBound())
+		{
+			check(QuadtreeMeshUserData->ParameterBuffer);
+			ShaderBindings.Add(QuadtreeMeshParameters, QuadtreeMeshUserData->ParameterBuffer->GetSRV());
+		}
+
 #if RHI_RAYTRACING
 		if (IsRayTracingEnabled())
 		{
@@ -65,15 +74,59 @@ public:
 			}
 		}
 	}
+
+private:
+	/** Per render data parameters, see FQuadtreeMeshParameterBuffer */
+	LAYOUT_FIELD(FShaderResourceParameter, QuadtreeMeshParameters);
 };
 
-FQuadtreeMeshVertexFactory::FQuadtreeMeshVertexFactory(ERHIFeatureLevel::Type InFeatureLevel, int32 InNumQuadsPerSide, float InLODScale)
+/** The instance comes from the primitive id stream the engine binds, only the uniforms and the parameters of the grid factory are left */
+class FQuadtreeMeshGPUSceneVertexFactoryShaderParameters : public FVertexFactoryShaderParameters
+{
+	DECLARE_TYPE_LAYOUT(FQuadtreeMeshGPUSceneVertexFactoryShaderParameters, NonVirtual);
+public:
+
+	void Bind(const FShaderParameterMap& ParameterMap)
+	{
+		QuadtreeMeshParameters.Bind(ParameterMap, TEXT("QuadtreeMeshParameters"));
+	}
+
+	void GetElementShaderBindings(
+		const class FSceneInterface* Scene,
+		const class FSceneView* View,
+		const class FMeshMaterialShader* Shader,
+		const EVertexInputStreamType InputStreamType,
+		ERHIFeatureLevel::Type FeatureLevel,
+		const class FVertexFactory* InVertexFactory,
+		const struct FMeshBatchElement& BatchElement,
+		class FMeshDrawSingleShaderBindings& ShaderBindings,
+		FVertexInputStreamArray& VertexStreams) const
+	{
+		const FQuadtreeMeshVertexFactory* GridVertexFactory = static_cast<const FQuadtreeMeshGPUSceneVertexFactory*>(InVertexFactory)->GetGridVertexFactory();
+		const FQuadtreeMeshUserData* QuadtreeMeshUserData = static_cast<const FQuadtreeMeshUserData*>(BatchElement.UserData);
+
+		ShaderBindings.Add(Shader->GetUniformBufferParameter<FQuadtreeMeshVertexFactoryParameters>(), GridVertexFactory->GeFQuadtreeMeshVertexFactoryUniformBuffer(QuadtreeMeshUserData->RenderGroupType));
+
+		if (QuadtreeMeshParameters.IsBound())
+		{
+			check(QuadtreeMeshUserData->ParameterBuffer);
+			ShaderBindings.Add(QuadtreeMeshParameters, QuadtreeMeshUserData->ParameterBuffer->GetSRV());
+		}
+	}
+
+private:
+	/** Per render data parameters, see FQuadtreeMeshParameterBuffer */
+	LAYOUT_FIELD(FShaderResourceParameter, QuadtreeMeshParameters);
+};
+
+FQuadtreeMeshVertexFactory::FQuadtreeMeshVertexFactory(ERHIFeatureLevel::Type InFeatureLevel, int32 InNumQuadsPerSide, float InLODScale, const FVector& InClipCircle, bool bInRequestGrid)
 	: FVertexFactory(InFeatureLevel)
 	, NumQuadsPerSide(InNumQuadsPerSide)
 	, LODScale(InLODScale)
+	, ClipCircle(InClipCircle)
 {
-	VertexBuffer = new FQuadtreeMeshVertexBuffer(NumQuadsPerSide);
-	IndexBuffer = new FQuadtreeMeshIndexBuffer(NumQuadsPerSide);
+	VertexBuffer = new FQuadtreeMeshVertexBuffer(NumQuadsPerSide, bInRequestGrid);
+	IndexBuffer = new FQuadtreeMeshIndexBuffer(NumQuadsPerSide, bInRequestGrid);
 }
 
 
@@ -154,6 +207,69 @@ void FQuadtreeMeshVertexFactory::ReleaseRHI()
 }
 
 
+void FQuadtreeMeshVertexFactory::SetLODScale(float InLODScale)
+{
+	check(IsInRenderingThread());
+
+	if (LODScale == InLODScale)
+	{
+		return;
+	}
+
+	LODScale = InLODScale;
+
+	if (IsInitialized())
+	{
+		for (int32 GroupIndex = 0; GroupIndex < NumRenderGroups; ++GroupIndex)
+		{
+			SetupUniformDataForGroup(static_cast<EQuadtreeMeshRenderGroupType>(GroupIndex));
+		}
+	}
+}
+
+void FQuadtreeMeshVertexFactory::SetClipCircle(const FVector& InClipCircle)
+{
+	check(IsInRenderingThread());
+
+	if (ClipCircle == InClipCircle)
+	{
+		return;
+	}
+
+	ClipCircle = InClipCircle;
+
+	if (IsInitialized())
+	{
+		for (int32 GroupIndex = 0; GroupIndex < NumRenderGroups; ++GroupIndex)
+		{
+			SetupUniformDataForGroup(static_cast<EQuadtreeMeshRenderGroupType>(GroupIndex));
+		}
+	}
+}
+
+void FQuadtreeMeshVertexFactory::SetOcean(FRHITexture* InOceanTexture, FRHITexture* InOceanSlopeTexture, float InPatchSize, int32 InResolution)
+{
+	check(IsInRenderingThread());
+
+	if (OceanTexture == InOceanTexture && OceanSlopeTexture == InOceanSlopeTexture && OceanPatchSize == InPatchSize && OceanResolution == InResolution)
+	{
+		return;
+	}
+
+	OceanTexture = InOceanTexture;
+	OceanSlopeTexture = InOceanSlopeTexture;
+	OceanPatchSize = InOceanTexture ? InPatchSize : 0.0f;
+	OceanResolution = InOceanTexture ? InResolution : 0;
+
+	if (IsInitialized())
+	{
+		for (int32 GroupIndex = 0; GroupIndex < NumRenderGroups; ++GroupIndex)
+		{
+			SetupUniformDataForGroup(static_cast<EQuadtreeMeshRenderGroupType>(GroupIndex));
+		}
+	}
+}
+
 void FQuadtreeMeshVertexFactory::SetupUniformDataForGroup(EQuadtreeMeshRenderGroupType InRenderGroupType)
 {
 	FQuadtreeMeshVertexFactoryParameters UniformParams;
@@ -161,6 +277,16 @@ void FQuadtreeMeshVertexFactory::SetupUniformDataForGroup(EQuadtreeMeshRenderGro
 	UniformParams.LODScale = LODScale;
 	UniformParams.bRenderSelected = (InRenderGroupType != EQuadtreeMeshRenderGroupType::RG_RenderUnselectedQuadtreeMeshTilesOnly);
 	UniformParams.bRenderUnselected = (InRenderGroupType != EQuadtreeMeshRenderGroupType::RG_RenderSelectedQuadtreeMeshTilesOnly);
+	// Split so the shader can move the center to translated world space without losing precision far from the origin
+	const FDFVector3 ClipCenter(FVector(ClipCircle.X, ClipCircle.Y, 0.0));
+	UniformParams.ClipCenterHigh = ClipCenter.High;
+	UniformParams.ClipCenterLow = ClipCenter.Low;
+	UniformParams.ClipRadius = static_cast<float>(ClipCircle.Z);
+	// A zero patch size skips the lookup, the texture only has to be valid
+	UniformParams.OceanDisplacement = OceanTexture ? OceanTexture.GetReference() : GBlackTexture->TextureRHI.GetReference();
+	UniformParams.OceanSlope = OceanSlopeTexture ? OceanSlopeTexture.GetReference() : GBlackTexture->TextureRHI.GetReference();
+	UniformParams.OceanPatchSize = OceanPatchSize;
+	UniformParams.OceanResolution = OceanResolution;
 	UniformBuffers[static_cast<int32>(InRenderGroupType)] = FQuadtreeMeshVertexFactoryBufferRef::CreateUniformBufferImmediate(UniformParams, UniformBuffer_MultiFrame);
 }
 
@@ -202,6 +328,48 @@ void FQuadtreeMeshVertexFactory::GetPSOPrecacheVertexFetchElements(EVertexInputS
 	
 }
 
+FQuadtreeMeshGPUSceneVertexFactory::FQuadtreeMeshGPUSceneVertexFactory(ERHIFeatureLevel::Type InFeatureLevel, const FQuadtreeMeshVertexFactory* InGridVertexFactory)
+	: FVertexFactory(InFeatureLevel)
+	, GridVertexFactory(InGridVertexFactory)
+{
+}
+
+void FQuadtreeMeshGPUSceneVertexFactory::InitRHI(FRHICommandListBase& RHICmdList)
+{
+	Super::InitRHI(RHICmdList);
+
+	check(Streams.Num() == 0);
+
+	// The buffer is resolved when drawing, the grid factory may release and recreate it meanwhile
+	FVertexStream PositionVertexStream;
+	PositionVertexStream.VertexBuffer = GridVertexFactory->VertexBuffer;
+	PositionVertexStream.Stride = sizeof(FVector4f);
+	PositionVertexStream.Offset = 0;
+	PositionVertexStream.VertexStreamUsage = EVertexStreamUsage::Default;
+
+	FVertexDeclarationElementList Elements;
+	Elements.Add(FVertexElement(Streams.Add(PositionVertexStream), 0, VET_Float4, 0, PositionVertexStream.Stride, false));
+	AddPrimitiveIdStreamElement(EVertexInputStreamType::Default, Elements, 13, 0xff);
+	InitDeclaration(Elements);
+}
+
+bool FQuadtreeMeshGPUSceneVertexFactory::ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters& Parameters)
+{
+	return FQuadtreeMeshVertexFactory::ShouldCompilePermutation(Parameters) && UseGPUScene(Parameters.Platform, GetMaxSupportedFeatureLevel(Parameters.Platform));
+}
+
+void FQuadtreeMeshGPUSceneVertexFactory::ModifyCompilationEnvironment(const FVertexFactoryShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	OutEnvironment.SetDefine(TEXT("QUADTREE_MESH_FACTORY"), 1);
+	OutEnvironment.SetDefine(TEXT("QUADTREE_MESH_GPUSCENE_INSTANCES"), 1);
+}
+
+void FQuadtreeMeshGPUSceneVertexFactory::GetPSOPrecacheVertexFetchElements(EVertexInputStreamType VertexInputStreamType, FVertexDeclarationElementList& Elements)
+{
+	Elements.Add(FVertexElement(0, 0, VET_Float4, 0, sizeof(FVector4f), false));
+	Elements.Add(FVertexElement(1, 0, VET_UInt, 13, sizeof(uint32), true));
+}
+
 void FQuadtreeMeshVertexFactory::ValidateCompiledResult(const FVertexFactoryType* Type, EShaderPlatform Platform,
 	const FShaderParameterMap& ParameterMap, TArray<FString>& OutErrors)
 {
@@ -237,6 +405,17 @@ IMPLEMENT_VERTEX_FACTORY_TYPE(FQuadtreeMeshVertexFactory, "/Plugin/QuadtreeMesh/
    | EVertexFactoryFlags::SupportsPSOPrecaching
 	)
 
+// Same shader file, QUADTREE_MESH_GPUSCENE_INSTANCES selects the GPU Scene instance input. No ray tracing, the ray tracing tiles keep their own traversal
+IMPLEMENT_TYPE_LAYOUT(FQuadtreeMeshGPUSceneVertexFactoryShaderParameters);
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FQuadtreeMeshGPUSceneVertexFactory, SF_Vertex, FQuadtreeMeshGPUSceneVertexFactoryShaderParameters);
+IMPLEMENT_VERTEX_FACTORY_TYPE(FQuadtreeMeshGPUSceneVertexFactory, "/Plugin/QuadtreeMesh/Private/QuadtreeMeshVertexFactory.ush",
+	EVertexFactoryFlags::UsedWithMaterials
+   | EVertexFactoryFlags::SupportsDynamicLighting
+   | EVertexFactoryFlags::SupportsPrecisePrevWorldPos
+   | EVertexFactoryFlags::SupportsPrimitiveIdStream
+   | EVertexFactoryFlags::SupportsPSOPrecaching
+	)
+
 
 
 
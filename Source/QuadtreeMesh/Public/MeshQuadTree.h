@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include "Serialization/BulkData.h"
 
 class UQuadtreeMeshComponent;
 class FMaterialRenderProxy;
@@ -17,16 +18,33 @@ struct FQuadtreeMeshRenderData
 	/** Whether the water body actor is selected or not */
 	bool bQuadtreeMeshSelected = false;
 
+	/** Per body parameters, uploaded to the parameter buffer and fetched in the shader through the instance's render data index */
+	FLinearColor SurfaceColor = FLinearColor::White;
+	FVector4f WaveParameters = FVector4f::Zero();
+
 	bool operator==(const FQuadtreeMeshRenderData& Other) const
 	{
 		return	Material				== Other.Material &&
 				SurfaceBaseHeight		== Other.SurfaceBaseHeight
 				&& HitProxy == Other.HitProxy
-				&& bQuadtreeMeshSelected == Other.bQuadtreeMeshSelected; 
+				&& bQuadtreeMeshSelected == Other.bQuadtreeMeshSelected
+				&& SurfaceColor == Other.SurfaceColor
+				&& WaveParameters == Other.WaveParameters;
 	}
 	
 };
 
+/** The part of FQuadtreeMeshRenderData read by the traversal and the instance packing, kept small and dense to stay in cache */
+struct FQuadtreeMeshRenderDataHot
+{
+	double SurfaceBaseHeight = 0.0;
+	/** Resolved from the hit proxy when the render data is added, black if there is none */
+	FColor HitProxyColor = FColor::Black;
+	int16 MaterialIndex = INDEX_NONE;
+	bool bHasMaterial = false;
+	bool bQuadtreeMeshSelected = false;
+};
+
 
 struct FMeshQuadTree
 {
@@ -34,29 +52,112 @@ struct FMeshQuadTree
 
 	static constexpr int32 NumStreams =  3 ;
 
+	/** Number of float4 in the parameter buffer for each render data: [0] surface color, [1] wave parameters */
+	static constexpr int32 NumParametersPerRenderData = 2;
+
 	struct FStagingInstanceData
 	{
 		int32 BucketIndex;
+		/** False if the tile is outside of the frustum, only happens when gathering unculled instances */
+		bool bInFrustum;
 		FVector4f Data[NumStreams];
 	};
 
+	/** Result of a frustum test, carried down the traversal so that the descendants of fully inside or fully outside nodes don't get tested again */
+	enum class EFrustumTestResult : uint8
+	{
+		Intersecting,
+		Inside,
+		Outside,
+		/** Already found to intersect by a batched test of the parent, no need to test again */
+		KnownIntersecting,
+	};
+
+	/** Compact record of a node picked by the traversal. The packing stage turns these into FStagingInstanceData */
+	struct FSelectedTile
+	{
+		FVector2D Center;
+		FVector2f Size;
+		uint16 BucketIndex;
+		uint16 QuadtreeMeshIndex;
+		uint8 LODLevel;
+		uint8 DensityIndex;
+		/** False if the tile is outside of the frustum, only happens when gathering unculled instances */
+		bool bInFrustum;
+	};
+
 	struct FTraversalOutput
 	{
+		/** Number of instances in the frustum, per bucket */
 		TArray<int32> BucketInstanceCounts;
 
+		/** Number of instances regardless of frustum culling, per bucket. Only filled when gathering unculled instances */
+		TArray<int32> UnculledBucketInstanceCounts;
+
+		/** Nodes selected by the traversal, in traversal order (sorted by bucket when gathering unculled instances) */
+		TArray<FSelectedTile> SelectedTiles;
+
 		/**
 		 *	This is the raw data that will be bound for the draw call through a buffer. Stored in buckets sorted by material and density level
 		 *	Each instance contains:
-		 *	[0] (xyz: translate, w: wave param index)
+		 *	[0] (xyz: translate, w: render data index, used to fetch the per body parameters)
 		 *	[1] (x: (bit 0-7)lod level, (bit 8)bShouldMorph, y: HeightMorph zw: scale)
 		 *  [2] (editor only, HitProxy ID of the associated WaterBody actor)
+		 *	When gathering unculled instances, this also contains the tiles outside of the frustum and is sorted by bucket
 		 */
 		TArray<FStagingInstanceData> StagingInstanceData;
 
-		/** Number of added instances */
+		/** Number of added instances in the frustum */
 		int32 InstanceCount = 0;
+
+		/** Number of added instances regardless of frustum culling. Only counted when gathering unculled instances */
+		int32 UnculledInstanceCount = 0;
+
+#if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
+		/** Traversal cost, used to compare traversal settings */
+		struct FTraversalStats
+		{
+			int32 NodeVisits = 0;
+			/** Single box frustum tests */
+			int32 FrustumTests = 0;
+			/** SIMD tests of 4 children at once */
+			int32 BatchedFrustumTests = 0;
+			/** SIMD tests of the 4x4 children of a 16-ary node at once, see FTraversalDesc::bWideTraversal */
+			int32 WideFrustumTests = 0;
+			int32 MaxDepth = 0;
+		} Stats;
+#endif
+	};
+
+
+	/** Result of a nearest covered tile query */
+	struct FNearestTileQueryResult
+	{
+		/** Closest point to the query location on the covered tile, at the tile base height */
+		FVector SurfaceLocation = FVector::ZeroVector;
+		FBox TileBounds = FBox(ForceInit);
+		/** 2D distance from the query location to SurfaceLocation, 0 if the query location is covered */
+		double Distance = 0.0;
+		uint32 QuadtreeMeshIndex = 0;
+		bool bFound = false;
 	};
 
+	/** Residency and load statistics of the paged subtrees, see BuildPagedTree(..) */
+	struct FPagingStats
+	{
+		int32 NumPages = 0;
+		int32 NumResidentPages = 0;
+		uint64 ResidentPageMemory = 0;
+		/** Size of all the compressed pages, held in memory unless they're streamed from cooked data */
+		uint64 CompressedPageMemory = 0;
+		bool bCooked = false;
+		/** Number of times the traversal or a query reached a page that wasn't resident */
+		uint64 NumMisses = 0;
+		uint64 NumLoads = 0;
+		/** Time from the first miss to the page being resident */
+		double AverageLoadLatencyMs = 0.0;
+		double MaxLoadLatencyMs = 0.0;
+	};
 
 	struct FTraversalDesc
 	{
@@ -65,6 +166,8 @@ struct FMeshQuadTree
 		int32 DensityCount = 0;
 		float HeightMorph = 0.0f;
 		int32 ForceCollapseDensityLevel = TNumericLimits<int32>::Max();
+		/** Densities below this index are never drawn, their tiles use the next coarser grid instead. Must be below DensityCount */
+		int32 MinDensityIndex = 0;
 		float LODScale = 1.0;
 		FVector ObserverPosition = FVector::ZeroVector;
 		FVector PreViewTranslation = FVector::ZeroVector;
@@ -72,6 +175,31 @@ struct FMeshQuadTree
 		bool bLODMorphingEnabled = true;
 		FBox2D TessellatedQuadtreeMeshBounds = FBox2D(ForceInit);
 
+		/** Added to the node extents when culling, covers vertex displacement the tree was not built with (e.g. ocean waves, xy: horizontal, z: vertical) */
+		FVector BoundsPadding = FVector::ZeroVector;
+
+		/** Animated clip circle in world space (xy: center, z: radius). Nodes entirely outside of it are skipped, the vertex factory clips the rest. Disabled when the radius is negative */
+		FVector ClipCircle = FVector(0.0, 0.0, -1.0);
+
+		/** Cells of a 2^OcclusionCellDepth grid over the root (row major) found occluded by the sub primitive occlusion queries. Nodes fitting in an occluded cell are skipped */
+		const TBitArray<>* OccludedCells = nullptr;
+		int32 OcclusionCellDepth = 0;
+		FVector2D OcclusionCellOrigin = FVector2D::ZeroVector;
+		FVector2D OcclusionCellSize = FVector2D::ZeroVector;
+
+		/** Frustum culling only flags the tiles instead of rejecting them, so one traversal yields both the raster set and the full (ray tracing) set */
+		bool bGatherUnculledInstances = false;
+
+		/** Test the 4 children of a node intersecting the frustum with a single SIMD test instead of one test per child */
+		bool bBatchChildFrustumTests = true;
+
+		/**
+		 *	Traverse the tree as a 16-ary tree: each step goes down two levels and tests the 4x4 grandchildren of a node with a single SIMD test.
+		 *	The LOD levels map to half-levels, the skipped level is rendered from implicit intermediate tiles (the 2x2 groups of the 16 children).
+		 *	Only applies to the distance based selection, not to the tessellated region. Child tests are always batched then
+		 */
+		bool bWideTraversal = false;
+
 #if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
 		// Debug
 		int32 DebugShowTile = 0;
@@ -83,23 +211,87 @@ struct FMeshQuadTree
 	/** Obtain all possible hit proxies (proxies of all the water bodies) */
 	void GatherHitProxies(TArray<TRefCountPtr<HHitProxy> >& OutHitProxies) const;
 
+	/** Obtain the parameters of all the render data, NumParametersPerRenderData entries per render data in render data index order */
+	void GatherParameterData(TArray<FVector4f>& OutParameters) const;
+
+	/** Aligned block of 4^Level leaves of the root grid, starting at leaf MortonBegin in Morton order (x in the even bits) */
+	struct FLeafBlock
+	{
+		uint64 MortonBegin = 0;
+		int32 Level = 0;
+	};
+
+	/** Render data index shared by all the leaves of a block (0: no tile), INDEX_NONE if they differ. Single leaves can't differ */
+	using FGetLeafBlockQuadtreeMeshIndex = TFunctionRef<int32(const FLeafBlock& InBlock)>;
+
+	/** Nodes and render data changed by RebuildLeafBlocks(..), see ApplyEditPatch(..) */
+	struct FEditPatch;
+
 
 public:
 	/** 
 		 *	Initialize the tree. This will unlock the tree for node insertion using AddWaterTilesInsideBounds(...). 
 		 *	Tree must be locked before traversal, see Lock(). 
+		 *	InCoverageBounds is the union of what will be inserted, the tile region starts at its min and is rounded up to whole tiles so no empty space deepens the tree.
+		 *	bInReserveNodes reserves the nodes of a full tree, needed by AddQuadtreeMeshTilesInsideBounds(..) but not by BuildPagedTree(..) or LoadPages(..)
 		 */
-	void InitTree(const FBox2D& InBounds, float InTileSize, FIntPoint InExtentInTiles,bool bInIsGPUQuadTree);
+	void InitTree(const FBox2D& InCoverageBounds, float InTileSize, bool bInIsGPUQuadTree, bool bInReserveNodes = true);
 	/** Unlock to make it read-only. This will optionally prune the node array to remove redundant nodes, nodes that can be implicitly traversed */
 	void Unlock(bool bPruneRedundantNodes);
+	/**
+	 *	Build the tiles of a tree fresh from InitTree(..) and AddQuadtreeMeshRenderData(..), with the subtrees below InPageDepth in compressed pages.
+	 *	Each subtree is built alone and compressed before the next one, only the nodes above InPageDepth and one subtree are ever decompressed.
+	 *	Pages are decompressed asynchronously when the traversal or a query reaches them, until then the node at InPageDepth renders in place of its subtree.
+	 *	At most InMaxResidentPages stay decompressed, the least recently used ones are evicted first. Leaves the tree locked, copies of the tree share the pages
+	 */
+	void BuildPagedTree(int32 InPageDepth, int32 InMaxResidentPages, FGetLeafBlockQuadtreeMeshIndex InGetBlockQuadtreeMeshIndex, double InMinZOffset, double InMaxZOffset);
+
+	/** Write the resident nodes and the page layout of a paged tree to Ar and its compressed pages to OutPageData, see LoadPages(..) */
+	void SavePages(FArchive& Ar, TArray64<uint8>& OutPageData) const;
+
+	/**
+	 *	Load what SavePages(..) wrote instead of building the tree, the pages are then streamed from InPageBulkData. The tree must be fresh from InitTree(..)
+	 *	with the inputs it was built with and have its render data. Returns false, leaving the tree unlocked, if the data doesn't match the tree
+	 */
+	bool LoadPages(FArchive& Ar, const TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>& InPageBulkData, int32 InMaxResidentPages);
+
+	bool HasPagedSubtrees() const { return NodeData.PageTable.IsValid(); }
+
+	FPagingStats GetPagingStats() const;
+
 	/** Add tiles that intersect InBounds recursively from the root node. Tree must be unlocked. Typically called on Game Thread */
 	void AddQuadtreeMeshTilesInsideBounds(const FBox& InBounds, uint32 InQuadtreeMeshIndex);
 	
 	void AddQuadtreeMesh(const TArray<FVector2D>& InPoly, const FBox& InMeshBounds, uint32 InQuadtreeMeshIndex);
+
+	/**
+	 *	Add the leaves of the root grid from their render data index, only descending into the blocks InGetBlockQuadtreeMeshIndex can't resolve.
+	 *	Uniform aligned blocks are added at once, their Z range is offset from the base height of their render data. Tree must be unlocked
+	 */
+	void AddQuadtreeMeshTilesFromLeafBlocks(FGetLeafBlockQuadtreeMeshIndex InGetBlockQuadtreeMeshIndex, double InMinZOffset, double InMaxZOffset);
+
+	/**
+	 *	Rebuild the subtrees of InBlocks on a locked tree from the new render data index of their leaves, then update their ancestors. Nothing else is touched,
+	 *	OutPatch records the written nodes so a copy of the tree made before the edit can replay it. Returns false if the tree can't be edited in place (paged or empty), it has to be rebuilt then
+	 */
+	bool RebuildLeafBlocks(TConstArrayView<FLeafBlock> InBlocks, FGetLeafBlockQuadtreeMeshIndex InGetBlockQuadtreeMeshIndex, double InMinZOffset, double InMaxZOffset, FEditPatch& OutPatch);
+
+	/** Replay RebuildLeafBlocks(..) on a copy of the tree it was called on */
+	void ApplyEditPatch(const FEditPatch& InPatch);
 	/** Assign an index to each material */
 	void BuildMaterialIndices();
 
+	/** Select the tiles to render and pack them into instance data, see SelectQuadtreeMeshTiles(..) and PackQuadtreeMeshTileInstanceData(..) */
 	void BuildQuadtreeMeshTileInstanceData(const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+
+	/** Walk the tree and only record which nodes render with which LOD and density in Output.SelectedTiles, along with the bucket counts */
+	void SelectQuadtreeMeshTiles(const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+
+	/** Turn Output.SelectedTiles into Output.StagingInstanceData. Done in parallel chunks since every tile is packed independently */
+	void PackQuadtreeMeshTileInstanceData(const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+
+	/** Sort the selected tiles by bucket index with a counting sort, the unculled bucket counts must already be known */
+	static void SortSelectedTilesByBucket(FTraversalOutput& Output);
 	
 	/** Bilinear interpolation between four neighboring base height samples around InWorldLocationXY. The samples are done on the leaf node grid resolution. Returns true if all 4 samples were taken in valid nodes */
 	bool QueryInterpolatedTileBaseHeightAtLocation(const FVector2D& InWorldLocationXY, float& OutHeight) const;
@@ -107,16 +299,65 @@ public:
 	/** Walks down the tree and returns the tile height at InWorldLocationXY in OutWorldHeight. Returns true if the query hits an exact solution (either leaf tile or a complete subtree parent), otherwise false. */
 	bool QueryTileBaseHeightAtLocation(const FVector2D& InWorldLocationXY, float& OutWorldHeight) const;
 	
+	/**
+	 *	Best-first search for the covered tile closest to InWorldLocationXY, using node bounds as distance lower bounds.
+	 *	Only tiles within InMaxRadius are considered, and only tiles of render data InQuadtreeMeshIndexFilter when it's not INDEX_NONE.
+	 *	Read only, safe to call from any thread once the tree is locked.
+	 */
+	bool QueryNearestCoveredTile(const FVector2D& InWorldLocationXY, double InMaxRadius, int32 InQuadtreeMeshIndexFilter, FNearestTileQueryResult& OutResult) const;
+
+	/** Batched version of QueryNearestCoveredTile(..), the queries are spread over worker threads. OutResults must have the same size as InWorldLocationsXY */
+	void QueryNearestCoveredTiles(TConstArrayView<FVector2D> InWorldLocationsXY, double InMaxRadius, int32 InQuadtreeMeshIndexFilter, TArrayView<FNearestTileQueryResult> OutResults) const;
+
+	/**
+	 *	Returns in OutCell the largest 2D region around InWorldLocationXY over which coverage doesn't change: either the covered node containing the location,
+	 *	or the empty quadrant containing it. OutQuadtreeMeshIndex is the covering render data index, 0 if the location isn't covered.
+	 *	Callers can skip querying again until the location leaves the cell.
+	 */
+	void QueryCoverageCellAtLocation(const FVector2D& InWorldLocationXY, FBox2D& OutCell, uint32& OutQuadtreeMeshIndex) const;
+
+	/** Batched coverage and base height query, the queries are spread over worker threads. OutHeights is 0 where not covered */
+	QUADTREEMESH_API void QueryBaseHeightsAtLocations(TConstArrayView<FVector2D> InWorldLocationsXY, TArrayView<float> OutHeights, TArrayView<bool> OutCovered) const;
+
+	/**
+	 *	Closest point where coverage changes (water edge) within InMaxRadius of InWorldLocationXY. Works from both sides of the edge:
+	 *	from a covered location it searches the closest uncovered region, otherwise the closest covered tile. Returns false if there is no edge within InMaxRadius
+	 */
+	bool QueryNearestCoverageEdge(const FVector2D& InWorldLocationXY, double InMaxRadius, FVector2D& OutEdgeLocation, double& OutDistance) const;
+
+	/** Batched version of QueryNearestCoverageEdge(..). OutFound is false where no edge was found */
+	QUADTREEMESH_API void QueryNearestCoverageEdges(TConstArrayView<FVector2D> InWorldLocationsXY, double InMaxRadius, TArrayView<FVector2D> OutEdgeLocations, TArrayView<float> OutDistances, TArrayView<bool> OutFound) const;
+
+	/**
+	 *	Coarse coverage of the root bounds split in InResolution cells, row major. A bit is set when any tile overlaps its cell.
+	 *	Conservative: subtrees whose page isn't resident count as covered
+	 */
+	void BuildCoverageBitmap(FIntPoint InResolution, TBitArray<>& OutBitmap) const;
+
+	/** Bounds of the covered part of each cell of the 2^InCellDepth x 2^InCellDepth grid over the root, row major. Invalid for empty cells. Conservative like BuildCoverageBitmap */
+	void GetCoveredCellBounds(int32 InCellDepth, TArray<FBox>& OutCellBounds) const;
+
 	/** Walks down the tree and returns the tile bounds at InWorldLocationXY in OutWorldBounds. Returns true if the query finds a leaf tile to return, otherwise false. */
 	bool QueryTileBoundsAtLocation(const FVector2D& InWorldLocationXY, FBox& OutWorldBounds) const;
 
 	bool IsGPUQuadTree() const { return bIsGPUQuadTree; }
 
 	/** Add water body render data to this tree. Returns the index in the array. Use this index to add tiles with this water body to the tree, see AddWaterTilesInsideBounds(..) */
-	uint32 AddQuadtreeMeshRenderData(const FQuadtreeMeshRenderData& InQuadtreeMeshRenderData) { return NodeData.QuadtreeMeshRenderData.Add(InQuadtreeMeshRenderData); }
+	uint32 AddQuadtreeMeshRenderData(const FQuadtreeMeshRenderData& InQuadtreeMeshRenderData);
+
+	/** Number of render data added to this tree, not counting the default one at index 0 */
+	int32 GetQuadtreeMeshRenderDataCount() const { return FMath::Max(NodeData.QuadtreeMeshRenderData.Num() - 1, 0); }
+
+	const FQuadtreeMeshRenderData& GetQuadtreeMeshRenderData(uint32 InQuadtreeMeshIndex) const { return NodeData.QuadtreeMeshRenderData[InQuadtreeMeshIndex]; }
+
+	/** Replace added render data, the nodes using it keep their bounds. Safe on a locked tree, see RebuildLeafBlocks(..) to send it to copies */
+	void SetQuadtreeMeshRenderData(uint32 InQuadtreeMeshIndex, const FQuadtreeMeshRenderData& InQuadtreeMeshRenderData);
 
 	/** Get bounds of the root node if there is one, otherwise some default box */
 	FBox GetBounds() const { return NodeData.Nodes.Num() > 0 ? NodeData.Nodes[0].Bounds : FBox(-FVector::OneVector, FVector::OneVector); }
+
+	/** Union of the covered nodes, computed when the tree is locked. Invalid if nothing is covered */
+	FBox GetCoveredBounds() const { return CoveredBounds; }
 	
 	/** Return the 2D region containing water tiles. Tiles can not be generated outside of this region */
 	FBox2D GetTileRegion() const { return TileRegion; }
@@ -137,10 +378,60 @@ public:
 	/** Calculate the world distance to a LOD */
 	static float GetLODDistance(int32 InLODLevel, float InLODScale) { return FMath::Pow(2.0f, static_cast<float>(InLODLevel + 1)) * InLODScale; }
 
+	/** True when InBounds fits in a cell of the traversal found occluded, larger nodes also span visible cells */
+	static bool IsInOccludedCell(const FTraversalDesc& InTraversalDesc, const FBox& InBounds);
+
 	uint32 GetAllocatedSize() const { return NodeData.GetAllocatedSize() + QuadtreeMeshMaterials.GetAllocatedSize(); }
 
 private:
-	
+	/** Test a node against the frustum, reusing the parent's result when it already decides for all its descendants */
+	static EFrustumTestResult TestFrustum(const FConvexVolume& InFrustum, EFrustumTestResult InParentResult, const FVector& InCenter, const FVector& InExtent);
+
+	/** Test 4 boxes against the frustum at once, boxes intersecting the frustum are returned as KnownIntersecting */
+	static void TestFrustum4(const FConvexVolume& InFrustum, const FBox InBounds[4], EFrustumTestResult OutResults[4]);
+
+	/** Same as TestFrustum4(..) for the 16 children of a 16-ary node */
+	static void TestFrustum16(const FConvexVolume& InFrustum, const FBox InBounds[16], EFrustumTestResult OutResults[16]);
+
+	/** One box per lane, NumBoxes is a multiple of 4 */
+	template<int32 NumBoxes>
+	static void TestFrustumBatch(const FConvexVolume& InFrustum, const FBox* InBounds, EFrustumTestResult* OutResults);
+
+	/** Frustum state passed to each of the 4 children of a node, batch tests the children when the node intersects the frustum */
+	static void TestChildrenFrustum(const FBox InChildBounds[4], EFrustumTestResult InFrustumTest, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output, EFrustumTestResult OutChildFrustumTests[4]);
+
+	/** Same as TestChildrenFrustum(..) for the 4x4 children of a 16-ary node, always batched */
+	static void TestWideChildrenFrustum(const FBox InChildBounds[16], EFrustumTestResult InFrustumTest, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output, EFrustumTestResult OutChildFrustumTests[16]);
+
+	/** True when the clip circle of the traversal is enabled and doesn't touch InBounds */
+	static bool IsOutsideClipCircle(const FTraversalDesc& InTraversalDesc, const FBox& InBounds);
+
+	/** Bounds of the 4 children of a node whose children are implicit */
+	static void GetImplicitChildBounds(const FBox& InBounds, FBox OutChildBounds[4]);
+
+	/** Count a node visit in the traversal stats (non shipping builds only) */
+	static void RecordNodeVisit(FTraversalOutput& Output, int32 InDepth, EFrustumTestResult InParentFrustumTest);
+
+	/** Call InFunction with the bounds of the topmost nodes standing for covered areas. Subtrees whose page isn't resident count as covered */
+	void ForEachCoveredNode(TFunctionRef<void(const FBox&)> InFunction) const;
+
+	static FQuadtreeMeshRenderDataHot MakeRenderDataHot(const FQuadtreeMeshRenderData& InQuadtreeMeshRenderData);
+
+	/** Node for RebuildLeafBlocks(..), reuses the nodes it removed first */
+	uint32 AllocateNode(uint32 InParentIndex, TArray<uint32>& InOutWrittenNodes);
+
+	/** Hand InNodeIndex and its descendants over to AllocateNode(..) */
+	void FreeSubtree(uint32 InNodeIndex);
+
+	/** World XY bounds of a block of leaves, Z is 0 */
+	FBox GetLeafBlockBounds(const FLeafBlock& InBlock) const;
+
+	/** Give the node at InNodeIndex the tiles of InBlock and build its subtree like Unlock(true) would leave it. Returns false if the block has no tile to render */
+	bool FillLeafBlock(uint32 InNodeIndex, const FLeafBlock& InBlock, FGetLeafBlockQuadtreeMeshIndex InGetBlockQuadtreeMeshIndex, double InMinZOffset, double InMaxZOffset, TArray<uint32>& InOutWrittenNodes);
+
+	/** Recompute a node from its children, pruning them when they're redundant. Returns false if no child has a tile to render */
+	bool UpdateNodeFromChildren(uint32 InNodeIndex, TArray<uint32>& InOutWrittenNodes);
+
 	
 	
 	int32 TreeDepth = 0;
@@ -149,33 +440,59 @@ private:
 	int32 MaxLeafCount = 0;
 	FIntPoint ExtentInTiles = FIntPoint::ZeroValue;
 	FBox2D TileRegion;
+	FBox CoveredBounds = FBox(ForceInit);
 	TArray<FMaterialRenderProxy*> QuadtreeMeshMaterials;
 
 	bool bIsReadOnly = true;
 	bool bIsGPUQuadTree = false;
 
+	/** Nodes removed by RebuildLeafBlocks(..), no longer referenced by any parent */
+	TArray<uint32> FreeNodeIndices;
+
 	
 	struct FNodeData;
+	struct FPageTable;
 
 	struct FNode
 	{
 
-		FNode() : QuadtreeMeshIndex(0), TransitionQuadtreeMeshIndex(0), ParentIndex(INVALID_PARENT), HasCompleteSubtree(1), IsSubtreeSameQuadtreeMesh(1), HasMaterial(0) {}
+		FNode() : QuadtreeMeshIndex(0), TransitionQuadtreeMeshIndex(0), ParentIndex(INVALID_PARENT), HasCompleteSubtree(1), IsSubtreeSameQuadtreeMesh(1), HasMaterial(0), IsPaged(0) {}
 
 		/** If this node is allowed to be rendered, it means it can be rendered in place of all leaf nodes in its subtree. */
-		bool CanRender(int32 InDensityLevel, int32 InForceCollapseDensityLevel, const FQuadtreeMeshRenderData& InQuadtreeMeshRenderData) const;
+		bool CanRender(int32 InDensityLevel, int32 InForceCollapseDensityLevel, const FQuadtreeMeshRenderDataHot& InQuadtreeMeshRenderData) const;
 
-		/** Add instance for rendering this node*/
-		void AddNodeForRender(const FNodeData& InNodeData, const FQuadtreeMeshRenderData& InQuadtreeMeshRenderData, int32 InDensityLevel, int32 InLODLevel, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+		/** Frustum state of each child, see TestChildrenFrustum(..) */
+		void GetChildrenFrustumTests(const FNodeData& InNodeData, EFrustumTestResult InFrustumTest, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output, EFrustumTestResult OutChildFrustumTests[4]) const;
+
+		/** Record this node for rendering, the instance data is packed later in PackQuadtreeMeshTileInstanceData(..) */
+		void AddNodeForRender(const FNodeData& InNodeData, int32 InDensityLevel, int32 InLODLevel, bool bInFrustum, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+
+		/** Render a paged node whose page isn't resident yet in place of its whole subtree */
+		void AddPagedNodeForRender(const FNodeData& InNodeData, int32 InDensityLevel, int32 InLODLevel, EFrustumTestResult InParentFrustumTest, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
 
 		/** Recursive function to traverse down to the appropriate density level. The LODLevel is constant here since this function is only called on tiles that are fully inside a LOD range */
-		void SelectLODRefinement(const FNodeData& InNodeData, int32 InDensityLevel, int32 InLODLevel, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+		void SelectLODRefinement(const FNodeData& InNodeData, int32 InDensityLevel, int32 InLODLevel, EFrustumTestResult InParentFrustumTest, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
 
 		/** Recursive function to select nodes visible from the current point of view */
-		void SelectLOD(const FNodeData& InNodeData, int32 InLODLevel, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+		void SelectLOD(const FNodeData& InNodeData, int32 InLODLevel, EFrustumTestResult InParentFrustumTest, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+
+		/** Same as SelectLOD(..), taking this node as a 16-ary node: its children are handled in place as intermediate tiles and its 4x4 grandchildren are recursed into */
+		void SelectLODWide(const FNodeData& InNodeData, int32 InLODLevel, EFrustumTestResult InParentFrustumTest, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+
+		/**
+		 *	Part of SelectLOD(..) deciding from this node alone, InFrustumTest being its own test: render it or refine it when it's past or fully inside its LOD range.
+		 *	InChildFrustumTests are the tests of its children if already known. Returns false if the children have to select their LOD instead
+		 */
+		bool SelectLODForNode(const FNodeData& InNodeData, int32 InLODLevel, EFrustumTestResult InFrustumTest, const EFrustumTestResult* InChildFrustumTests, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+
+		/** Let the children (implicit or not) of a node in the frustum select their LOD with SelectLOD(..) */
+		void SelectChildrenLOD(const FNodeData& InNodeData, int32 InLODLevel, EFrustumTestResult InFrustumTest, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+
+		/** Run SelectLODRefinement(..) on the children, InChildFrustumTests are computed if null */
+		void SelectChildrenLODRefinement(const FNodeData& InNodeData, int32 InDensityLevel, int32 InLODLevel, EFrustumTestResult InFrustumTest, const EFrustumTestResult* InChildFrustumTests, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
 
 		/** Recursive function to select nodes visible from the current point of view within an active bounding box */
-		void SelectLODWithinBounds(const FNodeData& InNodeData, int32 InLODLevel, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
+		void SelectLODWithinBounds(const FNodeData& InNodeData, int32 InLODLevel, EFrustumTestResult InParentFrustumTest, const FTraversalDesc& InTraversalDesc, FTraversalOutput& Output) const;
 
 		/** Recursive function to query the height(prior to any displacement) at a given location, return false if no height could be found */
 		bool QueryBaseHeightAtLocation(const FNodeData& InNodeData, const FVector2D& InWorldLocationXY, float& OutHeight) const;
@@ -186,6 +503,9 @@ private:
 		/** Add nodes that intersect InMeshBounds. LODLevel is the current level. This is the only method used to generate the tree */
 		void AddNodes(FNodeData& InNodeData, const FBox& InMeshBounds, const FBox& InQuadtreeMeshBounds, uint32 InQuadtreeMeshIndex, int32 InLODLevel, uint32 InParentIndex);
 		
+		/** Whether this node stands for a fully covered area, meaning none of its descendants have to be visited to know what's under it */
+		bool IsCovered() const { return HasCompleteSubtree && IsSubtreeSameQuadtreeMesh && QuadtreeMeshIndex != 0; }
+
 		/** Check if all conditions are met to potentially allow this and another node to render as one */
 		bool CanMerge(const FNode& Other) const { return Other.QuadtreeMeshIndex == QuadtreeMeshIndex && Other.TransitionQuadtreeMeshIndex == TransitionQuadtreeMeshIndex; }
 
@@ -210,7 +530,8 @@ private:
 		/** Cached value to avoid having to visit this node's FWaterBodyRenderData */
 		uint32 HasMaterial : 1;
 
-		// 1 spare bits here in the bit field with ParentIndex
+		/** The subtree of this node lives in a page, its children are all 0 here. See FNodeData::AcquirePage(..) */
+		uint32 IsPaged : 1;
 
 		/** Children, 0 means invalid */
 		uint32 Children[4] = { 0, 0, 0, 0 };
@@ -222,12 +543,32 @@ private:
 		/** Storage for all nodes in the tree. Each node has 4 indices into this array to locate its children */
 		TArray<FNode> Nodes;
 
-		/** Render data for all water bodies in this tree, indexed by the nodes */
+		/** Render data for all water bodies in this tree, indexed by the nodes. Only the values needed by the traversal and packing, see QuadtreeMeshRenderData for the rest */
+		TArray<FQuadtreeMeshRenderDataHot> QuadtreeMeshRenderDataHot;
+
+		/** Full render data (materials, hit proxies, shader parameters), same indexing as QuadtreeMeshRenderDataHot. Not touched by the traversal */
 		TArray<FQuadtreeMeshRenderData> QuadtreeMeshRenderData;
 
-		/** Total memory dynamically allocated by this object */
-		uint32 GetAllocatedSize() const { return Nodes.GetAllocatedSize() + QuadtreeMeshRenderData.GetAllocatedSize(); }
+		/** Pages of the subtrees moved out of Nodes, null if the tree isn't paged */
+		TSharedPtr<FPageTable, ESPMode::ThreadSafe> PageTable;
+
+		/** Node data of the subtree of InPagedNode (its copy at index 0), or null if the page isn't resident yet, its load is requested then */
+		TSharedPtr<const FNodeData, ESPMode::ThreadSafe> AcquirePage(const FNode& InPagedNode) const;
+
+		/** Total memory dynamically allocated by this object, not counting the pages */
+		uint32 GetAllocatedSize() const { return Nodes.GetAllocatedSize() + QuadtreeMeshRenderDataHot.GetAllocatedSize() + QuadtreeMeshRenderData.GetAllocatedSize(); }
 	} NodeData;
+
+public:
+	struct FEditPatch
+	{
+		int32 NodeCount = 0;
+		TArray<uint32> NodeIndices;
+		TArray<FNode> Nodes;
+		/** All of it, it's small next to the nodes */
+		TArray<FQuadtreeMeshRenderData> RenderData;
+		FBox CoveredBounds = FBox(ForceInit);
+	};
 };
 
 
@@ -5,6 +5,8 @@
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
 
+QUADTREEMESH_API DECLARE_LOG_CATEGORY_EXTERN(LogQuadtreeMesh, Log, All);
+
 class FQuadtreeMeshModule : public IModuleInterface
 {
 public:
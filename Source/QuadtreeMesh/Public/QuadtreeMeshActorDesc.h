@@ -3,19 +3,55 @@
 #if WITH_EDITOR
 #include "WorldPartition/WorldPartitionActorDesc.h"
 
-class FQuadtreeMeshActorDesc : public FWorldPartitionActorDesc
+class QUADTREEMESH_API FQuadtreeMeshActorDesc : public FWorldPartitionActorDesc
 {
 public:
+	/** Coarse description of the actor's tree, lets world tools and builders query coverage and heights without loading the actor */
+	struct FTreeSummary
+	{
+		/** Bounds of the root node, the Z range is the min and max height of the mesh */
+		FBox Bounds = FBox(ForceInit);
+
+		/** Coverage of Bounds in CoverageResolution cells, row major. Conservative, see FMeshQuadTree::BuildCoverageBitmap(..) */
+		FIntPoint CoverageResolution = FIntPoint::ZeroValue;
+		TBitArray<> CoverageBitmap;
+
+		int32 RenderDataCount = 0;
+
+		bool IsValid() const { return Bounds.IsValid != 0; }
+
+		double GetMinHeight() const { return Bounds.Min.Z; }
+		double GetMaxHeight() const { return Bounds.Max.Z; }
+
+		/** False if no tile is at InWorldLocationXY, true if one may be */
+		bool MayBeCovered(const FVector2D& InWorldLocationXY) const;
+
+		/** False if no tile overlaps InWorldBounds, true if one may */
+		bool MayBeCovered(const FBox2D& InWorldBounds) const;
+
+		bool operator==(const FTreeSummary& Other) const
+		{
+			return Bounds == Other.Bounds && CoverageResolution == Other.CoverageResolution && CoverageBitmap == Other.CoverageBitmap && RenderDataCount == Other.RenderDataCount;
+		}
+
+		friend FArchive& operator<<(FArchive& Ar, FTreeSummary& Summary);
+	};
+
 	FQuadtreeMeshActorDesc();
 	virtual void Init(const AActor* InActor) override;
 	virtual bool Equals(const FWorldPartitionActorDesc* Other) const override;
 
 	int32 GetOverlapPriority() const { return OverlapPriority; }
+
+	/** Invalid if the actor was saved before summaries existed or covers nothing. Built on demand when the actor's tree wasn't */
+	const FTreeSummary& GetTreeSummary() const { return TreeSummary; }
 protected:
 	virtual uint32 GetSizeOf() const override { return sizeof(FQuadtreeMeshActorDesc); }
 	virtual void Serialize(FArchive& Ar) override;
 
 	int32 OverlapPriority;
+
+	FTreeSummary TreeSummary;
 };
 
 #endif
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "QuadtreeMeshAutoConfiguration.generated.h"
+
+/**
+ *	Leaf size, tessellation factor and LOD scale derived from a target vertex spacing near the camera and a vertex budget per view, see UQuadtreeMeshComponent::bAutoConfigure.
+ *	Estimates assume the whole LOD rings are in view, so they hold for any camera orientation
+ */
+USTRUCT(BlueprintType)
+struct QUADTREEMESH_API FQuadtreeMeshAutoConfiguration
+{
+	GENERATED_BODY()
+
+	/** Largest tessellation factor considered, the grids above it cost more GPU memory than they save in tiles */
+	static constexpr int32 MaxTessellationFactor = 8;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "QuadtreeMesh|Auto Configuration")
+	float LeafSize = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "QuadtreeMesh|Auto Configuration")
+	int32 TessellationFactor = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "QuadtreeMesh|Auto Configuration")
+	float LODScale = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "QuadtreeMesh|Auto Configuration")
+	int32 TreeDepth = 0;
+
+	/** Vertices are at the target spacing within this distance of the camera */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "QuadtreeMesh|Auto Configuration")
+	float FullDensityRadius = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "QuadtreeMesh|Auto Configuration")
+	int32 EstimatedTilesPerView = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "QuadtreeMesh|Auto Configuration")
+	int32 EstimatedVerticesPerView = 0;
+
+	/** Even the smallest tiles at the tightest LOD scale exceed the vertex budget */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "QuadtreeMesh|Auto Configuration")
+	bool bOverBudget = false;
+
+	bool IsValid() const { return TessellationFactor > 0; }
+
+	bool operator==(const FQuadtreeMeshAutoConfiguration& Other) const
+	{
+		return LeafSize == Other.LeafSize && TessellationFactor == Other.TessellationFactor && LODScale == Other.LODScale && TreeDepth == Other.TreeDepth;
+	}
+
+	/**
+	 *	Configuration covering InCoverageExtent (half size) with the fewest tiles: the largest tiles whose LOD scale, spread over the vertex budget, stays above the
+	 *	tightest scale that doesn't break the morphing. For a given budget larger tiles also push the full density radius further out
+	 */
+	static FQuadtreeMeshAutoConfiguration Compute(const FVector2D& InCoverageExtent, float InTargetVertexSpacing, int32 InVertexBudget);
+
+	FString ToString() const;
+};
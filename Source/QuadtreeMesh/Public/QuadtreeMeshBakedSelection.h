@@ -0,0 +1,110 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "MeshQuadTree.h"
+#include "QuadtreeMeshBakedSelection.generated.h"
+
+/**
+ *	Tile selection precomputed offline for a grid of camera cells, for fixed or rail cameras whose positions are known ahead of time.
+ *	Cells along X are delta-encoded against their neighbor (tiles removed, tiles added), the first cell of every row is a keyframe encoded against an empty set.
+ *	Only the selection is baked: frustum culling and the instance packing still run per view, see FQuadtreeMeshBakedSelectionDecoder
+ */
+USTRUCT()
+struct QUADTREEMESH_API FQuadtreeMeshBakedSelection
+{
+	GENERATED_BODY()
+
+	/** World space camera volume covered by the cells */
+	UPROPERTY(VisibleAnywhere, Category = "Baked LOD")
+	FBox Volume = FBox(ForceInit);
+
+	UPROPERTY(VisibleAnywhere, Category = "Baked LOD")
+	float CellSize = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, Category = "Baked LOD")
+	FIntVector CellCount = FIntVector::ZeroValue;
+
+	/** Traversal settings and tree the selection was baked with. The proxy falls back to the traversal when its own differ */
+	UPROPERTY()
+	float LODScale = 0.0f;
+
+	UPROPERTY()
+	int32 LODCount = 0;
+
+	UPROPERTY()
+	int32 DensityCount = 0;
+
+	UPROPERTY()
+	int32 ForceCollapseDensityLevel = 0;
+
+	UPROPERTY()
+	FBox TreeBounds = FBox(ForceInit);
+
+	UPROPERTY()
+	int32 TreeNodeCount = 0;
+
+	/** Offset of each cell in Data, X major */
+	UPROPERTY()
+	TArray<int32> CellOffsets;
+
+	UPROPERTY()
+	TArray<uint8> Data;
+
+	bool IsBaked() const { return CellOffsets.Num() > 0; }
+
+	/** True if the selection was baked from this tree with these traversal settings */
+	bool IsValidFor(const FMeshQuadTree& InTree, const FMeshQuadTree::FTraversalDesc& InTraversalDesc) const;
+
+	/** Cell containing InPosition, returns false outside of the volume */
+	bool GetCell(const FVector& InPosition, FIntVector& OutCell) const;
+
+	int32 GetCellIndex(const FIntVector& InCell) const { return InCell.X + CellCount.X * (InCell.Y + CellCount.Y * InCell.Z); }
+
+	uint32 GetAllocatedSize() const { return CellOffsets.GetAllocatedSize() + Data.GetAllocatedSize(); }
+
+	void Reset() { *this = FQuadtreeMeshBakedSelection(); }
+
+#if WITH_EDITOR
+	/**
+	 *	Select the tiles of every cell of InVolume with InTraversalDesc and encode them. InSetupObserver fills the observer dependent settings (LowestLOD, HeightMorph...) for each cell center.
+	 *	The traversal doesn't cull, frustum culling happens when decoding. Returns false if the tree can't be baked (paged subtrees, tessellated region, too many cells)
+	 */
+	bool Bake(const FMeshQuadTree& InTree, const FMeshQuadTree::FTraversalDesc& InTraversalDesc, const FBox& InVolume, float InCellSize,
+		TFunctionRef<void(const FVector&, FMeshQuadTree::FTraversalDesc&)> InSetupObserver);
+#endif
+};
+
+/** Decoded tile set of the last fetched cell, moving to the next cell of a row only applies one delta */
+class QUADTREEMESH_API FQuadtreeMeshBakedSelectionDecoder
+{
+public:
+	/**
+	 *	Fill Output.SelectedTiles and the bucket counts with the baked tiles of the cell containing InTraversalDesc.ObserverPosition, frustum culled with InTraversalDesc.Frustum.
+	 *	Returns false, leaving Output untouched, when the observer is outside of the baked volume or its lowest LOD differs from the one the cell was baked with
+	 */
+	bool SelectTiles(const FQuadtreeMeshBakedSelection& InBakedSelection, const FMeshQuadTree& InTree, const FMeshQuadTree::FTraversalDesc& InTraversalDesc,
+		FMeshQuadTree::FTraversalOutput& Output);
+
+	void Reset() { Tiles.Reset(); CellIndex = INDEX_NONE; }
+
+	uint32 GetAllocatedSize() const { return Tiles.GetAllocatedSize() + RemovedKeys.GetAllocatedSize() + AddedTiles.GetAllocatedSize(); }
+
+	/** Baked tile, the key holds the node depth and its position in the grid of that depth */
+	struct FBakedTile
+	{
+		uint64 Key;
+		uint16 QuadtreeMeshIndex;
+		uint8 LODLevel;
+		uint8 DensityIndex;
+	};
+
+private:
+	/** Apply the encoded delta at InData to Tiles, returns the lowest LOD the cell was baked with */
+	int32 ApplyCellDelta(const uint8* InData);
+
+	TArray<FBakedTile> Tiles;
+	TArray<uint64> RemovedKeys;
+	TArray<FBakedTile> AddedTiles;
+	int32 CellIndex = INDEX_NONE;
+	int32 CellLowestLOD = INDEX_NONE;
+};
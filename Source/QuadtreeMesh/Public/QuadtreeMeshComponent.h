@@ -3,6 +3,13 @@
 #pragma once
 #include "Components/MeshComponent.h"
 #include "MeshQuadTree.h"
+#include "QuadtreeMeshGridCache.h"
+#include "QuadtreeMeshBakedSelection.h"
+#include "QuadtreeMeshTelemetry.h"
+#include "QuadtreeMeshEdits.h"
+#include "QuadtreeMeshAutoConfiguration.h"
+#include "QuadtreeMeshGPUSceneInstances.h"
+#include "QuadtreeMeshOcean.h"
 #include "QuadtreeMeshComponent.generated.h"
 
 
@@ -28,10 +35,17 @@ public:
 	//UObject interface
 	virtual void PostLoad() override;
 	virtual void PostInitProperties() override;
+	virtual void Serialize(FArchive& Ar) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 
 	//UMeshComponent interface
 	virtual int32 GetNumMaterials() const override;
 
+	//UActorComponent interface
+	virtual void OnRegister() override;
+	virtual void OnUnregister() override;
+	virtual void BeginPlay() override;
+
 	//UPrimitiveComponent interface
 	virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
 	virtual void GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials = false) const override;
@@ -53,11 +67,121 @@ public:
 	//void NotifyIfMeshMaterialChanged();
 	
 	void PushTessellatedQuadtreeMeshBoundsToPoxy(const FBox2D& TessellatedWaterMeshBounds)const;
+
+	/** Restrict full density tiles to a region (typically around the player). Tiles outside of it are rendered collapsed at the coarsest density. Moving the region doesn't rebuild the mesh */
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh")
+	void SetTessellatedRegion(FVector Center, FVector2D HalfExtent);
+
+	/** Go back to regular distance based LOD selection over the whole mesh */
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh")
+	void ClearTessellatedRegion();
+
+	FBox2D GetTessellatedRegion() const { return TessellatedRegion; }
+
+	/**
+	 *	Only render the part of the mesh inside a circle, for effects growing over time (rising floods, spreading slicks). Build the mesh at its full coverage once and animate the circle:
+	 *	nodes outside of it are skipped by the traversal and vertices outside of it are moved onto its edge, nothing is rebuilt. A negative radius disables the clip
+	 */
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh")
+	void SetClipCircle(FVector Center, float Radius);
+
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh")
+	void ClearClipCircle();
+
+	/** xy: world center, z: radius, negative when disabled */
+	FVector GetClipCircle() const { return ClipCircle; }
+
+	/** Set by the subsystem GPU budget: drop the InEvictedDensityLevels densest grids and optionally the ray tracing geometry. Kept when the render state is recreated */
+	void SetGPUBudgetEviction(int32 InEvictedDensityLevels, bool bInEvictRayTracing);
+
+	int32 GetGPUBudgetEvictedDensityLevels() const { return GPUBudgetEvictedDensityLevels; }
+
+	bool IsRayTracingEvictedByGPUBudget() const { return bGPUBudgetEvictedRayTracing; }
+
+#if WITH_EDITOR
+	/** Precompute the selected tiles for every camera cell of BakeVolume. Views inside the volume then skip the tree traversal, for fixed or rail cameras */
+	UFUNCTION(CallInEditor, Category = "Rendering|Baked LOD")
+	void BakeLODSelection();
+
+	UFUNCTION(CallInEditor, Category = "Rendering|Baked LOD")
+	void ClearBakedLODSelection();
+#endif
+
+	/**
+	 *	Set the tiles whose center is in the box to a render data slot: 0 removes them (holes, draining), 1 restores this mesh's tiles, higher slots use the render data set with SetEditRenderData (flooding).
+	 *	Sent to clients as Morton ranges of leaf tiles when bReplicateEdits is set. Wherever the edit is applied only the subtrees of its ranges are rebuilt,
+	 *	and the proxy gets the changed nodes
+	 */
+	UFUNCTION(BlueprintCallable, BlueprintAuthorityOnly, Category = "QuadtreeMesh|Edits")
+	void EditCoverage(FVector Center, FVector2D HalfExtent, int32 RenderDataSlot);
+
+	/** Define the render data of RenderDataSlot (above 1) as this mesh's render data raised by SurfaceHeightOffset with another color */
+	UFUNCTION(BlueprintCallable, BlueprintAuthorityOnly, Category = "QuadtreeMesh|Edits")
+	void SetEditRenderData(int32 RenderDataSlot, float SurfaceHeightOffset, FLinearColor EditSurfaceColor);
+
+	/** Go back to the unedited mesh */
+	UFUNCTION(BlueprintCallable, BlueprintAuthorityOnly, Category = "QuadtreeMesh|Edits")
+	void ClearEdits();
+
+	/** Edits were added locally or received, patches them into the tree or schedules a rebuild */
+	void OnEditsChanged();
+
+	const FQuadtreeMeshEditLog& GetEditLog() const { return EditLog; }
+
+	/**
+	 *	Republish the GPU Scene instances when every view moved far enough from the last published selection, around the first view. The instances are pushed
+	 *	to the existing proxy. See bPublishGPUSceneInstances
+	 */
+	void UpdateGPUSceneInstances(TConstArrayView<FVector> InViewLocations);
+
+	const FQuadtreeMeshGPUSceneInstances& GetGPUSceneInstances() const { return GPUSceneInstances; }
+
+	/** Create, recreate or drop the ocean simulation to match bEnableOcean and OceanSettings, then step it to InWorldTime. Called by the subsystem every tick */
+	void UpdateOceanSimulation(double InWorldTime);
+
+	/** Null unless bEnableOcean */
+	const FQuadtreeMeshOceanSimulation* GetOceanSimulation() const { return OceanSimulation.Get(); }
+
+	/** Height of the rendered ocean surface above Location, the base height of the covering tile plus the simulated waves. Returns false if Location isn't covered */
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh|Ocean")
+	bool GetOceanSurfaceHeight(FVector Location, float& OutHeight) const;
+
+	/** MaxSurfaceDisplacement plus the largest wave height simulated so far */
+	float GetMaxSurfaceDisplacement() const { return MaxSurfaceDisplacement + AppliedOceanPadding.Z; }
+
+	/** Room left around the tiles for the simulated waves (xy: choppy horizontal offset, z: height). Culling only, the tree is built without it */
+	FVector GetOceanBoundsPadding() const { return AppliedOceanPadding; }
+
+	/** Traversal settings of the proxy at the default scalability, for selections made on the game thread. The observer dependent LOD parameters are left to the caller */
+	void GetDefaultTraversalDesc(FMeshQuadTree::FTraversalDesc& OutTraversalDesc) const;
+
+	/** Rolling averages of what this mesh costs to render, zero when it has no render state. Cheap enough to poll every frame in any build */
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh|Telemetry")
+	FQuadtreeMeshTelemetry GetTelemetry() const;
+
+	/** Find the closest point covered by this mesh within MaxRadius of Location (2D distance). Returns false if there is none */
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh")
+	bool FindNearestCoveredLocation(FVector Location, float MaxRadius, FVector& OutLocation) const;
 	
 	virtual void CollectPSOPrecacheData(const FPSOPrecacheParams& BasePrecachePSOParams, FMaterialInterfacePSOPrecacheParamsList& OutParams) override;
 
 	void Update();
 
+	/**
+	 *	Rebuilds are split in 3 so the subsystem can build many dirty components concurrently:
+	 *	PrepareRebuild and FinishRebuild must run on the game thread, BuildQuadtreeMesh only touches the tree and can run on any thread
+	 */
+	bool NeedsRebuild() const { return bNeedsRebuild; }
+	void PrepareRebuild();
+	void BuildQuadtreeMesh();
+	void FinishRebuild();
+
+	/**
+	 *	Build the tree this component would build into OutTree, leaving its own tree alone. For tools on actors whose tree was never built (commandlets,
+	 *	freshly loaded actors). Not paged out and without hit proxies. Any thread the component isn't modified on
+	 */
+	void BuildDetachedQuadTree(FMeshQuadTree& OutTree) const;
+
 	FVector GetDynamicQuadtreeMeshExtent()const;
 
 	void SetExtentInTiles();
@@ -69,6 +193,10 @@ public:
 	void SetTessellationFactor(int32 NewFactor);
 
 	void SetMeshMaterial(UMaterialInterface* NewMaterial);
+
+	/** Change the per body parameters fed to the shader. This rebuilds the mesh but doesn't need a separate material instance */
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh")
+	void SetSurfaceParameters(FLinearColor NewSurfaceColor, FVector4 NewWaveParameters);
 	
 	FIntPoint GetExtentInTiles() const { return ExtentInTiles; }
 	
@@ -76,6 +204,9 @@ public:
 	virtual bool IsNavigationRelevant() const override { return false; }
 
 	const FMeshQuadTree& GetMeshQuadTree() const { return MeshQuadTree; }
+
+	/** Changes every time MeshQuadTree does, see UQuadtreeMeshSubsystem::GetQuadTreeSnapshots */
+	uint32 GetTreeRevision() const { return TreeRevision; }
 	
 	void MarkQuadtreeMeshGridDirty() { bNeedsRebuild = true; }
 
@@ -83,16 +214,25 @@ public:
 
 	FMaterialRelevance GetQuadtreeMeshMaterialRelevance(ERHIFeatureLevel::Type InFeatureLevel) const;
 
-	float GetLODScale() const { return LODScale; }
+	float GetLODScale() const { return bAutoConfigure && AutoConfiguration.IsValid() ? AutoConfiguration.LODScale : LODScale; }
+
+	int32 GetTessellationFactor() const { return FMath::Clamp(bAutoConfigure && AutoConfiguration.IsValid() ? AutoConfiguration.TessellationFactor : TessellationFactor, 1, 12); }
+
+	/** World size of the leaf tiles, TileSize split LODLayer times (at least once) unless auto configured. LODLayer sets the tree depth this way */
+	float GetLeafSize() const { return bAutoConfigure && AutoConfiguration.IsValid() ? AutoConfiguration.LeafSize : TileSize / FMath::Max(2.0f, FMath::Pow(2.0f, static_cast<float>(LODLayer))); }
 
-	int32 GetTessellationFactor() const { return FMath::Clamp(TessellationFactor, 1, 12); }
+	/** Recomputes AutoConfiguration from the coverage and the targets, returns true when it changed */
+	bool UpdateAutoConfiguration();
 
 private:
 	//USceneComponent interface
 	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
 
 	/** Based on all water bodies in the scene, rebuild the water mesh */
-	void RebuildQuadtreeMesh(float InTileSize, const FIntPoint& InExtentInTiles);
+	void RebuildQuadtreeMesh();
+
+	/** Start building the grids of the current tessellation factor on worker threads, so they are ready when the proxy creates its buffers. Nothing on targets that never render */
+	void RequestGrids();
 	
 	bool UpdateQuadtreeMeshInfoTexture();
 
@@ -108,27 +248,212 @@ public:
 	UPROPERTY(EditAnywhere, Category = Rendering)
 	TObjectPtr<UMaterialInterface> MeshMaterial;
 
+	/** Exposed to the material as the vertex color */
+	UPROPERTY(EditAnywhere, Category = Rendering)
+	FLinearColor SurfaceColor = FLinearColor::White;
+
+	/** Free parameters readable in the material through QuadtreeMeshParameters[QuadtreeGridParamIndex * 2 + 1] */
+	UPROPERTY(EditAnywhere, Category = Rendering)
+	FVector4 WaveParameters = FVector4::Zero();
+
+	/**
+	 *	When above 0, subtrees below this depth are kept in compressed pages and decompressed when reached. For very large meshes with a small tile size.
+	 *	The pages are built when cooking and streamed from the cooked package, the tree is then never fully in memory. Built subtree by subtree at runtime
+	 *	and kept compressed in memory when the cooked pages don't match the mesh (edited, moved, uncooked)
+	 */
+	UPROPERTY(EditAnywhere, Category = Rendering, AdvancedDisplay, meta = (ClampMin = "0"))
+	int32 PageDepth = 0;
+
+	/** Number of pages kept decompressed, least recently used pages are evicted past that */
+	UPROPERTY(EditAnywhere, Category = Rendering, AdvancedDisplay, meta = (ClampMin = "1", EditCondition = "PageDepth > 0"))
+	int32 MaxResidentPages = 256;
+
+	/** How far the material can move the surface up or down from its base height (waves, world position offset). Sets the Z extent of the tiles and of the component bounds */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0"))
+	float MaxSurfaceDisplacement = 100.0f;
+
+	/** When above 0, the covered part of each cell of a 2^N x 2^N grid over the tree gets its own occlusion query, tiles of occluded cells are skipped by the traversal */
+	UPROPERTY(EditAnywhere, Category = Rendering, AdvancedDisplay, meta = (ClampMin = "0", ClampMax = "4"))
+	int32 SubprimitiveOcclusionDepth = 0;
+
+	/**
+	 *	Publish the tiles selected around the rendered view as GPU Scene instances of the density grids, with their morph parameters in the per instance custom data,
+	 *	and draw them from the GPU Scene so the engine's instance culling and HZB occlusion drop the hidden tiles. Republished when the views move by half a LOD 0 tile.
+	 *	Views away from the published observer (other split screen players, other viewports) keep drawing their own selection
+	 */
+	UPROPERTY(EditAnywhere, Category = Rendering, AdvancedDisplay)
+	bool bPublishGPUSceneInstances = false;
+
+	/** Replicate the runtime edits, the owner replicates from BeginPlay on. Off by default so unedited meshes cost no network channel */
+	UPROPERTY(EditAnywhere, Category = "QuadtreeMesh|Edits")
+	bool bReplicateEdits = false;
+
+	/**
+	 *	Displace the surface by a simulated ocean. The field is computed on the CPU and sampled by the vertex factory, the height queries read the same field.
+	 *	The field tiles every OceanSettings.PatchSize from the world origin
+	 */
+	UPROPERTY(EditAnywhere, Category = "Rendering|Ocean")
+	bool bEnableOcean = false;
+
+	UPROPERTY(EditAnywhere, Category = "Rendering|Ocean", meta = (EditCondition = "bEnableOcean"))
+	FQuadtreeMeshOceanSettings OceanSettings;
+
+	/** Derive the leaf size, the tessellation factor and the LOD scale from TargetVertexSpacing and VertexBudget instead of using the values set here. TileSize keeps setting the covered extent */
+	UPROPERTY(EditAnywhere, Category = "Rendering|Auto Configuration")
+	bool bAutoConfigure = false;
+
+	/** World space distance between vertices near the camera */
+	UPROPERTY(EditAnywhere, Category = "Rendering|Auto Configuration", meta = (ClampMin = "1", EditCondition = "bAutoConfigure"))
+	float TargetVertexSpacing = 50.0f;
+
+	/** Vertices drawn per view the LOD scale is fitted to */
+	UPROPERTY(EditAnywhere, Category = "Rendering|Auto Configuration", meta = (ClampMin = "1000", EditCondition = "bAutoConfigure"))
+	int32 VertexBudget = 1000000;
+
+	/** Values in use when bAutoConfigure is set, updated on every rebuild */
+	UPROPERTY(Transient, VisibleAnywhere, Category = "Rendering|Auto Configuration")
+	FQuadtreeMeshAutoConfiguration AutoConfiguration;
+
+#if WITH_EDITORONLY_DATA
+	/** World space volume the cameras move in, see BakeLODSelection. A rail is covered by a volume one cell thick around it */
+	UPROPERTY(EditAnywhere, Category = "Rendering|Baked LOD")
+	FBox BakeVolume = FBox(ForceInit);
+
+	/** Size of the camera cells, the selection of a cell is the one of its center */
+	UPROPERTY(EditAnywhere, Category = "Rendering|Baked LOD", meta = (ClampMin = "10"))
+	float BakeCellSize = 500.0f;
+#endif
+
+	/** Result of BakeLODSelection, discarded at runtime when the tree or the LOD settings changed since */
+	UPROPERTY(VisibleAnywhere, Category = "Rendering|Baked LOD")
+	FQuadtreeMeshBakedSelection BakedSelection;
+
 private:
-	/** World size of the QuadtreeMesh tiles at LOD0. Multiply this with the ExtentInTiles to get the world extents of the system */
+	/** Half the world size of the covered area before scaling. Subdivided LODLayer times into the leaf tiles, see GetLeafSize */
 	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "100", AllowPrivateAcces = "true"))
 	float TileSize;
 
-	/** The extent of the QuadtreeMesh in number of tiles. Maximum number of tiles for this system will be ExtentInTiles.X*2*ExtentInTiles.Y*2 */
+	/** Leaf tiles per TileSize. The tree itself only spans the tiles covered by the mesh, see FMeshQuadTree::InitTree */
 	UPROPERTY(Transient, VisibleAnywhere, Category = Rendering)
 	FIntPoint ExtentInTiles;
 
 	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0.5"))
 	float LODScale;
 
+	/** Times TileSize is halved into leaf tiles, the tree gets about that many LOD levels over the covered area */
 	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0"))
 	int32 LODLayer;
 	
 	FMeshQuadTree MeshQuadTree;
 
+	/** Everything the tree build reads, gathered on the game thread by PrepareRebuild */
+	struct FPendingBuild
+	{
+		FQuadtreeMeshRenderData RenderData;
+		FBox2D MeshWorldBox = FBox2D(ForceInit);
+		FBox TileBounds = FBox(ForceInit);
+		float TileSize = 0.0f;
+		int32 PageDepth = 0;
+		int32 MaxResidentPages = 0;
+		bool bShouldRender = false;
+		/** Copy of the applied edits, empty when there are none */
+		FQuadtreeMeshEditBaseline Edits;
+		/** Render data of each edit slot, slot 1 is RenderData */
+		TArray<FQuadtreeMeshRenderData> SlotRenderData;
+	};
+	FPendingBuild PendingBuild;
+
+	/** Fills OutBuild from the current settings, everything but the paging and the hit proxy */
+	void GatherBuildInputs(bool bInShouldRender, FPendingBuild& OutBuild) const;
+
+	static void BuildTree(const FPendingBuild& InBuild, FMeshQuadTree& OutTree);
+
+	/** Pages built when cooking, see Serialize(..) */
+	struct FCookedPages
+	{
+		/** GetCookedPagesKey(..) of the build they come from, 0 when there are none */
+		uint32 Key = 0;
+
+		/** See FMeshQuadTree::SavePages(..) */
+		TArray<uint8> Header;
+
+		/** Compressed pages, streamed one at a time */
+		TSharedPtr<FByteBulkData, ESPMode::ThreadSafe> BulkData;
+	};
+	FCookedPages CookedPages;
+
+	/** Hash of what the nodes of a build depend on, the cooked pages are only used by a build with the same key */
+	static uint32 GetCookedPagesKey(const FPendingBuild& InBuild);
+
+	/** Load the cooked pages instead of building the tree, false if they don't match PendingBuild */
+	bool LoadCookedPages();
+
+#if WITH_EDITOR
+	/** Build the pages of the mesh as placed, see PageDepth */
+	void CookPages();
+#endif
+
 	TSharedPtr<FQuadtreeMeshViewExtension> QuadtreeMeshViewExtension;
 
+	/** Last selection published for the GPU Scene, see bPublishGPUSceneInstances */
+	FQuadtreeMeshGPUSceneInstances GPUSceneInstances;
+
+	/** See bEnableOcean */
+	TUniquePtr<FQuadtreeMeshOceanSimulation> OceanSimulation;
+
+	/** See GetOceanBoundsPadding, grows with the simulated waves */
+	FVector AppliedOceanPadding = FVector::ZeroVector;
+
+	/** Pad the component bounds and the proxy's node culling, the tree and its pages are left alone */
+	void SetOceanBoundsPadding(const FVector& InPadding);
+
+	/** Padding of the GPU Scene instance bounds for the vertex displacement (xy: horizontal, z: vertical) */
+	FVector GetGPUSceneInstanceDisplacement() const;
+
+	/** Hand the published instances to the current proxy and have the scene upload them, without recreating the render state */
+	void PushGPUSceneInstancesToProxy();
+
+	/** Recent runtime edits, replicated as deltas */
+	UPROPERTY(Replicated)
+	FQuadtreeMeshEditLog EditLog;
+
+	/** Edits folded out of EditLog by the authority, sent again only when the log overflows or the edits are cleared */
+	UPROPERTY(ReplicatedUsing = OnRep_EditBaseline)
+	FQuadtreeMeshEditBaseline EditBaseline;
+
+	/** EditBaseline and the logged edits applied to the tree since */
+	FQuadtreeMeshEditBaseline AppliedEdits;
+
+	/** Unedited tiles of the current tree, see FPendingBuild::TileBounds */
+	FBox BuiltTileBounds = FBox(ForceInit);
+
+	UFUNCTION()
+	void OnRep_EditBaseline();
+
+	/** Authority only, moves the oldest logged edits to EditBaseline once the log is longer than FQuadtreeMeshEditLog::MaxLoggedEdits */
+	void FoldLoggedEdits();
+
+	/** Rebuild the subtrees of the ranges from AppliedEdits and send the changed nodes to the proxy. False if the tree can't be patched */
+	bool PatchEditedTree(TConstArrayView<FQuadtreeMeshMortonRange> InRanges);
+
+	/** Region where tiles are rendered at full density, invalid when not in use */
+	FBox2D TessellatedRegion = FBox2D(ForceInit);
+
+	/** See SetClipCircle */
+	FVector ClipCircle = FVector(0.0, 0.0, -1.0);
+
+	int32 GPUBudgetEvictedDensityLevels = 0;
+
+	bool bGPUBudgetEvictedRayTracing = false;
+
+	/** Grids of every density for the current tessellation factor, keeps them cached until the next proxy is created and its buffers take them over */
+	TArray<FQuadtreeMeshGridRef> Grids;
+
 	bool bNeedsRebuild = true;
 
+	/** See GetTreeRevision */
+	uint32 TreeRevision = 0;
+
 	bool bIsInit = true;
 
 	FVector2f MeshHeightExtents;
@@ -0,0 +1,27 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/Guid.h"
+
+/** Version of the data serialized by the QuadtreeMesh module */
+struct QUADTREEMESH_API FQuadtreeMeshCustomVersion
+{
+	enum Type
+	{
+		// Before any version changes were made
+		BeforeCustomVersionWasAdded = 0,
+
+		// Actor descriptors carry the overlap priority and a summary of the tree
+		ActorDescTreeSummary,
+
+		// -----<new versions can be added above this line>-------------------------------------------------
+		VersionPlusOne,
+		LatestVersion = VersionPlusOne - 1
+	};
+
+	// The GUID for this custom version number
+	static const FGuid GUID;
+
+private:
+	FQuadtreeMeshCustomVersion() {}
+};
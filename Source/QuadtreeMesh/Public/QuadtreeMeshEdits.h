@@ -0,0 +1,226 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Net/Serialization/FastArraySerializer.h"
+#include "MeshQuadTree.h"
+#include "QuadtreeMeshEdits.generated.h"
+
+class UQuadtreeMeshComponent;
+
+/** Leaves [Begin, End) in Morton order of the leaf grid of the tree root */
+USTRUCT()
+struct FQuadtreeMeshMortonRange
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	uint64 Begin = 0;
+
+	UPROPERTY()
+	uint64 End = 0;
+
+	bool operator==(const FQuadtreeMeshMortonRange& Other) const { return Begin == Other.Begin && End == Other.End; }
+};
+
+/**
+ *	Runtime edit of a quadtree mesh. Either sets the render data slot of leaf ranges (0 removes the tiles, 1 is the component's own render data),
+ *	or defines the render data of a slot above 1 as an offset of the component's. Edits apply in Revision order
+ */
+USTRUCT()
+struct QUADTREEMESH_API FQuadtreeMeshEdit : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	uint32 Revision = 0;
+
+	UPROPERTY()
+	uint8 Slot = 0;
+
+	/** Render data edit when true, coverage edit otherwise */
+	UPROPERTY()
+	bool bRenderData = false;
+
+	/** Sorted, non overlapping */
+	UPROPERTY()
+	TArray<FQuadtreeMeshMortonRange> Ranges;
+
+	UPROPERTY()
+	float SurfaceHeightOffset = 0.0f;
+
+	UPROPERTY()
+	FColor SurfaceColor = FColor::White;
+
+	/** Ranges are sent as packed gaps and lengths, render data edits only send their values */
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+
+	bool operator==(const FQuadtreeMeshEdit& Other) const
+	{
+		return Revision == Other.Revision && Slot == Other.Slot && bRenderData == Other.bRenderData && Ranges == Other.Ranges
+			&& SurfaceHeightOffset == Other.SurfaceHeightOffset && SurfaceColor == Other.SurfaceColor;
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FQuadtreeMeshEdit> : public TStructOpsTypeTraitsBase2<FQuadtreeMeshEdit>
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
+
+/** Leaves from Begin to the next run share Slot */
+USTRUCT()
+struct FQuadtreeMeshSlotRun
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	uint64 Begin = 0;
+
+	/** FQuadtreeMeshEditBaseline::Unedited where the mesh's own coverage shows */
+	UPROPERTY()
+	int16 Slot = 0;
+
+	bool operator==(const FQuadtreeMeshSlotRun& Other) const { return Begin == Other.Begin && Slot == Other.Slot; }
+};
+
+/**
+ *	Edits folded into the slot of every leaf, stored as runs of leaves in Morton order. Later edits overwrite earlier ones, so this is the same as applying them all.
+ *	Keeps the edit log short: the server folds its old edits into the replicated baseline, and every machine folds the edits it applies into its own copy
+ */
+USTRUCT()
+struct QUADTREEMESH_API FQuadtreeMeshEditBaseline
+{
+	GENERATED_BODY()
+
+	static constexpr int16 Unedited = INDEX_NONE;
+
+	/** Last folded edit */
+	UPROPERTY()
+	uint32 Revision = 0;
+
+	/** Sorted, neighbors have different slots. Empty when no leaf was edited */
+	UPROPERTY()
+	TArray<FQuadtreeMeshSlotRun> Runs;
+
+	/** Last render data edit of each slot */
+	UPROPERTY()
+	TArray<FQuadtreeMeshEdit> RenderDataEdits;
+
+	/** Drop all the edits, InRevision comes after all of them */
+	void Reset(uint32 InRevision);
+
+	/** Fold an edit in, it must come after the folded ones */
+	void Apply(const FQuadtreeMeshEdit& InEdit);
+
+	/** Slot shared by the leaves [InBegin, InEnd), returns false if they don't share one */
+	bool GetUniformSlot(uint64 InBegin, uint64 InEnd, int16& OutSlot) const;
+
+	/** Some leaf has InSlot */
+	bool UsesSlot(int16 InSlot) const;
+
+	bool HasEdits() const { return Runs.Num() > 0 || RenderDataEdits.Num() > 0; }
+
+	/** Render data of every slot: slot 1 is InBaseRenderData, slots set by the render data edits are offsets of it */
+	void GetSlotRenderData(const FQuadtreeMeshRenderData& InBaseRenderData, TArray<FQuadtreeMeshRenderData>& OutSlotRenderData) const;
+
+	/** Runs are sent as packed gaps */
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+
+	bool operator==(const FQuadtreeMeshEditBaseline& Other) const { return Revision == Other.Revision && Runs == Other.Runs && RenderDataEdits == Other.RenderDataEdits; }
+
+private:
+	/** Run containing InLeaf, Runs must not be empty */
+	int32 FindRun(uint64 InLeaf) const;
+
+	void Assign(uint64 InBegin, uint64 InEnd, int16 InSlot);
+};
+
+template<>
+struct TStructOpsTypeTraits<FQuadtreeMeshEditBaseline> : public TStructOpsTypeTraitsBase2<FQuadtreeMeshEditBaseline>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true,
+	};
+};
+
+/**
+ *	Unedited coverage and leaf grid of a tree, resolves the render data index of its leaf blocks from a FQuadtreeMeshEditBaseline.
+ *	Render data indices are the slots: the edited trees add one render data per slot in slot order
+ */
+struct QUADTREEMESH_API FQuadtreeMeshEditCoverage
+{
+	/** InTileBounds are the unedited tiles, like AddQuadtreeMeshTilesInsideBounds(..) takes them */
+	FQuadtreeMeshEditCoverage(const FMeshQuadTree& InTree, const FBox& InTileBounds);
+
+	/** Render data index of the block, INDEX_NONE if its leaves differ. See FMeshQuadTree::FGetLeafBlockQuadtreeMeshIndex */
+	int32 GetBlockQuadtreeMeshIndex(const FQuadtreeMeshEditBaseline& InEdits, const FMeshQuadTree::FLeafBlock& InBlock) const;
+
+	/** Unedited tiles, inclusive leaf coordinates */
+	FIntPoint TileMin = FIntPoint::ZeroValue;
+	FIntPoint TileMax = FIntPoint(-1, -1);
+
+	/** Last leaf of the tile region, nothing is ever added past it */
+	FIntPoint RegionMax = FIntPoint(-1, -1);
+};
+
+/** Replicated log of the recent runtime edits of a component, only the edits added since the last update are sent. Older edits are folded into a FQuadtreeMeshEditBaseline */
+USTRUCT()
+struct QUADTREEMESH_API FQuadtreeMeshEditLog : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	/** Render data slots are stored per run in an int16, the render data index of a slot is the slot */
+	static constexpr int32 MaxSlots = 256;
+
+	/** Leaf Morton codes are 32 bits per axis */
+	static constexpr int32 MaxTreeDepth = 31;
+
+	/** The server folds the older half of the log into the baseline past this many edits */
+	static constexpr int32 MaxLoggedEdits = 32;
+
+	UPROPERTY()
+	TArray<FQuadtreeMeshEdit> Edits;
+
+	UPROPERTY(NotReplicated)
+	TObjectPtr<UQuadtreeMeshComponent> Owner;
+
+	/** Last revision handed out by AddEdit, authority only */
+	uint32 LastRevision = 0;
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+	{
+		return FFastArraySerializer::FastArrayDeltaSerialize<FQuadtreeMeshEdit, FQuadtreeMeshEditLog>(Edits, DeltaParms, *this);
+	}
+
+	/** Rebuilds the owner's tree once per received bunch, whatever the number of edits in it */
+	void PostReplicatedReceive(const FFastArraySerializer::FPostReplicatedReceiveParameters& Parameters);
+
+	/** Add an edit with the next revision, authority only */
+	FQuadtreeMeshEdit& AddEdit();
+
+	/** Morton ranges of the leaves in [InMin, InMax] (inclusive leaf coordinates) of a tree of depth InTreeDepth */
+	static void GetMortonRanges(FIntPoint InMin, FIntPoint InMax, int32 InTreeDepth, TArray<FQuadtreeMeshMortonRange>& OutRanges);
+
+	/** Split Morton ranges into the largest aligned blocks, the subtrees to rebuild for them */
+	static void GetLeafBlocks(TConstArrayView<FQuadtreeMeshMortonRange> InRanges, int32 InTreeDepth, TArray<FMeshQuadTree::FLeafBlock>& OutBlocks);
+
+	/**
+	 *	Add the tiles of an unlocked tree: the leaves overlapping InTileBounds use the render data of slot 1, then InEdits are applied.
+	 *	Adds the render data of every slot, InSlotRenderData is indexed by slot and index 0 is unused
+	 */
+	static void AddEditedTiles(FMeshQuadTree& InOutTree, const FBox& InTileBounds, TConstArrayView<FQuadtreeMeshRenderData> InSlotRenderData, const FQuadtreeMeshEditBaseline& InEdits);
+};
+
+template<>
+struct TStructOpsTypeTraits<FQuadtreeMeshEditLog> : public TStructOpsTypeTraitsBase2<FQuadtreeMeshEditLog>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
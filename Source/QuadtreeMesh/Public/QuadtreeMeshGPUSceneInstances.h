@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#include "MeshQuadTree.h"
+#include "InstanceUniformShaderParameters.h"
+
+/**
+ *	Tiles selected around an observer, laid out as engine GPU Scene instances of the unit grid of their density. Only the LOD selection is done on the CPU,
+ *	the frustum and the HZB occlusion culling are left to the engine's instance culling. Published on the game thread and pushed to the existing proxy,
+ *	so it has no render thread or RHI dependency. See FQuadtreeMeshGPUSceneVertexFactory for the draws
+ */
+struct QUADTREEMESH_API FQuadtreeMeshGPUSceneInstances
+{
+	/**
+	 *	Per instance custom data:
+	 *	[0] (bit 0-7) lod level, (bit 8) bShouldMorph, (bit 9) bCanMorphTwice, same packing as FMeshQuadTree::FStagingInstanceData::Data[1].x
+	 *	[1] height morph
+	 *	[2-3] tile size
+	 *	[4] render data index
+	 *	[5] density index
+	 */
+	static constexpr int32 NumCustomDataFloats = 6;
+
+	/** Instances sorted by bucket (material * density count + density), the transform places the unit grid of the density on the tile, relative to the primitive */
+	TArray<FInstanceSceneData> InstanceSceneData;
+	TArray<float> InstanceCustomData;
+	TArray<FRenderBounds> InstanceLocalBounds;
+
+	/** First instance of each bucket, plus one entry past the last bucket */
+	TArray<int32> BucketFirstInstance;
+
+	/** Observer the LOD selection was made for, invalid if nothing was published */
+	FVector ObserverPosition = FVector::ZeroVector;
+	/** Views further than this from ObserverPosition would select other tiles, they draw their own traversal instead */
+	double ObserverTolerance = 0.0;
+	bool bIsValid = false;
+
+	/** Traversal settings the tiles were selected with, a proxy whose scalability or tessellated region differs draws its own traversal */
+	int32 DensityCount = 0;
+	float LODScale = 0.0f;
+	int32 ForceCollapseDensityLevel = TNumericLimits<int32>::Max();
+	FBox2D TessellatedQuadtreeMeshBounds = FBox2D(ForceInit);
+
+	/**
+	 *	Select the tiles of the whole tree around InTraversalDesc.ObserverPosition and lay them out as instances. The frustum and the clip circle of the desc are ignored,
+	 *	the instance transforms are relative to InPrimitiveToWorld. InDisplacement pads the instance bounds (xy: horizontal, z: vertical) for the vertex displacement
+	 */
+	void Publish(const FMeshQuadTree& InMeshQuadTree, const FMeshQuadTree::FTraversalDesc& InTraversalDesc, const FTransform& InPrimitiveToWorld, const FVector& InDisplacement, double InObserverTolerance);
+
+	void Reset();
+
+	/** The published tiles are the ones a traversal from InObserverPosition would select, within the tolerance */
+	bool IsValidFor(const FVector& InObserverPosition) const
+	{
+		return bIsValid && FVector::DistSquared(InObserverPosition, ObserverPosition) <= FMath::Square(ObserverTolerance);
+	}
+
+	int32 Num() const { return InstanceSceneData.Num(); }
+
+	int32 GetBucketInstanceCount(int32 InBucketIndex) const
+	{
+		return BucketFirstInstance[InBucketIndex + 1] - BucketFirstInstance[InBucketIndex];
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return InstanceSceneData.GetAllocatedSize() + InstanceCustomData.GetAllocatedSize() + InstanceLocalBounds.GetAllocatedSize() + BucketFirstInstance.GetAllocatedSize();
+	}
+};
@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Tasks/Task.h"
+
+/**
+ *	CPU copy of the vertices and Morton ordered indices of a NumQuadsPerSide x NumQuadsPerSide grid, built on a worker thread.
+ *	Uploaded by FQuadtreeMeshVertexBuffer / FQuadtreeMeshIndexBuffer, the data must only be read once IsReady() or after Wait()
+ */
+class QUADTREEMESH_API FQuadtreeMeshGrid
+{
+public:
+	explicit FQuadtreeMeshGrid(int32 InNumQuadsPerSide) : NumQuadsPerSide(InNumQuadsPerSide) {}
+
+	~FQuadtreeMeshGrid() { BuildTask.Wait(); }
+
+	bool IsReady() const { return BuildTask.IsCompleted(); }
+
+	void Wait() const { BuildTask.Wait(); }
+
+	int32 GetNumQuadsPerSide() const { return NumQuadsPerSide; }
+
+	TConstArrayView<FVector4f> GetVertices() const { return Vertices; }
+
+	/** Raw index data, uint16 below 256 quads per side and uint32 above */
+	TConstArrayView<uint8> GetIndexData() const { return IndexData; }
+
+	uint32 GetIndexStride() const { return NumQuadsPerSide < 256 ? sizeof(uint16) : sizeof(uint32); }
+
+	int32 GetIndexCount() const { return IndexData.Num() / GetIndexStride(); }
+
+private:
+	friend class FQuadtreeMeshGridCache;
+
+	void Build();
+
+	template <typename IndexType>
+	void BuildIndices();
+
+	const int32 NumQuadsPerSide;
+	TArray<FVector4f> Vertices;
+	TArray<uint8> IndexData;
+	UE::Tasks::FTask BuildTask;
+};
+
+using FQuadtreeMeshGridRef = TSharedRef<const FQuadtreeMeshGrid, ESPMode::ThreadSafe>;
+
+/**
+ *	Grids only depend on the number of quads per side, so they are shared by every proxy and built ahead of the render resource initialization.
+ *	A grid stays cached as long as something references it: components from their rebuild to their next proxy, buffers until they've uploaded it
+ */
+class QUADTREEMESH_API FQuadtreeMeshGridCache
+{
+public:
+	static FQuadtreeMeshGridCache& Get();
+
+	/** Return the cached grid or start building it on a worker thread. Any thread */
+	FQuadtreeMeshGridRef Request(int32 NumQuadsPerSide);
+
+private:
+	FCriticalSection Mutex;
+	TMap<int32, TWeakPtr<const FQuadtreeMeshGrid, ESPMode::ThreadSafe>> Grids;
+};
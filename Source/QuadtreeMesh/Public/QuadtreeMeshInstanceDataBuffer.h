@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "RenderingThread.h"
+#include <atomic>
 
 
 class FQuadtreeMeshInstanceDataBuffers
@@ -22,6 +23,8 @@ public:
 					Buffer[i] = RHICmdList.CreateVertexBuffer(SizeInBytes, BUF_Dynamic, CreateInfo);
 					BufferMemory[i] = TArrayView<FVector4f>();
 				}
+
+				AllocatedSize = static_cast<uint64>(SizeInBytes) * NumBuffers;
 			}
 		);
 	}
@@ -62,6 +65,12 @@ public:
 		return BufferMemory[InBufferID];
 	}
 
+	/** GPU memory of all the buffers, readable from any thread */
+	uint64 GetAllocatedSize() const
+	{
+		return AllocatedSize.load(std::memory_order_relaxed);
+	}
+
 	
 private:
 	
@@ -71,13 +80,14 @@ private:
 
 		if (SizeInBytes > Buffer[InBufferID]->GetSize())
 		{
+			// Align size in to avoid reallocating for a few differences of instance count
+			uint32 AlignedSizeInBytes = Align<uint32>(SizeInBytes, 4 * 1024);
+			AllocatedSize += static_cast<uint64>(AlignedSizeInBytes) - Buffer[InBufferID]->GetSize();
+
 			Buffer[InBufferID].SafeRelease();
 
 			FRHIResourceCreateInfo CreateInfo(TEXT("QuadtreeMeshInstanceDataBuffers"));
 
-			// Align size in to avoid reallocating for a few differences of instance count
-			uint32 AlignedSizeInBytes = Align<uint32>(SizeInBytes, 4 * 1024);
-
 			Buffer[InBufferID] = RHICmdList.CreateVertexBuffer(AlignedSizeInBytes, BUF_Dynamic, CreateInfo);
 		}
 
@@ -92,4 +102,6 @@ private:
 
 	FBufferRHIRef Buffer[NumBuffers];
 	TArrayView<FVector4f> BufferMemory[NumBuffers];
+
+	std::atomic<uint64> AllocatedSize = 0;
 };
\ No newline at end of file
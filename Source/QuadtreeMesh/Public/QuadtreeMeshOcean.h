@@ -0,0 +1,157 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "RenderResource.h"
+#include "Tasks/Task.h"
+#include "QuadtreeMeshOcean.generated.h"
+
+/** Statistical ocean simulated with an FFT of a Phillips spectrum, see FQuadtreeMeshOceanSimulation */
+USTRUCT(BlueprintType)
+struct QUADTREEMESH_API FQuadtreeMeshOceanSettings
+{
+	GENERATED_BODY()
+
+	/** Samples per side of the displacement field, rounded to a power of two */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "QuadtreeMesh|Ocean", meta = (ClampMin = "16", ClampMax = "512"))
+	int32 Resolution = 128;
+
+	/** World size of the simulated patch, the field tiles with this period */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "QuadtreeMesh|Ocean", meta = (ClampMin = "100"))
+	float PatchSize = 20000.0f;
+
+	/** In cm/s, sets the size of the largest waves */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "QuadtreeMesh|Ocean", meta = (ClampMin = "1"))
+	float WindSpeed = 1000.0f;
+
+	/** In degrees around Z, 0 blows along +X */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "QuadtreeMesh|Ocean")
+	float WindDirection = 0.0f;
+
+	/** Mean height of the highest third of the waves, the spectrum is scaled to it */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "QuadtreeMesh|Ocean", meta = (ClampMin = "0"))
+	float SignificantWaveHeight = 200.0f;
+
+	/** Horizontal displacement towards the crests, sharpens them. Above 1 the surface can fold over */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "QuadtreeMesh|Ocean", meta = (ClampMin = "0", ClampMax = "2"))
+	float Choppiness = 1.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "QuadtreeMesh|Ocean")
+	int32 Seed = 1;
+
+	bool operator==(const FQuadtreeMeshOceanSettings& Other) const
+	{
+		return Resolution == Other.Resolution && PatchSize == Other.PatchSize && WindSpeed == Other.WindSpeed && WindDirection == Other.WindDirection
+			&& SignificantWaveHeight == Other.SignificantWaveHeight && Choppiness == Other.Choppiness && Seed == Other.Seed;
+	}
+
+	bool operator!=(const FQuadtreeMeshOceanSettings& Other) const { return !(*this == Other); }
+};
+
+/**
+ *	One simulated step: Resolution x Resolution displacements (xy: horizontal, z: height) and slopes of the displaced surface over a patch tiling the world
+ *	from the origin. Both are indexed by the undisplaced grid point. Immutable once published
+ */
+struct QUADTREEMESH_API FQuadtreeMeshOceanField
+{
+	int32 Resolution = 0;
+	float PatchSize = 0.0f;
+	double Time = 0.0;
+	TArray<FVector4f> Displacement;
+
+	/** dz/dx and dz/dy of the displaced surface, the horizontal stretch of the choppy waves is accounted for */
+	TArray<FVector2f> Slopes;
+
+	/** Largest height and horizontal displacement (per axis) reached in this field */
+	float MaxHeight = 0.0f;
+	float MaxOffset = 0.0f;
+
+	/** Displacement of the grid point at InWorldLocationXY, bilinear and wrapped like SampleOcean in QuadtreeMeshVertexFactory.ush */
+	FVector3f SampleDisplacement(const FVector2D& InWorldLocationXY) const;
+
+	/**
+	 *	Height of the rendered surface above InWorldLocationXY. The rendered vertices are also displaced horizontally, the grid point that lands there
+	 *	is found with a few fixed point iterations
+	 */
+	float SampleHeight(const FVector2D& InWorldLocationXY, int32 InNumIterations = 4) const;
+};
+
+/** Displacement (TextureRHI) and slope fields on the GPU, updated from the published fields. Sampled by the vertex factory */
+class QUADTREEMESH_API FQuadtreeMeshOceanTexture : public FTexture
+{
+public:
+	explicit FQuadtreeMeshOceanTexture(int32 InResolution) : Resolution(InResolution) {}
+
+	virtual void InitRHI(FRHICommandListBase& RHICmdList) override;
+
+	virtual uint32 GetSizeX() const override { return Resolution; }
+	virtual uint32 GetSizeY() const override { return Resolution; }
+
+	/** Render thread */
+	void Update(FRHICommandListImmediate& RHICmdList, const FQuadtreeMeshOceanField& InField);
+
+	FTextureRHIRef SlopeTextureRHI;
+
+private:
+	const int32 Resolution = 0;
+};
+
+/**
+ *	Tessendorf style ocean: a Phillips spectrum is animated and turned into heights, horizontal displacements and slopes with inverse 2D FFTs each tick.
+ *	The FFTs run as a task between two ticks, lines are transformed 4 at a time, one per SIMD lane, and the batches of lines run in parallel.
+ *	The field published by a tick backs both the texture the vertex factory samples and the height queries, so what floats matches what is drawn
+ */
+class QUADTREEMESH_API FQuadtreeMeshOceanSimulation
+{
+public:
+	explicit FQuadtreeMeshOceanSimulation(const FQuadtreeMeshOceanSettings& InSettings);
+	~FQuadtreeMeshOceanSimulation();
+
+	/** Publish the field simulated since the last tick, upload it and start simulating InTime. Game thread */
+	void Tick(double InTime);
+
+	/** Last published field, null before the first one. Any thread */
+	TSharedPtr<const FQuadtreeMeshOceanField, ESPMode::ThreadSafe> GetField() const;
+
+	const FQuadtreeMeshOceanSettings& GetSettings() const { return Settings; }
+
+	/** Largest height of all the published fields so far, starts at the significant wave height. Game thread */
+	float GetMaxAmplitude() const { return MaxAmplitude; }
+
+	/** Largest horizontal displacement along either axis so far, starts at the significant wave height times the choppiness. Game thread */
+	float GetMaxHorizontalAmplitude() const { return MaxHorizontalAmplitude; }
+
+	TSharedPtr<FQuadtreeMeshOceanTexture, ESPMode::ThreadSafe> GetTexture() const { return Texture; }
+
+private:
+	void Simulate(double InTime, FQuadtreeMeshOceanField& OutField) const;
+
+	/** Inverse FFT of the rows then the columns of a Resolution x Resolution complex field, in place */
+	void InverseFFT2D(TArray<float>& InOutReal, TArray<float>& InOutImag) const;
+
+	/** Inverse FFT of 4 interleaved lines, element i of line l at [i * 4 + l] */
+	void InverseFFT4(float* InOutReal, float* InOutImag) const;
+
+	FQuadtreeMeshOceanSettings Settings;
+	int32 Resolution = 0;
+
+	/** Initial spectrum amplitudes (complex), dispersion, direction and length of each wave vector, in FFT order */
+	TArray<FVector2f> InitialSpectrum;
+	TArray<float> AngularFrequencies;
+	TArray<FVector2f> WaveDirections;
+	TArray<float> WaveNumbers;
+
+	/** e^(2 PI i j / Resolution) for j < Resolution / 2 */
+	TArray<FVector2f> Twiddles;
+	TArray<int32> BitReversedIndices;
+
+	TSharedPtr<FQuadtreeMeshOceanField, ESPMode::ThreadSafe> PendingField;
+	UE::Tasks::FTask SimulationTask;
+
+	mutable FCriticalSection FieldMutex;
+	TSharedPtr<const FQuadtreeMeshOceanField, ESPMode::ThreadSafe> Field;
+
+	float MaxAmplitude = 0.0f;
+	float MaxHorizontalAmplitude = 0.0f;
+
+	TSharedPtr<FQuadtreeMeshOceanTexture, ESPMode::ThreadSafe> Texture;
+};
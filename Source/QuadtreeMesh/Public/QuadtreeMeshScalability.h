@@ -0,0 +1,35 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ *	Runtime quality settings applied on top of the per component TessellationFactor, LODScale and ForceCollapseDensityLevel.
+ *	Read from the r.QuadtreeMesh.Scalability.* cvars, which follow sg.ViewDistanceQuality unless set with a higher priority (ini, console)
+ */
+struct QUADTREEMESH_API FQuadtreeMeshScalability
+{
+	/** Number of densest grids that are never drawn, their buffers are released */
+	int32 ClampedDensityLevels = 0;
+
+	/** Multiplies the LODScale of every mesh, still clamped to the tightest scale that doesn't break the morphing */
+	float LODScaleMultiplier = 1.0f;
+
+	/** Used when lower than the component's ForceCollapseDensityLevel, -1 leaves the components alone */
+	int32 ForceCollapseDensityLevel = -1;
+
+	bool operator==(const FQuadtreeMeshScalability& Other) const
+	{
+		return ClampedDensityLevels == Other.ClampedDensityLevels
+			&& LODScaleMultiplier == Other.LODScaleMultiplier
+			&& ForceCollapseDensityLevel == Other.ForceCollapseDensityLevel;
+	}
+
+	bool operator!=(const FQuadtreeMeshScalability& Other) const { return !(*this == Other); }
+
+	/** Current cvar values, game thread */
+	static FQuadtreeMeshScalability Get();
+
+	/** Follow the engine scalability levels, called on module startup */
+	static void Initialize();
+	static void Shutdown();
+};
@@ -3,13 +3,20 @@
 #include "Materials/MaterialInterface.h"
 #include "PrimitiveSceneProxy.h"
 #include "QuadtreeMeshVertexFactory.h"
+#include "QuadtreeMeshScalability.h"
+#include "QuadtreeMeshBakedSelection.h"
+#include "QuadtreeMeshTelemetry.h"
+#include "QuadtreeMeshGPUSceneInstances.h"
 #include "Materials/MaterialRelevance.h"
 #include "RayTracingGeometry.h"
+#include "Tasks/Task.h"
+#include <atomic>
 
 
 struct FRayTracingMaterialGatheringContext;
 
 class UQuadtreeMeshComponent;
+class FQuadtreeMeshOceanTexture;
 
 class FQuadtreeMeshSceneProxy final:public FPrimitiveSceneProxy
 {
@@ -28,7 +35,8 @@ public:
 
 	uint32 GetAllocatedSize() const 
 	{
-		return(FPrimitiveSceneProxy::GetAllocatedSize() + (QuadtreeMeshVertexFactories.GetAllocatedSize() + QuadtreeMeshVertexFactories.Num() * sizeof(FQuadtreeMeshVertexFactory)) + MeshQuadTree.GetAllocatedSize());
+		return(FPrimitiveSceneProxy::GetAllocatedSize() + (QuadtreeMeshVertexFactories.GetAllocatedSize() + QuadtreeMeshVertexFactories.Num() * sizeof(FQuadtreeMeshVertexFactory)) + MeshQuadTree.GetAllocatedSize()
+			+ BakedSelection.GetAllocatedSize() + BakedSelectionDecoder.GetAllocatedSize() + OcclusionBounds.GetAllocatedSize() + OcclusionCellIndices.GetAllocatedSize());
 	}
 
 	virtual bool CanBeOccluded() const override
@@ -40,8 +48,66 @@ public:
 
 	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const override;
 
+	virtual bool HasSubprimitiveOcclusionQueries() const override { return OcclusionBounds.Num() > 0; }
+
+	virtual const TArray<FBoxSphereBounds>* GetOcclusionQueries(const FSceneView* View) const override { return &OcclusionBounds; }
+
+	virtual void AcceptOcclusionResults(const FSceneView* View, TArray<bool>* Results, int32 ResultsStart, int32 NumResults) override;
+
 	void OnTessellatedQuadtreeMeshBoundsChanged_GameThread(const FBox2D& InTessellatedWaterMeshBounds);
 
+	/** Move the animated clip circle (xy: world center, z: radius, negative to disable). Only touches the traversal and the vertex factory uniforms */
+	void OnClipCircleChanged_GameThread(const FVector& InClipCircle);
+
+	/** Grow the culling bounds of every node (see FMeshQuadTree::FTraversalDesc::BoundsPadding) without rebuilding the tree */
+	void OnBoundsPaddingChanged_GameThread(const FVector& InBoundsPadding);
+
+	/** The proxy was created with an instance data buffer and can take GPU Scene instances, see UQuadtreeMeshComponent::bPublishGPUSceneInstances. Fixed at creation */
+	bool SupportsGPUSceneInstances() const { return bSupportsGPUSceneInstances; }
+
+	/** Replace the GPU Scene instances, the caller then has the scene upload them with FSceneInterface::UpdatePrimitiveInstances */
+	void UpdateGPUSceneInstances_GameThread(const FQuadtreeMeshGPUSceneInstances& InInstances);
+
+	/** Apply the nodes and render data changed by runtime edits, see FMeshQuadTree::RebuildLeafBlocks */
+	void ApplyEditPatch_GameThread(FMeshQuadTree::FEditPatch&& InPatch);
+
+	/** GPU memory held by the proxy, split by what the GPU budget can act on */
+	struct FGPUMemoryUsage
+	{
+		uint64 GridBytes = 0;
+		uint64 InstanceBytes = 0;
+		uint64 RayTracingBytes = 0;
+
+		uint64 GetTotal() const { return GridBytes + InstanceBytes + RayTracingBytes; }
+	};
+
+	/** Current usage, safe to call from the game thread */
+	FGPUMemoryUsage GetGPUMemoryUsage() const;
+
+	/** Size of the grid of each density, densest first. Fixed at creation so it can be read from the game thread */
+	const TArray<uint64>& GetDensityGridMemorySizes() const { return DensityGridMemorySizes; }
+
+	/** Size of the ray tracing geometry the last time it was gathered, what restoring it after an eviction would cost */
+	uint64 GetLastRayTracingMemorySize() const { return LastRayTracingMemorySize.load(std::memory_order_relaxed); }
+
+	/** Release the InEvictedDensityLevels densest grids, their tiles collapse to the next coarser grid, and optionally the ray tracing geometry */
+	void SetGPUBudgetEviction_GameThread(int32 InEvictedDensityLevels, bool bInEvictRayTracing);
+
+	/** Apply new runtime quality settings without recreating the proxy */
+	void SetScalability_GameThread(const FQuadtreeMeshScalability& InScalability);
+
+	/** Rolling averages of the rendering cost, safe to call from the game thread. See r.QuadtreeMesh.Telemetry */
+	FQuadtreeMeshTelemetry GetTelemetry() const;
+
+	struct FQuadtreeMeshLODParams
+	{
+		int32 LowestLOD;
+		float HeightLODFactor;
+		float QuadtreeMeshHeightForLOD;
+	};
+
+	/** Lowest LOD and its morph factor for an observer at Position, based on its height above the tree. Also used to bake the LOD selection */
+	static FQuadtreeMeshLODParams GetQuadtreeMeshLODParams(const FMeshQuadTree& InMeshQuadTree, float InLODScale, const FVector& Position);
 	
 
 #if WITH_EDITOR
@@ -56,13 +122,6 @@ public:
 
 
 private:
-	struct FQuadtreeMeshLODParams
-	{
-		int32 LowestLOD;
-		float HeightLODFactor;
-		float QuadtreeMeshHeightForLOD;
-	};
-
 #if RHI_RAYTRACING
 	struct FRayTracingQuadtreeMeshData
 	{
@@ -71,53 +130,205 @@ private:
 	};
 	
 	void SetupRayTracingInstances(FRHICommandListBase& RHICmdList, int32 NumInstances, uint32 DensityIndex);
-	
-	void OnTessellatedQuadtreeMeshBoundsChanged_RenderThread(const FBox2D& InTessellatedWaterMeshBounds);
 
+	void ReleaseRayTracingData();
 #endif
 
+	void OnTessellatedQuadtreeMeshBoundsChanged_RenderThread(const FBox2D& InTessellatedWaterMeshBounds);
+
+	void OnClipCircleChanged_RenderThread(const FVector& InClipCircle);
+
+	void OnBoundsPaddingChanged_RenderThread(const FVector& InBoundsPadding);
+
+	void ApplyEditPatch_RenderThread(FRHICommandListBase& RHICmdList, const FMeshQuadTree::FEditPatch& InPatch);
+
+	void SetGPUBudgetEviction_RenderThread(FRHICommandListBase& RHICmdList, int32 InEvictedDensityLevels, bool bInEvictRayTracing);
+
+	void SetScalability_RenderThread(FRHICommandListBase& RHICmdList, const FQuadtreeMeshScalability& InScalability);
+
+	/** Release the grids below the densest allowed by the GPU budget and the scalability settings, and recreate the ones above it */
+	void UpdateDensityResources_RenderThread(FRHICommandListBase& RHICmdList);
+
+	float GetScaledLODScale(float InLODScaleMultiplier) const
+	{
+		// Leaf size * 0.5 equals the tightest possible LOD Scale that doesn't break the morphing. Can be scaled larger
+		return MeshQuadTree.GetLeafSize() * FMath::Max(ComponentLODScale * InLODScaleMultiplier, 0.5f);
+	}
+
+	int32 GetScaledForceCollapseDensityLevel(int32 InScalabilityForceCollapseDensityLevel) const
+	{
+		return InScalabilityForceCollapseDensityLevel > -1 ? FMath::Min(ComponentForceCollapseDensityLevel, InScalabilityForceCollapseDensityLevel) : ComponentForceCollapseDensityLevel;
+	}
+
 	bool HasQuadtreeData() const 
 	{
 		return MeshQuadTree.GetNodeCount() != 0 && DensityCount != 0;
 	}
 
-	FQuadtreeMeshLODParams GetQuadtreeMeshLODParams(const FVector& Position) const;
+	FQuadtreeMeshLODParams GetQuadtreeMeshLODParams(const FVector& Position) const
+	{
+		return GetQuadtreeMeshLODParams(MeshQuadTree, LODScale, Position);
+	}
+
+	/** Traversal of the predicted next view, run on a worker while the current frame renders. See r.QuadtreeMesh.SpeculativeTraversal */
+	struct FSpeculativeTraversal
+	{
+		FMeshQuadTree::FTraversalDesc Desc;
+		FMeshQuadTree::FTraversalOutput Output;
+		UE::Tasks::FTask Task;
+		FMatrix ProjectionMatrix = FMatrix::Identity;
+		FQuat PredictedRotation = FQuat::Identity;
+		float PositionTolerance = 0.0f;
+		float AngleTolerance = 0.0f;
+		uint32 TargetFrameNumber = INDEX_NONE;
+
+		/** Last gathered view, the prediction extrapolates from it */
+		FVector LastViewOrigin = FVector::ZeroVector;
+		FQuat LastViewRotation = FQuat::Identity;
+		uint32 LastFrameNumber = INDEX_NONE;
+		uint32 ViewKey = 0;
+	};
+
+	/** Cost of one view family, summed over the view families of a frame */
+	struct FTelemetryFrame
+	{
+		int32 TilesDrawn = 0;
+		int32 DrawCalls = 0;
+		uint64 TraversalCycles = 0;
+		uint64 UploadBytes = 0;
+	};
+
+	/** Cells occluded in the last results of the view, false if there are none recent enough to trust */
+	bool GetOccludedCells(const FSceneView& View, uint32 InFrameNumber, TBitArray<>& OutOccludedCells) const;
+
+	/** Add the cost of a view family to its frame, previous frames are folded into the averages when a new one starts */
+	void RecordTelemetry_RenderThread(uint32 InFrameNumber, const FTelemetryFrame& InFrame) const;
+
+	/** Take the tiles selected by the speculative traversal if the actual view is within tolerance of the prediction. Only the packing is left to do on success */
+	bool TryAcceptSpeculativeTraversal(const FSceneView& View, const FMeshQuadTree::FTraversalDesc& InTraversalDesc, FMeshQuadTree::FTraversalOutput& Output) const;
+
+	/** Extrapolate the next view from this one and the previous one, and start selecting its tiles on a worker */
+	void LaunchSpeculativeTraversal(const FSceneView& View, const FMeshQuadTree::FTraversalDesc& InTraversalDesc) const;
+
+	/** Take the instance arrays for the scene and keep the selection to draw them */
+	void SetGPUSceneInstances(FQuadtreeMeshGPUSceneInstances&& InInstances);
+
+	/** The view can draw the published instances instead of its own traversal */
+	bool CanDrawGPUSceneInstances(const FSceneView& View) const;
+
+	/** One instance run per non empty bucket of the published selection, culled by the engine */
+	void DrawGPUSceneInstances(int32 ViewIndex, const FMaterialRenderProxy* InWireframeMaterial, FMeshElementCollector& Collector, FTelemetryFrame& OutTelemetry) const;
 	
 	FMaterialRelevance MaterialRelevance;
 
 	// One vertex factory per LOD
 	TArray<FQuadtreeMeshVertexFactory*> QuadtreeMeshVertexFactories;
 
+	/** Same densities drawn from the GPU Scene instances, empty unless bSupportsGPUSceneInstances */
+	TArray<FQuadtreeMeshGPUSceneVertexFactory*> GPUSceneVertexFactories;
+
+	/** Published selection without its instance arrays, which were handed to the GPU Scene. Render thread */
+	FQuadtreeMeshGPUSceneInstances GPUSceneSelection;
+
+	/** First and last instance of each bucket of GPUSceneSelection, pointed at by the mesh batches */
+	TArray<uint32> GPUSceneInstanceRuns;
+
+	bool bSupportsGPUSceneInstances = false;
+
 	/** Tiles containing water, stored in a quad tree */
 	FMeshQuadTree MeshQuadTree;
 
 	/** Unique Instance data buffer shared accross water batch draw calls */	
 	FQuadtreeMeshInstanceDataBuffers* QuadtreeMeshInstanceDataBuffers;
 
+	/** Parameters of every render data in the tree, lets bodies with different looks share the same draw calls */
+	FQuadtreeMeshParameterBuffer* QuadtreeMeshParameterBuffer;
+
 	/** Per-"water render group" user data (the number of groups might vary depending on whether we're in the editor or not) */
 	FQuadtreeMeshUserDataBuffers* QuadtreeMeshUserDataBuffers;
 
 	FBox2D TessellatedQuadtreeMeshBounds = FBox2D(ForceInit);
 
+	/** See FMeshQuadTree::FTraversalDesc::ClipCircle */
+	FVector ClipCircle = FVector(0.0, 0.0, -1.0);
+
+	/** See FMeshQuadTree::FTraversalDesc::BoundsPadding */
+	FVector BoundsPadding = FVector::ZeroVector;
+
+	/** See UQuadtreeMeshComponent::bEnableOcean, kept alive here so the vertex factories never point at a released texture */
+	TSharedPtr<FQuadtreeMeshOceanTexture, ESPMode::ThreadSafe> OceanTexture;
+	float OceanPatchSize = 0.0f;
+	int32 OceanResolution = 0;
+
 	uint32 SceneProxyCreatedFrameNumberRenderThread = INDEX_NONE;
 
 	int32 ForceCollapseDensityLevel = TNumericLimits<int32>::Max();
+	int32 ComponentForceCollapseDensityLevel = TNumericLimits<int32>::Max();
 
 	float LODScale = -1.0f;
+	float ComponentLODScale = 1.0f;
 
 	int32 DensityCount = 0;
 
+	/** Densities below this one were evicted by the GPU budget or clamped by the scalability settings */
+	int32 MinDensityIndex = 0;
+	int32 BudgetEvictedDensityLevels = 0;
+	int32 ScalabilityClampedDensityLevels = 0;
+
+	TArray<uint64> DensityGridMemorySizes;
+	std::atomic<uint64> GridMemorySize = 0;
+
 	double MeshQuadTreeMinHeight = DBL_MAX;
 	double MeshQuadTreeMaxHeight = -DBL_MAX;
 
 	mutable int32 HistoricalMaxViewInstanceCount = 0;
 
+	mutable FSpeculativeTraversal SpeculativeTraversal;
+
+	/** Written on the render thread, read on the game thread */
+	mutable FCriticalSection TelemetryMutex;
+	mutable FQuadtreeMeshTelemetry TelemetryAverages;
+	mutable FTelemetryFrame TelemetryFrame;
+	mutable uint32 TelemetryFrameNumber = INDEX_NONE;
+	/** GFrameNumberRenderThread of the last recorded frame, lets GetTelemetry decay the averages of meshes that stopped rendering */
+	mutable uint32 TelemetryRenderFrameNumber = INDEX_NONE;
+
+	/** Occlusion results of a view, true for the occluded cells */
+	struct FOcclusionResults
+	{
+		TBitArray<> OccludedCells;
+		uint32 FrameNumber = INDEX_NONE;
+	};
+
+	/** Covered part of the non empty cells of the sub primitive occlusion grid, and their cell index. See UQuadtreeMeshComponent::SubprimitiveOcclusionDepth */
+	TArray<FBoxSphereBounds> OcclusionBounds;
+	TArray<int32> OcclusionCellIndices;
+	int32 OcclusionCellDepth = 0;
+
+	/** Results may be accepted from the parallel visibility tasks */
+	mutable FCriticalSection OcclusionMutex;
+	TMap<uint32, FOcclusionResults> OcclusionResultsByView;
+
+	/** Offline tile selection of the component for fixed or rail cameras, used instead of the traversal inside its volume. See r.QuadtreeMesh.BakedSelection */
+	FQuadtreeMeshBakedSelection BakedSelection;
+	mutable FQuadtreeMeshBakedSelectionDecoder BakedSelectionDecoder;
+
 	bool bIsVisble;
 
 
 #if RHI_RAYTRACING
 	// Per density array of ray tracing geometries.
 	TArray<TArray<FRayTracingQuadtreeMeshData>> RayTracingQuadtreeMeshData;	
+
+	/** Unculled tiles, sorted by bucket. Gathered along with the raster tiles of the first view so the ray tracing gather doesn't need its own traversal */
+	mutable FMeshQuadTree::FTraversalOutput RayTracingTraversalOutput;
+	mutable uint32 RayTracingTraversalFrameNumber = INDEX_NONE;
+	mutable FVector RayTracingTraversalObserverPosition = FVector::ZeroVector;
+
+	bool bRayTracingEvicted = false;
 #endif
+
+	std::atomic<uint64> RayTracingMemorySize = 0;
+	std::atomic<uint64> LastRayTracingMemorySize = 0;
 	
 };
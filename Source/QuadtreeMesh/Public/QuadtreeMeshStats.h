@@ -0,0 +1,6 @@
+﻿#pragma once
+
+#include "Stats/Stats.h"
+
+/** Shared by the rendering and the query paths so "stat QuadtreeMesh" shows both */
+DECLARE_STATS_GROUP(TEXT("Quadtree Mesh"), STATGROUP_QuadtreeMesh, STATCAT_Advanced);
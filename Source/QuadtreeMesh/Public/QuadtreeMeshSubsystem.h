@@ -4,10 +4,17 @@
 
 #include "CoreMinimal.h"
 #include "Subsystems/WorldSubsystem.h"
+#include "QuadtreeMeshScalability.h"
+#include "QuadtreeMeshTelemetry.h"
 #include "QuadtreeMeshSubsystem.generated.h"
 
+class UQuadtreeMeshComponent;
+struct FMeshQuadTree;
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnQuadtreeMeshOverlapChanged, AActor*, Actor, UQuadtreeMeshComponent*, QuadtreeMeshComponent);
+
 /**
- * 
+ * Ticks the quadtree meshes of a world and tracks which registered actors are over them
  */
 UCLASS(BlueprintType)
 class QUADTREEMESH_API UQuadtreeMeshSubsystem : public UTickableWorldSubsystem
@@ -31,7 +38,99 @@ public:
 	virtual void Deinitialize() override;
 	// USubsystem implementation End
 
+	/** Start tracking Actor against the coverage of all quadtree meshes, enter/exit events fire from the next tick */
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh")
+	void RegisterOverlapActor(AActor* Actor);
+
+	/** Stop tracking Actor, no exit event is fired */
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh")
+	void UnregisterOverlapActor(AActor* Actor);
+
+	/** Quadtree mesh currently under Actor, null if none or if the actor isn't registered */
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh")
+	UQuadtreeMeshComponent* GetOverlappedQuadtreeMesh(const AActor* Actor) const;
+
+	/** Sum of the telemetry of every quadtree mesh of the world, see UQuadtreeMeshComponent::GetTelemetry */
+	UFUNCTION(BlueprintCallable, Category = "QuadtreeMesh|Telemetry")
+	FQuadtreeMeshTelemetry GetTotalTelemetry() const;
+
+	void RegisterQuadtreeMeshComponent(UQuadtreeMeshComponent* Component);
+	void UnregisterQuadtreeMeshComponent(UQuadtreeMeshComponent* Component);
+
+	/** Called when the coverage of a quadtree mesh changes, tracked actors query again on the next tick */
+	void NotifyCoverageChanged() { ++CoverageRevision; }
+
+	/** Changes whenever any coverage changes, lets users of the trees know when to refresh their copies */
+	uint32 GetCoverageRevision() const { return CoverageRevision; }
+
+	const TArray<TWeakObjectPtr<UQuadtreeMeshComponent>>& GetQuadtreeMeshComponents() const { return QuadtreeMeshComponents; }
+
+	/** Immutable copy of a tree, can be read on any thread while the game thread rebuilds the original */
+	using FQuadTreeSnapshot = TSharedPtr<const FMeshQuadTree, ESPMode::ThreadSafe>;
+
+	/**
+	 *	Snapshots of the non empty trees sorted by decreasing overlap priority, refreshed when the coverage revision changes.
+	 *	A tree is only copied again once it was rebuilt, and every reader shares the same copy. Game thread
+	 */
+	const TArray<FQuadTreeSnapshot>& GetQuadTreeSnapshots();
+
+	UPROPERTY(BlueprintAssignable, Category = "QuadtreeMesh")
+	FOnQuadtreeMeshOverlapChanged OnActorEnteredQuadtreeMesh;
+
+	UPROPERTY(BlueprintAssignable, Category = "QuadtreeMesh")
+	FOnQuadtreeMeshOverlapChanged OnActorExitedQuadtreeMesh;
+
 private:
+	/** Rebuild every dirty quadtree mesh, the tree builds run concurrently */
+	void RebuildDirtyQuadtreeMeshes();
+
+	void UpdateOverlapActors();
+
+	/** Push changed scalability settings to the existing proxies */
+	void ApplyScalability();
+
+	/** Keep the GPU memory of all the quadtree meshes within r.QuadtreeMesh.GPUBudgetMB by evicting the ray tracing data, then the densest grids, of the least important meshes */
+	void UpdateGPUBudget(float DeltaTime);
+
+	/** Republish the GPU Scene instances of the components that publish them around the views rendered last frame */
+	void UpdateGPUSceneInstances();
+
+	/** Step the ocean simulation of every component to the world time */
+	void UpdateOceanSimulations();
+
+	struct FTrackedOverlapActor
+	{
+		TWeakObjectPtr<AActor> Actor;
+		TWeakObjectPtr<UQuadtreeMeshComponent> OverlappedComponent;
+		/** Region around the last queried location where coverage is known not to change */
+		FBox2D Cell = FBox2D(ForceInit);
+		uint32 CoverageRevision = 0;
+	};
+
+	TArray<FTrackedOverlapActor> TrackedOverlapActors;
+
+	TArray<TWeakObjectPtr<UQuadtreeMeshComponent>> QuadtreeMeshComponents;
+
+	/** Bumped whenever any coverage changes, invalidates the cached cells */
+	uint32 CoverageRevision = 1;
+
+	struct FCachedQuadTreeSnapshot
+	{
+		TWeakObjectPtr<const UQuadtreeMeshComponent> Component;
+		/** UQuadtreeMeshComponent::GetTreeRevision() the tree was copied at */
+		uint32 TreeRevision = 0;
+		FQuadTreeSnapshot Tree;
+	};
+
+	/** See GetQuadTreeSnapshots */
+	TArray<FCachedQuadTreeSnapshot> CachedQuadTreeSnapshots;
+	TArray<FQuadTreeSnapshot> QuadTreeSnapshots;
+	uint32 QuadTreeSnapshotsRevision = 0;
+
+	float TimeSinceGPUBudgetUpdate = 0.0f;
+
+	FQuadtreeMeshScalability AppliedScalability;
+
 #if WITH_EDITOR
 	static bool bAllowQuadtreeMeshSubsystemOnPreviewWorld;
 #endif
@@ -0,0 +1,43 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "QuadtreeMeshTelemetry.generated.h"
+
+/**
+ *	Rendering cost of quadtree meshes, available in every build configuration. Per frame values are rolling averages over the last
+ *	r.QuadtreeMesh.Telemetry.SmoothingFrames frames, frames skipped between two rendered frames of a mesh count as zero
+ */
+USTRUCT(BlueprintType)
+struct QUADTREEMESH_API FQuadtreeMeshTelemetry
+{
+	GENERATED_BODY()
+
+	/** Tiles drawn per frame, all views */
+	UPROPERTY(BlueprintReadOnly, Category = "QuadtreeMesh|Telemetry")
+	float TilesDrawn = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "QuadtreeMesh|Telemetry")
+	float DrawCalls = 0.0f;
+
+	/** Tile selection and instance packing time per frame, render thread */
+	UPROPERTY(BlueprintReadOnly, Category = "QuadtreeMesh|Telemetry")
+	float TraversalMicroseconds = 0.0f;
+
+	/** Instance data uploaded per frame */
+	UPROPERTY(BlueprintReadOnly, Category = "QuadtreeMesh|Telemetry")
+	float UploadBytes = 0.0f;
+
+	/** Current GPU memory: grids, instance buffers and ray tracing geometry */
+	UPROPERTY(BlueprintReadOnly, Category = "QuadtreeMesh|Telemetry")
+	int64 GPUMemoryBytes = 0;
+
+	FQuadtreeMeshTelemetry& operator+=(const FQuadtreeMeshTelemetry& Other)
+	{
+		TilesDrawn += Other.TilesDrawn;
+		DrawCalls += Other.DrawCalls;
+		TraversalMicroseconds += Other.TraversalMicroseconds;
+		UploadBytes += Other.UploadBytes;
+		GPUMemoryBytes += Other.GPUMemoryBytes;
+		return *this;
+	}
+};
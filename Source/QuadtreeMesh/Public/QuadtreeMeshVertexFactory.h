@@ -3,12 +3,20 @@
 #include "VertexFactory.h"
 #include "Containers/DynamicRHIResourceArray.h"
 #include "QuadtreeMeshInstanceDataBuffer.h"
+#include "QuadtreeMeshGridCache.h"
 
 BEGIN_GLOBAL_SHADER_PARAMETER_STRUCT(FQuadtreeMeshVertexFactoryParameters, )
 	SHADER_PARAMETER(float, LODScale)
 	SHADER_PARAMETER(int32, NumQuadsPerTileSide)
 	SHADER_PARAMETER(int32, bRenderSelected)
 	SHADER_PARAMETER(int32, bRenderUnselected)
+	SHADER_PARAMETER(FVector3f, ClipCenterHigh)
+	SHADER_PARAMETER(FVector3f, ClipCenterLow)
+	SHADER_PARAMETER(float, ClipRadius)
+	SHADER_PARAMETER_TEXTURE(Texture2D<float4>, OceanDisplacement)
+	SHADER_PARAMETER_TEXTURE(Texture2D<float2>, OceanSlope)
+	SHADER_PARAMETER(float, OceanPatchSize)
+	SHADER_PARAMETER(int32, OceanResolution)
 END_GLOBAL_SHADER_PARAMETER_STRUCT()
 using FQuadtreeMeshVertexFactoryBufferRef = TUniformBufferRef<FQuadtreeMeshVertexFactoryParameters>;
 
@@ -19,108 +27,76 @@ BEGIN_GLOBAL_SHADER_PARAMETER_STRUCT(FQuadtreeMeshVertexFactoryRaytracingParamet
 END_GLOBAL_SHADER_PARAMETER_STRUCT()
 using FQuadtreeMeshVertexFactoryRaytracingParametersRef = TUniformBufferRef<FQuadtreeMeshVertexFactoryRaytracingParameters>;
 
+/**
+ *	Uploads the shared grid of FQuadtreeMeshGridCache. Unless bInRequestGrid is false (buffers that aren't initialized right away),
+ *	the grid is requested on construction so it's usually built by the time InitRHI runs
+ */
 class FQuadtreeMeshIndexBuffer : public FIndexBuffer
 {
 public:
-	FQuadtreeMeshIndexBuffer(int32 InNumQuadsPerSide) : NumQuadsPerSide(InNumQuadsPerSide) {}
-	void InitRHI(FRHICommandListBase& RHICmdList) override
+	FQuadtreeMeshIndexBuffer(int32 InNumQuadsPerSide, bool bInRequestGrid)
+		: NumQuadsPerSide(InNumQuadsPerSide)
 	{
-		// This is an optimized index buffer path for water tiles containing less than uint16 max vertices
-		if (NumQuadsPerSide < 256)
-		{
-			IndexBufferRHI = CreateIndexBuffer<uint16>(RHICmdList);
-		}
-		else
+		if (bInRequestGrid)
 		{
-			IndexBufferRHI = CreateIndexBuffer<uint32>(RHICmdList);
+			Grid = FQuadtreeMeshGridCache::Get().Request(InNumQuadsPerSide);
 		}
 	}
 
-	int32 GetIndexCount() const { return NumIndices; };
-	
-private:
-	
-	template <typename IndexType>
-	FBufferRHIRef CreateIndexBuffer(FRHICommandListBase& RHICmdList)
+	void InitRHI(FRHICommandListBase& RHICmdList) override
 	{
-		TResourceArray<IndexType, INDEXBUFFER_ALIGNMENT> Indices;
+		// The grid is dropped after the upload, a buffer released by the GPU budget requests it again (usually still cached)
+		FQuadtreeMeshGridRef GridToUpload = Grid.IsValid() ? Grid.ToSharedRef() : FQuadtreeMeshGridCache::Get().Request(NumQuadsPerSide);
+		Grid.Reset();
 
-		// Allocate room for indices
-		Indices.Reserve(NumQuadsPerSide * NumQuadsPerSide * 6);
+		GridToUpload->Wait();
 
-		// Build index buffer in morton order for better vertex reuse. This amounts to roughly 75% reuse rate vs 66% of naive scanline approach
-		for (int32 Morton = 0; Morton < NumQuadsPerSide * NumQuadsPerSide; Morton++)
-		{
-			int32 SquareX = FMath::ReverseMortonCode2(Morton);
-			int32 SquareY = FMath::ReverseMortonCode2(Morton >> 1);
-
-			bool ForwardDiagonal = false;
-
-			if (SquareX % 2)
-			{
-				ForwardDiagonal = !ForwardDiagonal;
-			}
-			if (SquareY % 2)
-			{
-				ForwardDiagonal = !ForwardDiagonal;
-			}
-
-			int32 Index0 = SquareX + SquareY * (NumQuadsPerSide + 1);
-			int32 Index1 = Index0 + 1;
-			int32 Index2 = Index0 + (NumQuadsPerSide + 1);
-			int32 Index3 = Index2 + 1;
-
-			Indices.Add(Index3);
-			Indices.Add(Index1);
-			Indices.Add(ForwardDiagonal ? Index2 : Index0);
-			Indices.Add(Index0);
-			Indices.Add(Index2);
-			Indices.Add(ForwardDiagonal ? Index1 : Index3);
-		}
+		const TConstArrayView<uint8> IndexData = GridToUpload->GetIndexData();
+		NumIndices = GridToUpload->GetIndexCount();
 
-		NumIndices = Indices.Num();
-		const uint32 Size = Indices.GetResourceDataSize();
-		const uint32 Stride = sizeof(IndexType);
-
-		// Create index buffer. Fill buffer with initial data upon creation
-		FRHIResourceCreateInfo CreateInfo(TEXT("FQuadtreeMeshIndexBuffer"), &Indices);
-		return RHICmdList.CreateIndexBuffer(Stride, Size, BUF_Static, CreateInfo);
+		FRHIResourceCreateInfo CreateInfo(TEXT("FQuadtreeMeshIndexBuffer"));
+		IndexBufferRHI = RHICmdList.CreateIndexBuffer(GridToUpload->GetIndexStride(), IndexData.Num(), BUF_Static, CreateInfo);
+		void* Data = RHICmdList.LockBuffer(IndexBufferRHI, 0, IndexData.Num(), RLM_WriteOnly);
+		FMemory::Memcpy(Data, IndexData.GetData(), IndexData.Num());
+		RHICmdList.UnlockBuffer(IndexBufferRHI);
 	}
-		
+
+	int32 GetIndexCount() const { return NumIndices; };
+	
+private:
 	const int32 NumQuadsPerSide = 0;
 	int32 NumIndices = 0;
+	TSharedPtr<const FQuadtreeMeshGrid, ESPMode::ThreadSafe> Grid;
 };
 
 class FQuadtreeMeshVertexBuffer:public FVertexBuffer
 {
 public:
-	FQuadtreeMeshVertexBuffer(int32 InNumQuadsPerSide) : NumQuadsPerSide(InNumQuadsPerSide) {}
+	FQuadtreeMeshVertexBuffer(int32 InNumQuadsPerSide, bool bInRequestGrid)
+		: NumQuadsPerSide(InNumQuadsPerSide)
+	{
+		if (bInRequestGrid)
+		{
+			Grid = FQuadtreeMeshGridCache::Get().Request(InNumQuadsPerSide);
+		}
+	}
 
 	virtual void InitRHI(FRHICommandListBase& RHICmdList) override
 	{
 		ensureAlways(NumQuadsPerSide > 0);
-		const uint32 NumVertsPerSide = NumQuadsPerSide + 1;
 
-		NumVerts = NumVertsPerSide * NumVertsPerSide;
+		FQuadtreeMeshGridRef GridToUpload = Grid.IsValid() ? Grid.ToSharedRef() : FQuadtreeMeshGridCache::Get().Request(NumQuadsPerSide);
+		Grid.Reset();
 
-		FRHIResourceCreateInfo CreateInfo(TEXT("FQuadtreeMeshVertexBuffer"));
-		VertexBufferRHI = RHICmdList.CreateBuffer(sizeof(FVector4f) * NumVerts, BUF_Static | BUF_VertexBuffer | BUF_ShaderResource, 0, ERHIAccess::VertexOrIndexBuffer | ERHIAccess::SRVMask, CreateInfo);
-		FVector4f* DummyContents = static_cast<FVector4f*>(RHICmdList.LockBuffer(VertexBufferRHI, 0, sizeof(FVector4f) * NumVerts, RLM_WriteOnly));
-
-		for (uint32 VertY = 0; VertY < NumVertsPerSide; VertY++)
-		{
-			FVector4f VertPos;
-			VertPos.Y = static_cast<float>(VertY) / NumQuadsPerSide - 0.5f;
+		GridToUpload->Wait();
 
-			for (uint32 VertX = 0; VertX < NumVertsPerSide; VertX++)
-			{
-				VertPos.X = static_cast<float>(VertX) / NumQuadsPerSide - 0.5f;
-
-				DummyContents[NumVertsPerSide * VertY + VertX] = VertPos;
-			}
-			
-		}
+		const TConstArrayView<FVector4f> Vertices = GridToUpload->GetVertices();
+		NumVerts = Vertices.Num();
 
+		FRHIResourceCreateInfo CreateInfo(TEXT("FQuadtreeMeshVertexBuffer"));
+		VertexBufferRHI = RHICmdList.CreateBuffer(Vertices.NumBytes(), BUF_Static | BUF_VertexBuffer | BUF_ShaderResource, 0, ERHIAccess::VertexOrIndexBuffer | ERHIAccess::SRVMask, CreateInfo);
+		void* Data = RHICmdList.LockBuffer(VertexBufferRHI, 0, Vertices.NumBytes(), RLM_WriteOnly);
+		FMemory::Memcpy(Data, Vertices.GetData(), Vertices.NumBytes());
 		RHICmdList.UnlockBuffer(VertexBufferRHI);
 
 		SRV = RHICmdList.CreateShaderResourceView(VertexBufferRHI, sizeof(float), PF_R32_FLOAT);
@@ -138,10 +114,59 @@ public:
 private:
 	int32 NumVerts = 0;
 	const int32 NumQuadsPerSide = 0;
+	TSharedPtr<const FQuadtreeMeshGrid, ESPMode::ThreadSafe> Grid;
 
 	FShaderResourceViewRHIRef SRV;
 };
 
+/** Per render data parameters (color, waves...) of a quadtree mesh, indexed in the shader by the render data index stored in each instance */
+class FQuadtreeMeshParameterBuffer : public FRenderResource
+{
+public:
+	FQuadtreeMeshParameterBuffer(TArray<FVector4f>&& InParameters) : Parameters(MoveTemp(InParameters)) {}
+
+	virtual void InitRHI(FRHICommandListBase& RHICmdList) override
+	{
+		// Keep a valid SRV around even if there is no render data
+		if (Parameters.IsEmpty())
+		{
+			Parameters.Add(FVector4f(FLinearColor::White));
+			Parameters.Add(FVector4f::Zero());
+		}
+
+		const uint32 SizeInBytes = Parameters.Num() * sizeof(FVector4f);
+
+		FRHIResourceCreateInfo CreateInfo(TEXT("FQuadtreeMeshParameterBuffer"));
+		BufferRHI = RHICmdList.CreateBuffer(SizeInBytes, BUF_Static | BUF_StructuredBuffer | BUF_ShaderResource, sizeof(FVector4f), ERHIAccess::SRVMask, CreateInfo);
+		void* Data = RHICmdList.LockBuffer(BufferRHI, 0, SizeInBytes, RLM_WriteOnly);
+		FMemory::Memcpy(Data, Parameters.GetData(), SizeInBytes);
+		RHICmdList.UnlockBuffer(BufferRHI);
+
+		SRV = RHICmdList.CreateShaderResourceView(BufferRHI);
+	}
+
+	virtual void ReleaseRHI() override
+	{
+		SRV.SafeRelease();
+		BufferRHI.SafeRelease();
+	}
+
+	FRHIShaderResourceView* GetSRV() const { return SRV; }
+
+	/** Replace the parameters, the SRV is recreated. Render thread only */
+	void SetParameters(FRHICommandListBase& RHICmdList, TArray<FVector4f>&& InParameters)
+	{
+		Parameters = MoveTemp(InParameters);
+		UpdateRHI(RHICmdList);
+	}
+
+private:
+	TArray<FVector4f> Parameters;
+
+	FBufferRHIRef BufferRHI;
+	FShaderResourceViewRHIRef SRV;
+};
+
 
 enum class EQuadtreeMeshRenderGroupType : uint8
 {
@@ -158,7 +183,8 @@ public:
 	static constexpr int32 NumRenderGroups =  3 ; // Must match EWaterMeshRenderGroupType
 	static constexpr int32 NumAdditionalVertexStreams = FQuadtreeMeshInstanceDataBuffers::NumBuffers;
 	
-	FQuadtreeMeshVertexFactory(ERHIFeatureLevel::Type InFeatureLevel, int32 InNumQuadsPerSide,	float InLODScale);
+	/** bInRequestGrid starts building the grid for an InitResource coming soon, factories left uninitialized don't hold on to it */
+	FQuadtreeMeshVertexFactory(ERHIFeatureLevel::Type InFeatureLevel, int32 InNumQuadsPerSide,	float InLODScale, const FVector& InClipCircle, bool bInRequestGrid = true);
 	~FQuadtreeMeshVertexFactory();
 
 	virtual void InitRHI(FRHICommandListBase& RHICmdList) override;
@@ -172,7 +198,24 @@ public:
 	static void ValidateCompiledResult(const FVertexFactoryType* Type, EShaderPlatform Platform, const FShaderParameterMap& ParameterMap, TArray<FString>& OutErrors);
 
 	static void GetPSOPrecacheVertexFetchElements(EVertexInputStreamType VertexInputStreamType, FVertexDeclarationElementList& Elements);
+
+	/** Size of the vertex and index buffers of a grid with InNumQuadsPerSide quads per side, known without creating them */
+	static uint64 GetGridMemorySize(int32 InNumQuadsPerSide)
+	{
+		const uint64 NumVertsPerSide = InNumQuadsPerSide + 1;
+		const uint64 IndexSize = InNumQuadsPerSide < 256 ? sizeof(uint16) : sizeof(uint32);
+		return NumVertsPerSide * NumVertsPerSide * sizeof(FVector4f) + static_cast<uint64>(InNumQuadsPerSide) * InNumQuadsPerSide * 6 * IndexSize;
+	}
 	
+	/** Change the scale used by the morphing, the uniform buffers are recreated if the factory is initialized. Render thread */
+	void SetLODScale(float InLODScale);
+
+	/** Change the animated clip circle (xy: world center, z: radius, negative to disable), vertices outside of it are moved onto its edge. Render thread */
+	void SetClipCircle(const FVector& InClipCircle);
+
+	/** Displace the vertices by a tileable ocean field (xyz) and orient them along its slopes, see FQuadtreeMeshOceanSimulation. A null texture disables it. Render thread */
+	void SetOcean(FRHITexture* InOceanTexture, FRHITexture* InOceanSlopeTexture, float InPatchSize, int32 InResolution);
+
 	const FUniformBufferRHIRef GeFQuadtreeMeshVertexFactoryUniformBuffer(EQuadtreeMeshRenderGroupType InRenderGroupType) const { return UniformBuffers[static_cast<int32>(InRenderGroupType)]; }
 
 private:
@@ -186,7 +229,40 @@ private:
 	TStaticArray<FQuadtreeMeshVertexFactoryBufferRef, NumRenderGroups> UniformBuffers;
 
 	const int32 NumQuadsPerSide = 0;
-	const float LODScale = 0.0f;
+	float LODScale = 0.0f;
+	FVector ClipCircle = FVector(0.0, 0.0, -1.0);
+
+	FTextureRHIRef OceanTexture;
+	FTextureRHIRef OceanSlopeTexture;
+	float OceanPatchSize = 0.0f;
+	int32 OceanResolution = 0;
+};
+
+/**
+ *	Draws the tiles published as GPU Scene instances, see FQuadtreeMeshGPUSceneInstances. The tile and its morph parameters are read from the instance transform and custom data
+ *	instead of the instance streams, so the engine's instance culling can drop the hidden tiles. Shares the grid and the uniform buffers of the factory of the same density
+ */
+class FQuadtreeMeshGPUSceneVertexFactory : public FVertexFactory
+{
+	DECLARE_VERTEX_FACTORY_TYPE(FQuadtreeMeshGPUSceneVertexFactory);
+public:
+	using Super = FVertexFactory;
+
+	FQuadtreeMeshGPUSceneVertexFactory(ERHIFeatureLevel::Type InFeatureLevel, const FQuadtreeMeshVertexFactory* InGridVertexFactory);
+
+	virtual void InitRHI(FRHICommandListBase& RHICmdList) override;
+
+	static bool ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters& Parameters);
+
+	static void ModifyCompilationEnvironment(const FVertexFactoryShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+
+	static void GetPSOPrecacheVertexFetchElements(EVertexInputStreamType VertexInputStreamType, FVertexDeclarationElementList& Elements);
+
+	/** Owner of the grid and the uniform buffers, its resources must be initialized to draw with this factory */
+	const FQuadtreeMeshVertexFactory* GetGridVertexFactory() const { return GridVertexFactory; }
+
+private:
+	const FQuadtreeMeshVertexFactory* GridVertexFactory = nullptr;
 };
 
 
@@ -194,14 +270,16 @@ struct FQuadtreeMeshUserData
 {
 	FQuadtreeMeshUserData() = default;
 
-	FQuadtreeMeshUserData(EQuadtreeMeshRenderGroupType InRenderGroupType, const FQuadtreeMeshInstanceDataBuffers* InInstanceDataBuffers)
+	FQuadtreeMeshUserData(EQuadtreeMeshRenderGroupType InRenderGroupType, const FQuadtreeMeshInstanceDataBuffers* InInstanceDataBuffers, const FQuadtreeMeshParameterBuffer* InParameterBuffer)
 		: RenderGroupType(InRenderGroupType)
 		, InstanceDataBuffers(InInstanceDataBuffers)
+		, ParameterBuffer(InParameterBuffer)
 	{
 	}
 
 	EQuadtreeMeshRenderGroupType RenderGroupType = EQuadtreeMeshRenderGroupType::RG_RenderQuadtreeMeshTiles;
 	const FQuadtreeMeshInstanceDataBuffers* InstanceDataBuffers = nullptr;
+	const FQuadtreeMeshParameterBuffer* ParameterBuffer = nullptr;
 
 #if RHI_RAYTRACING	
 	FUniformBufferRHIRef QuadtreeMeshVertexFactoryRaytracingVFUniformBuffer = nullptr;
@@ -213,12 +291,12 @@ struct FQuadtreeMeshUserDataBuffers
 {
 	using FQuadtreeMeshUserData = FQuadtreeMeshUserData;
 
-	FQuadtreeMeshUserDataBuffers(const FQuadtreeMeshInstanceDataBuffers* InInstanceDataBuffers)
+	FQuadtreeMeshUserDataBuffers(const FQuadtreeMeshInstanceDataBuffers* InInstanceDataBuffers, const FQuadtreeMeshParameterBuffer* InParameterBuffer)
 	{
 		int32 Index = 0;
-		UserData[Index++] = MakeUnique<FQuadtreeMeshUserData>(EQuadtreeMeshRenderGroupType::RG_RenderQuadtreeMeshTiles, InInstanceDataBuffers);
-		UserData[Index++] = MakeUnique<FQuadtreeMeshUserData>(EQuadtreeMeshRenderGroupType::RG_RenderSelectedQuadtreeMeshTilesOnly, InInstanceDataBuffers);
-		UserData[Index++] = MakeUnique<FQuadtreeMeshUserData>(EQuadtreeMeshRenderGroupType::RG_RenderUnselectedQuadtreeMeshTilesOnly, InInstanceDataBuffers);
+		UserData[Index++] = MakeUnique<FQuadtreeMeshUserData>(EQuadtreeMeshRenderGroupType::RG_RenderQuadtreeMeshTiles, InInstanceDataBuffers, InParameterBuffer);
+		UserData[Index++] = MakeUnique<FQuadtreeMeshUserData>(EQuadtreeMeshRenderGroupType::RG_RenderSelectedQuadtreeMeshTilesOnly, InInstanceDataBuffers, InParameterBuffer);
+		UserData[Index++] = MakeUnique<FQuadtreeMeshUserData>(EQuadtreeMeshRenderGroupType::RG_RenderUnselectedQuadtreeMeshTilesOnly, InInstanceDataBuffers, InParameterBuffer);
 	}
 
 	const FQuadtreeMeshUserData* GetUserData(EQuadtreeMeshRenderGroupType InRenderGroupType)
@@ -30,6 +30,7 @@ public class QuadtreeMesh : ModuleRules
 				"Engine",
 				"RHI",
 				"GeometryCore", 
+				"NetCore",
 				// ... add other public dependencies that you statically link with here ...
 			}
 			);
@@ -70,6 +71,7 @@ public class QuadtreeMesh : ModuleRules
 			PrivateDependencyModuleNames.AddRange(
 				new string[] {
 					"SourceControl",
+					"DerivedDataCache",
 					"UnrealEd",
 					"StaticMeshDescription",
 					"MeshMergeUtilities"
@@ -0,0 +1,336 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "NiagaraDataInterfaceQuadtreeMesh.h"
+#include "MeshQuadTree.h"
+#include "NiagaraSystemInstance.h"
+#include "NiagaraTypes.h"
+#include "QuadtreeMeshStats.h"
+#include "QuadtreeMeshSubsystem.h"
+#include "VectorVM.h"
+
+#define LOCTEXT_NAMESPACE "NiagaraDataInterfaceQuadtreeMesh"
+
+DECLARE_CYCLE_STAT(TEXT("Niagara Surface Queries"), STAT_QuadtreeMeshNiagaraQueries, STATGROUP_QuadtreeMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Niagara Query Batches"), STAT_QuadtreeMeshNiagaraQueryBatches, STATGROUP_QuadtreeMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Niagara Queries"), STAT_QuadtreeMeshNiagaraQueryCount, STATGROUP_QuadtreeMesh);
+
+namespace NDIQuadtreeMeshLocal
+{
+	static const FName QueryCoverageName(TEXT("QueryCoverage"));
+	static const FName QueryBaseHeightName(TEXT("QueryBaseHeight"));
+	static const FName QueryNearestEdgeName(TEXT("QueryNearestEdge"));
+
+	struct FInstanceData
+	{
+		TWeakObjectPtr<UQuadtreeMeshSubsystem> Subsystem;
+
+		/** Revision of the subsystem coverage the trees were copied at */
+		uint32 CoverageRevision = 0;
+
+		/** Snapshots of the trees sorted by decreasing overlap priority, shared with every other instance. The simulation can run while the game thread rebuilds the originals */
+		TArray<UQuadtreeMeshSubsystem::FQuadTreeSnapshot> QuadTrees;
+
+		/** Simulation positions are relative to the system LWC tile */
+		FVector LWCTileOffset = FVector::ZeroVector;
+	};
+
+	static void RefreshQuadTrees(FInstanceData& InstanceData)
+	{
+		UQuadtreeMeshSubsystem* Subsystem = InstanceData.Subsystem.Get();
+		if (!Subsystem)
+		{
+			InstanceData.QuadTrees.Reset();
+			return;
+		}
+
+		if (Subsystem->GetCoverageRevision() == InstanceData.CoverageRevision)
+		{
+			return;
+		}
+
+		InstanceData.QuadTrees = Subsystem->GetQuadTreeSnapshots();
+		InstanceData.CoverageRevision = Subsystem->GetCoverageRevision();
+	}
+
+	static void GatherQueryLocations(FNDIInputParam<FNiagaraPosition>& InPosition, int32 NumInstances, const FVector& LWCTileOffset, TArray<FVector2D>& OutLocations, TArray<FVector3f>* OutPositions = nullptr)
+	{
+		OutLocations.SetNumUninitialized(NumInstances);
+		if (OutPositions)
+		{
+			OutPositions->SetNumUninitialized(NumInstances);
+		}
+
+		for (int32 Instance = 0; Instance < NumInstances; ++Instance)
+		{
+			const FVector3f Position = InPosition.GetAndAdvance();
+			OutLocations[Instance] = FVector2D(FVector(Position) + LWCTileOffset);
+			if (OutPositions)
+			{
+				(*OutPositions)[Instance] = Position;
+			}
+		}
+
+		INC_DWORD_STAT(STAT_QuadtreeMeshNiagaraQueryBatches);
+		INC_DWORD_STAT_BY(STAT_QuadtreeMeshNiagaraQueryCount, NumInstances);
+	}
+}
+
+void UNiagaraDataInterfaceQuadtreeMesh::PostInitProperties()
+{
+	Super::PostInitProperties();
+
+	if (HasAnyFlags(RF_ClassDefaultObject))
+	{
+		ENiagaraTypeRegistryFlags Flags = ENiagaraTypeRegistryFlags::AllowAnyVariable | ENiagaraTypeRegistryFlags::AllowParameter;
+		FNiagaraTypeRegistry::Register(FNiagaraTypeDefinition(GetClass()), Flags);
+	}
+}
+
+bool UNiagaraDataInterfaceQuadtreeMesh::InitPerInstanceData(void* PerInstanceData, FNiagaraSystemInstance* SystemInstance)
+{
+	using namespace NDIQuadtreeMeshLocal;
+
+	FInstanceData* InstanceData = new (PerInstanceData) FInstanceData();
+	if (UWorld* World = SystemInstance->GetWorld())
+	{
+		InstanceData->Subsystem = World->GetSubsystem<UQuadtreeMeshSubsystem>();
+	}
+	InstanceData->LWCTileOffset = FVector(SystemInstance->GetLWCTile()) * FLargeWorldRenderScalar::GetTileSize();
+	RefreshQuadTrees(*InstanceData);
+	return true;
+}
+
+void UNiagaraDataInterfaceQuadtreeMesh::DestroyPerInstanceData(void* PerInstanceData, FNiagaraSystemInstance* SystemInstance)
+{
+	using namespace NDIQuadtreeMeshLocal;
+
+	static_cast<FInstanceData*>(PerInstanceData)->~FInstanceData();
+}
+
+bool UNiagaraDataInterfaceQuadtreeMesh::PerInstanceTick(void* PerInstanceData, FNiagaraSystemInstance* SystemInstance, float DeltaSeconds)
+{
+	using namespace NDIQuadtreeMeshLocal;
+
+	FInstanceData* InstanceData = static_cast<FInstanceData*>(PerInstanceData);
+	InstanceData->LWCTileOffset = FVector(SystemInstance->GetLWCTile()) * FLargeWorldRenderScalar::GetTileSize();
+	RefreshQuadTrees(*InstanceData);
+	return false;
+}
+
+int32 UNiagaraDataInterfaceQuadtreeMesh::PerInstanceDataSize() const
+{
+	return sizeof(NDIQuadtreeMeshLocal::FInstanceData);
+}
+
+#if WITH_EDITORONLY_DATA
+void UNiagaraDataInterfaceQuadtreeMesh::GetFunctionsInternal(TArray<FNiagaraFunctionSignature>& OutFunctions) const
+{
+	using namespace NDIQuadtreeMeshLocal;
+
+	FNiagaraFunctionSignature DefaultSignature;
+	DefaultSignature.bMemberFunction = true;
+	DefaultSignature.bRequiresContext = false;
+	DefaultSignature.bSupportsGPU = false;
+	DefaultSignature.Inputs.Emplace(FNiagaraTypeDefinition(GetClass()), TEXT("QuadtreeMesh"));
+	DefaultSignature.Inputs.Emplace(FNiagaraTypeDefinition::GetPositionDef(), TEXT("Position"));
+
+	{
+		FNiagaraFunctionSignature& Signature = OutFunctions.Add_GetRef(DefaultSignature);
+		Signature.Name = QueryCoverageName;
+		Signature.Outputs.Emplace(FNiagaraTypeDefinition::GetBoolDef(), TEXT("IsCovered"));
+		Signature.SetDescription(LOCTEXT("QueryCoverageDesc", "Whether Position is over any quadtree mesh of the world."));
+	}
+	{
+		FNiagaraFunctionSignature& Signature = OutFunctions.Add_GetRef(DefaultSignature);
+		Signature.Name = QueryBaseHeightName;
+		Signature.Outputs.Emplace(FNiagaraTypeDefinition::GetBoolDef(), TEXT("IsCovered"));
+		Signature.Outputs.Emplace(FNiagaraTypeDefinition::GetFloatDef(), TEXT("BaseHeight"));
+		Signature.SetDescription(LOCTEXT("QueryBaseHeightDesc", "Surface base height under Position, from the highest priority quadtree mesh covering it. 0 when not covered."));
+	}
+	{
+		FNiagaraFunctionSignature& Signature = OutFunctions.Add_GetRef(DefaultSignature);
+		Signature.Name = QueryNearestEdgeName;
+		Signature.Outputs.Emplace(FNiagaraTypeDefinition::GetBoolDef(), TEXT("IsValid"));
+		Signature.Outputs.Emplace(FNiagaraTypeDefinition::GetPositionDef(), TEXT("EdgePosition"));
+		Signature.Outputs.Emplace(FNiagaraTypeDefinition::GetFloatDef(), TEXT("Distance"));
+		Signature.SetDescription(LOCTEXT("QueryNearestEdgeDesc", "Closest point where the quadtree mesh coverage starts or ends, searched up to MaxEdgeSearchRadius. Keeps the height of Position."));
+	}
+}
+#endif
+
+void UNiagaraDataInterfaceQuadtreeMesh::GetVMExternalFunction(const FVMExternalFunctionBindingInfo& BindingInfo, void* InstanceData, FVMExternalFunction& OutFunc)
+{
+	using namespace NDIQuadtreeMeshLocal;
+
+	if (BindingInfo.Name == QueryCoverageName)
+	{
+		OutFunc = FVMExternalFunction::CreateUObject(this, &UNiagaraDataInterfaceQuadtreeMesh::VMQueryCoverage);
+	}
+	else if (BindingInfo.Name == QueryBaseHeightName)
+	{
+		OutFunc = FVMExternalFunction::CreateUObject(this, &UNiagaraDataInterfaceQuadtreeMesh::VMQueryBaseHeight);
+	}
+	else if (BindingInfo.Name == QueryNearestEdgeName)
+	{
+		OutFunc = FVMExternalFunction::CreateUObject(this, &UNiagaraDataInterfaceQuadtreeMesh::VMQueryNearestEdge);
+	}
+}
+
+bool UNiagaraDataInterfaceQuadtreeMesh::Equals(const UNiagaraDataInterface* Other) const
+{
+	if (!Super::Equals(Other))
+	{
+		return false;
+	}
+	return CastChecked<const UNiagaraDataInterfaceQuadtreeMesh>(Other)->MaxEdgeSearchRadius == MaxEdgeSearchRadius;
+}
+
+bool UNiagaraDataInterfaceQuadtreeMesh::CopyToInternal(UNiagaraDataInterface* Destination) const
+{
+	if (!Super::CopyToInternal(Destination))
+	{
+		return false;
+	}
+	CastChecked<UNiagaraDataInterfaceQuadtreeMesh>(Destination)->MaxEdgeSearchRadius = MaxEdgeSearchRadius;
+	return true;
+}
+
+void UNiagaraDataInterfaceQuadtreeMesh::VMQueryCoverage(FVectorVMExternalFunctionContext& Context)
+{
+	using namespace NDIQuadtreeMeshLocal;
+	SCOPE_CYCLE_COUNTER(STAT_QuadtreeMeshNiagaraQueries);
+
+	VectorVM::FUserPtrHandler<FInstanceData> InstanceData(Context);
+	FNDIInputParam<FNiagaraPosition> InPosition(Context);
+	FNDIOutputParam<bool> OutCovered(Context);
+
+	const int32 NumInstances = Context.GetNumInstances();
+
+	TArray<FVector2D> Locations;
+	GatherQueryLocations(InPosition, NumInstances, InstanceData->LWCTileOffset, Locations);
+
+	TArray<bool> Covered;
+	Covered.SetNumZeroed(NumInstances);
+
+	TArray<float> Heights;
+	TArray<bool> TreeCovered;
+	Heights.SetNumUninitialized(NumInstances);
+	TreeCovered.SetNumUninitialized(NumInstances);
+	for (const UQuadtreeMeshSubsystem::FQuadTreeSnapshot& QuadTree : InstanceData->QuadTrees)
+	{
+		QuadTree->QueryBaseHeightsAtLocations(Locations, Heights, TreeCovered);
+		for (int32 Instance = 0; Instance < NumInstances; ++Instance)
+		{
+			Covered[Instance] |= TreeCovered[Instance];
+		}
+	}
+
+	for (int32 Instance = 0; Instance < NumInstances; ++Instance)
+	{
+		OutCovered.SetAndAdvance(Covered[Instance]);
+	}
+}
+
+void UNiagaraDataInterfaceQuadtreeMesh::VMQueryBaseHeight(FVectorVMExternalFunctionContext& Context)
+{
+	using namespace NDIQuadtreeMeshLocal;
+	SCOPE_CYCLE_COUNTER(STAT_QuadtreeMeshNiagaraQueries);
+
+	VectorVM::FUserPtrHandler<FInstanceData> InstanceData(Context);
+	FNDIInputParam<FNiagaraPosition> InPosition(Context);
+	FNDIOutputParam<bool> OutCovered(Context);
+	FNDIOutputParam<float> OutBaseHeight(Context);
+
+	const int32 NumInstances = Context.GetNumInstances();
+
+	TArray<FVector2D> Locations;
+	GatherQueryLocations(InPosition, NumInstances, InstanceData->LWCTileOffset, Locations);
+
+	TArray<bool> Covered;
+	TArray<float> BaseHeights;
+	Covered.SetNumZeroed(NumInstances);
+	BaseHeights.SetNumZeroed(NumInstances);
+
+	TArray<float> Heights;
+	TArray<bool> TreeCovered;
+	Heights.SetNumUninitialized(NumInstances);
+	TreeCovered.SetNumUninitialized(NumInstances);
+	for (const UQuadtreeMeshSubsystem::FQuadTreeSnapshot& QuadTree : InstanceData->QuadTrees)
+	{
+		// Trees are sorted by priority, the first one covering a location gives its height
+		QuadTree->QueryBaseHeightsAtLocations(Locations, Heights, TreeCovered);
+		for (int32 Instance = 0; Instance < NumInstances; ++Instance)
+		{
+			if (TreeCovered[Instance] && !Covered[Instance])
+			{
+				Covered[Instance] = true;
+				BaseHeights[Instance] = static_cast<float>(Heights[Instance] - InstanceData->LWCTileOffset.Z);
+			}
+		}
+	}
+
+	for (int32 Instance = 0; Instance < NumInstances; ++Instance)
+	{
+		OutCovered.SetAndAdvance(Covered[Instance]);
+		OutBaseHeight.SetAndAdvance(BaseHeights[Instance]);
+	}
+}
+
+void UNiagaraDataInterfaceQuadtreeMesh::VMQueryNearestEdge(FVectorVMExternalFunctionContext& Context)
+{
+	using namespace NDIQuadtreeMeshLocal;
+	SCOPE_CYCLE_COUNTER(STAT_QuadtreeMeshNiagaraQueries);
+
+	VectorVM::FUserPtrHandler<FInstanceData> InstanceData(Context);
+	FNDIInputParam<FNiagaraPosition> InPosition(Context);
+	FNDIOutputParam<bool> OutValid(Context);
+	FNDIOutputParam<FNiagaraPosition> OutEdgePosition(Context);
+	FNDIOutputParam<float> OutDistance(Context);
+
+	const int32 NumInstances = Context.GetNumInstances();
+
+	// Positions are kept to output the edge at the height of the query
+	TArray<FVector2D> Locations;
+	TArray<FVector3f> Positions;
+	GatherQueryLocations(InPosition, NumInstances, InstanceData->LWCTileOffset, Locations, &Positions);
+
+	TArray<FVector2D> EdgeLocations;
+	TArray<float> Distances;
+	TArray<bool> Found;
+	EdgeLocations.SetNumUninitialized(NumInstances);
+	Distances.Init(TNumericLimits<float>::Max(), NumInstances);
+	Found.SetNumZeroed(NumInstances);
+
+	TArray<FVector2D> TreeEdgeLocations;
+	TArray<float> TreeDistances;
+	TArray<bool> TreeFound;
+	TreeEdgeLocations.SetNumUninitialized(NumInstances);
+	TreeDistances.SetNumUninitialized(NumInstances);
+	TreeFound.SetNumUninitialized(NumInstances);
+	for (const UQuadtreeMeshSubsystem::FQuadTreeSnapshot& QuadTree : InstanceData->QuadTrees)
+	{
+		// Edges are per tree, where meshes overlap the closest one wins
+		QuadTree->QueryNearestCoverageEdges(Locations, MaxEdgeSearchRadius, TreeEdgeLocations, TreeDistances, TreeFound);
+		for (int32 Instance = 0; Instance < NumInstances; ++Instance)
+		{
+			if (TreeFound[Instance] && TreeDistances[Instance] < Distances[Instance])
+			{
+				Found[Instance] = true;
+				Distances[Instance] = TreeDistances[Instance];
+				EdgeLocations[Instance] = TreeEdgeLocations[Instance];
+			}
+		}
+	}
+
+	for (int32 Instance = 0; Instance < NumInstances; ++Instance)
+	{
+		const FVector3f& Position = Positions[Instance];
+		const FVector2D EdgeLocation = Found[Instance] ? EdgeLocations[Instance] - FVector2D(InstanceData->LWCTileOffset) : FVector2D(Position);
+
+		OutValid.SetAndAdvance(Found[Instance]);
+		OutEdgePosition.SetAndAdvance(FNiagaraPosition(FVector3f(static_cast<float>(EdgeLocation.X), static_cast<float>(EdgeLocation.Y), Position.Z)));
+		OutDistance.SetAndAdvance(Found[Instance] ? Distances[Instance] : 0.0f);
+	}
+}
+
+#undef LOCTEXT_NAMESPACE
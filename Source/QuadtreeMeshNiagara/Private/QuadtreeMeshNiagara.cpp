@@ -0,0 +1,6 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "Modules/ModuleManager.h"
+
+/** Niagara data interface of the quadtree meshes, kept out of QuadtreeMesh so Niagara only loads with this module */
+IMPLEMENT_MODULE(FDefaultModuleImpl, QuadtreeMeshNiagara)
@@ -0,0 +1,46 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NiagaraDataInterface.h"
+#include "NiagaraDataInterfaceQuadtreeMesh.generated.h"
+
+/**
+ * Surface queries against every quadtree mesh of the world (coverage, base height, nearest edge) for CPU simulations.
+ * All particles of a tick are answered with one batched query per quadtree mesh
+ */
+UCLASS(EditInlineNew, Category = "QuadtreeMesh", CollapseCategories, meta = (DisplayName = "Quadtree Mesh"))
+class QUADTREEMESHNIAGARA_API UNiagaraDataInterfaceQuadtreeMesh : public UNiagaraDataInterface
+{
+	GENERATED_BODY()
+public:
+	/** Nearest edge queries give up past this distance */
+	UPROPERTY(EditAnywhere, Category = "QuadtreeMesh", meta = (ClampMin = "0.0"))
+	float MaxEdgeSearchRadius = 10000.0f;
+
+	// UObject Interface
+	virtual void PostInitProperties() override;
+	// UObject Interface End
+
+	// UNiagaraDataInterface Interface
+	virtual bool CanExecuteOnTarget(ENiagaraSimTarget Target) const override { return Target == ENiagaraSimTarget::CPUSim; }
+	virtual bool InitPerInstanceData(void* PerInstanceData, FNiagaraSystemInstance* SystemInstance) override;
+	virtual void DestroyPerInstanceData(void* PerInstanceData, FNiagaraSystemInstance* SystemInstance) override;
+	virtual bool PerInstanceTick(void* PerInstanceData, FNiagaraSystemInstance* SystemInstance, float DeltaSeconds) override;
+	virtual int32 PerInstanceDataSize() const override;
+	virtual void GetVMExternalFunction(const FVMExternalFunctionBindingInfo& BindingInfo, void* InstanceData, FVMExternalFunction& OutFunc) override;
+	virtual bool Equals(const UNiagaraDataInterface* Other) const override;
+	// UNiagaraDataInterface Interface End
+
+protected:
+#if WITH_EDITORONLY_DATA
+	virtual void GetFunctionsInternal(TArray<FNiagaraFunctionSignature>& OutFunctions) const override;
+#endif
+	virtual bool CopyToInternal(UNiagaraDataInterface* Destination) const override;
+
+private:
+	void VMQueryCoverage(FVectorVMExternalFunctionContext& Context);
+	void VMQueryBaseHeight(FVectorVMExternalFunctionContext& Context);
+	void VMQueryNearestEdge(FVectorVMExternalFunctionContext& Context);
+};